@@ -0,0 +1,732 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "spectr/config.h"
+#include "spectr/types.h"
+#include "spectr/decoding/input.h"
+#include "spectr/decoding/raw.h"
+#include "spectr/rendering/image.h"
+#include "spectr/rendering/pyramid.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/transform/attr.h"
+#include "spectr/transform/fourier.h"
+#include "spectr/transform/plan.h"
+#include "spectr/transform/window.h"
+#include "spectr/util/arena.h"
+#include "spectr/util/profile.h"
+#include "spectr/util/simd.h"
+#include "spectr/util/thread.h"
+
+/*!
+ * \brief This structure stores the options given on our command line.
+ */
+typedef struct s_bench_options
+{
+	size_t threads;
+	size_t repeats;
+	size_t seconds;
+	const char *output;
+	char **paths;
+	size_t paths_length;
+} s_bench_options_t;
+
+/*!
+ * \brief This structure describes a single measurement, as we report it.
+ */
+typedef struct s_bench_result
+{
+	const char *stage;
+	const char *input;
+	size_t samples;
+	size_t window;
+	size_t hop;
+	size_t threads;
+	s_precision_t precision;
+	double seconds;
+	double count;
+	const char *unit;
+} s_bench_result_t;
+
+/*
+ * These are the STFT window sizes we measure, and the number of hops each
+ * window is divided into (i.e., no overlap, 50% overlap and 87.5% overlap).
+ */
+static const size_t s_bench_windows[] = {512, 2048, 8192};
+static const size_t s_bench_hop_divisors[] = {1, 2, 8};
+
+int s_bench_parse_options(s_bench_options_t *, int, char *[]);
+void s_bench_reset_peak();
+long s_bench_peak_kb();
+void s_bench_report(const s_bench_result_t *);
+int s_bench_synthetic(s_raw_audio_t **, size_t);
+int s_bench_decode(s_raw_audio_t **, const char *, const s_bench_options_t *);
+int s_bench_stft(const s_raw_audio_t *, const char *,
+	const s_bench_options_t *);
+int s_bench_stft_case(s_bench_result_t *, const s_raw_audio_t *,
+	const s_bench_options_t *);
+int s_bench_render(const s_raw_audio_t *, const char *,
+	const s_bench_options_t *);
+int s_bench_input(const s_raw_audio_t *, const char *,
+	const s_bench_options_t *);
+void s_bench_print_usage();
+
+int main(int argc, char *argv[])
+{
+	int ret = EXIT_SUCCESS;
+	int r;
+	size_t i;
+	s_bench_options_t opts;
+	s_raw_audio_t *raw = NULL;
+
+	r = s_bench_parse_options(&opts, argc, argv);
+
+	if(r < 0)
+	{
+		s_bench_print_usage();
+		return EXIT_FAILURE;
+	}
+
+	printf("stage,input,samples,window,hop,threads,precision,simd,"
+		"seconds,rate,unit,peak_kb\n");
+
+	// Benchmark a synthetic input first, and then each of our inputs.
+
+	r = s_bench_synthetic(&raw, opts.seconds);
+
+	if(r >= 0)
+		r = s_bench_input(raw, "synthetic", &opts);
+
+	s_free_raw_audio(&raw);
+
+	for(i = 0; (r >= 0) && (i < opts.paths_length); ++i)
+	{
+		r = s_bench_decode(&raw, opts.paths[i], &opts);
+
+		if(r >= 0)
+			r = s_bench_input(raw, opts.paths[i], &opts);
+
+		s_free_raw_audio(&raw);
+	}
+
+	if(r < 0)
+	{
+		fprintf(stderr, "Fatal error %d: %s\n", -r, strerror(-r));
+		ret = EXIT_FAILURE;
+	}
+
+	s_free_windows();
+	s_free_rfft_plans();
+	s_free_arena_pool();
+	return ret;
+}
+
+/*!
+ * This function parses our command-line arguments into the given options
+ * structure.
+ *
+ * \param opts The options structure to populate.
+ * \param argc The number of command-line arguments.
+ * \param argv The list of command-line arguments.
+ * \return 0 on success, or an error number if the arguments are invalid.
+ */
+int s_bench_parse_options(s_bench_options_t *opts, int argc, char *argv[])
+{
+	int opt;
+	char *end;
+
+	opts->threads = 0;
+	opts->repeats = S_BENCH_REPEATS;
+	opts->seconds = S_BENCH_SYNTHETIC_SECONDS;
+	opts->output = "/dev/null";
+	opts->paths = NULL;
+	opts->paths_length = 0;
+
+	while((opt = getopt(argc, argv, "j:n:o:t:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'j':
+				opts->threads = (size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0'))
+					return -EINVAL;
+				break;
+
+			case 'n':
+				opts->repeats = (size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0') ||
+					(opts->repeats < 1))
+				{
+					return -EINVAL;
+				}
+				break;
+
+			case 'o':
+				opts->output = optarg;
+				break;
+
+			case 't':
+				opts->seconds = (size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0') ||
+					(opts->seconds < 1))
+				{
+					return -EINVAL;
+				}
+				break;
+
+			default:
+				return -EINVAL;
+		}
+	}
+
+	opts->paths = argv + optind;
+	opts->paths_length = (size_t) (argc - optind);
+
+	return 0;
+}
+
+/*!
+ * This function resets our process' peak resident memory, so s_bench_peak_kb
+ * reports the peak of the next measurement alone. This is only supported by
+ * Linux (since 4.0); elsewhere, the peak covers our whole run so far.
+ */
+void s_bench_reset_peak()
+{
+	FILE *f = fopen("/proc/self/clear_refs", "w");
+
+	if(f == NULL)
+		return;
+
+	fputs("5", f);
+	fclose(f);
+}
+
+/*!
+ * This function returns our process' peak resident memory, since it was last
+ * reset (see s_bench_reset_peak).
+ *
+ * \return The peak resident memory, in KiB, or -1 if it isn't available.
+ */
+long s_bench_peak_kb()
+{
+	FILE *f;
+	char line[128];
+	long kb = -1;
+	struct rusage usage;
+
+	f = fopen("/proc/self/status", "r");
+
+	if(f != NULL)
+	{
+		while(fgets(line, sizeof(line), f) != NULL)
+		{
+			if(sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+				break;
+		}
+
+		fclose(f);
+	}
+
+	if((kb < 0) && (getrusage(RUSAGE_SELF, &usage) == 0))
+		kb = usage.ru_maxrss;
+
+	return kb;
+}
+
+/*!
+ * This function prints the given measurement, as one line of CSV (see the
+ * header printed by main). The rate is the measured count of items (e.g.
+ * samples or frames) per second.
+ *
+ * \param result The measurement to print.
+ */
+void s_bench_report(const s_bench_result_t *result)
+{
+	printf("%s,%s,%zu,%zu,%zu,%zu,%s,%s,%.6f,%.1f,%s,%ld\n",
+		result->stage, result->input, result->samples, result->window,
+		result->hop, result->threads,
+		result->precision == PRECISION_FLOAT ? "float" : "double",
+		s_simd_name(), result->seconds,
+		result->count / fmax(result->seconds, 1e-9), result->unit,
+		s_bench_peak_kb());
+
+	fflush(stdout);
+}
+
+/*!
+ * This function generates our synthetic input: the given number of seconds
+ * of 16-bit, 44.1 KHz stereo audio, consisting of a sine sweep from 50 Hz to
+ * 20 KHz in the left channel, and noise in the right channel. It is mixed down
+ * like any decoded input (see s_mixdown_raw_audio).
+ *
+ * \param raw This will receive the generated audio.
+ * \param seconds The length of the audio, in seconds.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_bench_synthetic(s_raw_audio_t **raw, size_t seconds)
+{
+	int r;
+	size_t i;
+	uint32_t noise = 1;
+	double t;
+	double lo = 50.0;
+	double hi = 20000.0;
+
+	r = s_init_raw_audio(raw);
+
+	if(r < 0)
+		return r;
+
+	(*raw)->stat.type = FTYPE_INVALID;
+	(*raw)->stat.bit_depth = 16;
+	(*raw)->stat.sample_rate = 44100;
+	(*raw)->stat.samples = seconds * (*raw)->stat.sample_rate;
+
+	(*raw)->samples = malloc(sizeof(s_stereo_sample_t) *
+		(*raw)->stat.samples);
+
+	if((*raw)->samples == NULL)
+	{
+		s_free_raw_audio(raw);
+		return -ENOMEM;
+	}
+
+	(*raw)->samples_length = (*raw)->stat.samples;
+
+	for(i = 0; i < (*raw)->samples_length; ++i)
+	{
+		// This is an exponential sweep, so each octave is as long.
+
+		t = ((double) i) / ((double) (*raw)->stat.sample_rate);
+
+		(*raw)->samples[i].l = (int32_t) (16000.0 * sin(2.0 * M_PI *
+			lo * ((double) seconds) / log(hi / lo) *
+			(exp(t / ((double) seconds) * log(hi / lo)) - 1.0)));
+
+		noise = noise * 1664525U + 1013904223U;
+		(*raw)->samples[i].r = (int32_t) (noise >> 16) - 32768;
+	}
+
+	r = s_mixdown_raw_audio(*raw);
+
+	if(r < 0)
+		s_free_raw_audio(raw);
+
+	return r;
+}
+
+/*!
+ * This function measures how quickly the given input file is decoded, using
+ * one thread and then (if there are more) all of them. The decoded audio is
+ * returned, for our other measurements.
+ *
+ * \param raw This will receive the decoded audio.
+ * \param path The path to the input file.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_bench_decode(s_raw_audio_t **raw, const char *path,
+	const s_bench_options_t *opts)
+{
+	int r;
+	size_t t;
+	size_t i;
+	double begin;
+	s_input_t *input = NULL;
+	s_bench_result_t result;
+	size_t threads[2] = {1, s_get_thread_count(opts->threads)};
+
+	r = s_init_input(&input, path);
+
+	if(r < 0)
+		return r;
+
+	r = s_init_raw_audio(raw);
+
+	if(r < 0)
+		goto done;
+
+	result.stage = "decode";
+	result.input = path;
+	result.window = 0;
+	result.hop = 0;
+	result.precision = PRECISION_DOUBLE;
+	result.unit = "samples/s";
+
+	for(t = 0; t < 2; ++t)
+	{
+		if((t > 0) && (threads[t] == threads[0]))
+			break;
+
+		result.threads = threads[t];
+		result.seconds = HUGE_VAL;
+
+		s_bench_reset_peak();
+
+		for(i = 0; i < opts->repeats; ++i)
+		{
+			begin = s_profile_now();
+
+			r = s_decode_raw_audio(*raw, input, threads[t]);
+
+			if(r < 0)
+				goto done;
+
+			result.seconds = fmin(result.seconds,
+				s_profile_now() - begin);
+		}
+
+		result.samples = (*raw)->samples_length;
+		result.count = (double) result.samples;
+
+		s_bench_report(&result);
+	}
+
+done:
+	if(r < 0)
+		s_free_raw_audio(raw);
+
+	s_free_input(&input);
+	return r;
+}
+
+/*!
+ * This function measures how quickly we compute the whole STFT of the given
+ * audio, for each of our window sizes and overlaps, in both precisions, using
+ * one thread and then (if there are more) all of them.
+ *
+ * \param raw The audio to transform.
+ * \param name The name of the input, for our report.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_bench_stft(const s_raw_audio_t *raw, const char *name,
+	const s_bench_options_t *opts)
+{
+	int r;
+	size_t w;
+	size_t o;
+	size_t p;
+	size_t t;
+	s_bench_result_t result;
+	size_t threads[2] = {1, s_get_thread_count(opts->threads)};
+
+	result.stage = "stft";
+	result.input = name;
+	result.samples = raw->samples_length;
+	result.unit = "frames/s";
+
+	for(w = 0; w < sizeof(s_bench_windows) / sizeof(size_t); ++w)
+	{
+		for(o = 0; o < sizeof(s_bench_hop_divisors) / sizeof(size_t);
+			++o)
+		{
+			result.window = s_bench_windows[w];
+			result.hop = result.window / s_bench_hop_divisors[o];
+
+			for(p = 0; p < 2; ++p)
+			{
+				result.precision = p == 0 ? PRECISION_DOUBLE :
+					PRECISION_FLOAT;
+
+				for(t = 0; t < 2; ++t)
+				{
+					if((t > 0) &&
+						(threads[t] == threads[0]))
+					{
+						break;
+					}
+
+					result.threads = threads[t];
+
+					r = s_bench_stft_case(&result, raw,
+						opts);
+
+					if(r < 0)
+						return r;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * This function measures how quickly we compute the STFT of the given audio,
+ * with the parameters (window size, hop, precision and threads) in the given
+ * result, and then reports it.
+ *
+ * \param result The measurement's parameters, which receives its result.
+ * \param raw The audio to transform.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_bench_stft_case(s_bench_result_t *result, const s_raw_audio_t *raw,
+	const s_bench_options_t *opts)
+{
+	int r;
+	size_t i;
+	double begin;
+	s_stft_t *stft = NULL;
+
+	result->seconds = HUGE_VAL;
+
+	s_bench_reset_peak();
+
+	for(i = 0; i < opts->repeats; ++i)
+	{
+		begin = s_profile_now();
+
+		r = s_stft(&stft, raw, result->window, result->hop,
+			S_DEFAULT_WINDOW, result->precision, result->threads);
+
+		if(r < 0)
+			return r;
+
+		result->seconds = fmin(result->seconds,
+			s_profile_now() - begin);
+		result->count = (double) stft->length;
+
+		s_free_stft(&stft);
+	}
+
+	s_bench_report(result);
+
+	return 0;
+}
+
+/*!
+ * This function measures each of the stages between the given audio and an
+ * image of its spectrogram, with the STFT parameters the viewer would use:
+ * computing the STFT's pyramid (with one thread, and then all of them),
+ * reducing the pyramid to the spectrogram, computing the viewer's texture
+ * from it, and rendering it with our offline renderer.
+ *
+ * \param raw The audio to render.
+ * \param name The name of the input, for our report.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_bench_render(const s_raw_audio_t *raw, const char *name,
+	const s_bench_options_t *opts)
+{
+	int r;
+	size_t t;
+	size_t i;
+	size_t window;
+	size_t hop;
+	double begin;
+	double min;
+	double max;
+	float *texels = NULL;
+	s_pyramid_t *pyramid = NULL;
+	s_spectrogram_t *sg = NULL;
+	s_bench_result_t result;
+	size_t threads[2] = {1, s_get_thread_count(opts->threads)};
+
+	r = s_get_window_size(&window, S_VIEW_W, S_VIEW_H, raw->samples_length);
+
+	if(r >= 0)
+		r = s_get_hop_size(&hop, window, S_VIEW_W, raw->samples_length);
+
+	if(r < 0)
+		return r;
+
+	result.input = name;
+	result.samples = raw->samples_length;
+	result.window = window;
+	result.hop = hop;
+	result.precision = PRECISION_DOUBLE;
+
+	// Compute the STFT's pyramid.
+
+	result.stage = "pyramid";
+	result.unit = "frames/s";
+
+	for(t = 0; t < 2; ++t)
+	{
+		if((t > 0) && (threads[t] == threads[0]))
+			break;
+
+		result.threads = threads[t];
+		result.seconds = HUGE_VAL;
+
+		s_bench_reset_peak();
+
+		for(i = 0; i < opts->repeats; ++i)
+		{
+			s_free_pyramid(&pyramid);
+
+			begin = s_profile_now();
+
+			r = s_pyramid_from_raw(&pyramid, raw, window, hop,
+				S_DEFAULT_WINDOW, result.precision, S_VIEW_H,
+				S_DEFAULT_SCALE, result.threads);
+
+			if(r < 0)
+				goto done;
+
+			result.seconds = fmin(result.seconds,
+				s_profile_now() - begin);
+		}
+
+		result.count = (double) pyramid->level[0].columns;
+
+		s_bench_report(&result);
+	}
+
+	// The remaining stages are all single-threaded.
+
+	result.threads = 1;
+
+	// Reduce the pyramid to the spectrogram.
+
+	result.stage = "spectrogram";
+	result.unit = "columns/s";
+	result.seconds = HUGE_VAL;
+
+	s_bench_reset_peak();
+
+	for(i = 0; i < opts->repeats; ++i)
+	{
+		begin = s_profile_now();
+
+		r = s_spectrogram_from_pyramid(&sg, pyramid, 0,
+			pyramid->raw_length, S_VIEW_W, S_VIEW_H);
+
+		if(r < 0)
+			goto done;
+
+		result.seconds = fmin(result.seconds, s_profile_now() - begin);
+	}
+
+	result.count = (double) sg->width;
+
+	s_bench_report(&result);
+
+	// Compute the viewer's texture.
+
+	texels = malloc(sizeof(float) * sg->width * sg->height);
+
+	if(texels == NULL)
+	{
+		r = -ENOMEM;
+		goto done;
+	}
+
+	result.stage = "texture";
+	result.unit = "texels/s";
+	result.seconds = HUGE_VAL;
+
+	s_bench_reset_peak();
+
+	for(i = 0; i < opts->repeats; ++i)
+	{
+		begin = s_profile_now();
+
+		s_spectrogram_texels(texels, sg, &min, &max);
+
+		result.seconds = fmin(result.seconds, s_profile_now() - begin);
+	}
+
+	result.count = (double) (sg->width * sg->height);
+
+	s_bench_report(&result);
+
+	// Render the spectrogram to an image.
+
+	result.stage = "ppm";
+	result.unit = "pixels/s";
+	result.seconds = HUGE_VAL;
+
+	s_bench_reset_peak();
+
+	for(i = 0; i < opts->repeats; ++i)
+	{
+		begin = s_profile_now();
+
+		r = s_write_spectrogram_ppm(sg, opts->output);
+
+		if(r < 0)
+			goto done;
+
+		result.seconds = fmin(result.seconds, s_profile_now() - begin);
+	}
+
+	result.count = (double) (sg->width * sg->height);
+
+	s_bench_report(&result);
+
+done:
+	free(texels);
+	s_free_spectrogram(&sg);
+	s_free_pyramid(&pyramid);
+	return r;
+}
+
+/*!
+ * This function runs all of our measurements of the given (decoded) input.
+ *
+ * \param raw The decoded input.
+ * \param name The name of the input, for our report.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_bench_input(const s_raw_audio_t *raw, const char *name,
+	const s_bench_options_t *opts)
+{
+	int r;
+
+	r = s_bench_stft(raw, name, opts);
+
+	if(r < 0)
+		return r;
+
+	return s_bench_render(raw, name, opts);
+}
+
+void s_bench_print_usage()
+{
+	printf("Usage: spectr_bench [options] [file to decode ...]\n");
+	printf("\n");
+	printf("Measures each stage between an audio file and its spectrogram,\n");
+	printf("for a synthetic input and then each of the given files, and\n");
+	printf("prints the results as CSV.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-j <threads>  The most threads to measure with (default: one\n");
+	printf("\t              per CPU)\n");
+	printf("\t-n <repeats>  How many times to run each measurement; the\n");
+	printf("\t              fastest run is reported (default: %d)\n",
+		S_BENCH_REPEATS);
+	printf("\t-o <file>     Where to write rendered images (default:\n");
+	printf("\t              /dev/null)\n");
+	printf("\t-t <seconds>  The length of the synthetic input (default:\n");
+	printf("\t              %d)\n", S_BENCH_SYNTHETIC_SECONDS);
+}
@@ -20,12 +20,9 @@
 #define INCLUDE_SPECTR_CONFIG_H
 
 /*
- * This defines the number of frames we're willing to render each second.
- */
-#define S_WINDOW_FPS 20
-
-/*
- * This is the size of the window we'll plot our result in.
+ * This is the default size of the window we'll plot our result in. This is
+ * also the size of the images we render in headless mode. The window can be
+ * resized; its layout is then recomputed from the margins below.
  */
 #define S_VIEW_H 255
 #define S_VIEW_W 719
@@ -36,9 +33,188 @@
 #define S_WINDOW_W 800		// X_MAX + 5 (padding)
 #define S_WINDOW_H 291		// Y_MAX + 30 (padding)
 
+/*
+ * These are the margins around the spectrogram's frame, matching the default
+ * layout above, which are kept when the window is resized.
+ */
+#define S_VIEW_PAD_RIGHT 5
+#define S_VIEW_PAD_BOTTOM 30
+
+/*
+ * These values control zooming and panning in the viewer. Each zoom step
+ * scales the visible range by S_VIEW_ZOOM_FACTOR, and each pan step moves it
+ * by S_VIEW_PAN_FRACTION of its width. We never zoom in so far that the
+ * visible range is shorter than S_VIEW_MIN_SAMPLES.
+ */
+#define S_VIEW_ZOOM_FACTOR 1.25
+#define S_VIEW_PAN_FRACTION 0.25
+#define S_VIEW_MIN_SAMPLES 1024
+
+/*
+ * These values control the viewer's contrast. Each step moves the bottom or the
+ * top of the colormap by S_VIEW_RANGE_STEP dB, or scales its gamma by
+ * S_VIEW_GAMMA_STEP. The colormap itself is uploaded as a texture with
+ * S_COLORMAP_SIZE entries.
+ */
+#define S_VIEW_RANGE_STEP 3.0
+#define S_VIEW_GAMMA_STEP 1.25
+#define S_COLORMAP_SIZE 256
+
+/*
+ * This is the maximum number of STFT windows we'll average into each column of
+ * a spectrogram; the hop between windows is chosen so we never compute more
+ * (see s_get_hop_size). If the length of the input isn't known in advance,
+ * adjacent windows instead overlap by S_STFT_DEFAULT_OVERLAP of their size.
+ */
+#define S_VIEW_MAX_COLUMN_FRAMES 8
+#define S_STFT_DEFAULT_OVERLAP 0.05
+
+/*
+ * This is the STFT window function we use unless we're told otherwise, and
+ * the shape parameter (beta) of the Kaiser window. Larger values of beta trade
+ * frequency resolution for lower sidelobes.
+ */
+#define S_DEFAULT_WINDOW WINDOW_HANN
+#define S_WINDOW_KAISER_BETA 8.6
+
+/*
+ * Audio can be decimated by (at most) S_DECIMATE_MAX_FACTOR before computing
+ * its STFT. Its low-pass filter has S_DECIMATE_PHASE_TAPS taps per unit of the
+ * decimation factor, and is cut off at S_DECIMATE_CUTOFF of the decimated
+ * audio's Nyquist frequency, so its transition band ends just below it.
+ */
+#define S_DECIMATE_MAX_FACTOR 8
+#define S_DECIMATE_PHASE_TAPS 48
+#define S_DECIMATE_CUTOFF 0.875
+
+/*
+ * This is the scale of the frequency axis we use unless we're told otherwise.
+ */
+#define S_DEFAULT_SCALE SCALE_LINEAR
+
+/*
+ * When MP3 files are decoded in parallel, each segment's decoder starts
+ * S_MP3_PRIMING_FRAMES frames early, so its bit reservoir and synthesis
+ * filters are primed by the time it reaches the segment. Segments are never
+ * shorter than S_MP3_SEGMENT_MIN_FRAMES frames.
+ */
+#define S_MP3_PRIMING_FRAMES 10
+#define S_MP3_SEGMENT_MIN_FRAMES 256
+
+/*
+ * When searching for the first MP3 frame header, a candidate is only accepted
+ * if it is followed by this many more valid frame headers.
+ */
+#define S_MP3_SYNC_FRAMES 3
+
+/*
+ * When FLAC files are decoded in parallel, each thread decodes at least
+ * S_FLAC_SEGMENT_MIN_BYTES bytes of the file. When seeking in a FLAC file, we
+ * bisect the file until the frame we're looking for is within
+ * S_FLAC_SEEK_BYTES bytes, and then decode forward from there.
+ */
+#define S_FLAC_SEGMENT_MIN_BYTES 1048576
+#define S_FLAC_SEEK_BYTES 65536
+
+/*
+ * This is the number of columns in each tile of a spectrogram pyramid.
+ */
+#define S_PYRAMID_TILE_COLUMNS 256
+
+/*
+ * This is the name of the directory (inside e.g. ~/.cache) we store cached
+ * STFT pyramids in.
+ */
+#define S_CACHE_DIRECTORY "spectr"
+
 /*
  * These values define some properties of our spectrogram legend.
  */
 #define S_SPEC_LGND_TICK_SIZE 7
 
+/*
+ * These are the defaults for our benchmark (spectr_bench): the length of the
+ * synthetic input it generates, in seconds, and how many times it runs each
+ * measurement (it reports the fastest run).
+ */
+#define S_BENCH_SYNTHETIC_SECONDS 60
+#define S_BENCH_REPEATS 3
+
+/*
+ * These values define our self-test (s_test, in debug builds): the largest
+ * window size our FFT's are checked against the reference DFT at, the largest
+ * error (relative to the reference's largest magnitude) we accept in double
+ * and single precision, and the longest input each vectorized kernel is
+ * checked against the portable one with.
+ */
+#define S_TEST_MAX_WINDOW 512
+#define S_TEST_TOLERANCE 1e-9
+#define S_TEST_FTOLERANCE 1e-5
+#define S_TEST_KERNEL_LENGTH 64
+
+/*
+ * These values define our arena allocator (see s_arena_alloc): the size of
+ * each of the blocks allocations are carved out of, the alignment of each
+ * allocation, and the largest number of free blocks we keep around for reuse
+ * by later arenas (e.g., by the next file in batch mode).
+ */
+#define S_ARENA_BLOCK_SIZE 4194304
+#define S_ARENA_ALIGNMENT 64
+#define S_ARENA_POOL_BLOCKS 32
+
+/*
+ * These values define how lazily decoded audio (-z) is stored: it is decoded
+ * in chunks of S_SOURCE_CHUNK_SAMPLES samples (about three seconds at 44.1
+ * kHz), and at most S_SOURCE_CHUNKS of them (16 MiB of mono samples) are kept.
+ */
+#define S_SOURCE_CHUNK_SAMPLES 131072
+#define S_SOURCE_CHUNKS 32
+
+/*
+ * In batch mode (-b), this is the number of input files we decode ahead of the
+ * one being transformed. Each of them is held in memory (decoded) until it has
+ * been transformed.
+ */
+#define S_BATCH_AHEAD 1
+
+/*
+ * These values define the size of the queue of decoded blocks of samples
+ * between the decoder and the STFT, when streaming a file.
+ */
+#define S_STREAM_BLOCK_SAMPLES 4096
+#define S_STREAM_QUEUE_BLOCKS 64
+
+/*
+ * These values define our live mode (-r): the STFT window size and hop we use
+ * unless we're told otherwise, the largest number of samples we read from the
+ * input at once (which is less than a hop, so each frame is displayed as soon
+ * as it is complete), and how often (in milliseconds) the reader checks
+ * whether it should stop while it waits for input.
+ */
+#define S_LIVE_WINDOW 2048
+#define S_LIVE_HOP 512
+#define S_LIVE_READ_SAMPLES 256
+#define S_LIVE_POLL_MS 100
+
+/*
+ * These values define our progressive viewer (-P). Its coarse overview is
+ * computed from one frame for every S_REFINE_COARSE pixel columns, and it is
+ * then refined S_REFINE_BLOCK columns at a time.
+ */
+#define S_REFINE_COARSE 8
+#define S_REFINE_BLOCK 32
+
+/*
+ * These values define our GPU STFT (-g). Each frame is transformed by one
+ * workgroup of S_GPU_FFT_THREADS invocations, in shared memory, so the largest
+ * window it supports is S_GPU_MAX_WINDOW (32 KiB of complex floats, the least
+ * shared memory any GL 4.3 implementation has). Spectrograms are computed in
+ * tiles of S_GPU_TILE x S_GPU_TILE pixels, and the samples are uploaded
+ * S_GPU_UPLOAD_SAMPLES at a time.
+ */
+#define S_GPU_FFT_THREADS 256
+#define S_GPU_MAX_WINDOW 4096
+#define S_GPU_TILE 16
+#define S_GPU_UPLOAD_SAMPLES 1048576
+
 #endif
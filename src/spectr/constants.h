@@ -34,4 +34,89 @@
  */
 #define S_MICROSECOND_NANOSECONDS 1000
 
+/*
+ * The maximum number of samples (per channel) in a single MP3 frame.
+ */
+#define S_MP3_MAX_FRAME_SAMPLES 1152
+
+/*
+ * These values describe the FLAC format. Although FLAC allows for 32-bit
+ * samples, we only support up to 24 bits, so the side channel of a stereo
+ * frame (which has one extra bit) always fits in 32 bits.
+ */
+#define S_FLAC_MAX_CHANNELS 8
+#define S_FLAC_MAX_BIT_DEPTH 24
+#define S_FLAC_STREAMINFO_LENGTH 34
+#define S_FLAC_SEEK_POINT_LENGTH 18
+#define S_FLAC_MIN_FRAME_LENGTH 10
+
+/*
+ * The alignment, in bytes, of our STFT result storage (one cache line).
+ */
+#define S_STFT_ALIGNMENT 64
+
+/*
+ * The number of values our vectorized kernels' callers process per block,
+ * when they need a temporary buffer for the kernel's output.
+ */
+#define S_SIMD_BLOCK_LENGTH 256
+
+/*
+ * These values define our (little-endian) pyramid file format. See
+ * s_write_pyramid for its overall structure. The S_PYRAMID_HDR_* values are
+ * the byte offsets of each of the header's fields.
+ */
+#define S_PYRAMID_MAGIC "SPECTRPY"
+#define S_PYRAMID_VERSION 6
+#define S_PYRAMID_HEADER_LENGTH 128
+#define S_PYRAMID_LEVEL_ENTRY_LENGTH 16
+#define S_PYRAMID_DATA_ALIGNMENT 64
+
+#define S_PYRAMID_HDR_MAGIC 0		// char[8]
+#define S_PYRAMID_HDR_VERSION 8		// uint32_t
+#define S_PYRAMID_HDR_LENGTH 12		// uint32_t
+#define S_PYRAMID_HDR_FTYPE 16		// uint32_t
+#define S_PYRAMID_HDR_BIT_DEPTH 20	// uint32_t
+#define S_PYRAMID_HDR_SAMPLE_RATE 24	// uint32_t
+#define S_PYRAMID_HDR_FUNCTION 28	// uint32_t
+#define S_PYRAMID_HDR_RAW_LENGTH 32	// uint64_t
+#define S_PYRAMID_HDR_HOP 40		// uint64_t
+#define S_PYRAMID_HDR_HEIGHT 48		// uint64_t
+#define S_PYRAMID_HDR_WINDOW 56		// uint64_t
+#define S_PYRAMID_HDR_DECIMATION 64	// uint64_t
+#define S_PYRAMID_HDR_DEV 72		// uint64_t
+#define S_PYRAMID_HDR_INO 80		// uint64_t
+#define S_PYRAMID_HDR_SIZE 88		// uint64_t
+#define S_PYRAMID_HDR_MTIME_SEC 96	// uint64_t
+#define S_PYRAMID_HDR_MTIME_NSEC 104	// uint64_t
+#define S_PYRAMID_HDR_LEVELS 112	// uint64_t
+#define S_PYRAMID_HDR_PRECISION 120	// uint32_t
+#define S_PYRAMID_HDR_SCALE 124		// uint32_t
+
+/*
+ * These values define our (little-endian) STFT frame export format. See
+ * s_export_stft for its overall structure. The S_FRAMES_HDR_* values are the
+ * byte offsets of each of the header's fields.
+ */
+#define S_FRAMES_MAGIC "SPECTRFR"
+#define S_FRAMES_VERSION 1
+#define S_FRAMES_HEADER_LENGTH 128
+#define S_FRAMES_ALIGNMENT 64
+
+#define S_FRAMES_HDR_MAGIC 0		// char[8]
+#define S_FRAMES_HDR_VERSION 8		// uint32_t
+#define S_FRAMES_HDR_LENGTH 12		// uint32_t
+#define S_FRAMES_HDR_FTYPE 16		// uint32_t
+#define S_FRAMES_HDR_BIT_DEPTH 20	// uint32_t
+#define S_FRAMES_HDR_SAMPLE_RATE 24	// uint32_t
+#define S_FRAMES_HDR_FUNCTION 28	// uint32_t
+#define S_FRAMES_HDR_RAW_LENGTH 32	// uint64_t
+#define S_FRAMES_HDR_WINDOW 40		// uint64_t
+#define S_FRAMES_HDR_HOP 48		// uint64_t
+#define S_FRAMES_HDR_BINS 56		// uint64_t
+#define S_FRAMES_HDR_FRAMES 64		// uint64_t
+#define S_FRAMES_HDR_FORMAT 72		// uint32_t (s_sample_format_t)
+#define S_FRAMES_HDR_STRIDE 76		// uint32_t
+#define S_FRAMES_HDR_DATA 80		// uint64_t
+
 #endif
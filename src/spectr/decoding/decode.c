@@ -20,36 +20,112 @@
 
 #include <errno.h>
 
-#include "spectr/decoding/ftype.h"
+#include "spectr/decoding/quirks/flac.h"
 #include "spectr/decoding/quirks/mp3.h"
+#include "spectr/util/profile.h"
 
 /*!
- * This function decodes the contents of the file denoted the the path f,
- * storing the decoded audio data in the given buffer. The resulting buffer
- * will be null-terminated, and its size (excluding the null terminator) will
- * be stored in bufSize.
+ * This function decodes the contents of the given input file, storing the
+ * decoded audio data directly in a list of stereo samples. The number of
+ * samples decoded will be stored in length.
  *
- * The buffer is allocated to be the proper size to store the decoded audio
- * data. It is up to the caller to free() this buffer.
+ * The list is allocated to be the proper size to store the decoded audio
+ * data. It is up to the caller to free() this list.
  *
- * \param buf The buffer to store the decoded audio data in.
- * \param bufSize Receives the size of the decoded data, in bytes.
- * \param f The path to the file to decode.
+ * \param samples The list to store the decoded audio samples in.
+ * \param length Receives the number of decoded samples.
+ * \param in The input file to decode.
+ * \param threads The number of threads to use, or 0 for one per CPU.
  * \return 0 on success, or an error number if decoding fails.
  */
-int s_decode(uint8_t **buf, size_t *bufSize, const char *f)
+int s_decode(s_stereo_sample_t **samples, size_t *length,
+	const s_input_t *in, size_t threads)
 {
 	int r;
-	s_ftype_t type;
+	double begin = s_profile_begin();
 
-	r = s_ftype(&type, f);
+	switch(in->type)
+	{
+		case FTYPE_MP3:
+			r = s_decode_mp3(samples, length, in, threads);
+			s_profile_end(STAGE_DECODE_MP3, begin);
+			return r;
+
+		case FTYPE_FLAC:
+			r = s_decode_flac(samples, length, in, threads);
+			s_profile_end(STAGE_DECODE_FLAC, begin);
+			return r;
+
+		default:
+			return -EINVAL;
+	}
+}
+
+/*!
+ * This function decodes only the samples [begin, end) of the given input
+ * file, storing them in a list of stereo samples in the same way as s_decode.
+ * Sample positions are the same as if the whole file had been decoded, but
+ * only the part of the file which covers the requested range is decoded. If
+ * the range extends past the end of the file, fewer samples are returned.
+ *
+ * An MP3 file's frames are found with the given index of them (see
+ * s_init_mp3_index), or, if it is NULL, with one built just for this range.
+ *
+ * \param samples The list to store the decoded audio samples in.
+ * \param length Receives the number of decoded samples.
+ * \param in The input file to decode.
+ * \param index An MP3 file's index (ignored for other types), or NULL.
+ * \param begin The position of the first sample to decode.
+ * \param end The position one past the last sample to decode.
+ * \return 0 on success, or an error number if decoding fails.
+ */
+int s_decode_range(s_stereo_sample_t **samples, size_t *length,
+	const s_input_t *in, const s_mp3_index_t *index, size_t begin,
+	size_t end)
+{
+	int r;
+	double start = s_profile_begin();
+
+	switch(in->type)
+	{
+		case FTYPE_MP3:
+			r = s_decode_mp3_range(samples, length, in,
+				index, begin, end);
+			s_profile_end(STAGE_DECODE_MP3, start);
+			return r;
 
-	if(r != 0)
-		return r;
+		case FTYPE_FLAC:
+			r = s_decode_flac_range(samples, length, in,
+				begin, end);
+			s_profile_end(STAGE_DECODE_FLAC, start);
+			return r;
+
+		default:
+			return -EINVAL;
+	}
+}
 
-	switch(type)
+/*!
+ * This function decodes the contents of the given input file, passing each
+ * block of decoded samples to the given function as soon as it has been
+ * decoded, rather than storing the whole decoded file.
+ *
+ * The list of samples given to the sink is only valid for the duration of that
+ * call. If the sink returns an error, decoding stops and that error is
+ * returned.
+ *
+ * \param in The input file to decode.
+ * \param sink The function to pass each block of decoded samples to.
+ * \param ctx The context pointer to pass to the sink.
+ * \return 0 on success, or an error number if decoding fails.
+ */
+int s_decode_stream(const s_input_t *in,
+	int (*sink)(void *, const s_stereo_sample_t *, size_t), void *ctx)
+{
+	switch(in->type)
 	{
-		case FTYPE_MP3: return s_decode_mp3(buf, bufSize, f);
+		case FTYPE_MP3: return s_decode_mp3_stream(in, sink, ctx);
+		case FTYPE_FLAC: return s_decode_flac_stream(in, sink, ctx);
 		default: return -EINVAL;
 	}
 }
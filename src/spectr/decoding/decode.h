@@ -22,6 +22,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
-extern int s_decode(uint8_t **, size_t *, const char *);
+#include "spectr/types.h"
+
+extern int s_decode(s_stereo_sample_t **, size_t *, const s_input_t *,
+	size_t);
+extern int s_decode_range(s_stereo_sample_t **, size_t *,
+	const s_input_t *, const s_mp3_index_t *, size_t, size_t);
+extern int s_decode_stream(const s_input_t *,
+	int (*)(void *, const s_stereo_sample_t *, size_t), void *);
 
 #endif
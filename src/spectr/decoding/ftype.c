@@ -18,26 +18,39 @@
 
 #include "ftype.h"
 
+#include "spectr/decoding/quirks/flac.h"
 #include "spectr/decoding/quirks/mp3.h"
 
 /*!
- * This function determines the file type of the file denoted by the given path
- * f, placing the result in the variable pointed to by t.
+ * This function determines the file type of the given file contents, placing
+ * the result in the variable pointed to by t. The offset at which the file's
+ * audio data starts is placed in the variable pointed to by o.
  *
  * If the given file's type can't be determined (or it is a format we don't
  * support), then t will receive FTYPE_INVALID, and we will return EINVAL.
  *
  * \param t This will receive the computed file type.
- * \param f The path to the file whose type will be determined.
+ * \param o This will receive the offset of the file's audio data.
+ * \param data The contents of the file whose type will be determined.
+ * \param length The length of the file, in bytes.
  * \return 0 on success, or an error number otherwise.
  */
-int s_ftype(s_ftype_t *t, const char *f)
+int s_ftype(s_ftype_t *t, size_t *o, const uint8_t *data, size_t length)
 {
-	size_t off;
-
 	*t = FTYPE_INVALID;
 
-	if(s_get_mp3_frame_header_offset(&off, f) == 0)
+	/*
+	 * FLAC files are detected first, since their (compressed) audio data
+	 * could easily contain something which looks like an MP3 frame.
+	 */
+
+	if(s_find_flac_frames(o, data, length) == 0)
+	{
+		*t = FTYPE_FLAC;
+		return 0;
+	}
+
+	if(s_find_mp3_frame_header(o, data, length) == 0)
 	{
 		*t = FTYPE_MP3;
 		return 0;
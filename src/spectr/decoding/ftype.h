@@ -27,7 +27,7 @@
 
 #include "spectr/types.h"
 
-extern int s_ftype(s_ftype_t *, const char *);
+extern int s_ftype(s_ftype_t *, size_t *, const uint8_t *, size_t);
 extern enum AVCodecID s_codec_for_ftype(s_ftype_t);
 
 #endif
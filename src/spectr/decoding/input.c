@@ -0,0 +1,129 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "spectr/decoding/ftype.h"
+
+/*!
+ * This function initializes (allocates) a s_input_t variable, by mapping the
+ * given file into memory and detecting its format. If the pointer is
+ * non-NULL, we will not allocate a new value on top of it.
+ *
+ * The mapping is read-only, and is kept until the input is freed, so the same
+ * input can be shared by any number of threads.
+ *
+ * \param in The s_input_t to allocate.
+ * \param f The path to the file to map.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_input(s_input_t **in, const char *f)
+{
+	int ret = 0;
+	int r;
+	int fd;
+	struct stat stat;
+	void *data;
+
+	if(*in != NULL)
+		return -EINVAL;
+
+	fd = open(f, O_RDONLY);
+
+	if(fd < 0)
+	{
+		ret = -errno;
+		goto done;
+	}
+
+	r = fstat(fd, &stat);
+
+	if(r < 0)
+	{
+		ret = -errno;
+		goto err_after_open;
+	}
+
+	if(stat.st_size == 0)
+	{
+		ret = -EIO;
+		goto err_after_open;
+	}
+
+	data = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if(data == MAP_FAILED)
+	{
+		ret = -errno;
+		goto err_after_open;
+	}
+
+	*in = malloc(sizeof(s_input_t));
+
+	if(*in == NULL)
+	{
+		ret = -ENOMEM;
+		munmap(data, stat.st_size);
+		goto err_after_open;
+	}
+
+	(*in)->map = data;
+	(*in)->data = data;
+	(*in)->length = (size_t) stat.st_size;
+
+	// Detect the file's format, now that we can read it.
+
+	r = s_ftype(&((*in)->type), &((*in)->offset), (*in)->data,
+		(*in)->length);
+
+	if(r < 0)
+	{
+		ret = r;
+		s_free_input(in);
+	}
+
+err_after_open:
+	close(fd);
+done:
+	return ret;
+}
+
+/*!
+ * This function frees the given s_input_t structure, unmapping its file.
+ * Note that this function is safe against double-frees.
+ *
+ * \param in The s_input_t to free.
+ */
+void s_free_input(s_input_t **in)
+{
+	if(*in == NULL)
+		return;
+
+	munmap((*in)->map, (*in)->length);
+
+	free(*in);
+	*in = NULL;
+}
@@ -0,0 +1,1880 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flac.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spectr/config.h"
+#include "spectr/constants.h"
+#include "spectr/util/bitwise.h"
+#include "spectr/util/thread.h"
+
+/*!
+ * \brief This structure reads the contents of a FLAC frame, MSB first.
+ *
+ * Bytes are loaded into cache as needed; its bits most significant bits are
+ * the next bits to be read, and the rest are always zero. Reading past the end
+ * of the data yields zeros; see s_flac_bits_overrun.
+ */
+typedef struct s_flac_bits
+{
+	const uint8_t *data;
+	size_t length;
+	size_t pos;
+
+	uint64_t cache;
+	unsigned int bits;
+} s_flac_bits_t;
+
+/*!
+ * \brief This structure stores the properties of a single FLAC frame.
+ *
+ * The position is that of the frame's first sample, and samples is the number
+ * of samples (per channel) in the frame. The length is that of the frame's
+ * header, in bytes.
+ */
+typedef struct s_flac_header
+{
+	size_t position;
+	size_t samples;
+	uint32_t channels;
+	uint32_t assignment;
+	uint32_t bit_depth;
+	size_t length;
+} s_flac_header_t;
+
+/*!
+ * \brief This structure stores the state needed to decode FLAC frames.
+ *
+ * The channels list has room for each of a frame's channels, one after the
+ * other, and block receives the frame's stereo samples. Both are sized for
+ * the stream's largest block. Samples are output with the given bit depth.
+ */
+typedef struct s_flac_decoder
+{
+	const s_input_t *in;
+	const s_flac_info_t *info;
+	uint32_t depth;
+
+	int32_t *channels;
+	s_stereo_sample_t *block;
+} s_flac_decoder_t;
+
+/*!
+ * \brief This structure receives the samples decoded from a FLAC file.
+ *
+ * Only the samples [begin, end) of the file are output. If sink is NULL, each
+ * sample is stored at samples[position - begin], and the list is grown as
+ * needed (unless fixed is set, in which case samples past its capacity are
+ * dropped). Otherwise, the samples are passed to the sink, in order, and
+ * length counts how many have been passed so far.
+ *
+ * Either way, the samples of any corrupt frames we skip are output as silence,
+ * so every later sample stays in its place.
+ */
+typedef struct s_flac_output
+{
+	size_t begin;
+	size_t end;
+
+	s_stereo_sample_t *samples;
+	size_t length;
+	size_t capacity;
+	int fixed;
+
+	int (*sink)(void *, const s_stereo_sample_t *, size_t);
+	void *sink_ctx;
+} s_flac_output_t;
+
+/*!
+ * \brief This structure describes how a file is split up for s_decode_flac.
+ *
+ * Each segment is decoded into the same list of samples, through its own
+ * output structure.
+ */
+typedef struct s_flac_segment_job
+{
+	const s_input_t *in;
+	const s_flac_info_t *info;
+	s_flac_output_t *outputs;
+} s_flac_segment_job_t;
+
+int s_find_flac_metadata(size_t *, const uint8_t *, size_t);
+int s_read_flac_streaminfo(s_flac_info_t *, const uint8_t *, size_t);
+int s_read_flac_seek_table(s_flac_info_t *, const uint8_t *, size_t);
+uint8_t s_flac_crc8(const uint8_t *, size_t, size_t);
+uint16_t s_flac_crc16(const uint8_t *, size_t, size_t);
+void s_init_flac_bits(s_flac_bits_t *, const uint8_t *, size_t, size_t);
+void s_flac_bits_fill(s_flac_bits_t *);
+int s_flac_bits_overrun(const s_flac_bits_t *);
+uint32_t s_flac_read(s_flac_bits_t *, unsigned int);
+int32_t s_flac_read_signed(s_flac_bits_t *, unsigned int);
+int s_flac_read_unary(s_flac_bits_t *, uint32_t *);
+size_t s_flac_align(s_flac_bits_t *);
+int s_parse_flac_header(s_flac_header_t *, const uint8_t *, size_t, size_t,
+	const s_flac_info_t *);
+int s_decode_flac_residual(s_flac_bits_t *, int32_t *, size_t, size_t);
+int s_decode_flac_fixed(s_flac_bits_t *, int32_t *, size_t, uint32_t,
+	size_t);
+int s_decode_flac_lpc(s_flac_bits_t *, int32_t *, size_t, uint32_t, size_t);
+int s_decode_flac_subframe(s_flac_bits_t *, int32_t *, size_t, uint32_t);
+void s_flac_decorrelate(s_flac_decoder_t *, const s_flac_header_t *);
+int s_init_flac_decoder(s_flac_decoder_t *, const s_input_t *,
+	const s_flac_info_t *);
+void s_free_flac_decoder(s_flac_decoder_t *);
+int s_decode_flac_frame(s_flac_decoder_t *, s_flac_header_t *, size_t,
+	size_t *);
+size_t s_next_flac_frame(s_flac_decoder_t *, s_flac_header_t *, size_t,
+	size_t *);
+size_t s_seek_flac(s_flac_decoder_t *, size_t);
+int s_flac_reserve(s_flac_output_t *, size_t);
+int s_flac_pad(s_flac_output_t *, size_t);
+int s_flac_emit(s_flac_output_t *, size_t, const s_stereo_sample_t *, size_t);
+int s_decode_flac_frames(s_flac_decoder_t *, s_flac_output_t *, size_t,
+	size_t);
+int s_decode_flac_segments(s_flac_output_t *, const s_input_t *,
+	const s_flac_info_t *, size_t);
+int s_decode_flac_segment(void *, size_t, size_t, size_t);
+int s_decode_flac_output(s_flac_output_t *, const s_input_t *, size_t);
+
+/*
+ * These tables contain the CRC-8 (polynomial 0x07) and CRC-16 (polynomial
+ * 0x8005) of each possible 4-bit value, so the CRCs which protect each FLAC
+ * frame can be computed one nibble at a time.
+ */
+
+static const uint8_t s_flac_crc8_table[16] = {
+	0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+	0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+static const uint16_t s_flac_crc16_table[16] = {
+	0x0000, 0x8005, 0x800F, 0x000A, 0x801B, 0x001E, 0x0014, 0x8011,
+	0x8033, 0x0036, 0x003C, 0x8039, 0x0028, 0x802D, 0x8027, 0x0022
+};
+
+/*
+ * This block of silence is passed to an output's sink in place of the samples
+ * of any corrupt frames we skip (see s_flac_pad).
+ */
+
+static const s_stereo_sample_t s_flac_silence[256];
+
+/*
+ * This table maps each frame header's 3-bit sample size code to a bit depth.
+ * A value of 0 means the code is reserved, or a depth we don't support (code
+ * 0 means "the same as the STREAMINFO block", and is handled separately).
+ */
+
+static const uint32_t s_flac_bit_depths[8] = {
+	0, 8, 12, 0, 16, 20, 24, 0
+};
+
+/*!
+ * This function locates the start of the given FLAC file's audio data (i.e.,
+ * its first frame), by skipping over the "fLaC" marker and all of the file's
+ * metadata blocks. The first metadata block must be a STREAMINFO block, so
+ * this function can also be used to detect FLAC files.
+ *
+ * \param o This will receive the offset of the file's first frame.
+ * \param data The contents of the file to examine.
+ * \param length The length of the file, in bytes.
+ * \return 0 on success, or an error number if this isn't a FLAC file.
+ */
+int s_find_flac_frames(size_t *o, const uint8_t *data, size_t length)
+{
+	int r;
+	size_t off;
+	uint32_t header;
+
+	r = s_find_flac_metadata(&off, data, length);
+
+	if(r < 0)
+		return r;
+
+	if((off + 4 > length) || ((data[off] & 0x7F) != 0))
+		return -EINVAL;
+
+	/*
+	 * Each metadata block starts with a 32-bit header, containing a "last
+	 * block" flag, a 7-bit block type, and the 24-bit length of the rest
+	 * of the block.
+	 */
+
+	do
+	{
+		if(off + 4 > length)
+			return -EINVAL;
+
+		header = s_load_be_uint32(data, off);
+		off += 4 + (header & 0xFFFFFF);
+	} while(!(header & 0x80000000));
+
+	if(off > length)
+		return -EINVAL;
+
+	*o = off;
+
+	return 0;
+}
+
+/*!
+ * This function reads the STREAMINFO and SEEKTABLE metadata blocks of the
+ * given FLAC file into a newly allocated s_flac_info_t structure. If the
+ * pointer is non-NULL, we will not allocate a new value on top of it.
+ *
+ * \param info The s_flac_info_t to allocate.
+ * \param in The FLAC file to examine.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_init_flac_info(s_flac_info_t **info, const s_input_t *in)
+{
+	int r;
+	size_t off;
+	uint32_t header;
+	size_t size;
+
+	if(*info != NULL)
+		return -EINVAL;
+
+	r = s_find_flac_metadata(&off, in->data, in->length);
+
+	if(r < 0)
+		return r;
+
+	*info = malloc(sizeof(s_flac_info_t));
+
+	if(*info == NULL)
+		return -ENOMEM;
+
+	(*info)->min_block = 0;
+	(*info)->max_block = 0;
+	(*info)->sample_rate = 0;
+	(*info)->channels = 0;
+	(*info)->bit_depth = 0;
+	(*info)->samples = 0;
+	(*info)->seek_length = 0;
+	(*info)->seek_points = NULL;
+
+	// Read each of the metadata blocks we're interested in.
+
+	do
+	{
+		r = -EINVAL;
+
+		if(off + 4 > in->length)
+			break;
+
+		header = s_load_be_uint32(in->data, off);
+		size = header & 0xFFFFFF;
+		off += 4;
+
+		if(off + size > in->length)
+			break;
+
+		switch((header >> 24) & 0x7F)
+		{
+			case 0:
+				r = s_read_flac_streaminfo(*info,
+					in->data + off, size);
+				break;
+
+			case 3:
+				r = s_read_flac_seek_table(*info,
+					in->data + off, size);
+				break;
+
+			default:
+				r = 0;
+				break;
+		}
+
+		off += size;
+	} while((r == 0) && !(header & 0x80000000));
+
+	// Make sure we actually found the file's STREAMINFO block.
+
+	if((r == 0) && ((*info)->max_block == 0))
+		r = -EINVAL;
+
+	if(r < 0)
+		s_free_flac_info(info);
+
+	return r;
+}
+
+/*!
+ * This function frees the given s_flac_info_t structure, including its seek
+ * table. Note that this function is safe against double-frees.
+ *
+ * \param info The s_flac_info_t to free.
+ */
+void s_free_flac_info(s_flac_info_t **info)
+{
+	if(*info == NULL)
+		return;
+
+	free((*info)->seek_points);
+
+	free(*info);
+	*info = NULL;
+}
+
+/*!
+ * This function decodes a given FLAC file to raw PCM samples, storing the
+ * decoded data in the given list of stereo samples. Samples keep the file's
+ * own bit depth (rounded up to a multiple of 8 bits), mono files are decoded
+ * with identical left and right channels, and only the first two channels of
+ * files with more than two are kept.
+ *
+ * FLAC frames don't depend on each other, so if the file is large enough, it
+ * is split up into segments which are decoded in parallel.
+ *
+ * NOTE: It is up to the caller to ensure that the given list hasn't already
+ * been allocated, and to free it when done.
+ *
+ * \param samples This will receive the list of decoded samples.
+ * \param length This will receive the number of decoded samples.
+ * \param in The FLAC file to decode.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_flac(s_stereo_sample_t **samples, size_t *length,
+	const s_input_t *in, size_t threads)
+{
+	int r;
+	s_flac_output_t out;
+	s_stereo_sample_t *shrunk;
+
+	memset(&out, 0, sizeof(s_flac_output_t));
+	out.end = SIZE_MAX;
+
+	r = s_decode_flac_output(&out, in, s_get_thread_count(threads));
+
+	if(r < 0)
+	{
+		free(out.samples);
+		return r;
+	}
+
+	// Release any capacity the file's STREAMINFO block over-estimated.
+
+	if((out.length > 0) && (out.length < out.capacity))
+	{
+		shrunk = realloc(out.samples,
+			sizeof(s_stereo_sample_t) * out.length);
+
+		if(shrunk != NULL)
+			out.samples = shrunk;
+	}
+
+	*samples = out.samples;
+	*length = out.length;
+
+	return 0;
+}
+
+/*!
+ * This function decodes only the samples [begin, end) of the given FLAC file,
+ * placing them in the given list of stereo samples, in the same format as
+ * s_decode_flac. The frame containing begin is found using the file's seek
+ * table (if it has one), and by bisecting the file, so only the frames which
+ * cover the requested range are decoded. If the range extends past the end of
+ * the file, fewer samples are returned.
+ *
+ * NOTE: It is up to the caller to ensure that the given list hasn't already
+ * been allocated, and to free it when done.
+ *
+ * \param samples This will receive the list of decoded samples.
+ * \param length This will receive the number of decoded samples.
+ * \param in The FLAC file to decode.
+ * \param begin The position of the first sample to decode.
+ * \param end The position one past the last sample to decode.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_flac_range(s_stereo_sample_t **samples, size_t *length,
+	const s_input_t *in, size_t begin, size_t end)
+{
+	int r;
+	s_flac_output_t out;
+
+	if(end <= begin)
+		return -EINVAL;
+
+	memset(&out, 0, sizeof(s_flac_output_t));
+	out.begin = begin;
+	out.end = end;
+
+	r = s_decode_flac_output(&out, in, 1);
+
+	if(r < 0)
+	{
+		free(out.samples);
+		return r;
+	}
+
+	*samples = out.samples;
+	*length = out.length;
+
+	return 0;
+}
+
+/*!
+ * This function decodes a given FLAC file in the same format as
+ * s_decode_flac, passing each decoded frame's samples to the given function
+ * as soon as it has been decoded.
+ *
+ * The list of samples given to the sink is only valid for the duration of that
+ * call. If the sink returns an error, decoding stops and that error is
+ * returned.
+ *
+ * \param in The FLAC file to decode.
+ * \param sink The function to pass each block of decoded samples to.
+ * \param ctx The context pointer to pass to the sink.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_flac_stream(const s_input_t *in,
+	int (*sink)(void *, const s_stereo_sample_t *, size_t), void *ctx)
+{
+	s_flac_output_t out;
+
+	memset(&out, 0, sizeof(s_flac_output_t));
+	out.end = SIZE_MAX;
+	out.sink = sink;
+	out.sink_ctx = ctx;
+
+	return s_decode_flac_output(&out, in, 1);
+}
+
+/*!
+ * This function returns the bit depth of the samples we decode from a FLAC
+ * stream with the given properties. This is the stream's own bit depth,
+ * rounded up to a multiple of 8 bits.
+ *
+ * \param info The properties of the FLAC stream.
+ * \return The bit depth of the decoded samples.
+ */
+uint32_t s_get_flac_bit_depth(const s_flac_info_t *info)
+{
+	return (info->bit_depth + 7) & ~((uint32_t) 7);
+}
+
+/*!
+ * This function locates the start of the given FLAC file's metadata, just
+ * after its "fLaC" marker. Some files have an ID3v2 tag before the marker,
+ * which we skip.
+ *
+ * \param o This will receive the offset of the first metadata block.
+ * \param data The contents of the file to examine.
+ * \param length The length of the file, in bytes.
+ * \return 0 on success, or an error number if this isn't a FLAC file.
+ */
+int s_find_flac_metadata(size_t *o, const uint8_t *data, size_t length)
+{
+	size_t off = 0;
+
+	if( (length >= 10) && (data[0] == 0x49) && (data[1] == 0x44) &&
+		(data[2] == 0x33) )
+	{
+		off = 10 + (size_t) s_from_synchsafe_int32(data, 6);
+
+		if(data[5] & 0x10)
+			off += 10;
+	}
+
+	if((off + 4 > length) || (memcmp(data + off, "fLaC", 4) != 0))
+		return -EINVAL;
+
+	*o = off + 4;
+
+	return 0;
+}
+
+/*!
+ * This function reads the contents of a FLAC file's STREAMINFO metadata block
+ * into the given structure. We reject streams we can't decode here, so the
+ * rest of the decoder can rely on these properties.
+ *
+ * \param info The structure to populate.
+ * \param block The contents of the metadata block.
+ * \param length The length of the metadata block.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_read_flac_streaminfo(s_flac_info_t *info, const uint8_t *block,
+	size_t length)
+{
+	uint64_t v;
+
+	if(length != S_FLAC_STREAMINFO_LENGTH)
+		return -EINVAL;
+
+	/*
+	 * The block starts with the minimum and maximum block sizes (16 bits
+	 * each) and frame sizes (24 bits each). Next is a 64-bit field
+	 * containing the sample rate (20 bits), the number of channels minus
+	 * one (3 bits), the bit depth minus one (5 bits) and the total number
+	 * of samples (36 bits). An MD5 digest of the audio follows.
+	 */
+
+	info->min_block = (((uint32_t) block[0]) << 8) | block[1];
+	info->max_block = (((uint32_t) block[2]) << 8) | block[3];
+
+	v = s_load_be_uint64(block, 10);
+
+	info->sample_rate = (uint32_t) (v >> 44);
+	info->channels = (uint32_t) ((v >> 41) & 0x7) + 1;
+	info->bit_depth = (uint32_t) ((v >> 36) & 0x1F) + 1;
+	info->samples = (size_t) (v & 0xFFFFFFFFFULL);
+
+	if((info->max_block < 16) || (info->min_block > info->max_block))
+		return -EINVAL;
+
+	if((info->sample_rate == 0) || (info->bit_depth < 4) ||
+		(info->bit_depth > S_FLAC_MAX_BIT_DEPTH))
+	{
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function reads the contents of a FLAC file's SEEKTABLE metadata block
+ * into the given structure. Placeholder points are skipped.
+ *
+ * \param info The structure to populate.
+ * \param block The contents of the metadata block.
+ * \param length The length of the metadata block.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_read_flac_seek_table(s_flac_info_t *info, const uint8_t *block,
+	size_t length)
+{
+	size_t i;
+	size_t count = length / S_FLAC_SEEK_POINT_LENGTH;
+	uint64_t sample;
+	s_flac_seek_point_t *points;
+
+	if(count == 0)
+		return 0;
+
+	points = realloc(info->seek_points,
+		sizeof(s_flac_seek_point_t) * (info->seek_length + count));
+
+	if(points == NULL)
+		return -ENOMEM;
+
+	info->seek_points = points;
+
+	/*
+	 * Each point is the 64-bit position of a frame's first sample, then
+	 * the 64-bit offset of the frame, then the number of samples in the
+	 * frame (16 bits), which we don't need.
+	 */
+
+	for(i = 0; i < count; ++i)
+	{
+		sample = s_load_be_uint64(block, i * S_FLAC_SEEK_POINT_LENGTH);
+
+		if(sample == UINT64_MAX)
+			continue;
+
+		points[info->seek_length].sample = (size_t) sample;
+		points[info->seek_length].offset = (size_t) s_load_be_uint64(
+			block, i * S_FLAC_SEEK_POINT_LENGTH + 8);
+
+		++info->seek_length;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function computes the CRC-8 of the bytes [begin, end) of the given
+ * buffer, as used to protect FLAC frame headers.
+ *
+ * \param buf The buffer containing the data.
+ * \param begin The offset of the first byte.
+ * \param end The offset one past the last byte.
+ * \return The CRC-8 of the given bytes.
+ */
+uint8_t s_flac_crc8(const uint8_t *buf, size_t begin, size_t end)
+{
+	size_t i;
+	uint8_t crc = 0;
+
+	for(i = begin; i < end; ++i)
+	{
+		crc ^= buf[i];
+		crc = (uint8_t) ((crc << 4) ^ s_flac_crc8_table[crc >> 4]);
+		crc = (uint8_t) ((crc << 4) ^ s_flac_crc8_table[crc >> 4]);
+	}
+
+	return crc;
+}
+
+/*!
+ * This function computes the CRC-16 of the bytes [begin, end) of the given
+ * buffer, as used to protect entire FLAC frames.
+ *
+ * \param buf The buffer containing the data.
+ * \param begin The offset of the first byte.
+ * \param end The offset one past the last byte.
+ * \return The CRC-16 of the given bytes.
+ */
+uint16_t s_flac_crc16(const uint8_t *buf, size_t begin, size_t end)
+{
+	size_t i;
+	uint16_t crc = 0;
+
+	for(i = begin; i < end; ++i)
+	{
+		crc ^= (uint16_t) (((uint16_t) buf[i]) << 8);
+		crc = (uint16_t) ((crc << 4) ^ s_flac_crc16_table[crc >> 12]);
+		crc = (uint16_t) ((crc << 4) ^ s_flac_crc16_table[crc >> 12]);
+	}
+
+	return crc;
+}
+
+/*!
+ * This function initializes the given bit reader, to start reading the given
+ * buffer at the given offset.
+ *
+ * \param b The bit reader to initialize.
+ * \param data The buffer to read.
+ * \param length The length of the buffer.
+ * \param off The offset of the first byte to read.
+ */
+void s_init_flac_bits(s_flac_bits_t *b, const uint8_t *data, size_t length,
+	size_t off)
+{
+	b->data = data;
+	b->length = length;
+	b->pos = off;
+
+	b->cache = 0;
+	b->bits = 0;
+}
+
+/*!
+ * This function loads as many bytes into the given bit reader's cache as will
+ * fit. Bytes past the end of the buffer are loaded as zeros.
+ *
+ * \param b The bit reader to fill.
+ */
+void s_flac_bits_fill(s_flac_bits_t *b)
+{
+	while(b->bits <= 56)
+	{
+		if(b->pos < b->length)
+		{
+			b->cache |= ((uint64_t) b->data[b->pos]) <<
+				(56 - b->bits);
+		}
+
+		++b->pos;
+		b->bits += 8;
+	}
+}
+
+/*!
+ * This function tests if the given bit reader has read past the end of its
+ * buffer.
+ *
+ * \param b The bit reader to test.
+ * \return Whether or not any bits past the end of the buffer were read.
+ */
+int s_flac_bits_overrun(const s_flac_bits_t *b)
+{
+	return (b->pos * 8 - b->bits) > (b->length * 8);
+}
+
+/*!
+ * This function reads the given number of bits as an unsigned integer.
+ *
+ * \param b The bit reader to read from.
+ * \param n The number of bits to read. Must be no more than 32.
+ * \return The value which was read.
+ */
+uint32_t s_flac_read(s_flac_bits_t *b, unsigned int n)
+{
+	uint32_t v;
+
+	if(n == 0)
+		return 0;
+
+	if(b->bits < n)
+		s_flac_bits_fill(b);
+
+	v = (uint32_t) (b->cache >> (64 - n));
+
+	b->cache <<= n;
+	b->bits -= n;
+
+	return v;
+}
+
+/*!
+ * This function reads the given number of bits as a two's complement signed
+ * integer.
+ *
+ * \param b The bit reader to read from.
+ * \param n The number of bits to read. Must be no more than 32.
+ * \return The value which was read.
+ */
+int32_t s_flac_read_signed(s_flac_bits_t *b, unsigned int n)
+{
+	int64_t v;
+
+	if(n == 0)
+		return 0;
+
+	v = (int64_t) s_flac_read(b, n);
+
+	if(v & (((int64_t) 1) << (n - 1)))
+		v -= ((int64_t) 1) << n;
+
+	return (int32_t) v;
+}
+
+/*!
+ * This function reads a unary-coded value: the number of 0 bits before the
+ * next 1 bit.
+ *
+ * \param b The bit reader to read from.
+ * \param v This will receive the value which was read.
+ * \return 0 on success, or an error number if we ran out of data.
+ */
+int s_flac_read_unary(s_flac_bits_t *b, uint32_t *v)
+{
+	*v = 0;
+
+	// All of the bits in the cache past the valid ones are always zero.
+
+	while(b->cache == 0)
+	{
+		*v += b->bits;
+		b->bits = 0;
+
+		if(s_flac_bits_overrun(b))
+			return -EIO;
+
+		s_flac_bits_fill(b);
+	}
+
+	while(!(b->cache & 0x8000000000000000ULL))
+	{
+		b->cache <<= 1;
+		--b->bits;
+		++(*v);
+	}
+
+	b->cache <<= 1;
+	--b->bits;
+
+	return 0;
+}
+
+/*!
+ * This function skips to the next byte boundary, and returns the offset of
+ * the byte the given bit reader will read next.
+ *
+ * \param b The bit reader to align.
+ * \return The offset of the next byte to be read.
+ */
+size_t s_flac_align(s_flac_bits_t *b)
+{
+	b->cache <<= b->bits & 7;
+	b->bits &= ~7U;
+
+	return b->pos - b->bits / 8;
+}
+
+/*!
+ * This function parses the FLAC frame header at the given offset in the
+ * given buffer, and checks that it is valid for a stream with the given
+ * properties (including its CRC-8).
+ *
+ * \param header This will receive the frame's properties.
+ * \param buf The buffer containing the frame.
+ * \param off The offset of the frame's header.
+ * \param length The length of the buffer.
+ * \param info The properties of the stream the frame belongs to.
+ * \return 0 on success, or an error number if the header is invalid.
+ */
+int s_parse_flac_header(s_flac_header_t *header, const uint8_t *buf,
+	size_t off, size_t length, const s_flac_info_t *info)
+{
+	size_t p = off + 4;
+	uint32_t code;
+	uint32_t mask;
+	uint32_t extra;
+	uint64_t number;
+
+	if(off + S_FLAC_MIN_FRAME_LENGTH > length)
+		return -EINVAL;
+
+	/*
+	 * The header starts with a 14-bit sync code and a reserved bit (which
+	 * must be zero), followed by a bit indicating whether the stream has a
+	 * variable block size.
+	 */
+
+	if((buf[off] != 0xFF) || ((buf[off + 1] & 0xFE) != 0xF8))
+		return -EINVAL;
+
+	if(buf[off + 3] & 0x01)
+		return -EINVAL;
+
+	/*
+	 * Next is the frame number (or, for variable block size streams, the
+	 * position of the frame's first sample), coded like a UTF-8 character
+	 * of up to 7 bytes.
+	 */
+
+	code = buf[p++];
+	extra = 0;
+
+	for(mask = 0x80; code & mask; mask >>= 1)
+		++extra;
+
+	if((extra == 1) || (extra > 7))
+		return -EINVAL;
+
+	extra = extra > 0 ? extra - 1 : 0;
+	number = code & (mask - 1);
+
+	if(p + extra + 4 > length)
+		return -EINVAL;
+
+	for(; extra > 0; --extra)
+	{
+		if((buf[p] & 0xC0) != 0x80)
+			return -EINVAL;
+
+		number = (number << 6) | (buf[p++] & 0x3F);
+	}
+
+	// Decode the block size, which may follow the frame number.
+
+	code = buf[off + 2] >> 4;
+
+	if(code == 0)
+		return -EINVAL;
+	else if(code == 1)
+		header->samples = 192;
+	else if(code <= 5)
+		header->samples = ((size_t) 576) << (code - 2);
+	else if(code == 6)
+		header->samples = ((size_t) buf[p++]) + 1;
+	else if(code == 7)
+	{
+		header->samples = ((((size_t) buf[p]) << 8) | buf[p + 1]) + 1;
+		p += 2;
+	}
+	else
+		header->samples = ((size_t) 256) << (code - 8);
+
+	/*
+	 * The sample rate may also be stored after the frame number. We always
+	 * use the rate from the STREAMINFO block, but need to skip it.
+	 */
+
+	code = buf[off + 2] & 0x0F;
+
+	if(code == 15)
+		return -EINVAL;
+	else if(code == 12)
+		p += 1;
+	else if(code >= 13)
+		p += 2;
+
+	// Decode the channel assignment and the bit depth.
+
+	header->assignment = buf[off + 3] >> 4;
+
+	if(header->assignment > 10)
+		return -EINVAL;
+
+	header->channels = header->assignment < 8 ?
+		header->assignment + 1 : 2;
+
+	code = (buf[off + 3] >> 1) & 0x07;
+	header->bit_depth = code == 0 ? info->bit_depth :
+		s_flac_bit_depths[code];
+
+	if(header->bit_depth == 0)
+		return -EINVAL;
+
+	// Make sure the frame fits the stream's STREAMINFO.
+
+	if((header->channels != info->channels) ||
+		(header->samples > info->max_block) ||
+		(header->bit_depth > s_get_flac_bit_depth(info)))
+	{
+		return -EINVAL;
+	}
+
+	// Finally, the header is protected by a CRC-8.
+
+	if(p >= length)
+		return -EINVAL;
+
+	if(s_flac_crc8(buf, off, p) != buf[p])
+		return -EINVAL;
+
+	header->length = p + 1 - off;
+
+	if(buf[off + 1] & 0x01)
+		header->position = (size_t) number;
+	else
+		header->position = (size_t) number * info->max_block;
+
+	return 0;
+}
+
+/*!
+ * This function decodes the Rice-coded residual of a FIXED or LPC subframe,
+ * placing it in out[order, n).
+ *
+ * \param b The bit reader to read the residual from.
+ * \param out The list of the subframe's samples.
+ * \param n The number of samples in the subframe.
+ * \param order The predictor's order (i.e., the number of warm-up samples).
+ * \return 0 on success, or an error number if the residual is invalid.
+ */
+int s_decode_flac_residual(s_flac_bits_t *b, int32_t *out, size_t n,
+	size_t order)
+{
+	int r;
+	uint32_t method;
+	uint32_t partition_order;
+	uint32_t pbits;
+	uint32_t parameter;
+	uint32_t q;
+	uint64_t u;
+	size_t p;
+	size_t count;
+	size_t i = order;
+	size_t j;
+
+	/*
+	 * The residual is split into 2^partition_order partitions, each of
+	 * which has its own Rice parameter (4 or 5 bits, depending on the
+	 * coding method). A parameter of all ones is an escape code, meaning
+	 * the partition's samples are stored unencoded instead.
+	 */
+
+	method = s_flac_read(b, 2);
+
+	if(method > 1)
+		return -EINVAL;
+
+	pbits = method == 0 ? 4 : 5;
+	partition_order = s_flac_read(b, 4);
+
+	if(((n >> partition_order) << partition_order) != n)
+		return -EINVAL;
+
+	if((n >> partition_order) < order)
+		return -EINVAL;
+
+	for(p = 0; p < (((size_t) 1) << partition_order); ++p)
+	{
+		count = (n >> partition_order) - (p == 0 ? order : 0);
+		parameter = s_flac_read(b, pbits);
+
+		if(parameter == (1U << pbits) - 1)
+		{
+			parameter = s_flac_read(b, 5);
+
+			for(j = 0; j < count; ++j)
+				out[i++] = s_flac_read_signed(b, parameter);
+
+			continue;
+		}
+
+		for(j = 0; j < count; ++j)
+		{
+			r = s_flac_read_unary(b, &q);
+
+			if(r < 0)
+				return r;
+
+			u = (((uint64_t) q) << parameter) |
+				s_flac_read(b, parameter);
+
+			// Values are "zig-zag" coded, i.e. 0, -1, 1, -2, ...
+
+			out[i++] = (int32_t) ((int64_t) (u >> 1) ^
+				-((int64_t) (u & 1)));
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * This function decodes a FIXED subframe, which predicts each sample with a
+ * fixed polynomial of the given order (from 0 to 4).
+ *
+ * \param b The bit reader to read the subframe from.
+ * \param out The list which will receive the subframe's samples.
+ * \param n The number of samples in the subframe.
+ * \param bits The bit depth of the subframe's samples.
+ * \param order The order of the predictor.
+ * \return 0 on success, or an error number if the subframe is invalid.
+ */
+int s_decode_flac_fixed(s_flac_bits_t *b, int32_t *out, size_t n,
+	uint32_t bits, size_t order)
+{
+	int r;
+	size_t i;
+	int64_t p;
+
+	if(order > n)
+		return -EINVAL;
+
+	for(i = 0; i < order; ++i)
+		out[i] = s_flac_read_signed(b, bits);
+
+	r = s_decode_flac_residual(b, out, n, order);
+
+	if(r < 0)
+		return r;
+
+	for(i = order; i < n; ++i)
+	{
+		switch(order)
+		{
+			case 1:
+				p = (int64_t) out[i - 1];
+				break;
+
+			case 2:
+				p = 2 * (int64_t) out[i - 1] - out[i - 2];
+				break;
+
+			case 3:
+				p = 3 * ((int64_t) out[i - 1] - out[i - 2]) +
+					out[i - 3];
+				break;
+
+			case 4:
+				p = 4 * ((int64_t) out[i - 1] + out[i - 3]) -
+					6 * (int64_t) out[i - 2] - out[i - 4];
+				break;
+
+			default:
+				p = 0;
+				break;
+		}
+
+		out[i] = (int32_t) (out[i] + p);
+	}
+
+	return 0;
+}
+
+/*!
+ * This function decodes an LPC subframe, which predicts each sample with a
+ * linear combination of the preceding samples, with the given order (from 1
+ * to 32).
+ *
+ * \param b The bit reader to read the subframe from.
+ * \param out The list which will receive the subframe's samples.
+ * \param n The number of samples in the subframe.
+ * \param bits The bit depth of the subframe's samples.
+ * \param order The order of the predictor.
+ * \return 0 on success, or an error number if the subframe is invalid.
+ */
+int s_decode_flac_lpc(s_flac_bits_t *b, int32_t *out, size_t n,
+	uint32_t bits, size_t order)
+{
+	int r;
+	size_t i;
+	size_t j;
+	uint32_t precision;
+	int32_t shift;
+	int32_t coefficients[32];
+	int64_t sum;
+
+	if(order > n)
+		return -EINVAL;
+
+	for(i = 0; i < order; ++i)
+		out[i] = s_flac_read_signed(b, bits);
+
+	/*
+	 * The warm-up samples are followed by the precision of the predictor's
+	 * coefficients (minus one), the (non-negative) shift to apply to each
+	 * prediction, and then the coefficients themselves.
+	 */
+
+	precision = s_flac_read(b, 4) + 1;
+	shift = s_flac_read_signed(b, 5);
+
+	if((precision == 16) || (shift < 0))
+		return -EINVAL;
+
+	for(i = 0; i < order; ++i)
+		coefficients[i] = s_flac_read_signed(b, precision);
+
+	r = s_decode_flac_residual(b, out, n, order);
+
+	if(r < 0)
+		return r;
+
+	for(i = order; i < n; ++i)
+	{
+		sum = 0;
+
+		for(j = 0; j < order; ++j)
+			sum += (int64_t) coefficients[j] * out[i - 1 - j];
+
+		out[i] = (int32_t) (out[i] + (sum >> shift));
+	}
+
+	return 0;
+}
+
+/*!
+ * This function decodes a single subframe (i.e., one channel of a frame).
+ *
+ * \param b The bit reader to read the subframe from.
+ * \param out The list which will receive the subframe's samples.
+ * \param n The number of samples in the subframe.
+ * \param bits The bit depth of the subframe's samples.
+ * \return 0 on success, or an error number if the subframe is invalid.
+ */
+int s_decode_flac_subframe(s_flac_bits_t *b, int32_t *out, size_t n,
+	uint32_t bits)
+{
+	int r = 0;
+	uint32_t type;
+	uint32_t wasted = 0;
+	size_t i;
+
+	/*
+	 * Each subframe starts with a zero bit, the 6-bit subframe type, and a
+	 * flag which indicates that the low bits of every sample are zero. If
+	 * so, the (unary-coded) number of these "wasted" bits, minus one,
+	 * follows, and the samples are stored without them.
+	 */
+
+	if(s_flac_read(b, 1) != 0)
+		return -EINVAL;
+
+	type = s_flac_read(b, 6);
+
+	if(s_flac_read(b, 1))
+	{
+		r = s_flac_read_unary(b, &wasted);
+
+		if(r < 0)
+			return r;
+
+		++wasted;
+
+		if(wasted >= bits)
+			return -EINVAL;
+
+		bits -= wasted;
+	}
+
+	if(type == 0)
+	{
+		// CONSTANT: a single value, repeated n times.
+
+		out[0] = s_flac_read_signed(b, bits);
+
+		for(i = 1; i < n; ++i)
+			out[i] = out[0];
+	}
+	else if(type == 1)
+	{
+		// VERBATIM: the samples, unencoded.
+
+		for(i = 0; i < n; ++i)
+			out[i] = s_flac_read_signed(b, bits);
+	}
+	else if((type >= 8) && (type <= 12))
+	{
+		r = s_decode_flac_fixed(b, out, n, bits, type - 8);
+	}
+	else if(type >= 32)
+	{
+		r = s_decode_flac_lpc(b, out, n, bits, type - 31);
+	}
+	else
+	{
+		return -EINVAL;
+	}
+
+	if(r < 0)
+		return r;
+
+	if(wasted > 0)
+	{
+		for(i = 0; i < n; ++i)
+			out[i] = (int32_t) (((uint32_t) out[i]) << wasted);
+	}
+
+	return s_flac_bits_overrun(b) ? -EIO : 0;
+}
+
+/*!
+ * This function converts the channels of the frame the given decoder just
+ * decoded into its block of stereo samples, undoing any inter-channel
+ * decorrelation the encoder applied.
+ *
+ * \param dec The decoder which decoded the frame.
+ * \param header The frame's header.
+ */
+void s_flac_decorrelate(s_flac_decoder_t *dec, const s_flac_header_t *header)
+{
+	size_t i;
+	const int32_t *a = dec->channels;
+	const int32_t *b = dec->channels;
+	int32_t l;
+	int32_t r;
+	int32_t m;
+	int32_t scale;
+
+	if(header->channels > 1)
+		b += dec->info->max_block;
+
+	scale = ((int32_t) 1) << (dec->depth - header->bit_depth);
+
+	/*
+	 * Stereo frames may be stored as left / side, side / right or
+	 * mid / side (where side = left - right, and mid = (left + right) / 2,
+	 * whose lost low bit is the same as the side channel's).
+	 */
+
+	for(i = 0; i < header->samples; ++i)
+	{
+		switch(header->assignment)
+		{
+			case 8:
+				l = a[i];
+				r = a[i] - b[i];
+				break;
+
+			case 9:
+				l = a[i] + b[i];
+				r = b[i];
+				break;
+
+			case 10:
+				m = (int32_t) ((uint32_t) a[i] << 1);
+				m |= b[i] & 1;
+				l = (m + b[i]) >> 1;
+				r = (m - b[i]) >> 1;
+				break;
+
+			default:
+				l = a[i];
+				r = b[i];
+				break;
+		}
+
+		dec->block[i].l = l * scale;
+		dec->block[i].r = r * scale;
+	}
+}
+
+/*!
+ * This function initializes the given FLAC decoder, allocating enough space
+ * to decode any of the given stream's frames.
+ *
+ * \param dec The decoder to initialize.
+ * \param in The FLAC file to decode.
+ * \param info The properties of the FLAC stream.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_init_flac_decoder(s_flac_decoder_t *dec, const s_input_t *in,
+	const s_flac_info_t *info)
+{
+	dec->in = in;
+	dec->info = info;
+	dec->depth = s_get_flac_bit_depth(info);
+
+	dec->channels = malloc(sizeof(int32_t) * info->channels *
+		info->max_block);
+	dec->block = malloc(sizeof(s_stereo_sample_t) * info->max_block);
+
+	if((dec->channels == NULL) || (dec->block == NULL))
+	{
+		s_free_flac_decoder(dec);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the buffers allocated by s_init_flac_decoder.
+ *
+ * \param dec The decoder to free.
+ */
+void s_free_flac_decoder(s_flac_decoder_t *dec)
+{
+	free(dec->channels);
+	dec->channels = NULL;
+
+	free(dec->block);
+	dec->block = NULL;
+}
+
+/*!
+ * This function decodes the FLAC frame at the given offset into the given
+ * decoder's block of stereo samples. The whole frame is checked against its
+ * CRC-16, so this also tells us whether there really is a frame here.
+ *
+ * \param dec The decoder to decode the frame with.
+ * \param header This will receive the frame's properties.
+ * \param off The offset of the frame in the decoder's input.
+ * \param length This will receive the frame's length, in bytes.
+ * \return 0 on success, or an error number if there is no valid frame here.
+ */
+int s_decode_flac_frame(s_flac_decoder_t *dec, s_flac_header_t *header,
+	size_t off, size_t *length)
+{
+	int r;
+	uint32_t c;
+	uint32_t bits;
+	size_t end;
+	s_flac_bits_t b;
+	const uint8_t *data = dec->in->data;
+	size_t inl = dec->in->length;
+
+	r = s_parse_flac_header(header, data, off, inl, dec->info);
+
+	if(r < 0)
+		return r;
+
+	s_init_flac_bits(&b, data, inl, off + header->length);
+
+	for(c = 0; c < header->channels; ++c)
+	{
+		// The side channel of a stereo frame has one extra bit.
+
+		bits = header->bit_depth;
+
+		if( ((header->assignment == 8) && (c == 1)) ||
+			((header->assignment == 9) && (c == 0)) ||
+			((header->assignment == 10) && (c == 1)) )
+		{
+			++bits;
+		}
+
+		r = s_decode_flac_subframe(&b, dec->channels +
+			c * dec->info->max_block, header->samples, bits);
+
+		if(r < 0)
+			return r;
+	}
+
+	// The frame is padded to a whole byte, and then ends with its CRC-16.
+
+	end = s_flac_align(&b);
+
+	if(end + 2 > inl)
+		return -EIO;
+
+	if(s_flac_crc16(data, off, end) !=
+		((((uint16_t) data[end]) << 8) | data[end + 1]))
+	{
+		return -EIO;
+	}
+
+	*length = end + 2 - off;
+
+	s_flac_decorrelate(dec, header);
+
+	return 0;
+}
+
+/*!
+ * This function finds and decodes the first valid FLAC frame at or after the
+ * given offset. Candidates are found with memchr (since every frame starts
+ * with an 0xFF byte), and are only accepted if they decode successfully.
+ *
+ * \param dec The decoder to decode the frame with.
+ * \param header This will receive the frame's properties.
+ * \param off The offset to start searching from.
+ * \param length This will receive the frame's length, in bytes.
+ * \return The offset of the frame, or the input's length if none was found.
+ */
+size_t s_next_flac_frame(s_flac_decoder_t *dec, s_flac_header_t *header,
+	size_t off, size_t *length)
+{
+	const uint8_t *p;
+	const uint8_t *data = dec->in->data;
+	size_t inl = dec->in->length;
+
+	while(off + S_FLAC_MIN_FRAME_LENGTH <= inl)
+	{
+		if(s_decode_flac_frame(dec, header, off, length) == 0)
+			return off;
+
+		p = memchr(data + off + 1, 0xFF, inl - off - 1);
+
+		if(p == NULL)
+			break;
+
+		off = (size_t) (p - data);
+	}
+
+	return inl;
+}
+
+/*!
+ * This function finds the offset of a FLAC frame which starts at or before the
+ * given sample, and which is as close to it as we can cheaply find. We start
+ * with the closest points in the file's seek table (if any), and then bisect
+ * the remaining range, until it is at most S_FLAC_SEEK_BYTES long.
+ *
+ * \param dec The decoder to decode frames with.
+ * \param sample The position of the sample to seek to.
+ * \return The offset to start decoding from.
+ */
+size_t s_seek_flac(s_flac_decoder_t *dec, size_t sample)
+{
+	size_t i;
+	size_t lo = dec->in->offset;
+	size_t hi = dec->in->length;
+	size_t mid;
+	size_t off;
+	size_t length;
+	s_flac_header_t header;
+	const s_flac_seek_point_t *point;
+
+	for(i = 0; i < dec->info->seek_length; ++i)
+	{
+		point = &(dec->info->seek_points[i]);
+		off = dec->in->offset + point->offset;
+
+		if(off >= dec->in->length)
+			continue;
+
+		if((point->sample <= sample) && (off > lo))
+			lo = off;
+		else if((point->sample > sample) && (off < hi))
+			hi = off;
+	}
+
+	/*
+	 * Invariant: the frame at lo starts at or before the given sample, and
+	 * any frame at or after hi starts after it.
+	 */
+
+	while((hi > lo) && (hi - lo > S_FLAC_SEEK_BYTES))
+	{
+		mid = lo + (hi - lo) / 2;
+		off = s_next_flac_frame(dec, &header, mid, &length);
+
+		if(off >= hi)
+			hi = mid;
+		else if(header.position <= sample)
+			lo = off;
+		else
+			hi = off;
+	}
+
+	return lo;
+}
+
+/*!
+ * This function makes sure the given output's list of samples has room for
+ * at least the given number of samples. Any newly allocated samples are set
+ * to silence, so gaps left by corrupt frames don't contain garbage.
+ *
+ * \param out The output to grow.
+ * \param n The number of samples the list needs room for.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_flac_reserve(s_flac_output_t *out, size_t n)
+{
+	size_t capacity;
+	s_stereo_sample_t *samples;
+
+	if(n <= out->capacity)
+		return 0;
+
+	capacity = out->capacity * 2;
+
+	if(capacity < n)
+		capacity = n;
+
+	samples = realloc(out->samples, sizeof(s_stereo_sample_t) * capacity);
+
+	if(samples == NULL)
+		return -ENOMEM;
+
+	memset(samples + out->capacity, 0,
+		sizeof(s_stereo_sample_t) * (capacity - out->capacity));
+
+	out->samples = samples;
+	out->capacity = capacity;
+
+	return 0;
+}
+
+/*!
+ * This function outputs silence up to (but not including) the given position,
+ * if the given output hasn't reached it yet. This fills the gap left by any
+ * corrupt frames we skipped, or by a file which is shorter than its
+ * STREAMINFO block says.
+ *
+ * \param out The output to pad.
+ * \param position The position of the first sample which isn't padded.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_flac_pad(s_flac_output_t *out, size_t position)
+{
+	int r;
+	size_t n;
+	size_t count;
+	size_t silence = sizeof(s_flac_silence) / sizeof(s_stereo_sample_t);
+
+	position = position < out->end ? position : out->end;
+
+	if(position <= out->begin + out->length)
+		return 0;
+
+	n = position - out->begin;
+
+	if(out->sink == NULL)
+	{
+		// New samples are already silent (see s_flac_reserve).
+
+		if(out->fixed)
+			n = n < out->capacity ? n : out->capacity;
+		else
+		{
+			r = s_flac_reserve(out, n);
+
+			if(r < 0)
+				return r;
+		}
+
+		out->length = n > out->length ? n : out->length;
+
+		return 0;
+	}
+
+	while(out->length < n)
+	{
+		count = n - out->length;
+		count = count < silence ? count : silence;
+
+		r = out->sink(out->sink_ctx, s_flac_silence, count);
+
+		if(r < 0)
+			return r;
+
+		out->length += count;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function outputs the given decoded frame, according to the given
+ * output's settings. A sink is given silence in place of any samples we
+ * skipped before the frame, and only the part of the frame it hasn't already
+ * been given (the buffered path instead lets a later frame overwrite an
+ * earlier one).
+ *
+ * \param out The output to pass the frame to.
+ * \param position The position of the frame's first sample.
+ * \param block The frame's samples.
+ * \param n The number of samples in the frame.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_flac_emit(s_flac_output_t *out, size_t position,
+	const s_stereo_sample_t *block, size_t n)
+{
+	int r;
+	size_t skip = 0;
+	size_t count;
+	size_t idx;
+
+	if((position >= out->end) || (position + n <= out->begin))
+		return 0;
+
+	// Only output the part of the frame inside [begin, end).
+
+	if(position < out->begin)
+		skip = out->begin - position;
+
+	count = n - skip;
+
+	if(position + n > out->end)
+		count -= position + n - out->end;
+
+	if(out->sink != NULL)
+	{
+		r = s_flac_pad(out, position + skip);
+
+		if(r < 0)
+			return r;
+
+		// Drop any part of the frame which overlaps what we've output.
+
+		idx = out->begin + out->length - position;
+
+		if(idx >= skip + count)
+			return 0;
+
+		count -= idx - skip;
+
+		r = out->sink(out->sink_ctx, block + idx, count);
+
+		if(r < 0)
+			return r;
+
+		out->length += count;
+
+		return 0;
+	}
+
+	idx = position + skip - out->begin;
+
+	if(out->fixed)
+	{
+		if(idx >= out->capacity)
+			return 0;
+
+		if(idx + count > out->capacity)
+			count = out->capacity - idx;
+	}
+	else
+	{
+		r = s_flac_reserve(out, idx + count);
+
+		if(r < 0)
+			return r;
+	}
+
+	memcpy(out->samples + idx, block + skip,
+		sizeof(s_stereo_sample_t) * count);
+
+	if(idx + count > out->length)
+		out->length = idx + count;
+
+	return 0;
+}
+
+/*!
+ * This function decodes each FLAC frame which starts in the range [from, to)
+ * of the decoder's input, passing each of them to the given output. Corrupt
+ * frames are skipped. We stop early once we pass the end of the output's
+ * range of samples.
+ *
+ * \param dec The decoder to decode frames with.
+ * \param out The output to pass each decoded frame to.
+ * \param from The offset to start decoding from.
+ * \param to The offset past which no new frames are decoded.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_flac_frames(s_flac_decoder_t *dec, s_flac_output_t *out,
+	size_t from, size_t to)
+{
+	int r;
+	size_t off;
+	size_t length;
+	s_flac_header_t header;
+
+	off = s_next_flac_frame(dec, &header, from, &length);
+
+	while((off < to) && (header.position < out->end))
+	{
+		r = s_flac_emit(out, header.position, dec->block,
+			header.samples);
+
+		if(r < 0)
+			return r;
+
+		off = s_next_flac_frame(dec, &header, off + length, &length);
+	}
+
+	return 0;
+}
+
+/*!
+ * This function decodes the given FLAC file in parallel, by splitting it up
+ * into the given number of contiguous segments. Every frame header contains
+ * the position of the frame's first sample, so each segment can be decoded
+ * straight into the right place in the output's list of samples.
+ *
+ * \param out The output which receives the decoded data.
+ * \param in The FLAC file to decode.
+ * \param info The properties of the FLAC stream.
+ * \param segments The number of segments to decode concurrently.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_flac_segments(s_flac_output_t *out, const s_input_t *in,
+	const s_flac_info_t *info, size_t segments)
+{
+	int r;
+	size_t i;
+	s_flac_segment_job_t job;
+
+	r = s_flac_reserve(out, info->samples);
+
+	if(r < 0)
+		return r;
+
+	job.in = in;
+	job.info = info;
+	job.outputs = malloc(sizeof(s_flac_output_t) * segments);
+
+	if(job.outputs == NULL)
+		return -ENOMEM;
+
+	for(i = 0; i < segments; ++i)
+	{
+		job.outputs[i] = *out;
+		job.outputs[i].fixed = 1;
+	}
+
+	r = s_parallel_for(in->length - in->offset, segments,
+		s_decode_flac_segment, &job);
+
+	for(i = 0; i < segments; ++i)
+	{
+		if(job.outputs[i].length > out->length)
+			out->length = job.outputs[i].length;
+	}
+
+	free(job.outputs);
+
+	return r;
+}
+
+/*!
+ * This function is the s_parallel_for worker for s_decode_flac_segments. It
+ * decodes the frames which start in the given range of the file (relative to
+ * its first frame).
+ *
+ * \param ctx The s_flac_segment_job_t describing the file.
+ * \param worker The index of the segment to decode.
+ * \param begin The offset of the start of the segment.
+ * \param end The offset of the end of the segment.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_flac_segment(void *ctx, size_t worker, size_t begin, size_t end)
+{
+	int r;
+	s_flac_segment_job_t *job = ctx;
+	s_flac_decoder_t dec;
+
+	r = s_init_flac_decoder(&dec, job->in, job->info);
+
+	if(r < 0)
+		return r;
+
+	r = s_decode_flac_frames(&dec, &(job->outputs[worker]),
+		job->in->offset + begin, job->in->offset + end);
+
+	s_free_flac_decoder(&dec);
+
+	return r;
+}
+
+/*!
+ * This function decodes the given FLAC file into the given output. Whole
+ * files whose length is known are decoded in parallel (if we're given more
+ * than one thread, and the file is large enough); otherwise, we seek to the
+ * start of the output's range and decode from there.
+ *
+ * \param out The output which receives the decoded data.
+ * \param in The FLAC file to decode.
+ * \param threads The number of threads to decode with.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_flac_output(s_flac_output_t *out, const s_input_t *in,
+	size_t threads)
+{
+	int r;
+	size_t segments;
+	size_t expected;
+	size_t from;
+	s_flac_info_t *info = NULL;
+	s_flac_decoder_t dec;
+
+	r = s_init_flac_info(&info, in);
+
+	if(r < 0)
+		return r;
+
+	segments = (in->length - in->offset) / S_FLAC_SEGMENT_MIN_BYTES;
+	segments = segments < threads ? segments : threads;
+
+	if((segments > 1) && (out->sink == NULL) && (out->begin == 0) &&
+		(out->end == SIZE_MAX) && (info->samples > 0))
+	{
+		r = s_decode_flac_segments(out, in, info, segments);
+		goto done;
+	}
+
+	// Make room for the samples we expect, if we know how many there are.
+
+	expected = out->end - out->begin;
+
+	if(info->samples < out->end)
+	{
+		expected = info->samples > out->begin ?
+			info->samples - out->begin : 0;
+	}
+
+	if((out->sink == NULL) && (expected > 0))
+	{
+		r = s_flac_reserve(out, expected);
+
+		if(r < 0)
+			goto done;
+	}
+
+	r = s_init_flac_decoder(&dec, in, info);
+
+	if(r < 0)
+		goto done;
+
+	from = out->begin > 0 ? s_seek_flac(&dec, out->begin) : in->offset;
+
+	r = s_decode_flac_frames(&dec, out, from, in->length);
+
+	s_free_flac_decoder(&dec);
+done:
+	// Anything missing from the end of the file is output as silence.
+
+	if(r >= 0)
+		r = s_flac_pad(out, info->samples);
+
+	s_free_flac_info(&info);
+	return r;
+}
@@ -0,0 +1,40 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_DECODING_QUIRKS_FLAC_H
+#define INCLUDE_SPECTR_DECODING_QUIRKS_FLAC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spectr/types.h"
+
+extern int s_find_flac_frames(size_t *, const uint8_t *, size_t);
+
+extern int s_init_flac_info(s_flac_info_t **, const s_input_t *);
+extern void s_free_flac_info(s_flac_info_t **);
+extern uint32_t s_get_flac_bit_depth(const s_flac_info_t *);
+
+extern int s_decode_flac(s_stereo_sample_t **, size_t *, const s_input_t *,
+	size_t);
+extern int s_decode_flac_range(s_stereo_sample_t **, size_t *,
+	const s_input_t *, size_t, size_t);
+extern int s_decode_flac_stream(const s_input_t *,
+	int (*)(void *, const s_stereo_sample_t *, size_t), void *);
+
+#endif
@@ -18,95 +18,150 @@
 
 #include "mp3.h"
 
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <fcntl.h>
 #include <errno.h>
-#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <mad.h>
 
+#include "spectr/config.h"
+#include "spectr/constants.h"
 #include "spectr/defines.h"
 #include "spectr/util/bitwise.h"
+#include "spectr/util/thread.h"
 
 /*!
  * \brief This structure stores the input and output buffers for MAD decoding.
+ *
+ * If sink is NULL, decoded samples are appended directly to the samples list,
+ * which is grown as needed; capacity is the number of samples the list
+ * currently has room for. Otherwise, each decoded frame is scaled into block,
+ * and passed to the sink, so the decoded audio is never stored as a whole.
+ *
+ * Only the frames which start in the range [begin, end) of the file (whose
+ * contents start at base) are output; decoding may start a few frames before
+ * begin, so the decoder's state is primed by the time we reach it.
+ *
+ * If to is non-zero, only the samples [from, to) of the file are wanted; see
+ * s_decode_mp3_range. They are found with the given index of the file's
+ * frames, or (if it is NULL) with one built just for this range.
  */
 typedef struct s_mad_buffer
 {
+	const uint8_t *base;
 	const uint8_t *in;
 	size_t length;
-	FILE *out;
+	size_t inl;
+
+	struct mad_decoder *decoder;
+	size_t begin;
+	size_t end;
+	size_t offset;
+
+	size_t from;
+	size_t to;
+	const s_mp3_index_t *index;
+
+	s_stereo_sample_t *samples;
+	size_t samples_length;
+	size_t capacity;
+
+	int (*sink)(void *, const s_stereo_sample_t *, size_t);
+	void *sink_ctx;
+	s_stereo_sample_t block[S_MP3_MAX_FRAME_SAMPLES];
+
+	int error;
 } s_mad_buffer_t;
 
-int s_is_mp3_frame_header(const uint8_t *, size_t);
+/*!
+ * \brief This structure describes how a file is split up for s_decode_mp3.
+ *
+ * The file's frames (whose offsets are listed in frames) are divided into
+ * the given number of contiguous segments, each of which is decoded into its
+ * own buffer.
+ */
+typedef struct s_mp3_segment_job
+{
+	const uint8_t *in;
+	size_t inl;
+	const s_mp3_index_t *index;
+	size_t segments;
+	s_mad_buffer_t **buffers;
+} s_mp3_segment_job_t;
+
+int s_is_mp3_frame_sync(const uint8_t *, size_t, size_t);
+size_t s_scan_mp3_frames(const uint8_t *, size_t, size_t);
+void s_read_mp3_tag(s_mp3_tag_t *, const uint8_t *, size_t, size_t,
+	const s_mp3_frame_t *);
+int s_index_mp3_data(s_mp3_index_t *, const uint8_t *, size_t, size_t);
+size_t s_find_mp3_frame(const s_mp3_index_t *, size_t);
 enum mad_flow s_mad_input(void *, struct mad_stream *);
+enum mad_flow s_mad_header(void *, struct mad_header const *);
 int16_t s_mad_scale(mad_fixed_t);
 enum mad_flow s_mad_output(void *,
 	struct mad_header const *, struct mad_pcm *);
 enum mad_flow s_mad_error(void *, struct mad_stream *, struct mad_frame *);
-int s_decode_mp3_data(FILE *, const uint8_t *, size_t);
+int s_mad_reserve(s_mad_buffer_t *, struct mad_header const *, size_t);
+void s_init_mad_buffer(s_mad_buffer_t *);
+int s_decode_mp3_input(s_mad_buffer_t *, const s_input_t *, size_t);
+int s_decode_mp3_segments(s_mad_buffer_t *, const s_input_t *, size_t);
+int s_decode_mp3_segment(void *, size_t, size_t, size_t);
+int s_decode_mp3_window(s_mad_buffer_t *, const s_input_t *);
+int s_decode_mp3_data(s_mad_buffer_t *, const uint8_t *, size_t, size_t,
+	size_t, size_t);
+
+/*
+ * The bitrates (in kbit/s) each bitrate index in an MP3 frame header refers
+ * to, for MPEG version 1 layers I, II and III, and then for MPEG versions 2
+ * and 2.5 layer I, and layers II and III.
+ */
+static const uint16_t s_mp3_bitrates[5][16] = {
+	{
+		0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384,
+		416, 448, 0
+	},
+	{0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+	{0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+	{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+	{0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+};
+
+/*
+ * The sample rates each sample rate index in an MP3 frame header refers to,
+ * indexed by the frame's MPEG version ID (00 is the unofficial MPEG version
+ * 2.5, 10 is MPEG version 2 and 11 is MPEG version 1; 01 is reserved).
+ */
+static const uint32_t s_mp3_sample_rates[4][3] = {
+	{11025, 12000, 8000},
+	{0, 0, 0},
+	{22050, 24000, 16000},
+	{44100, 48000, 32000}
+};
 
 /*!
  * This function attemps to locate the first valid MP3 frame header in the
- * given file. If an ID3v2 tag is present, we try to use the information it
- * contains to find a valid header. Otherwise, the file is simply searched
- * sequentially.
+ * given file contents. If an ID3v2 tag is present, we try to use the
+ * information it contains to find a valid header. Otherwise, the file is
+ * searched sequentially with s_scan_mp3_frames.
  *
  * \param o This will receive the offset of the first valid MP3 frame header.
- * \param f The path to the file to examine.
+ * \param file The contents of the file to examine.
+ * \param length The length of the file, in bytes.
  * \return 0 on success, or an error number if no headers could be found.
  */
-int s_get_mp3_frame_header_offset(size_t *o, const char *f)
+int s_find_mp3_frame_header(size_t *o, const uint8_t *file, size_t length)
 {
-	int ret = 0;
-	int r;
-	int fd;
-	struct stat stat;
-	uint8_t *file;
 	size_t off = 0;
-	size_t i;
-
-	// mmap the file, since our reads will be rather random.
-
-	fd = open(f, O_RDONLY);
-
-	if(fd < 0)
-	{
-		ret = -errno;
-		goto done;
-	}
-
-	r = fstat(fd, &stat);
-
-	if(r < 0)
-	{
-		ret = -errno;
-		goto err_after_open;
-	}
-
-	if(stat.st_size < 10)
-	{
-		ret = -EIO;
-		goto err_after_open;
-	}
 
-	file = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-
-	if(file == MAP_FAILED)
-	{
-		ret = -errno;
-		goto err_after_open;
-	}
+	if(length < 10)
+		return -EIO;
 
 	/*
 	 * If the file has an ID3v2 header, find the offset to skip it. ID3v2
 	 * headers start with the bytes 0x49 0x44 0x33 ("ID3").
 	 */
 
-	if( (file[0] == 0x49) && (file[0] == 0x44) && (file[0] == 0x33) )
+	if( (file[0] == 0x49) && (file[1] == 0x44) && (file[2] == 0x33) )
 	{
 		/*
 		 * The 10-byte ID3v2 header is formatted as follows:
@@ -144,7 +199,7 @@ int s_get_mp3_frame_header_offset(size_t *o, const char *f)
 
 	// Verify that there's a valid MP3 header at the offset we found.
 
-	if(!s_is_mp3_frame_header(file, off))
+	if(!s_is_mp3_frame_sync(file, off, length))
 	{
 		/*
 		 * Looks like we didn't find a valid MP3 frame header where we
@@ -158,125 +213,956 @@ int s_get_mp3_frame_header_offset(size_t *o, const char *f)
 		 * somewhat malformed.
 		 */
 
-		for(i = 0; i < (size_t) (stat.st_size - 1); ++i)
+		off = s_scan_mp3_frames(file, length, 0);
+	}
+
+	// Verify that we eventually did find an MP3 frame header, and finish.
+
+	if(off >= length)
+		return -EINVAL;
+
+	*o = off;
+
+	return 0;
+}
+
+/*!
+ * This function parses the MPEG audio frame header at the given offset in the
+ * given buffer. The header is four bytes long, with the following fields:
+ *
+ *     AAAAAAAA AAABBCCD EEEEFFGH IIJJKLMM
+ *
+ *     A (11 bits) - Frame sync (all bits set)
+ *     B (2 bits)  - MPEG Audio version ID
+ *     C (2 bits)  - Layer description
+ *     D (1 bit)   - Protection bit
+ *     E (4 bits)  - Bitrate index
+ *     F (2 bits)  - Sampling rate frequency index
+ *     G (1 bit)   - Padding bit
+ *     H (1 bit)   - Private bit
+ *     I (2 bits)  - Channel mode
+ *
+ * These values are defined by the MP3 frame format. More information can be
+ * found e.g. here:
+ *
+ *     http://mpgedit.org/mpgedit/mpeg_format/MP3Format.html
+ *
+ * Free-format frames (whose bitrate index is 0) can't be measured from their
+ * header alone, so they are treated as invalid.
+ *
+ * \param frame This will receive the properties of the frame.
+ * \param buf The buffer to examine.
+ * \param off The offset in the buffer to examine.
+ * \param length The length of the buffer.
+ * \return 0 on success, or -EINVAL if there is no valid header here.
+ */
+int s_parse_mp3_frame(s_mp3_frame_t *frame, const uint8_t *buf, size_t off,
+	size_t length)
+{
+	uint8_t bitrate;
+	uint8_t rate;
+	size_t padding;
+
+	if((off + 4 > length) || (buf[off] != 0xFF) ||
+		((buf[off + 1] & 0xE0) != 0xE0))
+	{
+		return -EINVAL;
+	}
+
+	frame->version = (buf[off + 1] & 0x18) >> 3;
+	frame->layer = 4 - ((buf[off + 1] & 0x06) >> 1);
+	frame->crc = !(buf[off + 1] & 0x01);
+	bitrate = (buf[off + 2] & 0xF0) >> 4;
+	rate = (buf[off + 2] & 0x0C) >> 2;
+	padding = (buf[off + 2] & 0x02) >> 1;
+	frame->channels = ((buf[off + 3] & 0xC0) >> 6) == 0x03 ? 1 : 2;
+
+	if((frame->version == 0x01) || (frame->layer == 4) ||
+		(bitrate == 0x00) || (bitrate == 0x0F) || (rate == 0x03))
+	{
+		return -EINVAL;
+	}
+
+	frame->sample_rate = s_mp3_sample_rates[frame->version][rate];
+
+	// Look up the bitrate, and compute the frame's length for its layer.
+
+	if(frame->version == 0x03)
+	{
+		frame->bitrate = s_mp3_bitrates[frame->layer - 1][bitrate];
+	}
+	else
+	{
+		frame->bitrate = s_mp3_bitrates[frame->layer == 1 ? 3 : 4]
+			[bitrate];
+	}
+
+	if(frame->layer == 1)
+	{
+		frame->samples = 384;
+		frame->length = ((12000 * frame->bitrate) /
+			frame->sample_rate + padding) * 4;
+	}
+	else if((frame->layer == 3) && (frame->version != 0x03))
+	{
+		frame->samples = 576;
+		frame->length = (72000 * frame->bitrate) /
+			frame->sample_rate + padding;
+	}
+	else
+	{
+		frame->samples = 1152;
+		frame->length = (144000 * frame->bitrate) /
+			frame->sample_rate + padding;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function looks for a Xing, Info or VBRI tag in the given frame. These
+ * tags are written by encoders in place of the first frame's audio data, and
+ * tell us how many frames the file contains without having to scan it. If no
+ * tag is found, the tag's type is MP3_TAG_NONE.
+ *
+ * Xing tags (or Info tags, which are identical but written for constant
+ * bitrate files) start right after the frame's side information. LAME (and
+ * encoders derived from it) append an extension 120 bytes after the start of
+ * the Xing tag, which stores the encoder delay and padding. VBRI tags, which
+ * are written by the Fraunhofer encoder, always start 32 bytes after the
+ * frame's header. For details, see:
+ *
+ *     http://gabriel.mp3-tech.org/mp3infotag.html
+ *
+ * \param tag This will receive the contents of the tag.
+ * \param buf The buffer containing the frame.
+ * \param off The offset of the frame's header in the buffer.
+ * \param length The length of the buffer.
+ * \param frame The frame's (already parsed) header.
+ */
+void s_read_mp3_tag(s_mp3_tag_t *tag, const uint8_t *buf, size_t off,
+	size_t length, const s_mp3_frame_t *frame)
+{
+	size_t end = off + frame->length;
+	size_t o;
+	uint32_t flags;
+
+	end = end < length ? end : length;
+
+	tag->type = MP3_TAG_NONE;
+	tag->frames = 0;
+	tag->bytes = 0;
+	tag->delay = 0;
+	tag->padding = 0;
+
+	// Work out where the side information ends, and look for a Xing tag.
+
+	if(frame->version == 0x03)
+		o = off + 4 + (frame->channels == 1 ? 17 : 32);
+	else
+		o = off + 4 + (frame->channels == 1 ? 9 : 17);
+
+	if(frame->crc)
+		o += 2;
+
+	if((frame->layer == 3) && (o + 8 <= end) &&
+		((memcmp(buf + o, "Xing", 4) == 0) ||
+		(memcmp(buf + o, "Info", 4) == 0)))
+	{
+		tag->type = buf[o] == 'X' ? MP3_TAG_XING : MP3_TAG_INFO;
+		flags = s_load_be_uint32(buf, o + 4);
+
+		if((flags & 0x01) && (o + 12 <= end))
+			tag->frames = s_load_be_uint32(buf, o + 8);
+
+		if((flags & 0x03) == 0x03 && (o + 16 <= end))
+			tag->bytes = s_load_be_uint32(buf, o + 12);
+		else if((flags & 0x02) && (o + 12 <= end))
+			tag->bytes = s_load_be_uint32(buf, o + 8);
+
+		/*
+		 * The LAME extension stores the encoder delay and padding as
+		 * two 12-bit values, 21 bytes after its start.
+		 */
+
+		o += 120;
+
+		if((o + 24 <= end) && ((memcmp(buf + o, "LAME", 4) == 0) ||
+			(memcmp(buf + o, "Lavc", 4) == 0) ||
+			(memcmp(buf + o, "Lavf", 4) == 0)))
 		{
-			if(s_is_mp3_frame_header(file, i))
-			{
-				off = i;
-				break;
-			}
+			tag->delay = (((size_t) buf[o + 21]) << 4) |
+				(((size_t) buf[o + 22]) >> 4);
+			tag->padding = ((((size_t) buf[o + 22]) & 0x0F) << 8) |
+				((size_t) buf[o + 23]);
 		}
+
+		return;
 	}
 
-	// Verify that we eventually did find an MP3 frame header, and finish.
+	/*
+	 * A VBRI tag stores its version, the encoder delay and a quality
+	 * indicator (two bytes each), followed by the byte and frame counts.
+	 */
+
+	o = off + 4 + 32;
 
-	if(!s_is_mp3_frame_header(file, off))
+	if((o + 18 <= end) && (memcmp(buf + o, "VBRI", 4) == 0))
 	{
-		ret = -EINVAL;
-		goto err_after_mmap;
+		tag->type = MP3_TAG_VBRI;
+		tag->delay = (((size_t) buf[o + 6]) << 8) |
+			((size_t) buf[o + 7]);
+		tag->bytes = s_load_be_uint32(buf, o + 10);
+		tag->frames = s_load_be_uint32(buf, o + 14);
 	}
+}
 
-	*o = off;
+/*!
+ * This function initializes (allocates) a s_mp3_index_t variable. If the
+ * pointer is non-NULL, we will not allocate a new value on top of it.
+ *
+ * The index is built by scanning the headers of every frame in the given input
+ * file; none of the frames are decoded, so this is much faster than decoding
+ * the file.
+ *
+ * \param index The s_mp3_index_t to allocate.
+ * \param in The MP3 file to index.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_mp3_index(s_mp3_index_t **index, const s_input_t *in)
+{
+	int r;
 
-err_after_mmap:
-	munmap(file, stat.st_size);
-err_after_open:
-	close(fd);
-done:
-	return ret;
+	if(*index != NULL)
+		return -EINVAL;
+
+	*index = malloc(sizeof(s_mp3_index_t));
+
+	if(*index == NULL)
+		return -ENOMEM;
+
+	(*index)->length = 0;
+	(*index)->offsets = NULL;
+	(*index)->positions = NULL;
+	(*index)->samples = 0;
+
+	r = s_index_mp3_data(*index, in->data, in->length, in->offset);
+
+	if(r < 0)
+	{
+		s_free_mp3_index(index);
+		return r;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_mp3_index_t structure. Note that this
+ * function is safe against double-frees.
+ *
+ * \param index The s_mp3_index_t to free.
+ */
+void s_free_mp3_index(s_mp3_index_t **index)
+{
+	if(*index == NULL)
+		return;
+
+	free((*index)->offsets);
+	free((*index)->positions);
+
+	free(*index);
+	*index = NULL;
+}
+
+/*!
+ * This function determines the length (in samples) of the given MP3 file,
+ * without decoding it. If the file has a Xing, Info or VBRI tag which
+ * includes the number of frames the file contains, only its first frame is
+ * read. Otherwise, the file's frame headers are scanned with
+ * s_init_mp3_index.
+ *
+ * The length includes the tag's own frame (which is decoded as silence), as
+ * well as the encoder delay and padding, so it matches the length of the
+ * decoded audio.
+ *
+ * \param first This will receive the properties of the file's first frame.
+ * \param samples This will receive the number of samples in the file.
+ * \param in The MP3 file to examine.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_get_mp3_length(s_mp3_frame_t *first, size_t *samples,
+	const s_input_t *in)
+{
+	int r;
+	s_mp3_tag_t tag;
+	s_mp3_index_t *index = NULL;
+
+	// Try to get the length from the first frame's tag.
+
+	r = s_parse_mp3_frame(first, in->data, in->offset, in->length);
+
+	if(r < 0)
+		return r;
+
+	s_read_mp3_tag(&tag, in->data, in->offset, in->length, first);
+
+	if(tag.frames > 0)
+	{
+		*samples = (tag.frames + 1) * first->samples;
+		return 0;
+	}
+
+	// Otherwise, scan the whole file.
+
+	r = s_init_mp3_index(&index, in);
+
+	if(r < 0)
+		return r;
+
+	*samples = index->samples;
+
+	s_free_mp3_index(&index);
+
+	return 0;
+}
+
+/*!
+ * This function decodes a given MP3 file to raw 16-bit signed PCM samples,
+ * placing the output in the given list of stereo samples. Mono files are
+ * decoded with identical left and right channels.
+ *
+ * The file is split into (up to) the given number of segments at frame
+ * boundaries, which are decoded concurrently; see s_decode_mp3_segments.
+ *
+ * NOTE: It is up to the caller to ensure that the given list hasn't already
+ * been allocated, and to free it when done.
+ *
+ * \param samples This will receive the list of decoded samples.
+ * \param length This will receive the number of decoded samples.
+ * \param in The MP3 file to decode.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_mp3(s_stereo_sample_t **samples, size_t *length,
+	const s_input_t *in, size_t threads)
+{
+	int r;
+	s_mad_buffer_t *buffer;
+	s_stereo_sample_t *shrunk;
+
+	buffer = malloc(sizeof(s_mad_buffer_t));
+
+	if(buffer == NULL)
+		return -ENOMEM;
+
+	s_init_mad_buffer(buffer);
+
+	r = s_decode_mp3_input(buffer, in, s_get_thread_count(threads));
+
+	if(r < 0)
+	{
+		free(buffer->samples);
+		free(buffer);
+		return r;
+	}
+
+	// Release any capacity our estimate over-allocated.
+
+	if((buffer->samples_length > 0) &&
+		(buffer->samples_length < buffer->capacity))
+	{
+		shrunk = realloc(buffer->samples,
+			sizeof(s_stereo_sample_t) * buffer->samples_length);
+
+		if(shrunk != NULL)
+			buffer->samples = shrunk;
+	}
+
+	*samples = buffer->samples;
+	*length = buffer->samples_length;
+
+	free(buffer);
+
+	return 0;
 }
 
 /*!
- * This function decodes a given MP3 file to raw 16-bit signed little-endian
- * PCM samples, placing the output in the given buffer.
+ * This function decodes a given MP3 file to raw 16-bit signed PCM samples,
+ * passing each decoded frame's samples to the given function as soon as it has
+ * been decoded. Mono files are decoded with identical left and right channels.
+ *
+ * The list of samples given to the sink is only valid for the duration of that
+ * call. If the sink returns an error, decoding stops and that error is
+ * returned.
  *
- * NOTE: It is up to the caller to ensure that the given buffer hasn't already
+ * \param in The MP3 file to decode.
+ * \param sink The function to pass each block of decoded samples to.
+ * \param ctx The context pointer to pass to the sink.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_mp3_stream(const s_input_t *in,
+	int (*sink)(void *, const s_stereo_sample_t *, size_t), void *ctx)
+{
+	int r;
+	s_mad_buffer_t *buffer;
+
+	buffer = malloc(sizeof(s_mad_buffer_t));
+
+	if(buffer == NULL)
+		return -ENOMEM;
+
+	s_init_mad_buffer(buffer);
+
+	buffer->sink = sink;
+	buffer->sink_ctx = ctx;
+
+	r = s_decode_mp3_input(buffer, in, 1);
+
+	free(buffer);
+
+	return r;
+}
+
+/*!
+ * This function decodes only the samples [begin, end) of the given MP3 file,
+ * placing them in the given list of stereo samples. Sample positions are the
+ * same as if the whole file had been decoded with s_decode_mp3. The file's
+ * frames are indexed, so only the frames covering the requested range (and a
+ * few frames before it, to prime the decoder) are decoded. If the range
+ * extends past the end of the file, fewer samples are returned.
+ *
+ * Indexing the file means scanning all of its frame headers, so callers which
+ * decode many ranges of the same file should build its index once, with
+ * s_init_mp3_index, and pass it in.
+ *
+ * NOTE: It is up to the caller to ensure that the given list hasn't already
  * been allocated, and to free it when done.
  *
- * \param buf The buffer to write decoded audio data to.
- * \param bufSize This will receive the size of the resulting audio.
- * \param f The path to the MP3 file to decode.
+ * \param samples This will receive the list of decoded samples.
+ * \param length This will receive the number of decoded samples.
+ * \param in The MP3 file to decode.
+ * \param index The file's index, or NULL to index it just for this range.
+ * \param begin The position of the first sample to decode.
+ * \param end The position one past the last sample to decode.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_mp3_range(s_stereo_sample_t **samples, size_t *length,
+	const s_input_t *in, const s_mp3_index_t *index, size_t begin,
+	size_t end)
+{
+	int r;
+	s_mad_buffer_t *buffer;
+
+	if(end <= begin)
+		return -EINVAL;
+
+	buffer = malloc(sizeof(s_mad_buffer_t));
+
+	if(buffer == NULL)
+		return -ENOMEM;
+
+	s_init_mad_buffer(buffer);
+
+	buffer->from = begin;
+	buffer->to = end;
+	buffer->index = index;
+
+	r = s_decode_mp3_input(buffer, in, 1);
+
+	if(r < 0)
+	{
+		free(buffer->samples);
+		free(buffer);
+		return r;
+	}
+
+	*samples = buffer->samples;
+	*length = buffer->samples_length;
+
+	free(buffer);
+
+	return 0;
+}
+
+/*!
+ * This function initializes the given MAD buffer structure to an empty state,
+ * which appends decoded samples to its own list.
+ *
+ * \param buffer The buffer to initialize.
+ */
+void s_init_mad_buffer(s_mad_buffer_t *buffer)
+{
+	buffer->base = NULL;
+	buffer->in = NULL;
+	buffer->length = 0;
+	buffer->inl = 0;
+
+	buffer->decoder = NULL;
+	buffer->begin = 0;
+	buffer->end = 0;
+	buffer->offset = 0;
+
+	buffer->from = 0;
+	buffer->to = 0;
+	buffer->index = NULL;
+
+	buffer->samples = NULL;
+	buffer->samples_length = 0;
+	buffer->capacity = 0;
+
+	buffer->sink = NULL;
+	buffer->sink_ctx = NULL;
+
+	buffer->error = 0;
+}
+
+/*!
+ * This function decodes the given MP3 file using the given (initialized) MAD
+ * buffer structure. If the buffer only wants a range of the file's samples,
+ * only that range is decoded. Otherwise, if more than one thread is given and
+ * the buffer stores its samples (rather than passing them to a sink), the
+ * file is decoded in parallel with s_decode_mp3_segments.
+ *
+ * \param buffer The buffer which receives the decoded data.
+ * \param in The MP3 file to decode.
+ * \param threads The number of threads to decode with.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_mp3_input(s_mad_buffer_t *buffer, const s_input_t *in,
+	size_t threads)
+{
+	if(buffer->to > 0)
+		return s_decode_mp3_window(buffer, in);
+
+	if((threads > 1) && (buffer->sink == NULL))
+		return s_decode_mp3_segments(buffer, in, threads);
+
+	return s_decode_mp3_data(buffer, in->data, in->length, in->offset,
+		in->offset, in->length);
+}
+
+/*!
+ * This function decodes the given MP3 file contents in (up to) the given
+ * number of segments concurrently, appending the concatenated result to the
+ * given buffer's list of samples.
+ *
+ * We first index every frame in the file, and then split the list of frames
+ * into contiguous segments. Each segment is decoded by its own MAD decoder,
+ * which starts S_MP3_PRIMING_FRAMES frames before the segment does: layer III
+ * frames may borrow data from the frames before them (the "bit reservoir"),
+ * and the synthesis filters carry state from one frame to the next, so the
+ * first few frames a decoder sees are either undecodable or inaccurate. The
+ * output of those priming frames is discarded. If the file is too short to
+ * be worth splitting, it is simply decoded on this thread.
+ *
+ * \param buffer The buffer which receives the decoded data.
+ * \param in The MP3 file to decode.
+ * \param threads The number of segments to decode concurrently.
+ * \return 0 on success, or an error number if something goes wrong.
  */
-int s_decode_mp3(uint8_t **buf, size_t *bufSize, const char *f)
+int s_decode_mp3_segments(s_mad_buffer_t *buffer, const s_input_t *in,
+	size_t threads)
 {
 	int ret = 0;
 	int r;
-	struct stat s;
-	int fd;
-	void *in;
-	FILE *out;
+	s_mp3_index_t *index = NULL;
+	size_t i;
+	size_t total;
+	s_stereo_sample_t *samples;
+	s_mp3_segment_job_t job;
+
+	r = s_init_mp3_index(&index, in);
 
-	// Map the file into memory.
+	if(r < 0)
+		return r;
 
-	fd = open(f, O_RDONLY);
+	if(threads > index->length / S_MP3_SEGMENT_MIN_FRAMES)
+		threads = index->length / S_MP3_SEGMENT_MIN_FRAMES;
 
-	if(fd < 0)
+	if(threads <= 1)
 	{
-		ret = -errno;
-		goto done;
+		s_free_mp3_index(&index);
+		return s_decode_mp3_data(buffer, in->data, in->length,
+			in->offset, in->offset, in->length);
 	}
 
-	r = stat(f, &s);
+	job.in = in->data;
+	job.inl = in->length;
+	job.index = index;
+	job.segments = threads;
+	job.buffers = calloc(threads, sizeof(s_mad_buffer_t *));
+
+	if(job.buffers == NULL)
+	{
+		ret = -ENOMEM;
+		goto err_after_index_alloc;
+	}
+
+	// Decode each segment, and then stitch their samples together in order.
+
+	r = s_parallel_for(threads, threads, s_decode_mp3_segment, &job);
 
 	if(r < 0)
 	{
-		ret = -errno;
-		goto err_after_open;
+		ret = r;
+		goto err_after_buffers_alloc;
 	}
 
-	in = mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	total = buffer->samples_length;
+
+	for(i = 0; i < threads; ++i)
+		total += job.buffers[i]->samples_length;
 
-	if(in == MAP_FAILED)
+	samples = realloc(buffer->samples, sizeof(s_stereo_sample_t) * total);
+
+	if((samples == NULL) && (total > 0))
 	{
-		ret = -errno;
-		goto err_after_open;
+		ret = -ENOMEM;
+		goto err_after_buffers_alloc;
 	}
 
-	// Open a memory stream on the given buffer.
+	buffer->samples = samples;
+	buffer->capacity = total;
 
-	out = open_memstream((char **) buf, bufSize);
+	for(i = 0; i < threads; ++i)
+	{
+		memcpy(buffer->samples + buffer->samples_length,
+			job.buffers[i]->samples, sizeof(s_stereo_sample_t) *
+			job.buffers[i]->samples_length);
 
-	if(out == NULL)
+		buffer->samples_length += job.buffers[i]->samples_length;
+	}
+
+err_after_buffers_alloc:
+	for(i = 0; i < threads; ++i)
 	{
-		ret = -EIO;
-		goto err_after_mmap;
+		if(job.buffers[i] != NULL)
+		{
+			free(job.buffers[i]->samples);
+			free(job.buffers[i]);
+		}
 	}
 
-	// Decode the mapped file.
+	free(job.buffers);
+err_after_index_alloc:
+	s_free_mp3_index(&index);
 
-	r = s_decode_mp3_data(out, in, s.st_size);
+	return ret;
+}
+
+/*!
+ * This function is an s_parallel_for worker which decodes a range of the
+ * segments described by the given s_mp3_segment_job_t, each into its own
+ * newly allocated buffer.
+ *
+ * \param ctx The s_mp3_segment_job_t describing the segments to decode.
+ * \param id The index of this worker (unused).
+ * \param begin The index of the first segment to decode.
+ * \param end The index one past the last segment to decode.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_mp3_segment(void *ctx, size_t UNUSED(id), size_t begin,
+	size_t end)
+{
+	int r;
+	s_mp3_segment_job_t *job = ctx;
+	const s_mp3_index_t *index = job->index;
+	s_mad_buffer_t *buffer;
+	size_t s;
+	size_t first;
+	size_t last;
+	size_t prime;
+
+	for(s = begin; s < end; ++s)
+	{
+		buffer = malloc(sizeof(s_mad_buffer_t));
+
+		if(buffer == NULL)
+			return -ENOMEM;
+
+		s_init_mad_buffer(buffer);
+		job->buffers[s] = buffer;
+
+		// Work out which frames (and bytes) this segment covers.
+
+		first = (index->length * s) / job->segments;
+		last = (index->length * (s + 1)) / job->segments;
+		prime = first > S_MP3_PRIMING_FRAMES ?
+			first - S_MP3_PRIMING_FRAMES : 0;
+
+		r = s_decode_mp3_data(buffer, job->in, job->inl,
+			index->offsets[prime], index->offsets[first],
+			last < index->length ? index->offsets[last] :
+			job->inl);
+
+		if(r < 0)
+			return r;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function decodes only the range of samples [buffer->from, buffer->to)
+ * of the given MP3 file contents. We decode the frames which cover the range
+ * (starting S_MP3_PRIMING_FRAMES early, as s_decode_mp3_segments does), and
+ * then trim the result to exactly the requested samples. If the buffer doesn't
+ * have an index of the file's frames, we build one first.
+ *
+ * \param buffer The buffer which receives the decoded data.
+ * \param in The MP3 file to decode.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_mp3_window(s_mad_buffer_t *buffer, const s_input_t *in)
+{
+	int ret = 0;
+	int r;
+	s_mp3_index_t *built = NULL;
+	const s_mp3_index_t *index = buffer->index;
+	size_t first;
+	size_t last;
+	size_t prime;
+	size_t skip;
+	size_t n;
+
+	if(index == NULL)
+	{
+		r = s_init_mp3_index(&built, in);
+
+		if(r < 0)
+			return r;
+
+		index = built;
+	}
+
+	first = s_find_mp3_frame(index, buffer->from);
+
+	if(first >= index->length)
+		goto done;
+
+	last = s_find_mp3_frame(index, buffer->to - 1) + 1;
+	prime = first > S_MP3_PRIMING_FRAMES ? first - S_MP3_PRIMING_FRAMES : 0;
+
+	r = s_decode_mp3_data(buffer, in->data, in->length,
+		index->offsets[prime], index->offsets[first],
+		last < index->length ? index->offsets[last] : in->length);
 
 	if(r < 0)
 	{
 		ret = r;
-		goto err_after_memstream;
+		goto done;
 	}
 
-	// Clean up and we're done!
+	// Drop the decoded samples which fall outside of the requested range.
+
+	skip = buffer->from - index->positions[first];
+	skip = skip < buffer->samples_length ? skip : buffer->samples_length;
+	n = buffer->samples_length - skip;
+	n = n < buffer->to - buffer->from ? n : buffer->to - buffer->from;
+
+	memmove(buffer->samples, buffer->samples + skip,
+		sizeof(s_stereo_sample_t) * n);
+
+	buffer->samples_length = n;
 
-err_after_memstream:
-	fclose(out);
-err_after_mmap:
-	munmap(in, s.st_size);
-err_after_open:
-	close(fd);
 done:
+	s_free_mp3_index(&built);
+
 	return ret;
 }
 
 /*!
- * This is a very simple function which tests if, at the given offset in the
- * given buffer, there is a valid MP3 frame header. MP3 frame headers always
- * start with the bytes 0xFF 0xFB -or- 0xFF 0xFA.
+ * This function tests if, at the given offset in the given buffer, there is a
+ * valid MP3 frame header. Since the two sync bytes can easily occur by
+ * chance (e.g. inside a tag, or in album art), we also check that the header
+ * is followed by S_MP3_SYNC_FRAMES more valid headers, each exactly one frame
+ * after the last, which share its version, layer and sample rate. A chain
+ * which ends exactly at the end of the buffer is accepted.
  *
  * \param buf The buffer to examine.
  * \param off The offset in the buffer to examine.
- * \return Whether or not an MP3 frame header is presen at the given offset.
+ * \param length The length of the buffer.
+ * \return Whether or not an MP3 frame header is present at the given offset.
  */
-int s_is_mp3_frame_header(const uint8_t *buf, size_t off)
+int s_is_mp3_frame_sync(const uint8_t *buf, size_t off, size_t length)
 {
-	return (buf[off] == 0xFF) &&
-		( (buf[off + 1] == 0xFB) || (buf[off + 1] == 0xFA) );
+	size_t i;
+	s_mp3_frame_t first;
+	s_mp3_frame_t next;
+
+	if(s_parse_mp3_frame(&first, buf, off, length) < 0)
+		return 0;
+
+	next = first;
+
+	for(i = 0; i < S_MP3_SYNC_FRAMES; ++i)
+	{
+		off += next.length;
+
+		if(off > length)
+			return 0;
+
+		if(off == length)
+			break;
+
+		if(s_parse_mp3_frame(&next, buf, off, length) < 0)
+			return 0;
+
+		if((next.version != first.version) ||
+			(next.layer != first.layer) ||
+			(next.sample_rate != first.sample_rate))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*!
+ * This function searches the given buffer for the first valid MP3 frame
+ * header at or after the given offset. Candidates are found with memchr
+ * (which is vectorized by any reasonable C library), since every header
+ * starts with an 0xFF byte, and are then validated with s_is_mp3_frame_sync.
+ *
+ * \param buf The buffer to search.
+ * \param length The length of the buffer.
+ * \param off The offset to start searching from.
+ * \return The offset of the header, or length if none was found.
+ */
+size_t s_scan_mp3_frames(const uint8_t *buf, size_t length, size_t off)
+{
+	const uint8_t *p;
+
+	while(off + 1 < length)
+	{
+		p = memchr(buf + off, 0xFF, length - off - 1);
+
+		if(p == NULL)
+			break;
+
+		off = (size_t) (p - buf);
+
+		// Only bother with candidates whose second byte matches, too.
+
+		if(((buf[off + 1] & 0xE0) == 0xE0) &&
+			s_is_mp3_frame_sync(buf, off, length))
+		{
+			return off;
+		}
+
+		++off;
+	}
+
+	return length;
+}
+
+/*!
+ * This function builds the given index's lists of frames, by scanning the
+ * given file contents. Starting from the given (first) header, we step from
+ * frame to frame using each frame's length. If we don't land on a valid
+ * header (e.g. because the file is corrupt, or we've reached a trailing tag),
+ * we search forward for the next one.
+ *
+ * \param index The index to populate.
+ * \param in The MP3 file's contents.
+ * \param inl The length of the given input buffer.
+ * \param off The offset of the file's first frame header.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_index_mp3_data(s_mp3_index_t *index, const uint8_t *in, size_t inl,
+	size_t off)
+{
+	int r;
+	size_t capacity = 0;
+	size_t initial = 1024;
+	size_t *offsets;
+	size_t *positions;
+	s_mp3_frame_t frame;
+
+	r = s_parse_mp3_frame(&(index->first), in, off, inl);
+
+	if(r < 0)
+		return r;
+
+	s_read_mp3_tag(&(index->tag), in, off, inl, &(index->first));
+
+	// If the tag tells us how many frames there are, allocate exactly once.
+
+	if(index->tag.frames > 0)
+		initial = index->tag.frames + 1;
+
+	while(off < inl)
+	{
+		if(s_parse_mp3_frame(&frame, in, off, inl) < 0)
+		{
+			off = s_scan_mp3_frames(in, inl, off + 1);
+			continue;
+		}
+
+		if(index->length == capacity)
+		{
+			capacity = capacity > 0 ? capacity * 2 : initial;
+
+			offsets = realloc(index->offsets,
+				sizeof(size_t) * capacity);
+
+			if(offsets == NULL)
+				return -ENOMEM;
+
+			index->offsets = offsets;
+
+			positions = realloc(index->positions,
+				sizeof(size_t) * capacity);
+
+			if(positions == NULL)
+				return -ENOMEM;
+
+			index->positions = positions;
+		}
+
+		index->offsets[index->length] = off;
+		index->positions[index->length] = index->samples;
+		++index->length;
+
+		index->samples += frame.samples;
+		off += frame.length;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function finds the frame in the given index which contains the given
+ * sample position, using a binary search over the frames' positions.
+ *
+ * \param index The index to search.
+ * \param position The position of the sample to look for.
+ * \return The index of the frame, or index->length if it is past the end.
+ */
+size_t s_find_mp3_frame(const s_mp3_index_t *index, size_t position)
+{
+	size_t lo = 0;
+	size_t hi = index->length;
+	size_t mid;
+
+	if(position >= index->samples)
+		return index->length;
+
+	// Find the last frame which starts at or before the given position.
+
+	while(hi - lo > 1)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if(index->positions[mid] <= position)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
 }
 
 /*!
@@ -301,6 +1187,28 @@ enum mad_flow s_mad_input(void *data, struct mad_stream *stream)
 	return MAD_FLOW_CONTINUE;
 }
 
+/*!
+ * This function is a callback for libmad which is called once each frame's
+ * header has been decoded. We keep track of where in the file the frame is,
+ * and stop decoding once we reach the end of the range we were asked for.
+ *
+ * \param data The s_mad_buffer_t used to initialize the decoder.
+ * \param header The MPEG frame header information.
+ * \return How / whether to proceed with decoding.
+ */
+enum mad_flow s_mad_header(void *data, struct mad_header const *UNUSED(header))
+{
+	s_mad_buffer_t *buffer = data;
+
+	buffer->offset = (size_t)
+		(buffer->decoder->sync->stream.this_frame - buffer->base);
+
+	if(buffer->offset >= buffer->end)
+		return MAD_FLOW_STOP;
+
+	return MAD_FLOW_CONTINUE;
+}
+
 /*!
  * This is an extremely basic function which scales MAD's high-resolution
  * samples down to 16-bit PCM. Its output is not particularly high-quality,
@@ -324,44 +1232,120 @@ int16_t s_mad_scale(mad_fixed_t sample)
 	return sample >> (MAD_F_FRACBITS + 1 - 16);
 }
 
+/*!
+ * This function makes sure the given buffer's list of samples has room for at
+ * least the given number of additional samples, growing it if necessary.
+ *
+ * The first time this is called, we estimate the total number of samples in
+ * the file from the first frame's bitrate and sample rate, so that for
+ * constant bitrate files the list is allocated exactly once. If the estimate
+ * turns out to be too small (e.g. for variable bitrate files), the list is
+ * grown geometrically.
+ *
+ * \param buffer The s_mad_buffer_t whose list of samples should be grown.
+ * \param header The header of the frame about to be appended.
+ * \param n The number of samples about to be appended.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_mad_reserve(s_mad_buffer_t *buffer, struct mad_header const *header,
+	size_t n)
+{
+	size_t capacity = buffer->capacity;
+	s_stereo_sample_t *samples;
+
+	if(buffer->samples_length + n <= capacity)
+		return 0;
+
+	if((capacity == 0) && (header->bitrate > 0))
+	{
+		capacity = (size_t) ((((double) buffer->inl) * 8.0) /
+			((double) header->bitrate) *
+			((double) header->samplerate));
+	}
+
+	while(capacity < buffer->samples_length + n)
+		capacity = capacity > 0 ? capacity * 2 : n;
+
+	samples = realloc(buffer->samples,
+		sizeof(s_stereo_sample_t) * capacity);
+
+	if(samples == NULL)
+		return -ENOMEM;
+
+	buffer->samples = samples;
+	buffer->capacity = capacity;
+
+	return 0;
+}
+
 /*!
  * This function is a callback for libmad  which handles successfully decoded
- * output from the decoder. In particular, we write the sample(s) to our output
- * buffer.
+ * output from the decoder. In particular, we scale the sample(s) and append
+ * them to our output list, or pass them to our sink.
  *
  * \param data The s_mad_buffer_t used to initialize the decoder.
  * \param header The MPEG frame header information.
  * \param pcm The decoded raw PCM data.
  * \return How / whether to proceed with decoding.
  */
-enum mad_flow s_mad_output(void *data, struct mad_header const *UNUSED(header),
+enum mad_flow s_mad_output(void *data, struct mad_header const *header,
 	struct mad_pcm *pcm)
 {
-	int16_t outbuf[1];
+	int r;
 	s_mad_buffer_t *buffer = data;
-	unsigned int nchannels;
+	unsigned int i;
 	unsigned int nsamples;
 	mad_fixed_t const *left_ch;
 	mad_fixed_t const *right_ch;
+	s_stereo_sample_t *out;
+
+	// Drop the output of any frames we only decoded to prime the decoder.
+
+	if(buffer->offset < buffer->begin)
+		return MAD_FLOW_CONTINUE;
 
-	nchannels = pcm->channels;
 	nsamples = pcm->length;
 	left_ch = pcm->samples[0];
-	right_ch = pcm->samples[1];
+	right_ch = pcm->channels == 2 ? pcm->samples[1] : pcm->samples[0];
+
+	// Work out where to put this frame's samples.
 
-	while(nsamples--)
+	if(buffer->sink != NULL)
 	{
-		outbuf[0] = s_mad_scale(*left_ch++);
-		fwrite(outbuf, sizeof(int16_t), 1, buffer->out);
+		out = buffer->block;
+	}
+	else
+	{
+		r = s_mad_reserve(buffer, header, nsamples);
 
-		if(nchannels == 2)
+		if(r < 0)
 		{
-			outbuf[0] = s_mad_scale(*right_ch++);
-			fwrite(outbuf, sizeof(int16_t), 1, buffer->out);
+			buffer->error = r;
+			return MAD_FLOW_BREAK;
 		}
+
+		out = buffer->samples + buffer->samples_length;
+		buffer->samples_length += nsamples;
 	}
 
-	fflush(buffer->out);
+	for(i = 0; i < nsamples; ++i)
+	{
+		out[i].l = s_mad_scale(left_ch[i]);
+		out[i].r = s_mad_scale(right_ch[i]);
+	}
+
+	// If we're streaming, hand the samples off to our sink.
+
+	if(buffer->sink != NULL)
+	{
+		r = buffer->sink(buffer->sink_ctx, out, nsamples);
+
+		if(r < 0)
+		{
+			buffer->error = r;
+			return MAD_FLOW_BREAK;
+		}
+	}
 
 	return MAD_FLOW_CONTINUE;
 }
@@ -386,27 +1370,38 @@ enum mad_flow s_mad_error(void *UNUSED(data),
  * This is a very basic utility function which initializes an instance of the
  * MAD decoder, and uses it to decode the data in the given input buffer.
  *
- * \param out The FILE * to write decoded data to.
+ * Decoding starts at the given priming offset, but only the frames which
+ * start in the range [begin, end) are output. All of these offsets should be
+ * at frame boundaries.
+ *
+ * \param buffer The buffer which receives the decoded data.
  * \param in The input file's contents.
  * \param inl The length of the given input buffer.
+ * \param prime The offset to start decoding from.
+ * \param begin The offset of the first frame to output.
+ * \param end The offset one past the last frame to output.
  * \return 0 on success, or an error number if something goes wrong.
  */
-int s_decode_mp3_data(FILE *out, const uint8_t *in, size_t inl)
+int s_decode_mp3_data(s_mad_buffer_t *buffer, const uint8_t *in, size_t inl,
+	size_t prime, size_t begin, size_t end)
 {
-	s_mad_buffer_t buffer;
+	struct mad_decoder decoder;
 
-	buffer.in = in;
-	buffer.length = inl;
-	buffer.out = out;
+	buffer->base = in;
+	buffer->in = in + prime;
+	buffer->length = inl - prime;
+	buffer->inl = end - begin;
 
-	struct mad_decoder decoder;
+	buffer->decoder = &decoder;
+	buffer->begin = begin;
+	buffer->end = end;
 
-	mad_decoder_init(&decoder, &buffer, s_mad_input, NULL, NULL,
+	mad_decoder_init(&decoder, buffer, s_mad_input, s_mad_header, NULL,
 		s_mad_output, s_mad_error, NULL);
 
 	mad_decoder_run(&decoder, MAD_DECODER_MODE_SYNC);
 
 	mad_decoder_finish(&decoder);
 
-	return 0;
+	return buffer->error;
 }
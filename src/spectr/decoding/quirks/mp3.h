@@ -22,7 +22,21 @@
 #include <stddef.h>
 #include <stdint.h>
 
-extern int s_get_mp3_frame_header_offset(size_t *, const char *);
-extern int s_decode_mp3(uint8_t **, size_t *, const char *);
+#include "spectr/types.h"
+
+extern int s_find_mp3_frame_header(size_t *, const uint8_t *, size_t);
+extern int s_parse_mp3_frame(s_mp3_frame_t *, const uint8_t *, size_t,
+	size_t);
+
+extern int s_init_mp3_index(s_mp3_index_t **, const s_input_t *);
+extern void s_free_mp3_index(s_mp3_index_t **);
+extern int s_get_mp3_length(s_mp3_frame_t *, size_t *, const s_input_t *);
+
+extern int s_decode_mp3(s_stereo_sample_t **, size_t *, const s_input_t *,
+	size_t);
+extern int s_decode_mp3_range(s_stereo_sample_t **, size_t *,
+	const s_input_t *, const s_mp3_index_t *, size_t, size_t);
+extern int s_decode_mp3_stream(const s_input_t *,
+	int (*)(void *, const s_stereo_sample_t *, size_t), void *);
 
 #endif
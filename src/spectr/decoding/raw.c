@@ -20,10 +20,21 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "spectr/config.h"
+#include "spectr/constants.h"
 #include "spectr/decoding/decode.h"
+#include "spectr/decoding/source.h"
 #include "spectr/decoding/stat.h"
 #include "spectr/util/math.h"
+#include "spectr/util/profile.h"
+#include "spectr/util/simd.h"
+
+size_t s_raw_audio_sample_size(s_storage_t);
+void *s_raw_audio_data(const s_raw_audio_t *);
+void s_mixdown16(int16_t *, const s_stereo_sample_t *, size_t);
+void s_load_source_samples(double *, float *, s_source_t *, size_t, size_t);
 
 /*!
  * This function initializes (allocates) a s_raw_audio_t variable. If the
@@ -45,9 +56,14 @@ int s_init_raw_audio(s_raw_audio_t **r)
 	(*r)->stat.type = FTYPE_INVALID;
 	(*r)->stat.bit_depth = 0;
 	(*r)->stat.sample_rate = 0;
+	(*r)->stat.samples = 0;
 
 	(*r)->samples_length = 0;
+	(*r)->storage = STORAGE_STEREO;
 	(*r)->samples = NULL;
+	(*r)->mono16 = NULL;
+	(*r)->mono32 = NULL;
+	(*r)->source = NULL;
 
 	return 0;
 }
@@ -64,16 +80,32 @@ void s_free_raw_audio(s_raw_audio_t **r)
 	if(*r == NULL)
 		return;
 
-	if((*r)->samples != NULL)
-	{
-		free((*r)->samples);
-		(*r)->samples = NULL;
-	}
+	s_free_raw_audio_samples(*r);
 
 	free(*r);
 	*r = NULL;
 }
 
+/*!
+ * This function frees the list of samples the given s_raw_audio_t contains
+ * (if any), leaving it empty, with stereo storage.
+ *
+ * \param r The s_raw_audio_t whose samples should be freed.
+ */
+void s_free_raw_audio_samples(s_raw_audio_t *r)
+{
+	free(r->samples);
+	free(r->mono16);
+	free(r->mono32);
+	s_free_source(&(r->source));
+
+	r->samples_length = 0;
+	r->storage = STORAGE_STEREO;
+	r->samples = NULL;
+	r->mono16 = NULL;
+	r->mono32 = NULL;
+}
+
 /*!
  * This is a convenience function which copies the entire contents of the given
  * source structure to the given destination structure. This is a wapper for
@@ -93,7 +125,7 @@ int s_copy_raw_audio(s_raw_audio_t **dst, const s_raw_audio_t *src)
  * This function copies a portion of the given source structure into the given
  * destination structure. Only the samples in the range [o, o + w - w] will be
  * copied. Note, though, that the stat structure will be copied in its entirety
- * from the source structure.
+ * from the source structure. Lazily decoded audio can't be copied.
  *
  * \param dst The destination for the copy.
  * \param src The s_raw_audio_t structure to copy.
@@ -105,7 +137,11 @@ int s_copy_raw_audio_window(s_raw_audio_t **dst, const s_raw_audio_t *src,
 	size_t o, size_t w)
 {
 	int r;
-	size_t i;
+	size_t size = s_raw_audio_sample_size(src->storage);
+	void *data;
+
+	if(src->storage == STORAGE_SOURCE)
+		return -EINVAL;
 
 	// Make sure the destinatino is a newly-initialized s_raw_audio_t.
 
@@ -119,23 +155,39 @@ int s_copy_raw_audio_window(s_raw_audio_t **dst, const s_raw_audio_t *src,
 	// Copy the properties from the source structure.
 
 	(*dst)->stat = src->stat;
+	(*dst)->storage = src->storage;
 
 	// Allocate space for the copy.
 
-	(*dst)->samples_length = w;
-
-	(*dst)->samples = malloc(sizeof(s_stereo_sample_t) * w);
+	data = malloc(size * (w > 0 ? w : 1));
 
-	if((*dst)->samples == NULL)
+	if(data == NULL)
 	{
 		s_free_raw_audio(dst);
-		return r;
+		return -ENOMEM;
+	}
+
+	switch(src->storage)
+	{
+		case STORAGE_MONO16:
+			(*dst)->mono16 = data;
+			break;
+
+		case STORAGE_MONO32:
+			(*dst)->mono32 = data;
+			break;
+
+		default:
+			(*dst)->samples = data;
+			break;
 	}
 
+	(*dst)->samples_length = w;
+
 	// Copy the values from the source structure.
 
-	for(i = o; i < w; ++i)
-		(*dst)->samples[i] = src->samples[i + o];
+	memcpy(data, (const uint8_t *) s_raw_audio_data(src) + size * o,
+		size * w);
 
 	// We're done!
 
@@ -146,95 +198,388 @@ int s_copy_raw_audio_window(s_raw_audio_t **dst, const s_raw_audio_t *src,
  * This function decodes the audio in the given file to raw PCM format, and
  * then processes that raw data to populate the given s_raw_audio_t structure.
  *
+ * The decoder writes samples straight into the structure's list of samples,
+ * so the decoded audio is only ever held in memory once.
+ *
  * \param raw The raw audio structure to store the decoded data inside.
- * \param f The path to the input file to read.
+ * \param in The input file to read.
+ * \param threads The number of decoding threads, or 0 for one per CPU.
  * \return 0 on success, or an error number of something goes wrong.
  */
-int s_decode_raw_audio(s_raw_audio_t *raw, const char *f)
+int s_decode_raw_audio(s_raw_audio_t *raw, const s_input_t *in,
+	size_t threads)
 {
-	int ret = 0;
 	int r;
-	uint8_t *audio;
-	size_t bytes;
-	FILE *in;
-	int16_t buf[1];
-	size_t idx;
+	double begin = s_profile_begin();
+
+	r = s_audio_stat(&(raw->stat), in);
+
+	if(r < 0)
+		return r;
+
+	// Free any existing samples, and then try decoding the input file.
 
-	// Try decoding the input file.
+	s_free_raw_audio_samples(raw);
 
-	r = s_decode(&audio, &bytes, f);
+	r = s_decode(&(raw->samples), &(raw->samples_length), in, threads);
 
 	if(r < 0)
+		return r;
+
+	raw->stat.samples = raw->samples_length;
+
+	r = s_mixdown_raw_audio(raw);
+
+	if(r < 0)
+		return r;
+
+	s_profile_count(COUNTER_INPUT_BYTES, in->length);
+	s_profile_count(COUNTER_SAMPLES, raw->samples_length);
+	s_profile_alloc(raw->samples_length * sizeof(s_stereo_sample_t));
+	s_profile_end(STAGE_DECODE, begin);
+
+	return 0;
+}
+
+/*!
+ * This function sets the given s_raw_audio_t up to decode the given file
+ * lazily, replacing any samples it already has. Rather than decoding the
+ * whole file up front, chunks of it are decoded as they are read (see
+ * s_source_t), and only the most recently used S_SOURCE_CHUNKS chunks are
+ * kept, so the audio is never held in memory as a whole. The samples read are
+ * exactly the same as if the file had been decoded with s_decode_raw_audio.
+ *
+ * \param raw The raw audio structure to set up.
+ * \param path The path to the file to decode.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_open_raw_audio(s_raw_audio_t *raw, const char *path)
+{
+	int r;
+	s_source_t *source = NULL;
+
+	r = s_init_source(&source, path, S_SOURCE_CHUNKS);
+
+	if(r < 0)
+		return r;
+
+	s_free_raw_audio_samples(raw);
+
+	raw->stat = source->stat;
+	raw->samples_length = source->stat.samples;
+	raw->storage = STORAGE_SOURCE;
+	raw->source = source;
+
+	s_profile_count(COUNTER_INPUT_BYTES, source->input->length);
+
+	return 0;
+}
+
+/*!
+ * This function returns the first error hit while lazily decoding the given
+ * raw audio (see s_source_error). Any samples which couldn't be decoded have
+ * been read as silence.
+ *
+ * \param raw The raw audio to examine.
+ * \return 0 if nothing went wrong, or an error number otherwise.
+ */
+int s_raw_audio_error(const s_raw_audio_t *raw)
+{
+	if(raw->storage != STORAGE_SOURCE)
+		return 0;
+
+	return s_source_error(raw->source);
+}
+
+/*!
+ * This function mixes the given stereo raw audio down to mono, replacing its
+ * samples with the mono ones. Audio with a bit depth of (at most) 16 bits is
+ * stored in 16 bits per sample, and anything else in 32 bits, so the mixed
+ * audio takes a quarter (or half) as much memory. The mono samples are exactly
+ * the same as s_mono_sample would compute. Audio which is already mono is left
+ * alone.
+ *
+ * \param raw The raw audio to mix down.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_mixdown_raw_audio(s_raw_audio_t *raw)
+{
+	s_storage_t storage = STORAGE_MONO32;
+	void *data;
+
+	if(raw->storage != STORAGE_STEREO)
+		return 0;
+
+	if((raw->stat.bit_depth >= 1) && (raw->stat.bit_depth <= 16))
+		storage = STORAGE_MONO16;
+
+	data = malloc(s_raw_audio_sample_size(storage) *
+		(raw->samples_length > 0 ? raw->samples_length : 1));
+
+	if(data == NULL)
+		return -ENOMEM;
+
+	s_profile_alloc(s_raw_audio_sample_size(storage) *
+		raw->samples_length);
+
+	if(storage == STORAGE_MONO16)
 	{
-		ret = r;
-		goto done;
+		s_mixdown16(data, raw->samples, raw->samples_length);
+		raw->mono16 = data;
 	}
+	else
+	{
+		s_simd_mixdown(data, raw->samples, raw->samples_length);
+		raw->mono32 = data;
+	}
+
+	free(raw->samples);
+	raw->samples = NULL;
+	raw->storage = storage;
+
+	return 0;
+}
 
-	in = fmemopen(audio, bytes, "r");
+/*!
+ * This function returns the mono value of a single sample of the given raw
+ * audio, whichever way it is stored. The sample must exist.
+ *
+ * \param raw The raw audio to read.
+ * \param i The index of the sample.
+ * \return The sample's mono value.
+ */
+int32_t s_get_mono_sample(const s_raw_audio_t *raw, size_t i)
+{
+	double x;
 
-	if(in == NULL)
+	switch(raw->storage)
 	{
-		ret = -errno;
-		goto err_after_decode;
+		case STORAGE_MONO16:
+			return (int32_t) raw->mono16[i];
+
+		case STORAGE_MONO32:
+			return raw->mono32[i];
+
+		case STORAGE_SOURCE:
+			s_load_source_samples(&x, NULL, raw->source, i, 1);
+			return (int32_t) x;
+
+		default:
+			return s_mono_sample(raw->samples[i]);
 	}
+}
 
-	r = s_audio_stat(&(raw->stat), f);
+/*!
+ * This function loads the mono values of l consecutive samples of the given
+ * raw audio, starting at the given offset, into the given buffer. Samples past
+ * the end of the raw audio are treated as silence.
+ *
+ * \param x The buffer to load the l values into.
+ * \param raw The raw audio to read.
+ * \param o The offset of the first sample to load.
+ * \param l The number of samples to load.
+ */
+void s_load_mono_samples(double *x, const s_raw_audio_t *raw, size_t o,
+	size_t l)
+{
+	size_t i;
+	size_t n = o >= raw->samples_length ? 0 : raw->samples_length - o;
 
-	if(r < 0)
+	n = n < l ? n : l;
+
+	switch(raw->storage)
 	{
-		ret = r;
-		goto err_after_fmemopen;
+		case STORAGE_MONO16:
+			for(i = 0; i < n; ++i)
+				x[i] = (double) raw->mono16[o + i];
+			break;
+
+		case STORAGE_MONO32:
+			for(i = 0; i < n; ++i)
+				x[i] = (double) raw->mono32[o + i];
+			break;
+
+		case STORAGE_SOURCE:
+			s_load_source_samples(x, NULL, raw->source, o, n);
+			break;
+
+		default:
+			for(i = 0; i < n; ++i)
+			{
+				x[i] = (double) s_mono_sample(
+					raw->samples[o + i]);
+			}
+			break;
 	}
 
-	/*
-	 * Try allocating memory for the file's samples.
-	 *
-	 * For a bit depth of B, the left and right portions of each sample
-	 * will be B / 8 bytes each (or, in other words, each entire sample
-	 * will be B / 4 bytes). This means that:
-	 *
-	 *     - B / 4 should evenly divide the bytes in the raw output.
-	 *     - bytes / (B / 4) = number of samples
-	 */
-
-	if(raw->samples != NULL)
+	for(i = n; i < l; ++i)
+		x[i] = 0.0;
+}
+
+/*!
+ * This function is the single-precision equivalent of s_load_mono_samples.
+ *
+ * \param x The buffer to load the l values into.
+ * \param raw The raw audio to read.
+ * \param o The offset of the first sample to load.
+ * \param l The number of samples to load.
+ */
+void s_load_mono_samples_f(float *x, const s_raw_audio_t *raw, size_t o,
+	size_t l)
+{
+	size_t i;
+	size_t n = o >= raw->samples_length ? 0 : raw->samples_length - o;
+
+	n = n < l ? n : l;
+
+	switch(raw->storage)
 	{
-		free(raw->samples);
-		raw->samples = NULL;
+		case STORAGE_MONO16:
+			for(i = 0; i < n; ++i)
+				x[i] = (float) raw->mono16[o + i];
+			break;
+
+		case STORAGE_MONO32:
+			for(i = 0; i < n; ++i)
+				x[i] = (float) raw->mono32[o + i];
+			break;
+
+		case STORAGE_SOURCE:
+			s_load_source_samples(NULL, x, raw->source, o, n);
+			break;
+
+		default:
+			for(i = 0; i < n; ++i)
+			{
+				x[i] = (float) s_mono_sample(
+					raw->samples[o + i]);
+			}
+			break;
 	}
 
-	raw->samples_length = raw->stat.bit_depth / 4;
+	for(i = n; i < l; ++i)
+		x[i] = 0.0f;
+}
 
-	if( (bytes % raw->samples_length) != 0 )
+/*!
+ * This function returns the size of a single sample, stored the given way.
+ *
+ * \param storage The way the samples are stored.
+ * \return The size of each sample, in bytes.
+ */
+size_t s_raw_audio_sample_size(s_storage_t storage)
+{
+	switch(storage)
 	{
-		ret = -EINVAL;
-		goto err_after_fmemopen;
-	}
+		case STORAGE_MONO16:
+			return sizeof(int16_t);
 
-	raw->samples_length = bytes / raw->samples_length;
-	raw->samples = malloc(sizeof(s_stereo_sample_t) * raw->samples_length);
+		case STORAGE_MONO32:
+			return sizeof(int32_t);
 
-	if(raw->samples == NULL)
+		default:
+			return sizeof(s_stereo_sample_t);
+	}
+}
+
+/*!
+ * This function returns the list of samples the given raw audio contains,
+ * whichever way they are stored. Lazily decoded audio has no such list.
+ *
+ * \param raw The raw audio.
+ * \return The raw audio's list of samples, or NULL if it is decoded lazily.
+ */
+void *s_raw_audio_data(const s_raw_audio_t *raw)
+{
+	switch(raw->storage)
 	{
-		ret = -ENOMEM;
-		goto err_after_fmemopen;
+		case STORAGE_MONO16:
+			return raw->mono16;
+
+		case STORAGE_MONO32:
+			return raw->mono32;
+
+		default:
+			return raw->samples;
 	}
+}
 
-	// Iterate through the decoded raw data, reading in each sample.
+/*!
+ * This function mixes the given stereo samples down to 16-bit mono samples.
+ * The samples must fit in 16 bits. They are mixed by s_simd_mixdown, one block
+ * of S_SIMD_BLOCK_LENGTH samples at a time, and then narrowed.
+ *
+ * \param dst This will receive the n mono samples.
+ * \param src The n stereo samples.
+ * \param n The number of samples.
+ */
+void s_mixdown16(int16_t *dst, const s_stereo_sample_t *src, size_t n)
+{
+	size_t o;
+	size_t i;
+	size_t l;
+	int32_t block[S_SIMD_BLOCK_LENGTH];
 
-	for(idx = 0; idx < raw->samples_length; ++idx)
+	for(o = 0; o < n; o += l)
 	{
-		fread(buf, sizeof(int16_t), 1, in);
-		raw->samples[idx].l = buf[0];
+		l = n - o < S_SIMD_BLOCK_LENGTH ? n - o : S_SIMD_BLOCK_LENGTH;
+
+		s_simd_mixdown(block, src + o, l);
 
-		fread(buf, sizeof(int16_t), 1, in);
-		raw->samples[idx].r = buf[0];
+		for(i = 0; i < l; ++i)
+			dst[o + i] = (int16_t) block[i];
 	}
+}
 
-err_after_fmemopen:
-	fclose(in);
-err_after_decode:
-	free(audio);
-done:
-	return ret;
+/*!
+ * This function loads the mono values of l consecutive samples of the given
+ * lazily decoded audio, starting at the given offset, into whichever of the
+ * given buffers isn't NULL. The samples must exist (but any chunk which
+ * couldn't be decoded is loaded as silence).
+ *
+ * \param x The double precision buffer to load the l values into, or NULL.
+ * \param fx The single precision buffer to load the l values into, or NULL.
+ * \param source The source to read.
+ * \param o The offset of the first sample to load.
+ * \param l The number of samples to load.
+ */
+void s_load_source_samples(double *x, float *fx, s_source_t *source, size_t o,
+	size_t l)
+{
+	size_t i;
+	size_t j;
+	size_t n;
+	size_t m;
+	size_t skip;
+	int32_t v;
+	s_source_chunk_t *chunk;
+
+	for(i = 0; i < l; i += n)
+	{
+		skip = (o + i) % S_SOURCE_CHUNK_SAMPLES;
+		n = S_SOURCE_CHUNK_SAMPLES - skip;
+		n = n < l - i ? n : l - i;
+
+		chunk = s_acquire_source_chunk(source,
+			(o + i) / S_SOURCE_CHUNK_SAMPLES);
+
+		// Anything the chunk doesn't hold is silence.
+
+		m = chunk == NULL ? 0 : chunk->length;
+		m = m > skip ? m - skip : 0;
+		m = m < n ? m : n;
+
+		for(j = 0; j < n; ++j)
+		{
+			v = j < m ? chunk->samples[skip + j] : 0;
+
+			if(x != NULL)
+				x[i + j] = (double) v;
+			else
+				fx[i + j] = (float) v;
+		}
+
+		if(chunk != NULL)
+			s_release_source_chunk(source, chunk);
+	}
 }
@@ -25,10 +25,21 @@
 
 extern int s_init_raw_audio(s_raw_audio_t **);
 extern void s_free_raw_audio(s_raw_audio_t **);
+extern void s_free_raw_audio_samples(s_raw_audio_t *);
 
 extern int s_copy_raw_audio(s_raw_audio_t **, const s_raw_audio_t *);
 extern int s_copy_raw_audio_window(s_raw_audio_t **, const s_raw_audio_t *,
 	size_t, size_t);
-extern int s_decode_raw_audio(s_raw_audio_t *, const char *);
+extern int s_decode_raw_audio(s_raw_audio_t *, const s_input_t *,
+	size_t);
+extern int s_open_raw_audio(s_raw_audio_t *, const char *);
+extern int s_raw_audio_error(const s_raw_audio_t *);
+extern int s_mixdown_raw_audio(s_raw_audio_t *);
+
+extern int32_t s_get_mono_sample(const s_raw_audio_t *, size_t);
+extern void s_load_mono_samples(double *, const s_raw_audio_t *, size_t,
+	size_t);
+extern void s_load_mono_samples_f(float *, const s_raw_audio_t *, size_t,
+	size_t);
 
 #endif
@@ -0,0 +1,364 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "source.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "spectr/config.h"
+#include "spectr/decoding/decode.h"
+#include "spectr/decoding/input.h"
+#include "spectr/decoding/stat.h"
+#include "spectr/decoding/quirks/mp3.h"
+#include "spectr/util/profile.h"
+#include "spectr/util/simd.h"
+
+s_source_chunk_t *s_find_source_chunk(s_source_t *, size_t);
+s_source_chunk_t *s_evict_source_chunk(s_source_t *);
+int s_decode_source_chunk(s_source_t *, s_source_chunk_t *);
+
+/*!
+ * This function initializes (allocates) a s_source_t variable, which decodes
+ * the given file lazily, keeping (at most) the given number of decoded chunks.
+ * If the pointer is non-NULL, we will not allocate a new value on top of it.
+ *
+ * The file's length must be known without decoding it, so an MP3 file's
+ * frames are indexed here, and a FLAC file must list its number of samples.
+ *
+ * \param source The s_source_t to allocate.
+ * \param path The path to the file to decode.
+ * \param chunks The number of decoded chunks to keep. Must be at least 1.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_source(s_source_t **source, const char *path, size_t chunks)
+{
+	int r;
+	size_t i;
+
+	if(*source != NULL)
+		return -EINVAL;
+
+	if(chunks < 1)
+		return -EINVAL;
+
+	*source = malloc(sizeof(s_source_t));
+
+	if(*source == NULL)
+		return -ENOMEM;
+
+	(*source)->input = NULL;
+	(*source)->index = NULL;
+
+	(*source)->chunks = malloc(chunks * sizeof(s_source_chunk_t));
+	(*source)->chunks_length = chunks;
+	(*source)->clock = 0;
+	(*source)->error = 0;
+
+	pthread_mutex_init(&((*source)->lock), NULL);
+	pthread_cond_init(&((*source)->ready), NULL);
+
+	if((*source)->chunks == NULL)
+	{
+		(*source)->chunks_length = 0;
+		s_free_source(source);
+		return -ENOMEM;
+	}
+
+	for(i = 0; i < chunks; ++i)
+	{
+		(*source)->chunks[i].index = SIZE_MAX;
+		(*source)->chunks[i].samples = NULL;
+		(*source)->chunks[i].length = 0;
+		(*source)->chunks[i].loading = 0;
+		(*source)->chunks[i].refs = 0;
+		(*source)->chunks[i].used = 0;
+	}
+
+	r = s_init_input(&((*source)->input), path);
+
+	if(r >= 0)
+		r = s_audio_stat(&((*source)->stat), (*source)->input);
+
+	if((r >= 0) && ((*source)->input->type == FTYPE_MP3))
+	{
+		r = s_init_mp3_index(&((*source)->index), (*source)->input);
+
+		if(r >= 0)
+			(*source)->stat.samples = (*source)->index->samples;
+	}
+
+	if((r >= 0) && ((*source)->stat.samples == 0))
+		r = -EINVAL;
+
+	if(r < 0)
+	{
+		s_free_source(source);
+		return r;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_source_t structure, including all of its
+ * decoded chunks. None of its chunks may still be acquired. Note that this
+ * function is safe against double-frees.
+ *
+ * \param source The s_source_t to free.
+ */
+void s_free_source(s_source_t **source)
+{
+	size_t i;
+
+	if(*source == NULL)
+		return;
+
+	for(i = 0; i < (*source)->chunks_length; ++i)
+		free((*source)->chunks[i].samples);
+
+	free((*source)->chunks);
+
+	s_free_mp3_index(&((*source)->index));
+	s_free_input(&((*source)->input));
+
+	pthread_mutex_destroy(&((*source)->lock));
+	pthread_cond_destroy(&((*source)->ready));
+
+	free(*source);
+	*source = NULL;
+}
+
+/*!
+ * This function returns the chunk of the given source which holds the samples
+ * starting at c * S_SOURCE_CHUNK_SAMPLES, decoding it first if it isn't one of
+ * the chunks we have kept. The chunk can't be evicted until it is released
+ * with s_release_source_chunk, so every chunk which is acquired must be
+ * released. This function is safe to call from any number of threads at once.
+ *
+ * A chunk is decoded without the source's lock held, so other threads can
+ * keep reading the chunks they need (or decoding others) in the meantime.
+ * Threads which need the same chunk wait for it to finish loading instead.
+ *
+ * \param source The source to read.
+ * \param c The number of the chunk to acquire.
+ * \return The chunk, or NULL if it couldn't be decoded (see s_source_error).
+ */
+s_source_chunk_t *s_acquire_source_chunk(s_source_t *source, size_t c)
+{
+	int r;
+	s_source_chunk_t *chunk;
+
+	pthread_mutex_lock(&(source->lock));
+
+	for(;;)
+	{
+		chunk = s_find_source_chunk(source, c);
+
+		if((chunk != NULL) && !chunk->loading)
+		{
+			++chunk->refs;
+			chunk->used = ++source->clock;
+
+			pthread_mutex_unlock(&(source->lock));
+			return chunk;
+		}
+
+		// Claim a chunk to decode into, unless someone else already is.
+
+		if(chunk == NULL)
+			chunk = s_evict_source_chunk(source);
+
+		if((chunk != NULL) && !chunk->loading)
+			break;
+
+		pthread_cond_wait(&(source->ready), &(source->lock));
+	}
+
+	chunk->index = c;
+	chunk->loading = 1;
+	chunk->refs = 1;
+	chunk->used = ++source->clock;
+
+	pthread_mutex_unlock(&(source->lock));
+
+	r = s_decode_source_chunk(source, chunk);
+
+	pthread_mutex_lock(&(source->lock));
+
+	chunk->loading = 0;
+
+	if(r < 0)
+	{
+		chunk->index = SIZE_MAX;
+		chunk->refs = 0;
+
+		if(source->error == 0)
+			source->error = r;
+
+		chunk = NULL;
+	}
+
+	pthread_cond_broadcast(&(source->ready));
+	pthread_mutex_unlock(&(source->lock));
+
+	return chunk;
+}
+
+/*!
+ * This function releases a chunk acquired with s_acquire_source_chunk, so it
+ * can be evicted once it is the least recently used.
+ *
+ * \param source The source the chunk belongs to.
+ * \param chunk The chunk to release.
+ */
+void s_release_source_chunk(s_source_t *source, s_source_chunk_t *chunk)
+{
+	pthread_mutex_lock(&(source->lock));
+
+	--chunk->refs;
+
+	if(chunk->refs == 0)
+		pthread_cond_broadcast(&(source->ready));
+
+	pthread_mutex_unlock(&(source->lock));
+}
+
+/*!
+ * This function returns the first error the given source hit while decoding
+ * one of its chunks. Chunks which couldn't be decoded read as silence, so
+ * anything computed from the source is incomplete if this isn't 0.
+ *
+ * \param source The source to examine.
+ * \return 0 if every chunk was decoded, or the first error number otherwise.
+ */
+int s_source_error(s_source_t *source)
+{
+	int r;
+
+	pthread_mutex_lock(&(source->lock));
+	r = source->error;
+	pthread_mutex_unlock(&(source->lock));
+
+	return r;
+}
+
+/*!
+ * This function returns the given source's chunk with the given number, if
+ * we have kept it (or it is loading). The source's lock must be held.
+ *
+ * \param source The source to search.
+ * \param c The number of the chunk to find.
+ * \return The chunk, or NULL if it isn't one of the source's chunks.
+ */
+s_source_chunk_t *s_find_source_chunk(s_source_t *source, size_t c)
+{
+	size_t i;
+
+	for(i = 0; i < source->chunks_length; ++i)
+	{
+		if(source->chunks[i].index == c)
+			return &(source->chunks[i]);
+	}
+
+	return NULL;
+}
+
+/*!
+ * This function picks which of the given source's chunks should be replaced
+ * by a new one: an empty chunk if there is one, or otherwise the least
+ * recently used chunk which isn't being read or loaded. The source's lock must
+ * be held.
+ *
+ * \param source The source to pick a chunk from.
+ * \return The chunk to replace, or NULL if every chunk is in use.
+ */
+s_source_chunk_t *s_evict_source_chunk(s_source_t *source)
+{
+	size_t i;
+	s_source_chunk_t *chunk = NULL;
+
+	for(i = 0; i < source->chunks_length; ++i)
+	{
+		if((source->chunks[i].refs > 0) || source->chunks[i].loading)
+			continue;
+
+		if(source->chunks[i].index == SIZE_MAX)
+			return &(source->chunks[i]);
+
+		if((chunk == NULL) || (source->chunks[i].used < chunk->used))
+			chunk = &(source->chunks[i]);
+	}
+
+	return chunk;
+}
+
+/*!
+ * This function decodes the given chunk of the given source, and mixes it
+ * down to mono, replacing whatever the chunk held before. Only the thread
+ * which is loading the chunk may call this, and it needn't hold the lock.
+ *
+ * \param source The source to decode.
+ * \param chunk The chunk to decode, whose index has been set.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_decode_source_chunk(s_source_t *source, s_source_chunk_t *chunk)
+{
+	int r;
+	s_stereo_sample_t *samples = NULL;
+	size_t length = 0;
+	size_t begin = chunk->index * S_SOURCE_CHUNK_SAMPLES;
+	size_t end = begin + S_SOURCE_CHUNK_SAMPLES;
+
+	end = end < source->stat.samples ? end : source->stat.samples;
+
+	if(begin >= end)
+	{
+		chunk->length = 0;
+		return 0;
+	}
+
+	if(chunk->samples == NULL)
+	{
+		chunk->samples = malloc(S_SOURCE_CHUNK_SAMPLES *
+			sizeof(int32_t));
+
+		if(chunk->samples == NULL)
+			return -ENOMEM;
+
+		s_profile_alloc(S_SOURCE_CHUNK_SAMPLES * sizeof(int32_t));
+	}
+
+	r = s_decode_range(&samples, &length, source->input, source->index,
+		begin, end);
+
+	if(r < 0)
+		return r;
+
+	length = length < end - begin ? length : end - begin;
+
+	s_simd_mixdown(chunk->samples, samples, length);
+	chunk->length = length;
+
+	free(samples);
+
+	s_profile_count(COUNTER_SAMPLES, length);
+
+	return 0;
+}
@@ -24,7 +24,7 @@
 
 #include "spectr/types.h"
 
-extern int s_audio_stat(s_audio_stat_t *, const char *);
+extern int s_audio_stat(s_audio_stat_t *, const s_input_t *);
 
 extern uint32_t s_audio_duration_sec(const s_audio_stat_t *, size_t);
 extern int s_audio_duration_str(char *, size_t, const s_audio_stat_t *, size_t);
@@ -27,4 +27,9 @@
 		#endif
 	#endif
 
+	#ifndef S_STRINGIFY
+		#define S_STRINGIFY_VALUE(x) #x
+		#define S_STRINGIFY(x) S_STRINGIFY_VALUE(x)
+	#endif
+
 #endif
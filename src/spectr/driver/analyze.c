@@ -0,0 +1,159 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "analyze.h"
+
+#include <stdio.h>
+
+#include "spectr/config.h"
+#include "spectr/decoding/input.h"
+#include "spectr/decoding/raw.h"
+#include "spectr/decoding/stat.h"
+#include "spectr/driver/load.h"
+#include "spectr/rendering/image.h"
+#include "spectr/rendering/pyramid.h"
+#include "spectr/rendering/render.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/transform/stream.h"
+
+int s_stream_spectrogram(s_spectrogram_t **, const s_options_t *);
+
+/*!
+ * This function analyzes the single input file we were given: its spectrogram
+ * is computed (by loading the whole file, or by streaming it, if we were asked
+ * to), and then either written to an image file, or (if we weren't given one)
+ * displayed in the interactive viewer. The viewer keeps the STFT's pyramid and
+ * the decoded audio (if we have them), so it can zoom into any range of the
+ * track. If we exported the STFT's frames, we're done unless we were also
+ * given an image file.
+ *
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_analyze(const s_options_t *opts)
+{
+	int r;
+	s_spectrogram_t *sg = NULL;
+	s_raw_audio_t *audio = NULL;
+	s_pyramid_t *pyramid = NULL;
+
+	if(opts->stream)
+		r = s_stream_spectrogram(&sg, opts);
+	else
+		r = s_load_spectrogram(&sg, &audio, &pyramid, opts);
+
+	if(r < 0)
+		goto done;
+
+	if(opts->output != NULL)
+	{
+		r = s_write_spectrogram_ppm(sg, opts->output);
+	}
+	else if(opts->export == NULL)
+	{
+#ifdef SPECTR_DEBUG
+		printf("Entering rendering loop...\n");
+#endif
+
+		r = s_render(sg, audio, pyramid, opts->window, opts->precision,
+			opts->scale, opts->threads, opts->gpu);
+	}
+
+done:
+	s_free_spectrogram(&sg);
+	s_free_raw_audio(&audio);
+	s_free_pyramid(&pyramid);
+	return r;
+}
+/*!
+ * This function builds the spectrogram we'll render by streaming the input
+ * file through the decoder and the STFT, folding each frame into the
+ * spectrogram as soon as it is computed. Neither the decoded audio nor the
+ * STFT is ever stored as a whole, so memory use is bounded regardless of the
+ * length of the input.
+ *
+ * \param sg This will receive the computed spectrogram.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_stream_spectrogram(s_spectrogram_t **sg, const s_options_t *opts)
+{
+	int ret = 0;
+	int r;
+	s_input_t *input = NULL;
+	s_audio_stat_t stat;
+	size_t window;
+	size_t hop;
+	size_t samples;
+
+	r = s_init_input(&input, opts->path);
+
+	if(r < 0)
+		return r;
+
+	r = s_audio_stat(&stat, input);
+
+	if(r < 0)
+	{
+		ret = r;
+		goto done;
+	}
+
+	r = s_get_stft_size(&window, &hop, opts, stat.samples);
+
+	if(r < 0)
+	{
+		ret = r;
+		goto done;
+	}
+
+	/*
+	 * If we know how many samples there are without decoding them, the
+	 * spectrogram can map frames straight onto its columns. Otherwise
+	 * (stat.samples is 0), it merges columns as the frames arrive.
+	 */
+
+	s_free_spectrogram(sg);
+
+	r = s_init_spectrogram(sg, S_VIEW_W, S_VIEW_H,
+		stat.samples / hop, opts->scale);
+
+	if(r < 0)
+	{
+		ret = r;
+		goto done;
+	}
+
+	(*sg)->raw_stat = stat;
+
+	r = s_stft_stream_file(input, window, hop, opts->window,
+		s_spectrogram_sink, *sg, &samples);
+
+	if(r < 0)
+	{
+		s_free_spectrogram(sg);
+		ret = r;
+		goto done;
+	}
+
+	(*sg)->raw_length = samples;
+
+done:
+	s_free_input(&input);
+	return ret;
+}
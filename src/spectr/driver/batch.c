@@ -0,0 +1,347 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <linux/limits.h>
+
+#include "spectr/config.h"
+#include "spectr/driver/load.h"
+#include "spectr/rendering/image.h"
+#include "spectr/rendering/spectrogram.h"
+
+int s_batch_paths(s_batch_t *, const s_options_t *);
+int s_batch_output(char *, size_t, const s_batch_t *, size_t);
+const char *s_batch_name(const char *);
+void *s_batch_decoder(void *);
+
+/*!
+ * This function writes the spectrogram of each of the input files we were
+ * given (on our command line, and in our list file) to a PPM image in our
+ * batch directory. Each file is loaded just like s_load_spectrogram does, but
+ * the files are decoded on their own thread, up to S_BATCH_AHEAD files ahead
+ * of the one being transformed, so decoding one file overlaps transforming
+ * the previous one. Both halves still use all of our worker threads.
+ *
+ * Every process-wide table (FFT plans, window functions) is built once, and
+ * shared by every file with the same STFT parameters.
+ *
+ * If a file fails, the error is reported, and we carry on with the next one.
+ *
+ * \param opts The options we were given.
+ * \return 0 if every file succeeded, or the error number of the last failure.
+ */
+int s_batch(const s_options_t *opts)
+{
+	int ret = 0;
+	int r;
+	size_t i;
+	s_batch_t batch;
+	s_load_job_t *job;
+	pthread_t decoder;
+	s_spectrogram_t *sg = NULL;
+	char output[PATH_MAX];
+
+	batch.opts = opts;
+	batch.decoded = 0;
+	batch.transformed = 0;
+
+	r = s_batch_paths(&batch, opts);
+
+	if(r < 0)
+		return r;
+
+	pthread_mutex_init(&(batch.lock), NULL);
+	pthread_cond_init(&(batch.cond), NULL);
+
+	r = pthread_create(&decoder, NULL, s_batch_decoder, &batch);
+
+	if(r != 0)
+	{
+		ret = -r;
+		goto done;
+	}
+
+	// Transform each file as soon as it has been decoded.
+
+	for(i = 0; i < batch.length; ++i)
+	{
+		pthread_mutex_lock(&(batch.lock));
+
+		while(batch.decoded <= i)
+			pthread_cond_wait(&(batch.cond), &(batch.lock));
+
+		pthread_mutex_unlock(&(batch.lock));
+
+		job = &(batch.jobs[i % (S_BATCH_AHEAD + 1)]);
+		r = job->result;
+
+		if(r >= 0)
+			r = s_batch_output(output, PATH_MAX, &batch, i);
+
+		if(r >= 0)
+			r = s_transform_job(&sg, job, opts);
+
+		if(r >= 0)
+			r = s_write_spectrogram_ppm(sg, output);
+
+		if(r < 0)
+		{
+			printf("%s: Error %d: %s\n", job->path, -r,
+				strerror(-r));
+			ret = r;
+		}
+		else
+		{
+			printf("%s: %s\n", job->path, output);
+		}
+
+		s_free_spectrogram(&sg);
+		s_free_load_job(job);
+
+		pthread_mutex_lock(&(batch.lock));
+		++batch.transformed;
+		pthread_cond_broadcast(&(batch.cond));
+		pthread_mutex_unlock(&(batch.lock));
+	}
+
+	pthread_join(decoder, NULL);
+
+done:
+	pthread_cond_destroy(&(batch.cond));
+	pthread_mutex_destroy(&(batch.lock));
+
+	for(i = 0; i < batch.length; ++i)
+		free(batch.paths[i]);
+
+	free(batch.paths);
+	return ret;
+}
+
+/*!
+ * This function builds the list of paths of the given batch's input files:
+ * those given on our command line, followed by those listed (one per line) in
+ * our list file, if we were given one. A list file of "-" is read from stdin.
+ * Empty lines are ignored.
+ *
+ * \param batch The batch whose list of paths should be built.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_batch_paths(s_batch_t *batch, const s_options_t *opts)
+{
+	int ret = 0;
+	size_t i;
+	size_t capacity;
+	char **paths;
+	FILE *list = NULL;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t length;
+
+	capacity = opts->inputs_length > 0 ? opts->inputs_length : 1;
+
+	batch->paths = malloc(sizeof(char *) * capacity);
+	batch->length = 0;
+
+	if(batch->paths == NULL)
+		return -ENOMEM;
+
+	for(i = 0; i < opts->inputs_length; ++i)
+	{
+		batch->paths[i] = strdup(opts->inputs[i]);
+
+		if(batch->paths[i] == NULL)
+		{
+			ret = -ENOMEM;
+			goto err_after_paths_alloc;
+		}
+
+		++batch->length;
+	}
+
+	if(opts->list == NULL)
+		return 0;
+
+	if(strcmp(opts->list, "-") == 0)
+		list = stdin;
+	else
+		list = fopen(opts->list, "r");
+
+	if(list == NULL)
+	{
+		ret = -errno;
+		goto err_after_paths_alloc;
+	}
+
+	while((length = getline(&line, &size, list)) >= 0)
+	{
+		while((length > 0) && ((line[length - 1] == '\n') ||
+			(line[length - 1] == '\r')))
+		{
+			line[--length] = '\0';
+		}
+
+		if(length == 0)
+			continue;
+
+		if(batch->length == capacity)
+		{
+			paths = realloc(batch->paths,
+				sizeof(char *) * capacity * 2);
+
+			if(paths == NULL)
+			{
+				ret = -ENOMEM;
+				goto err_after_list_open;
+			}
+
+			batch->paths = paths;
+			capacity *= 2;
+		}
+
+		batch->paths[batch->length] = strdup(line);
+
+		if(batch->paths[batch->length] == NULL)
+		{
+			ret = -ENOMEM;
+			goto err_after_list_open;
+		}
+
+		++batch->length;
+	}
+
+	if(ferror(list))
+		ret = -EIO;
+	else if(batch->length == 0)
+		ret = -EINVAL;
+
+err_after_list_open:
+	free(line);
+
+	if(list != stdin)
+		fclose(list);
+
+	if(ret == 0)
+		return 0;
+
+err_after_paths_alloc:
+	for(i = 0; i < batch->length; ++i)
+		free(batch->paths[i]);
+
+	free(batch->paths);
+	batch->paths = NULL;
+	batch->length = 0;
+
+	return ret;
+}
+
+/*!
+ * This function builds the path of the image the spectrogram of the given
+ * batch's i-th input file is written to: the input file's name, followed by
+ * ".ppm", in our batch directory. The whole name is kept (e.g., "a.mp3.ppm"),
+ * so inputs which only differ in their extension don't overwrite each other.
+ *
+ * Inputs in different directories can still have the same name (e.g., a/x.mp3
+ * and b/x.mp3). Rather than silently overwrite the image of an earlier input
+ * with the same name, such an input fails.
+ *
+ * \param buf The buffer to store the path in.
+ * \param bufsiz The size of the given buffer.
+ * \param batch The batch the input file belongs to.
+ * \param i The index of the input file in the batch.
+ * \return 0 on success, -EEXIST if an earlier input has the same name, or
+ * another error number if something goes wrong.
+ */
+int s_batch_output(char *buf, size_t bufsiz, const s_batch_t *batch,
+	size_t i)
+{
+	int r;
+	size_t j;
+	const char *name = s_batch_name(batch->paths[i]);
+
+	for(j = 0; j < i; ++j)
+	{
+		if(strcmp(s_batch_name(batch->paths[j]), name) == 0)
+			return -EEXIST;
+	}
+
+	r = snprintf(buf, bufsiz, "%s/%s.ppm", batch->opts->batch, name);
+
+	if((r < 0) || (((size_t) r) >= bufsiz))
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+/*!
+ * This function returns the name of the given input file, i.e. the part of
+ * its path after the last '/'.
+ *
+ * \param path The path of the input file.
+ * \return The file's name, which points into the given path.
+ */
+const char *s_batch_name(const char *path)
+{
+	const char *name = strrchr(path, '/');
+
+	return name != NULL ? name + 1 : path;
+}
+
+/*!
+ * This function is the body of a batch's decoder thread. It decodes each of the
+ * batch's files in order (see s_decode_job), waiting whenever it is
+ * S_BATCH_AHEAD files ahead of the file being transformed. Each job's result
+ * is stored in the job itself.
+ *
+ * \param arg The s_batch_t whose files should be decoded.
+ * \return NULL.
+ */
+void *s_batch_decoder(void *arg)
+{
+	size_t i;
+	s_batch_t *batch = arg;
+	s_load_job_t *job;
+
+	for(i = 0; i < batch->length; ++i)
+	{
+		pthread_mutex_lock(&(batch->lock));
+
+		while(i > batch->transformed + S_BATCH_AHEAD)
+			pthread_cond_wait(&(batch->cond), &(batch->lock));
+
+		pthread_mutex_unlock(&(batch->lock));
+
+		job = &(batch->jobs[i % (S_BATCH_AHEAD + 1)]);
+
+		s_init_load_job(job, batch->paths[i]);
+		job->result = s_decode_job(job, batch->opts);
+
+		pthread_mutex_lock(&(batch->lock));
+		++batch->decoded;
+		pthread_cond_broadcast(&(batch->cond));
+		pthread_mutex_unlock(&(batch->lock));
+	}
+
+	return NULL;
+}
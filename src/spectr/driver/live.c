@@ -0,0 +1,58 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "live.h"
+
+#include "spectr/config.h"
+#include "spectr/rendering/render.h"
+#include "spectr/transform/live.h"
+
+/*!
+ * This function displays a live spectrogram of the raw PCM read from the input
+ * path we were given ("-" for stdin) in the viewer, until it is closed. Each
+ * hop of input is transformed as soon as it arrives, reusing one FFT plan and
+ * window table, and only its new column is uploaded to the viewer.
+ *
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_live(const s_options_t *opts)
+{
+	int r;
+	s_live_t *live = NULL;
+	size_t window = opts->window_size;
+	size_t hop = opts->hop;
+
+	if(window == 0)
+		window = S_LIVE_WINDOW;
+
+	if(hop == 0)
+		hop = S_LIVE_HOP;
+
+	r = s_init_live(&live, opts->path, opts->rate, opts->channels, window,
+		hop, opts->window, S_VIEW_W, S_VIEW_H, opts->scale);
+
+	if(r < 0)
+		return r;
+
+	r = s_render_live(live, hop);
+
+	s_free_live(&live);
+
+	return r;
+}
@@ -0,0 +1,388 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "load.h"
+
+#include <stdio.h>
+#include <linux/limits.h>
+
+#include "spectr/config.h"
+#include "spectr/decoding/input.h"
+#include "spectr/decoding/raw.h"
+#include "spectr/decoding/stat.h"
+#include "spectr/rendering/cache.h"
+#include "spectr/rendering/pyramid.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/transform/attr.h"
+#include "spectr/transform/decimate.h"
+#include "spectr/transform/export.h"
+#include "spectr/transform/fourier.h"
+#include "spectr/util/profile.h"
+
+#ifdef SPECTR_DEBUG
+	#include <inttypes.h>
+#endif
+
+/*!
+ * This function picks the STFT window size and hop we'll use to compute the
+ * spectrogram of an input with the given number of samples, so we compute
+ * only about as many windows as the spectrogram has columns (see
+ * s_get_hop_size). Either of them can be given on our command line instead.
+ *
+ * \param window This will receive the window size.
+ * \param hop This will receive the hop size.
+ * \param opts The options we were given.
+ * \param samples The number of samples in the input, or 0 if unknown.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_get_stft_size(size_t *window, size_t *hop, const s_options_t *opts,
+	size_t samples)
+{
+	int r;
+
+	*window = opts->window_size;
+
+	if(*window == 0)
+	{
+		r = s_get_window_size(window, S_VIEW_W, S_VIEW_H, samples);
+
+		if(r < 0)
+			return r;
+	}
+
+	*hop = opts->hop;
+
+	if(*hop == 0)
+		return s_get_hop_size(hop, *window, S_VIEW_W, samples);
+
+	return 0;
+}
+
+/*!
+ * This function decodes the entire input file, computes its STFT and the
+ * STFT's pyramid, and then builds the spectrogram we'll render from it. If we
+ * are going to display it in the viewer, the decoded audio is returned as
+ * well; otherwise, it isn't kept. Each of the STFT's frames is reduced into the
+ * pyramid as soon as it is computed, so the STFT itself is only stored if we
+ * were asked to export it. If we were asked to decimate the audio, everything
+ * after decoding (including the viewer) uses the decimated audio instead.
+ *
+ * Unless caching is disabled, the pyramid is saved in our on-disk cache, and
+ * if it is already cached for this file (and STFT parameters), we just map it
+ * instead of decoding and transforming the file at all. In that case, no raw
+ * audio is returned, unless we're exporting the STFT's frames: exporting must
+ * compute the STFT, since the cache only stores its pyramid.
+ *
+ * This is done in two halves, s_decode_job and s_transform_job, so that in
+ * batch mode one file can be decoded while another is being transformed.
+ *
+ * \param sg This will receive the computed spectrogram.
+ * \param raw This will receive the decoded audio, or NULL.
+ * \param pyramid This will receive the STFT's pyramid.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_load_spectrogram(s_spectrogram_t **sg, s_raw_audio_t **raw,
+	s_pyramid_t **pyramid, const s_options_t *opts)
+{
+	int r;
+	s_load_job_t job;
+
+	s_init_load_job(&job, opts->path);
+
+	r = s_decode_job(&job, opts);
+
+	if(r >= 0)
+		r = s_transform_job(sg, &job, opts);
+
+	if(r < 0)
+		goto done;
+
+	s_free_pyramid(pyramid);
+
+	*pyramid = job.pyramid;
+	job.pyramid = NULL;
+
+	// Keep the decoded audio for the viewer, if we're going to open it.
+
+	if((opts->output == NULL) && (opts->export == NULL))
+	{
+		s_free_raw_audio(raw);
+
+		*raw = job.audio;
+		job.audio = NULL;
+	}
+
+done:
+	s_free_load_job(&job);
+	return r;
+}
+
+/*!
+ * This function initializes the given job, to load the given input file.
+ * Nothing is allocated until the job is decoded.
+ *
+ * \param job The job to initialize.
+ * \param path The path of the input file to load.
+ */
+void s_init_load_job(s_load_job_t *job, const char *path)
+{
+	job->path = path;
+	job->window = 0;
+	job->hop = 0;
+	job->cacheable = 0;
+	job->audio = NULL;
+	job->pyramid = NULL;
+	job->result = 0;
+}
+
+/*!
+ * This function frees the decoded audio and the pyramid held by the given job
+ * (if any). Note that this function is safe against double-frees.
+ *
+ * \param job The job to free.
+ */
+void s_free_load_job(s_load_job_t *job)
+{
+	s_free_raw_audio(&(job->audio));
+	s_free_pyramid(&(job->pyramid));
+}
+
+/*!
+ * This function does the first half of s_load_spectrogram: it picks the STFT's
+ * window size and hop for the given job's input file, and then either maps its
+ * cached pyramid, or decodes (and decimates) the file.
+ *
+ * \param job The job to decode, initialized with s_init_load_job.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_decode_job(s_load_job_t *job, const s_options_t *opts)
+{
+	int ret = 0;
+	int r;
+	s_input_t *input = NULL;
+	s_audio_stat_t stat;
+	double begin;
+
+#ifdef SPECTR_DEBUG
+	uint32_t duration;
+#endif
+
+	/*
+	 * The hop depends on the length of the input, which we can usually get
+	 * without decoding it, so open it before looking in the cache.
+	 */
+
+	r = s_init_input(&input, job->path);
+
+	if(r < 0)
+		return r;
+
+	r = s_audio_stat(&stat, input);
+
+	if(r >= 0)
+	{
+		s_decimate_stat(&stat, opts->decimation);
+		r = s_get_stft_size(&(job->window), &(job->hop), opts,
+			stat.samples);
+	}
+
+	if(r < 0)
+	{
+		ret = r;
+		goto done;
+	}
+
+	// If we've already computed this file's pyramid, just load it.
+
+	if(opts->cache)
+	{
+		r = s_init_cache_key(&(job->key), job->path, job->window,
+			job->hop, opts->window, opts->precision, S_VIEW_H,
+			opts->scale, opts->decimation);
+
+		if(r >= 0)
+			r = s_get_cache_path(job->cache, PATH_MAX, &(job->key));
+
+		job->cacheable = r >= 0;
+
+		begin = s_profile_begin();
+
+		if(job->cacheable && (opts->export == NULL) &&
+			(s_map_pyramid(&(job->pyramid), &(job->key),
+			job->cache) == 0))
+		{
+			s_profile_end(STAGE_CACHE, begin);
+
+#ifdef SPECTR_DEBUG
+			printf("DEBUG: Loaded cached pyramid: %s\n",
+				job->cache);
+#endif
+
+			goto done;
+		}
+	}
+
+	/*
+	 * Decode the input file we were given. If we were asked to decode it
+	 * lazily, only the parts the STFT (or the viewer) read are decoded,
+	 * when they are read.
+	 */
+
+	r = s_init_raw_audio(&(job->audio));
+
+	if(r < 0)
+	{
+		ret = r;
+		goto done;
+	}
+
+	if(opts->lazy)
+		r = s_open_raw_audio(job->audio, job->path);
+	else
+		r = s_decode_raw_audio(job->audio, input, opts->threads);
+
+	s_free_input(&input);
+
+	/*
+	 * If we're only interested in the low end of the spectrum, decimate
+	 * the audio, so the STFT (and the viewer) work on fewer samples.
+	 */
+
+	if(r >= 0)
+	{
+		r = s_decimate_raw_audio(job->audio, opts->decimation,
+			opts->threads);
+	}
+
+	if(r < 0)
+	{
+		ret = r;
+		s_free_raw_audio(&(job->audio));
+		goto done;
+	}
+
+#ifdef SPECTR_DEBUG
+	printf("Loaded input file - %" PRIu32 " Hz / %" PRIu32 "-bit.\n",
+		job->audio->stat.sample_rate, job->audio->stat.bit_depth);
+
+	duration = s_audio_duration_sec(&(job->audio->stat),
+		job->audio->samples_length);
+
+	printf("\t%zu samples yields duration of %" PRIu32 "m %" PRIu32 "s\n",
+		job->audio->samples_length, duration / 60, duration % 60);
+#endif
+
+done:
+	s_free_input(&input);
+	return ret;
+}
+
+/*!
+ * This function does the second half of s_load_spectrogram: unless the given
+ * job's pyramid was cached, it computes the STFT of the job's decoded audio
+ * (exporting its frames, if we were asked to) and its pyramid, and saves the
+ * pyramid in the cache. Then, it builds the spectrogram we'll render from the
+ * pyramid. The job keeps its decoded audio and its pyramid.
+ *
+ * \param sg This will receive the computed spectrogram.
+ * \param job The job to transform, which has been decoded with s_decode_job.
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_transform_job(s_spectrogram_t **sg, s_load_job_t *job,
+	const s_options_t *opts)
+{
+	int r;
+	s_stft_t *stft = NULL;
+	double begin;
+
+	if(job->pyramid != NULL)
+		goto done;
+
+	// Compute the STFT of the raw audio input.
+
+#ifdef SPECTR_DEBUG
+	printf("DEBUG: Window size: %" PRIu64 ", hop: %" PRIu64 "\n",
+		(uint64_t) job->window, (uint64_t) job->hop);
+#endif
+
+	/*
+	 * Unless we need the STFT's frames themselves, reduce each one into the
+	 * pyramid as soon as it is computed, so the STFT is never stored.
+	 */
+
+	if(opts->export == NULL)
+	{
+		r = s_pyramid_from_raw(&(job->pyramid), job->audio, job->window,
+			job->hop, opts->window, opts->precision, S_VIEW_H,
+			opts->scale, opts->threads);
+	}
+	else
+	{
+		r = s_stft(&stft, job->audio, job->window, job->hop,
+			opts->window, opts->precision, opts->threads);
+
+		if(r >= 0)
+		{
+			r = s_export_stft(stft, job->hop, opts->window,
+				opts->format, opts->export);
+		}
+
+		if(r >= 0)
+		{
+			r = s_pyramid_from_stft(&(job->pyramid), stft, job->hop,
+				S_VIEW_H, opts->scale);
+		}
+
+		s_free_stft(&stft);
+	}
+
+	// Don't keep a pyramid of audio which couldn't all be decoded.
+
+	if(r >= 0)
+		r = s_raw_audio_error(job->audio);
+
+	if(r < 0)
+		return r;
+
+	// Save the pyramid for next time. This is only a best-effort attempt.
+
+	if(job->cacheable)
+	{
+		begin = s_profile_begin();
+		r = s_write_pyramid(job->pyramid, &(job->key), job->cache);
+		s_profile_end(STAGE_CACHE, begin);
+
+#ifdef SPECTR_DEBUG
+		if(r < 0)
+			printf("DEBUG: Caching pyramid failed: %d\n", r);
+#endif
+	}
+
+done:
+	/*
+	 * Reduce the pyramid to the pixels we'll render. We always build the
+	 * initial spectrogram from the pyramid, so it looks the same whether or
+	 * not the pyramid was cached.
+	 */
+
+	return s_spectrogram_from_pyramid(sg, job->pyramid, 0,
+		job->pyramid->raw_length, S_VIEW_W, S_VIEW_H);
+}
@@ -0,0 +1,36 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_DRIVER_LOAD_H
+#define INCLUDE_SPECTR_DRIVER_LOAD_H
+
+#include <stddef.h>
+
+#include "spectr/types.h"
+
+extern int s_get_stft_size(size_t *, size_t *, const s_options_t *, size_t);
+extern int s_load_spectrogram(s_spectrogram_t **, s_raw_audio_t **,
+	s_pyramid_t **, const s_options_t *);
+
+extern void s_init_load_job(s_load_job_t *, const char *);
+extern void s_free_load_job(s_load_job_t *);
+extern int s_decode_job(s_load_job_t *, const s_options_t *);
+extern int s_transform_job(s_spectrogram_t **, s_load_job_t *,
+	const s_options_t *);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "progressive.h"
+
+#include <stdio.h>
+
+#include "spectr/config.h"
+#include "spectr/decoding/raw.h"
+#include "spectr/driver/load.h"
+#include "spectr/rendering/cache.h"
+#include "spectr/rendering/refine.h"
+#include "spectr/rendering/render.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/util/profile.h"
+
+/*!
+ * This function displays the spectrogram of the input file we were given in
+ * the viewer, without waiting for its STFT. Once the file has been decoded,
+ * the viewer opens with a coarse overview of it, which is refined in the
+ * background, a block of columns at a time, until it is exactly what
+ * s_load_spectrogram would have computed. If the refinement finished before
+ * the viewer was closed, its pyramid is saved in our cache, as usual.
+ *
+ * If the file's pyramid was already cached, there is nothing to refine, so it
+ * is just displayed.
+ *
+ * \param opts The options we were given.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_progressive(const s_options_t *opts)
+{
+	int r;
+	s_load_job_t job;
+	s_refine_t *refine = NULL;
+	s_spectrogram_t *sg = NULL;
+	double begin;
+
+	s_init_load_job(&job, opts->path);
+
+	r = s_decode_job(&job, opts);
+
+	if(r < 0)
+		goto done;
+
+	if(job.pyramid != NULL)
+	{
+		r = s_transform_job(&sg, &job, opts);
+
+		if(r >= 0)
+		{
+			r = s_render(sg, NULL, job.pyramid, opts->window,
+				opts->precision, opts->scale, opts->threads, 0);
+		}
+
+		goto done;
+	}
+
+	r = s_init_refine(&refine, job.audio, job.window, job.hop,
+		opts->window, opts->precision, S_VIEW_W, S_VIEW_H, opts->scale,
+		opts->threads);
+
+	if(r >= 0)
+		r = s_render_refine(refine, opts->gpu);
+
+	if(r < 0)
+		goto done;
+
+	// Save the pyramid for next time, if it was finished (and complete).
+
+	if(job.cacheable && (s_refine_result(refine) > 0) &&
+		(s_raw_audio_error(job.audio) == 0))
+	{
+		begin = s_profile_begin();
+		r = s_write_pyramid(refine->pyramid, &(job.key), job.cache);
+		s_profile_end(STAGE_CACHE, begin);
+
+#ifdef SPECTR_DEBUG
+		if(r < 0)
+			printf("DEBUG: Caching pyramid failed: %d\n", r);
+#endif
+
+		r = 0;
+	}
+
+done:
+	s_free_refine(&refine);
+	s_free_spectrogram(&sg);
+	s_free_load_job(&job);
+	return r;
+}
@@ -0,0 +1,591 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+
+#include "spectr/constants.h"
+#include "spectr/config.h"
+#include "spectr/rendering/pyramid.h"
+#include "spectr/util/bitwise.h"
+#include "spectr/util/path.h"
+
+uint64_t s_cache_key_hash(const s_cache_key_t *);
+void s_encode_pyramid_header(uint8_t *, const s_pyramid_t *,
+	const s_cache_key_t *);
+int s_write_pyramid_level(FILE *, const s_pyramid_t *, size_t);
+int s_check_pyramid_header(const uint8_t *, size_t, const s_cache_key_t *);
+
+/*!
+ * This function fills in the cache key identifying the pyramid of the given
+ * input file, computed with the given STFT parameters.
+ *
+ * \param key The key to fill in.
+ * \param f The path to the input file.
+ * \param window The STFT's window size.
+ * \param hop The STFT's hop size.
+ * \param fn The STFT's window function.
+ * \param precision The precision the STFT is computed in.
+ * \param height The number of rows in each level of the pyramid.
+ * \param scale The scale of the pyramid's frequency axis.
+ * \param decimation The factor the input was decimated by before its STFT.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_init_cache_key(s_cache_key_t *key, const char *f, size_t window,
+	size_t hop, s_window_type_t fn, s_precision_t precision,
+	size_t height, s_scale_type_t scale, size_t decimation)
+{
+	struct stat st;
+
+	if(stat(f, &st) < 0)
+		return -errno;
+
+	key->dev = (uint64_t) st.st_dev;
+	key->ino = (uint64_t) st.st_ino;
+	key->size = (uint64_t) st.st_size;
+	key->mtime_sec = (uint64_t) st.st_mtim.tv_sec;
+	key->mtime_nsec = (uint64_t) st.st_mtim.tv_nsec;
+
+	key->window = window;
+	key->hop = hop;
+	key->function = (uint32_t) fn;
+	key->precision = (uint32_t) precision;
+	key->height = height;
+	key->scale = (uint32_t) scale;
+	key->decimation = decimation;
+
+	return 0;
+}
+
+/*!
+ * This function places the path of the cache file for the given key in the
+ * given buffer. The file is named after a hash of the key, inside our cache
+ * directory (see s_get_cache_dir), which is created if necessary.
+ *
+ * \param buf The buf to store the path in.
+ * \param bufsiz The size of the given buffer.
+ * \param key The key identifying the cached pyramid.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_get_cache_path(char *buf, size_t bufsiz, const s_cache_key_t *key)
+{
+	int r;
+	int l;
+	size_t o;
+
+	r = s_get_cache_dir(buf, bufsiz);
+
+	if(r < 0)
+		return r;
+
+	o = strlen(buf);
+	l = snprintf(buf + o, bufsiz - o, "/%016" PRIx64 ".pyr",
+		s_cache_key_hash(key));
+
+	if((l < 0) || ((size_t) l >= bufsiz - o))
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+/*!
+ * This function writes the given pyramid to the given file, in our pyramid
+ * file format. The file consists of:
+ *
+ * - A fixed-size header (S_PYRAMID_HEADER_LENGTH bytes), describing the input
+ *   audio and the STFT parameters, and identifying the input file.
+ * - A table with the number of columns and the file offset of each level.
+ * - Each level's cells, as 32-bit floats, column-major. Each level starts on
+ *   a S_PYRAMID_DATA_ALIGNMENT byte boundary.
+ *
+ * Every value is stored little-endian. See s_encode_pyramid_header for the
+ * header's layout. The file is written under a temporary name and renamed
+ * into place, so a partially written file is never read back.
+ *
+ * \param p The pyramid to write.
+ * \param key The key identifying the pyramid's input and parameters.
+ * \param path The path to write the pyramid to.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_write_pyramid(const s_pyramid_t *p, const s_cache_key_t *key,
+	const char *path)
+{
+	int r;
+	int ret = 0;
+	size_t i;
+	size_t offset;
+	uint8_t header[S_PYRAMID_HEADER_LENGTH];
+	uint8_t entry[S_PYRAMID_LEVEL_ENTRY_LENGTH];
+	uint8_t zero[S_PYRAMID_DATA_ALIGNMENT];
+	char tmp[PATH_MAX];
+	FILE *out;
+
+	r = snprintf(tmp, PATH_MAX, "%s.%ld.tmp", path, (long) getpid());
+
+	if((r < 0) || (r >= PATH_MAX))
+		return -ENAMETOOLONG;
+
+	out = fopen(tmp, "wb");
+
+	if(out == NULL)
+		return -errno;
+
+	// Write the header, and the table of levels.
+
+	s_encode_pyramid_header(header, p, key);
+
+	if(fwrite(header, 1, S_PYRAMID_HEADER_LENGTH, out) !=
+		S_PYRAMID_HEADER_LENGTH)
+	{
+		ret = -EIO;
+		goto err_after_open;
+	}
+
+	offset = S_PYRAMID_HEADER_LENGTH +
+		p->levels * S_PYRAMID_LEVEL_ENTRY_LENGTH;
+
+	for(i = 0; i < p->levels; ++i)
+	{
+		offset = ((offset + S_PYRAMID_DATA_ALIGNMENT - 1) /
+			S_PYRAMID_DATA_ALIGNMENT) * S_PYRAMID_DATA_ALIGNMENT;
+
+		s_store_le_uint64(entry, 0, p->level[i].columns);
+		s_store_le_uint64(entry, 8, offset);
+
+		if(fwrite(entry, 1, S_PYRAMID_LEVEL_ENTRY_LENGTH, out) !=
+			S_PYRAMID_LEVEL_ENTRY_LENGTH)
+		{
+			ret = -EIO;
+			goto err_after_open;
+		}
+
+		offset += p->level[i].columns * p->height * sizeof(float);
+	}
+
+	// Write each level's cells, padding up to the offsets above.
+
+	memset(zero, 0, S_PYRAMID_DATA_ALIGNMENT);
+
+	for(i = 0; i < p->levels; ++i)
+	{
+		offset = (size_t) ftell(out);
+		offset = (S_PYRAMID_DATA_ALIGNMENT - offset %
+			S_PYRAMID_DATA_ALIGNMENT) % S_PYRAMID_DATA_ALIGNMENT;
+
+		if(fwrite(zero, 1, offset, out) != offset)
+		{
+			ret = -EIO;
+			goto err_after_open;
+		}
+
+		r = s_write_pyramid_level(out, p, i);
+
+		if(r < 0)
+		{
+			ret = r;
+			goto err_after_open;
+		}
+	}
+
+	if(fclose(out) != 0)
+	{
+		ret = -errno;
+		goto err_after_close;
+	}
+
+	if(rename(tmp, path) < 0)
+	{
+		ret = -errno;
+		goto err_after_close;
+	}
+
+	return 0;
+
+err_after_open:
+	fclose(out);
+err_after_close:
+	unlink(tmp);
+	return ret;
+}
+
+/*!
+ * This function loads a pyramid from the given file, which must have been
+ * written by s_write_pyramid, by mapping it into memory. The pyramid's tiles
+ * point straight into the mapping, so no cells are read or copied until they
+ * are used, and the pyramid is read-only. The mapping is released by
+ * s_free_pyramid.
+ *
+ * If a key is given, the file is only loaded if it was written for the same
+ * input file and STFT parameters. Note that the cells are stored
+ * little-endian, so this is only supported on little-endian machines.
+ *
+ * \param p This will receive the loaded pyramid.
+ * \param key The key the pyramid must match, or NULL to accept any pyramid.
+ * \param path The path to load the pyramid from.
+ * \return 0 on success, -ESTALE if the file doesn't match the key, or another
+ *         error number if something goes wrong.
+ */
+int s_map_pyramid(s_pyramid_t **p, const s_cache_key_t *key, const char *path)
+{
+	int r;
+	int fd;
+	struct stat st;
+	uint8_t *map;
+	size_t length;
+	size_t i;
+	size_t t;
+	size_t levels;
+	size_t columns;
+	size_t offset;
+	s_pyramid_level_t *level;
+
+	if(!s_is_little_endian())
+		return -ENOTSUP;
+
+	s_free_pyramid(p);
+
+	// Map the whole file into memory.
+
+	fd = open(path, O_RDONLY);
+
+	if(fd < 0)
+		return -errno;
+
+	if(fstat(fd, &st) < 0)
+	{
+		r = -errno;
+		close(fd);
+		return r;
+	}
+
+	length = (size_t) st.st_size;
+
+	if(length < S_PYRAMID_HEADER_LENGTH)
+	{
+		close(fd);
+		return -EINVAL;
+	}
+
+	map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if(map == MAP_FAILED)
+		return -errno;
+
+	// Make sure the file is valid, and is the one we want.
+
+	r = s_check_pyramid_header(map, length, key);
+
+	if(r < 0)
+	{
+		munmap(map, length);
+		return r;
+	}
+
+	// Build the pyramid structure around the mapping.
+
+	r = s_init_pyramid(p, s_load_le_uint64(map, S_PYRAMID_HDR_HEIGHT),
+		s_load_le_uint64(map, S_PYRAMID_HDR_HOP), (s_scale_type_t)
+		s_load_le_uint32(map, S_PYRAMID_HDR_SCALE));
+
+	if(r < 0)
+	{
+		munmap(map, length);
+		return r;
+	}
+
+	(*p)->map = map;
+	(*p)->map_length = length;
+
+	(*p)->raw_stat.type = (s_ftype_t)
+		s_load_le_uint32(map, S_PYRAMID_HDR_FTYPE);
+	(*p)->raw_stat.bit_depth = s_load_le_uint32(map,
+		S_PYRAMID_HDR_BIT_DEPTH);
+	(*p)->raw_stat.sample_rate = s_load_le_uint32(map,
+		S_PYRAMID_HDR_SAMPLE_RATE);
+	(*p)->raw_length = s_load_le_uint64(map, S_PYRAMID_HDR_RAW_LENGTH);
+
+	levels = s_load_le_uint64(map, S_PYRAMID_HDR_LEVELS);
+	level = realloc((*p)->level, levels * sizeof(s_pyramid_level_t));
+
+	if(level == NULL)
+	{
+		s_free_pyramid(p);
+		return -ENOMEM;
+	}
+
+	(*p)->level = level;
+	memset(level, 0, levels * sizeof(s_pyramid_level_t));
+	(*p)->levels = levels;
+
+	for(i = 0; i < levels; ++i)
+	{
+		t = S_PYRAMID_HEADER_LENGTH + i * S_PYRAMID_LEVEL_ENTRY_LENGTH;
+
+		columns = s_load_le_uint64(map, t);
+		offset = s_load_le_uint64(map, t + 8);
+
+		level[i].columns = columns;
+		level[i].tiles = (columns + S_PYRAMID_TILE_COLUMNS - 1) /
+			S_PYRAMID_TILE_COLUMNS;
+		level[i].capacity = level[i].tiles;
+
+		if(level[i].tiles == 0)
+			continue;
+
+		level[i].tile = malloc(level[i].tiles * sizeof(float *));
+
+		if(level[i].tile == NULL)
+		{
+			s_free_pyramid(p);
+			return -ENOMEM;
+		}
+
+		for(t = 0; t < level[i].tiles; ++t)
+		{
+			level[i].tile[t] = (float *) (map + offset) +
+				t * S_PYRAMID_TILE_COLUMNS * (*p)->height;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * This function computes a 64-bit FNV-1a hash of the given cache key, which
+ * we use to name its cache file.
+ *
+ * \param key The key to hash.
+ * \return The key's hash.
+ */
+uint64_t s_cache_key_hash(const s_cache_key_t *key)
+{
+	size_t i;
+	uint8_t buf[92];
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	s_store_le_uint64(buf, 0, key->dev);
+	s_store_le_uint64(buf, 8, key->ino);
+	s_store_le_uint64(buf, 16, key->size);
+	s_store_le_uint64(buf, 24, key->mtime_sec);
+	s_store_le_uint64(buf, 32, key->mtime_nsec);
+	s_store_le_uint64(buf, 40, key->window);
+	s_store_le_uint64(buf, 48, key->hop);
+	s_store_le_uint64(buf, 56, key->height);
+	s_store_le_uint32(buf, 64, key->function);
+	s_store_le_uint32(buf, 68, key->precision);
+	s_store_le_uint64(buf, 72, S_PYRAMID_VERSION);
+	s_store_le_uint32(buf, 80, key->scale);
+	s_store_le_uint64(buf, 84, key->decimation);
+
+	for(i = 0; i < sizeof(buf); ++i)
+	{
+		hash ^= buf[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+/*!
+ * This function encodes the header of a pyramid file. Every field is stored
+ * little-endian, at the offsets defined by the S_PYRAMID_HDR_* constants;
+ * unused bytes are zeroed.
+ *
+ * \param buf The buffer to encode into, of S_PYRAMID_HEADER_LENGTH bytes.
+ * \param p The pyramid being written.
+ * \param key The key identifying the pyramid's input and parameters.
+ */
+void s_encode_pyramid_header(uint8_t *buf, const s_pyramid_t *p,
+	const s_cache_key_t *key)
+{
+	memset(buf, 0, S_PYRAMID_HEADER_LENGTH);
+	memcpy(buf + S_PYRAMID_HDR_MAGIC, S_PYRAMID_MAGIC, 8);
+
+	s_store_le_uint32(buf, S_PYRAMID_HDR_VERSION, S_PYRAMID_VERSION);
+	s_store_le_uint32(buf, S_PYRAMID_HDR_LENGTH, S_PYRAMID_HEADER_LENGTH);
+
+	s_store_le_uint32(buf, S_PYRAMID_HDR_FTYPE,
+		(uint32_t) p->raw_stat.type);
+	s_store_le_uint32(buf, S_PYRAMID_HDR_BIT_DEPTH, p->raw_stat.bit_depth);
+	s_store_le_uint32(buf, S_PYRAMID_HDR_SAMPLE_RATE,
+		p->raw_stat.sample_rate);
+	s_store_le_uint32(buf, S_PYRAMID_HDR_FUNCTION, key->function);
+	s_store_le_uint32(buf, S_PYRAMID_HDR_PRECISION, key->precision);
+	s_store_le_uint32(buf, S_PYRAMID_HDR_SCALE, key->scale);
+
+	s_store_le_uint64(buf, S_PYRAMID_HDR_RAW_LENGTH, p->raw_length);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_HOP, p->hop);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_HEIGHT, p->height);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_WINDOW, key->window);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_DECIMATION, key->decimation);
+
+	s_store_le_uint64(buf, S_PYRAMID_HDR_DEV, key->dev);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_INO, key->ino);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_SIZE, key->size);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_MTIME_SEC, key->mtime_sec);
+	s_store_le_uint64(buf, S_PYRAMID_HDR_MTIME_NSEC, key->mtime_nsec);
+
+	s_store_le_uint64(buf, S_PYRAMID_HDR_LEVELS, p->levels);
+}
+
+/*!
+ * This function writes the cells of one level of a pyramid to the given file,
+ * as little-endian 32-bit floats.
+ *
+ * \param out The file to write to.
+ * \param p The pyramid being written.
+ * \param lvl The level to write.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_write_pyramid_level(FILE *out, const s_pyramid_t *p, size_t lvl)
+{
+	size_t i;
+	size_t t;
+	size_t n;
+	uint32_t bits;
+	uint8_t le[sizeof(float)];
+	const s_pyramid_level_t *level = &(p->level[lvl]);
+
+	for(t = 0; t < level->tiles; ++t)
+	{
+		n = level->columns - t * S_PYRAMID_TILE_COLUMNS;
+		n = n < S_PYRAMID_TILE_COLUMNS ? n : S_PYRAMID_TILE_COLUMNS;
+		n *= p->height;
+
+		if(s_is_little_endian())
+		{
+			if(fwrite(level->tile[t], sizeof(float), n, out) != n)
+				return -EIO;
+
+			continue;
+		}
+
+		for(i = 0; i < n; ++i)
+		{
+			memcpy(&bits, &(level->tile[t][i]), sizeof(float));
+			s_store_le_uint32(le, 0, bits);
+
+			if(fwrite(le, 1, sizeof(float), out) != sizeof(float))
+				return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * This function checks that the given (mapped) pyramid file is valid: that it
+ * has our magic number and version, and that its table of levels fits inside
+ * the file. If a key is given, it also checks that the file was written for
+ * that key.
+ *
+ * \param map The contents of the file.
+ * \param length The length of the file, in bytes.
+ * \param key The key the file must match, or NULL.
+ * \return 0 if the file is valid, -ESTALE if it doesn't match the key, or
+ *         -EINVAL if it is invalid.
+ */
+int s_check_pyramid_header(const uint8_t *map, size_t length,
+	const s_cache_key_t *key)
+{
+	size_t i;
+	size_t t;
+	size_t height;
+	size_t levels;
+	uint64_t columns;
+	uint64_t offset;
+
+	if(memcmp(map + S_PYRAMID_HDR_MAGIC, S_PYRAMID_MAGIC, 8) != 0)
+		return -EINVAL;
+
+	if((s_load_le_uint32(map, S_PYRAMID_HDR_VERSION) !=
+		S_PYRAMID_VERSION) || (s_load_le_uint32(map,
+		S_PYRAMID_HDR_LENGTH) != S_PYRAMID_HEADER_LENGTH))
+	{
+		return -EINVAL;
+	}
+
+	if(key != NULL)
+	{
+		if((s_load_le_uint64(map, S_PYRAMID_HDR_DEV) != key->dev) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_INO) !=
+				key->ino) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_SIZE) !=
+				key->size) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_MTIME_SEC) !=
+				key->mtime_sec) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_MTIME_NSEC) !=
+				key->mtime_nsec) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_WINDOW) !=
+				key->window) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_HOP) !=
+				key->hop) ||
+			(s_load_le_uint32(map, S_PYRAMID_HDR_FUNCTION) !=
+				key->function) ||
+			(s_load_le_uint32(map, S_PYRAMID_HDR_PRECISION) !=
+				key->precision) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_HEIGHT) !=
+				key->height) ||
+			(s_load_le_uint32(map, S_PYRAMID_HDR_SCALE) !=
+				key->scale) ||
+			(s_load_le_uint64(map, S_PYRAMID_HDR_DECIMATION) !=
+				key->decimation))
+		{
+			return -ESTALE;
+		}
+	}
+
+	height = s_load_le_uint64(map, S_PYRAMID_HDR_HEIGHT);
+	levels = s_load_le_uint64(map, S_PYRAMID_HDR_LEVELS);
+
+	if((height < 1) || (s_load_le_uint64(map, S_PYRAMID_HDR_HOP) < 1) ||
+		(levels < 1) || (levels > (length - S_PYRAMID_HEADER_LENGTH) /
+		S_PYRAMID_LEVEL_ENTRY_LENGTH))
+	{
+		return -EINVAL;
+	}
+
+	// Make sure every level's cells fit inside the file.
+
+	for(i = 0; i < levels; ++i)
+	{
+		t = S_PYRAMID_HEADER_LENGTH + i * S_PYRAMID_LEVEL_ENTRY_LENGTH;
+
+		columns = s_load_le_uint64(map, t);
+		offset = s_load_le_uint64(map, t + 8);
+
+		if((offset % sizeof(float) != 0) || (offset > length) ||
+			(columns > (length - offset) / sizeof(float) / height))
+		{
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_RENDERING_CACHE_H
+#define INCLUDE_SPECTR_RENDERING_CACHE_H
+
+#include <stddef.h>
+
+#include "spectr/types.h"
+
+extern int s_init_cache_key(s_cache_key_t *, const char *, size_t, size_t,
+	s_window_type_t, s_precision_t, size_t, s_scale_type_t, size_t);
+extern int s_get_cache_path(char *, size_t, const s_cache_key_t *);
+
+extern int s_write_pyramid(const s_pyramid_t *, const s_cache_key_t *,
+	const char *);
+extern int s_map_pyramid(s_pyramid_t **, const s_cache_key_t *,
+	const char *);
+
+#endif
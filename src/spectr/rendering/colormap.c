@@ -0,0 +1,155 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "colormap.h"
+
+#include <math.h>
+
+void s_colormap_color(double *, double);
+double s_smoothstep(double, double, double);
+
+/*!
+ * \brief This is the list of colors our spectrogram's colormap blends between.
+ *
+ * These are the colors of our fragment shader's colormap texture (see
+ * glinit.c), from the lowest magnitude to the highest.
+ */
+static const double s_colormap_colors[6][3] = {
+	{ 0.0, 0.0, 0.0 },	// Black
+	{ 0.0, 0.0, 0.25 },	// Blue
+	{ 0.5, 0.0, 0.5 },	// Purple
+	{ 1.0, 0.0, 0.0 },	// Red
+	{ 1.0, 1.0, 0.0 },	// Yellow
+	{ 1.0, 1.0, 1.0 }	// White
+};
+
+/*!
+ * This function computes where a spectrogram pixel with the given
+ * log-magnitude falls in our colormap: 0 at (or below) the given bottom, and 1
+ * at (or above) the given top, with the given gamma applied in between.
+ * This is exactly the mapping our fragment shader uses (see glinit.c). Empty
+ * pixels (whose value is -FLT_MAX) are always at 0.
+ *
+ * \param z The log-magnitude of the pixel.
+ * \param bottom The log-magnitude at the bottom of the colormap.
+ * \param top The log-magnitude at the top of the colormap.
+ * \param gamma The exponent to apply to the pixel's level.
+ * \return The pixel's level, in [0, 1].
+ */
+double s_colormap_level(double z, double bottom, double top, double gamma)
+{
+	double t;
+
+	if(top <= bottom)
+		return 0.0;
+
+	t = fmin(fmax((z - bottom) / (top - bottom), 0.0), 1.0);
+
+	return pow(t, gamma);
+}
+
+/*!
+ * This function computes the color of a spectrogram pixel at the given level
+ * of our colormap (see s_colormap_level). This is a CPU implementation of
+ * exactly the same colors our fragment shader's colormap texture holds (see
+ * s_colormap_table), so images we render without OpenGL look the same as the
+ * interactive viewer.
+ *
+ * \param rgb This will receive the red, green and blue components.
+ * \param t The level of the pixel, in [0, 1].
+ */
+void s_colormap(uint8_t *rgb, double t)
+{
+	int c;
+	double color[3];
+
+	s_colormap_color(color, t);
+
+	for(c = 0; c < 3; ++c)
+		rgb[c] = (uint8_t) lrint(fmin(fmax(color[c], 0.0), 1.0) * 255.0);
+}
+
+/*!
+ * This function computes the given number of evenly spaced entries of our
+ * colormap, from level 0 to level 1, as red, green and blue components. This
+ * is the table our fragment shader looks each pixel's color up in.
+ *
+ * \param rgb This will receive the n * 3 components.
+ * \param n The number of entries to compute. Must be at least 2.
+ */
+void s_colormap_table(float *rgb, size_t n)
+{
+	size_t i;
+	int c;
+	double color[3];
+
+	for(i = 0; i < n; ++i)
+	{
+		s_colormap_color(color, (double) i / (double) (n - 1));
+
+		for(c = 0; c < 3; ++c)
+			rgb[i * 3 + c] = (float) color[c];
+	}
+}
+
+/*!
+ * This function blends our colormap's colors to compute the color at the
+ * given level: each fifth of the range blends smoothly from one color to the
+ * next.
+ *
+ * \param color This will receive the red, green and blue components.
+ * \param t The level to compute the color of, in [0, 1].
+ */
+void s_colormap_color(double *color, double t)
+{
+	int i;
+	int c;
+	double s;
+
+	for(c = 0; c < 3; ++c)
+		color[c] = s_colormap_colors[0][c];
+
+	for(i = 1; i < 6; ++i)
+	{
+		s = s_smoothstep(0.2 * (i - 1), 0.2 * i, t);
+
+		for(c = 0; c < 3; ++c)
+		{
+			color[c] = color[c] * (1.0 - s) +
+				s_colormap_colors[i][c] * s;
+		}
+	}
+}
+
+/*!
+ * This function implements GLSL's smoothstep(): a smooth Hermite interpolation
+ * between 0 and 1, for values of x in [e0, e1].
+ *
+ * \param e0 The lower edge.
+ * \param e1 The upper edge.
+ * \param x The value to interpolate.
+ * \return The interpolated value, in [0, 1].
+ */
+double s_smoothstep(double e0, double e1, double x)
+{
+	double t = (x - e0) / (e1 - e0);
+
+	t = fmin(fmax(t, 0.0), 1.0);
+
+	return t * t * (3.0 - 2.0 * t);
+}
@@ -0,0 +1,474 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "filterbank.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "spectr/constants.h"
+#include "spectr/transform/fourier.h"
+
+double s_scale_from_hz(s_scale_type_t, double);
+double s_scale_to_hz(s_scale_type_t, double);
+int s_filterbank_linear(s_filterbank_t *);
+int s_filterbank_warped(s_filterbank_t *);
+void s_filterbank_edges(double *, double *, const s_filterbank_t *, size_t);
+void s_filterbank_span(size_t *, size_t *, const s_filterbank_t *, double,
+	double);
+
+/*
+ * The names of each of our frequency scales, as accepted on the command line,
+ * indexed by s_scale_type_t.
+ */
+static const char *s_scale_names[SCALE_INVALID] = {
+	"linear",
+	"log",
+	"mel",
+	"bark"
+};
+
+/*!
+ * This function returns the name of the given frequency scale, as accepted by
+ * s_scale_type_from_name.
+ *
+ * \param type The frequency scale.
+ * \return The frequency scale's name, or NULL if it is invalid.
+ */
+const char *s_scale_name(s_scale_type_t type)
+{
+	if(type >= SCALE_INVALID)
+		return NULL;
+
+	return s_scale_names[type];
+}
+
+/*!
+ * This function returns the frequency scale with the given name.
+ *
+ * \param name The name of the frequency scale (e.g., "mel").
+ * \return The frequency scale, or SCALE_INVALID if the name is unknown.
+ */
+s_scale_type_t s_scale_type_from_name(const char *name)
+{
+	int i;
+
+	for(i = 0; i < SCALE_INVALID; ++i)
+	{
+		if(strcmp(name, s_scale_names[i]) == 0)
+			return (s_scale_type_t) i;
+	}
+
+	return SCALE_INVALID;
+}
+
+/*!
+ * This function initializes (allocates) a filterbank which maps the given
+ * number of DFT bins onto h rows, spaced evenly in the given frequency scale.
+ * If the pointer is non-NULL, we will not allocate a new value on top of it.
+ *
+ * For the linear scale, each bin falls entirely into one row, and the bins are
+ * spread evenly over the rows (1-1, if there are exactly as many bins as
+ * rows; if there are fewer, rows between bins repeat the bin below them). Any other scale gives each row the bins its frequency range overlaps,
+ * weighted by how much of each bin it covers. This way, rows narrower than a
+ * single bin (e.g., the low frequencies of a logarithmic scale) still have a
+ * value, instead of being left empty.
+ *
+ * \param fb The s_filterbank_t to allocate.
+ * \param scale The frequency scale to space the rows in.
+ * \param bins The number of bins being mapped (see s_filterbank_t).
+ * \param h The number of rows to map the bins onto.
+ * \param sample_rate The sample rate of the transformed audio, in Hz.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_filterbank(s_filterbank_t **fb, s_scale_type_t scale, size_t bins,
+	size_t h, uint32_t sample_rate)
+{
+	int r = 0;
+
+	if(*fb != NULL)
+		return -EINVAL;
+
+	if((scale >= SCALE_INVALID) || (h < 1))
+		return -EINVAL;
+
+	// Only the linear scale doesn't depend on the actual frequencies.
+
+	if((scale != SCALE_LINEAR) && (sample_rate == 0))
+		return -EINVAL;
+
+	*fb = malloc(sizeof(s_filterbank_t));
+
+	if(*fb == NULL)
+		return -ENOMEM;
+
+	(*fb)->scale = scale;
+	(*fb)->bins = bins;
+	(*fb)->height = h;
+	(*fb)->sample_rate = sample_rate;
+
+	(*fb)->first = malloc(h * sizeof(size_t));
+	(*fb)->offset = malloc((h + 1) * sizeof(size_t));
+	(*fb)->weight = NULL;
+
+	if(((*fb)->first == NULL) || ((*fb)->offset == NULL))
+	{
+		s_free_filterbank(fb);
+		return -ENOMEM;
+	}
+
+	if(scale == SCALE_LINEAR)
+		r = s_filterbank_linear(*fb);
+	else
+		r = s_filterbank_warped(*fb);
+
+	if(r < 0)
+		s_free_filterbank(fb);
+
+	return r;
+}
+
+/*!
+ * This function frees the given s_filterbank_t structure, including its
+ * weights. Note that this function is safe against double-frees.
+ *
+ * \param fb The s_filterbank_t to free.
+ */
+void s_free_filterbank(s_filterbank_t **fb)
+{
+	if(*fb == NULL)
+		return;
+
+	free((*fb)->first);
+	free((*fb)->offset);
+	free((*fb)->weight);
+
+	free(*fb);
+	*fb = NULL;
+}
+
+/*!
+ * This function makes sure the given filterbank maps the given number of bins
+ * onto h rows in the given scale. If it already does, it is left alone (and
+ * is only read); otherwise, it is replaced with a new one.
+ *
+ * \param fb The filterbank to check, which may be NULL.
+ * \param scale The frequency scale to space the rows in.
+ * \param bins The number of bins being mapped (see s_filterbank_t).
+ * \param h The number of rows to map the bins onto.
+ * \param sample_rate The sample rate of the transformed audio, in Hz.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_get_filterbank(s_filterbank_t **fb, s_scale_type_t scale, size_t bins,
+	size_t h, uint32_t sample_rate)
+{
+	if((*fb != NULL) && ((*fb)->scale == scale) && ((*fb)->bins == bins) &&
+		((*fb)->height == h) && ((scale == SCALE_LINEAR) ||
+		((*fb)->sample_rate == sample_rate)))
+	{
+		return 0;
+	}
+
+	s_free_filterbank(fb);
+
+	return s_init_filterbank(fb, scale, bins, h, sample_rate);
+}
+
+/*!
+ * This function applies the given filterbank to one DFT: each row of dst
+ * receives the weighted average of the base-10 log-magnitudes of the row's
+ * bins. Bins whose log-magnitude isn't finite (e.g., silence) are skipped, and
+ * rows which are left without any bins at all receive NAN.
+ *
+ * The DFT must have exactly the filterbank's number of bins, plus its DC and
+ * Nyquist bins. The filterbank is only read, so this function may be called
+ * concurrently.
+ *
+ * \param dst The buffer which will receive the value of each row.
+ * \param fb The filterbank to apply.
+ * \param dft The DFT to apply it to.
+ */
+void s_filterbank_apply(float *dst, const s_filterbank_t *fb,
+	const s_dft_t *dft)
+{
+	size_t row;
+	size_t k;
+	size_t bin;
+	size_t block = 0;
+	size_t length = 0;
+	double sum;
+	double total;
+	double z[S_SIMD_BLOCK_LENGTH];
+
+	/*
+	 * Each row's bins start at or after the previous row's last bin, so we
+	 * compute the bins' log-magnitudes a block at a time, moving the block
+	 * forward as we go, and compute each of them about once.
+	 */
+
+	for(row = 0; row < fb->height; ++row)
+	{
+		sum = 0.0;
+		total = 0.0;
+
+		bin = fb->first[row];
+
+		for(k = fb->offset[row]; k < fb->offset[row + 1]; ++k, ++bin)
+		{
+			if((bin < block) || (bin >= block + length))
+			{
+				block = bin;
+				length = fb->bins - bin;
+
+				if(length > S_SIMD_BLOCK_LENGTH)
+					length = S_SIMD_BLOCK_LENGTH;
+
+				s_dft_log_magnitudes(z, dft, block + 1, length);
+			}
+
+			// If we got a bogus Z value, just skip it.
+
+			if(isinf(z[bin - block]) || isnan(z[bin - block]))
+				continue;
+
+			sum += fb->weight[k] * z[bin - block];
+			total += fb->weight[k];
+		}
+
+		dst[row] = total > 0.0 ? (float) (sum / total) : NAN;
+	}
+}
+
+/*!
+ * This function maps a frequency onto the given scale. The rows of a
+ * filterbank are spaced evenly in the scale's units.
+ *
+ * The mel scale is O'Shaughnessy's, and the Bark scale is Traunmueller's
+ * approximation of Zwicker's critical bands.
+ *
+ * \param scale The frequency scale.
+ * \param f The frequency to map, in Hz.
+ * \return The given frequency, in the scale's units.
+ */
+double s_scale_from_hz(s_scale_type_t scale, double f)
+{
+	switch(scale)
+	{
+		case SCALE_LOG:
+			return log(f);
+
+		case SCALE_MEL:
+			return 2595.0 * log10(1.0 + f / 700.0);
+
+		case SCALE_BARK:
+			return (26.81 * f) / (1960.0 + f) - 0.53;
+
+		default:
+			return f;
+	}
+}
+
+/*!
+ * This function is the inverse of s_scale_from_hz.
+ *
+ * \param scale The frequency scale.
+ * \param s The value to map, in the scale's units.
+ * \return The frequency the given value corresponds to, in Hz.
+ */
+double s_scale_to_hz(s_scale_type_t scale, double s)
+{
+	switch(scale)
+	{
+		case SCALE_LOG:
+			return exp(s);
+
+		case SCALE_MEL:
+			return 700.0 * (pow(10.0, s / 2595.0) - 1.0);
+
+		case SCALE_BARK:
+			return (1960.0 * (s + 0.53)) / (26.28 - s);
+
+		default:
+			return s;
+	}
+}
+
+/*!
+ * This function fills in the weights of a linear filterbank. Row r receives
+ * each bin b with (b * height) / bins == r, with a weight of 1. If there are
+ * fewer bins than rows, a row which receives no bins this way takes the bin
+ * it falls into instead, so no row is left empty.
+ *
+ * \param fb The filterbank to fill in, whose weights aren't allocated yet.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_filterbank_linear(s_filterbank_t *fb)
+{
+	size_t row;
+	size_t end;
+	size_t k;
+	size_t h = fb->height;
+
+	fb->offset[0] = 0;
+
+	for(row = 0; row < h; ++row)
+	{
+		fb->first[row] = (row * fb->bins + h - 1) / h;
+		end = ((row + 1) * fb->bins + h - 1) / h;
+
+		if((end <= fb->first[row]) && (fb->bins > 0))
+		{
+			fb->first[row] = (row * fb->bins) / h;
+			end = fb->first[row] + 1;
+		}
+
+		fb->offset[row + 1] = fb->offset[row] + (end - fb->first[row]);
+	}
+
+	k = fb->offset[h];
+	fb->weight = malloc((k > 0 ? k : 1) * sizeof(double));
+
+	if(fb->weight == NULL)
+		return -ENOMEM;
+
+	while(k > 0)
+		fb->weight[--k] = 1.0;
+
+	return 0;
+}
+
+/*!
+ * This function fills in the weights of a filterbank in any non-linear scale.
+ * Each row covers an equal part of the scale, between the bottom of the first
+ * bin and the Nyquist frequency, and each bin it overlaps is weighted by the
+ * width of the overlap (in bins).
+ *
+ * \param fb The filterbank to fill in, whose weights aren't allocated yet.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_filterbank_warped(s_filterbank_t *fb)
+{
+	size_t row;
+	size_t k;
+	size_t bin;
+	size_t end;
+	double lo;
+	double hi;
+	double total;
+
+	// Work out each row's range of bins, and where its weights start.
+
+	fb->offset[0] = 0;
+
+	for(row = 0; row < fb->height; ++row)
+	{
+		s_filterbank_edges(&lo, &hi, fb, row);
+		s_filterbank_span(&(fb->first[row]), &end, fb, lo, hi);
+
+		fb->offset[row + 1] = fb->offset[row] + (end - fb->first[row]);
+	}
+
+	k = fb->offset[fb->height];
+	fb->weight = malloc((k > 0 ? k : 1) * sizeof(double));
+
+	if(fb->weight == NULL)
+		return -ENOMEM;
+
+	/*
+	 * Weight each bin by how much of it the row covers. If rounding left a
+	 * row covering none of its bins at all, it just takes its first bin.
+	 */
+
+	for(row = 0; row < fb->height; ++row)
+	{
+		s_filterbank_edges(&lo, &hi, fb, row);
+
+		bin = fb->first[row];
+		total = 0.0;
+
+		for(k = fb->offset[row]; k < fb->offset[row + 1]; ++k, ++bin)
+		{
+			fb->weight[k] = fmax(fmin(hi, (double) (bin + 1)) -
+				fmax(lo, (double) bin), 0.0);
+
+			total += fb->weight[k];
+		}
+
+		if((total <= 0.0) && (fb->offset[row + 1] > fb->offset[row]))
+			fb->weight[fb->offset[row]] = 1.0;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function computes the range of a non-linear filterbank's row, in bins
+ * (i.e., bin b covers [b, b + 1), and the range is within [0, bins]).
+ *
+ * \param lo This will receive the bottom of the row.
+ * \param hi This will receive the top of the row.
+ * \param fb The filterbank whose row should be computed.
+ * \param row The row to compute.
+ */
+void s_filterbank_edges(double *lo, double *hi, const s_filterbank_t *fb,
+	size_t row)
+{
+	double hz = (double) fb->sample_rate / (double) (2 * fb->bins + 2);
+	double s0 = s_scale_from_hz(fb->scale, hz);
+	double s1 = s_scale_from_hz(fb->scale, hz * (double) (fb->bins + 1));
+	double h = (double) fb->height;
+
+	*lo = s_scale_to_hz(fb->scale, s0 + (s1 - s0) * (double) row / h);
+	*hi = s_scale_to_hz(fb->scale, s0 + (s1 - s0) * (double) (row + 1) / h);
+
+	// Bin b's range starts at b + 1 times the bin width (see above).
+
+	*lo = fmax(*lo / hz - 1.0, 0.0);
+	*hi = fmin(*hi / hz - 1.0, (double) fb->bins);
+}
+
+/*!
+ * This function returns the bins a non-linear filterbank's row overlaps,
+ * given its range (see s_filterbank_edges). Rows always get at least one bin,
+ * as long as there are any.
+ *
+ * \param begin This will receive the first bin the row overlaps.
+ * \param end This will receive the bin one past the last bin it overlaps.
+ * \param fb The filterbank whose row is being computed.
+ * \param lo The bottom of the row's range, in bins.
+ * \param hi The top of the row's range, in bins.
+ */
+void s_filterbank_span(size_t *begin, size_t *end, const s_filterbank_t *fb,
+	double lo, double hi)
+{
+	if(fb->bins == 0)
+	{
+		*begin = 0;
+		*end = 0;
+		return;
+	}
+
+	*begin = (size_t) floor(lo);
+	*begin = *begin < fb->bins ? *begin : fb->bins - 1;
+
+	*end = (size_t) ceil(hi);
+	*end = *end < fb->bins ? *end : fb->bins;
+	*end = *end > *begin ? *end : *begin + 1;
+}
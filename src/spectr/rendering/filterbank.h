@@ -0,0 +1,39 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_RENDERING_FILTERBANK_H
+#define INCLUDE_SPECTR_RENDERING_FILTERBANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spectr/types.h"
+
+extern const char *s_scale_name(s_scale_type_t);
+extern s_scale_type_t s_scale_type_from_name(const char *);
+
+extern int s_init_filterbank(s_filterbank_t **, s_scale_type_t, size_t,
+	size_t, uint32_t);
+extern void s_free_filterbank(s_filterbank_t **);
+extern int s_get_filterbank(s_filterbank_t **, s_scale_type_t, size_t,
+	size_t, uint32_t);
+
+extern void s_filterbank_apply(float *, const s_filterbank_t *,
+	const s_dft_t *);
+
+#endif
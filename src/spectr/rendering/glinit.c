@@ -20,35 +20,49 @@
 
 #include <errno.h>
 #include <stdlib.h>
-#include <time.h>
-#include <sys/time.h>
-#include <math.h>
+#include <pthread.h>
 
 #ifdef SPECTR_DEBUG
 	#include <stdio.h>
 #endif
 
 #include "spectr/config.h"
-#include "spectr/constants.h"
+#include "spectr/defines.h"
+#include "spectr/rendering/colormap.h"
 
 int s_init_program();
+int s_init_colormap();
+void s_free_colormap();
 int s_set_uniforms();
 int s_init_vbo(s_vbo_t *, size_t);
+int s_init_cache(int, int);
+void s_free_cache();
+int s_render_cache();
+void s_present_cache();
+void s_handle_event_result(int);
+void s_window_refresh_callback(GLFWwindow *);
+void s_framebuffer_size_callback(GLFWwindow *, int, int);
+void s_key_callback(GLFWwindow *, int, int, int, int);
+void s_scroll_callback(GLFWwindow *, double, double);
 
 /*!
  * \brief This is the source code for our vertex shader.
  *
  * We load this shader into our program when initializing it, and then set its
  * resolution uniform based upon the size of the window we're doing 2D
- * rendering on.
+ * rendering on. The viewport uniform holds the pixel edges of the spectrogram
+ * area (left, top, right, bottom), which we use to compute texture
+ * coordinates for the spectrogram quad.
  */
 static const GLchar *s_vertex_shader_src = {
 	"#version 440\n"
 
 	"in vec3 position;\n"
 	"uniform vec2 resolution;\n"
+	"uniform vec4 viewport;\n"
 
 	"varying float magnitude;\n"
+	"varying vec2 texcoord;\n"
 
 	"void main()\n"
 	"{\n"
@@ -59,6 +73,10 @@ static const GLchar *s_vertex_shader_src = {
 		"\tvec2 zeroToTwo = zeroToOne * 2.0;\n"
 		"\tvec2 clipSpace = zeroToTwo - 1.0;\n"
 		"\tgl_Position = vec4(clipSpace * vec2(1.0, -1.0), 0.0, 1.0);\n"
+
+		"\ttexcoord = vec2((pixelrnd.x - viewport[0]) / "
+			"(viewport[2] - viewport[0]), (viewport[3] - "
+			"pixelrnd.y) / (viewport[3] - viewport[1]));\n"
 	"}\n"
 };
 
@@ -66,13 +84,25 @@ static const GLchar *s_vertex_shader_src = {
  * \brief This is the source code for our fragment shader.
  *
  * We load this shader into our program when initializing it, and then set its
- * uniform based upon what color we want to use for rendering.
+ * uniform based upon what color we want to use for rendering. Geometry with a
+ * negative Z component (our legend) is drawn in white; everything else
+ * samples the spectrogram's magnitude texture and looks its color up in our
+ * colormap texture: magnitudes from magnitudeFloor to magnitudeCeiling span
+ * the colormap, with gamma applied (see s_colormap_level). The spectrogram's
+ * texture is sampled scroll texels (as a fraction of its width) to the right,
+ * which lets a live spectrogram use its texture as a ring of columns.
  */
 static const GLchar *s_fragment_shader_src = {
 	"#version 440\n"
 
-	"uniform float maxMagnitude;\n"
+	"uniform float magnitudeFloor;\n"
+	"uniform float magnitudeCeiling;\n"
+	"uniform float gamma;\n"
+	"uniform float scroll;\n"
+	"uniform sampler2D spectrogram;\n"
+	"uniform sampler1D colormap;\n"
 	"varying float magnitude;\n"
+	"varying vec2 texcoord;\n"
 
 	"void main()\n"
 	"{\n"
@@ -82,34 +112,22 @@ static const GLchar *s_fragment_shader_src = {
 		"\t}\n"
 		"\telse\n"
 		"\t{\n"
-			"\t\tvec4 color;\n"
-
-			"\t\tvec4 black = vec4(0.0, 0.0, 0.0, 1.0);\n"
-			"\t\tvec4 blue = vec4(0.0, 0.0, 0.25, 1.0);\n"
-			"\t\tvec4 purple = vec4(0.5, 0.0, 0.5, 1.0);\n"
-			"\t\tvec4 red = vec4(1.0, 0.0, 0.0, 1.0);\n"
-			"\t\tvec4 yellow = vec4(1.0, 1.0, 0.0, 1.0);\n"
-			"\t\tvec4 white = vec4(1.0, 1.0, 1.0, 1.0);\n"
-
-			"\t\tfloat step1 = 0.0;\n"
-			"\t\tfloat step2 = maxMagnitude * 0.2;\n"
-			"\t\tfloat step3 = maxMagnitude * 0.4;\n"
-			"\t\tfloat step4 = maxMagnitude * 0.6;\n"
-			"\t\tfloat step5 = maxMagnitude * 0.8;\n"
-			"\t\tfloat step6 = maxMagnitude;\n"
-
-			"\t\tcolor = mix(black, blue, "
-				"smoothstep(step1, step2, magnitude));\n"
-			"\t\tcolor = mix(color, purple, "
-				"smoothstep(step2, step3, magnitude));\n"
-			"\t\tcolor = mix(color, red, "
-				"smoothstep(step3, step4, magnitude));\n"
-			"\t\tcolor = mix(color, yellow, "
-				"smoothstep(step4, step5, magnitude));\n"
-			"\t\tcolor = mix(color, white, "
-				"smoothstep(step5, step6, magnitude));\n"
-
-			"\t\tgl_FragColor = color;\n"
+			"\t\tfloat z = texture(spectrogram, vec2(texcoord.x + "
+				"scroll, texcoord.y)).r;\n"
+			"\t\tfloat range = magnitudeCeiling - "
+				"magnitudeFloor;\n"
+			"\t\tfloat t = 0.0;\n"
+
+			"\t\tif(range > 0.0)\n"
+				"\t\t\tt = pow(clamp((z - magnitudeFloor) / "
+					"range, 0.0, 1.0), gamma);\n"
+
+			// Sample between the first and last texels' centers.
+
+			"\t\tfloat n = float(textureSize(colormap, 0));\n"
+
+			"\t\tgl_FragColor = vec4(texture(colormap, "
+				"(t * (n - 1.0) + 0.5) / n).rgb, 1.0);\n"
 		"\t}\n"
 	"}\n"
 };
@@ -124,171 +142,470 @@ static GLuint s_program = 0;
  */
 static GLuint *s_vao;
 
+/*!
+ * \brief Our colormap's texture, which our fragment shader colors pixels from.
+ */
+static GLuint s_colormap_texture = 0;
+
+/*!
+ * \brief The handler which renders our scene and reacts to window events.
+ */
+static const s_gl_handler_t *s_handler = NULL;
+
+/*!
+ * \brief The first error returned by one of our handler's event callbacks.
+ */
+static int s_event_error = 0;
+
+/*!
+ * \brief The offscreen framebuffer our scene is rendered into.
+ */
+static GLuint s_cache_fbo = 0;
+
+/*!
+ * \brief The color texture attached to s_cache_fbo.
+ */
+static GLuint s_cache_texture = 0;
+
+/*!
+ * \brief The width of our scene (and of its cache), in window coordinates.
+ */
+static int s_scene_w = S_WINDOW_W;
+
+/*!
+ * \brief The height of our scene (and of its cache), in window coordinates.
+ */
+static int s_scene_h = S_WINDOW_H;
+
+/*!
+ * \brief Whether the scene needs to be rendered into the cache again.
+ */
+static int s_scene_dirty = 1;
+
+/*!
+ * \brief Whether the cached frame needs to be presented to the window.
+ */
+static int s_present_pending = 1;
+
+/*!
+ * \brief The window's current framebuffer width, in pixels.
+ */
+static int s_framebuffer_w = S_WINDOW_W;
+
+/*!
+ * \brief The window's current framebuffer height, in pixels.
+ */
+static int s_framebuffer_h = S_WINDOW_H;
+
+/*!
+ * \brief Whether our event loop is running, and can be woken by s_wake_gl.
+ */
+static int s_wakeable = 0;
+
+/*!
+ * \brief This guards s_wakeable, since s_wake_gl may be called from any thread.
+ */
+static pthread_mutex_t s_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*!
  * This is a utility function which initializes OpenGL in a way that it's ready
- * to render 2D graphics. We then call the given user-supplied function,
- * passing it the given STFT instance, to do the actual rendering.
+ * to render 2D graphics, and then runs our event loop using the given handler.
+ *
+ * The handler's render function draws the scene into an offscreen framebuffer,
+ * which is copied to the window whenever the window system tells us it has
+ * been exposed or resized. The scene is only rendered again when one of the
+ * handler's event functions reports that it has changed. In between, we block
+ * in glfwWaitEvents(), so an idle viewer uses no CPU or GPU time.
+ *
+ * The handler's resize function is called with the window's size before the
+ * scene is first rendered, and again each time the window is resized. Its
+ * update function (if any) is called each time the event loop wakes up, e.g.
+ * because another thread has called s_wake_gl. Its close function (if any)
+ * is called once the event loop has stopped, before the GL context is
+ * destroyed.
  *
  * NOTE: The projection we initialize is such that the origin (0,0) is in the
  * top-left corner, and the "largest" vertex that is on-screen will be
  * (width, height), in the bottom-right corner.
  *
- * \param fptr The function to call after initialization to do the rendering.
+ * \param handler The handler which renders our scene and handles events.
  * \param vbo The list of s_vbo_t objects to initialize.
  * \param vbol The number of objects in the VBO list.
- * \param stft The STFT instance to pass to the given function.
  * \return 0 on success, or an error number if something goes wrong.
  */
-int s_init_gl(int (*fptr)(const s_stft_t *, GLuint *),
-	s_vbo_t *vbo, size_t vbol, const s_stft_t *stft)
+int s_init_gl(const s_gl_handler_t *handler, s_vbo_t *vbo, size_t vbol)
 {
 	int r;
+	int ret = 0;
 	GLFWwindow *window;
 
-	double elapsed;
-	struct timeval t;
-	double sleep;
-	struct timespec sleepspec;
-	struct timespec sleeprem;
-
 	if(!glfwInit())
 		return -EINVAL;
 
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
 
 	window = glfwCreateWindow(S_WINDOW_W, S_WINDOW_H,
 		"Spectr", NULL, NULL);
 
 	if(!window)
 	{
-		glfwTerminate();
-		return -EINVAL;
+		ret = -EINVAL;
+		goto err_after_glfw_init;
 	}
 
 	glfwMakeContextCurrent(window);
 
+	s_handler = handler;
+	s_event_error = 0;
+
+	glfwGetWindowSize(window, &s_scene_w, &s_scene_h);
+	glfwGetFramebufferSize(window, &s_framebuffer_w, &s_framebuffer_h);
+
+	glfwSetWindowRefreshCallback(window, s_window_refresh_callback);
+	glfwSetFramebufferSizeCallback(window, s_framebuffer_size_callback);
+	glfwSetKeyCallback(window, s_key_callback);
+	glfwSetScrollCallback(window, s_scroll_callback);
+
 	r = s_init_program();
 
 	if(r < 0)
 	{
-		glfwTerminate();
-		return -EINVAL;
+		ret = -EINVAL;
+		goto err_after_window_alloc;
 	}
 
-	r = s_init_vbo(vbo, vbol);
+	r = s_init_colormap();
 
 	if(r < 0)
 	{
-		glfwTerminate();
-		return -EINVAL;
+		ret = r;
+		goto err_after_window_alloc;
 	}
 
-	while(!glfwWindowShouldClose(window))
+	r = s_init_vbo(vbo, vbol);
+
+	if(r < 0)
 	{
-		// Get the current time, so we can measure elapsed render time.
+		ret = -EINVAL;
+		goto err_after_colormap_alloc;
+	}
 
-		r = gettimeofday(&t, NULL);
+	r = s_init_cache(s_scene_w, s_scene_h);
 
-		if(r < 0)
-			return errno;
+	if(r < 0)
+	{
+		ret = r;
+		goto err_after_vao_alloc;
+	}
 
-		elapsed = t.tv_sec * ((double) S_SECOND_MICROSECONDS);
-		elapsed += t.tv_usec;
-		elapsed = -elapsed;
+	r = s_handler->resize(s_handler->ctx, s_scene_w, s_scene_h);
 
-		// Initialize the GL viewport.
+	if(r < 0)
+	{
+		ret = r;
+		goto err_after_cache_alloc;
+	}
+
+	pthread_mutex_lock(&s_wake_lock);
+	s_wakeable = 1;
+	pthread_mutex_unlock(&s_wake_lock);
 
-		glViewport(0, 0, S_WINDOW_W, S_WINDOW_H);
+	/*
+	 * Render the scene whenever it has changed, and present the cached
+	 * frame each time the window system asks for it.
+	 */
 
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+	s_scene_dirty = 1;
 
-		glUseProgram(s_program);
+	while(!glfwWindowShouldClose(window) && (s_event_error == 0))
+	{
+		if(s_handler->update != NULL)
+			s_handle_event_result(s_handler->update(s_handler->ctx));
 
-		r = s_set_uniforms();
+		if(s_event_error != 0)
+			break;
 
-		if(r < 0)
+		if(s_scene_dirty)
 		{
-			glfwTerminate();
-			return r;
-		}
+			r = s_render_cache();
 
-		// Call the user-provided rendering function.
+			if(r < 0)
+			{
+				ret = r;
+				goto err_after_cache_alloc;
+			}
 
-		r = fptr(stft, s_vao);
+			s_scene_dirty = 0;
+			s_present_pending = 1;
+		}
 
-		if(r < 0)
+		if(s_present_pending)
 		{
-			glfwTerminate();
-			return r;
+			s_present_cache();
+			glfwSwapBuffers(window);
+
+			s_present_pending = 0;
 		}
 
-		// End GL rendering, swap the buffer, and poll for events.
+		glfwWaitEvents();
+	}
+
+	ret = s_event_error;
+
+err_after_cache_alloc:
+	if(s_handler->close != NULL)
+		s_handler->close(s_handler->ctx);
+
+	pthread_mutex_lock(&s_wake_lock);
+	s_wakeable = 0;
+	pthread_mutex_unlock(&s_wake_lock);
+
+	s_free_cache();
+err_after_vao_alloc:
+	free(s_vao);
+	s_vao = NULL;
+err_after_colormap_alloc:
+	s_free_colormap();
+err_after_window_alloc:
+	glfwDestroyWindow(window);
+err_after_glfw_init:
+	glfwTerminate();
+
+	s_handler = NULL;
+
+	return ret;
+}
+
+/*!
+ * This function sets the magnitude our fragment shader maps onto the top of
+ * our colormap. Magnitudes above it are colored the same as it is.
+ *
+ * \param m The new ceiling magnitude value.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_set_magnitude_ceiling(GLfloat m)
+{
+	GLint uniform;
+
+	uniform = glGetUniformLocation(s_program, "magnitudeCeiling");
 
-		glUseProgram(0);
+	if(uniform == -1)
+		return 0;
 
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	glUniform1f(uniform, m);
 
-		// Compute the total elapsed time.
+	return 0;
+}
 
-		r = gettimeofday(&t, NULL);
+/*!
+ * This function sets the magnitude our fragment shader maps onto the bottom of
+ * our colormap. Magnitudes below it (and empty texels) are colored the same as
+ * it is.
+ *
+ * \param m The new floor magnitude value.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_set_magnitude_floor(GLfloat m)
+{
+	GLint uniform;
 
-		if(r < 0)
-			return errno;
+	uniform = glGetUniformLocation(s_program, "magnitudeFloor");
 
-		elapsed += t.tv_sec * ((double) S_SECOND_MICROSECONDS);
-		elapsed += t.tv_usec;
+	if(uniform == -1)
+		return 0;
 
-		// Sleep if our render time took less than 1 / FPS seconds.
+	glUniform1f(uniform, m);
 
-		sleep = ((double) S_SECOND_NANOSECONDS) /
-			((double) S_WINDOW_FPS);
+	return 0;
+}
 
-		sleep -= ((double) S_MICROSECOND_NANOSECONDS) * elapsed;
+/*!
+ * This function sets the gamma our fragment shader applies to each magnitude's
+ * position between the floor and the ceiling, before looking its color up.
+ * Values above 1 darken the quieter parts of the spectrogram.
+ *
+ * \param g The new gamma value. Must be positive.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_set_gamma(GLfloat g)
+{
+	GLint uniform;
 
-		if(sleep > 0.0)
-		{
-			sleepspec.tv_sec = 0.0;
-			sleepspec.tv_nsec = (long) floor(sleep);
+	if(g <= 0.0f)
+		return -EINVAL;
 
-			r = nanosleep(&sleepspec, &sleeprem);
+	uniform = glGetUniformLocation(s_program, "gamma");
 
-			if(r < 0)
-			{
-				glfwTerminate();
-				return errno;
-			}
-		}
-	}
+	if(uniform == -1)
+		return 0;
 
-	glfwTerminate();
+	glUniform1f(uniform, g);
 
 	return 0;
 }
 
 /*!
- * This function sets the maximum magnitude value our fragment shader will
- * account for. This determines how we will color points with a non-negative
- * Z component.
+ * This function sets how far our fragment shader scrolls the spectrogram's
+ * texture to the right, as a fraction of its width. The texture must wrap
+ * (GL_REPEAT) for this to be useful.
  *
- * \param m The new maximum magnitude value.
+ * \param s The new scroll offset.
  * \return 0 on success, or an error number if something goes wrong.
  */
-int s_set_max_magnitude(GLfloat m)
+int s_set_scroll(GLfloat s)
 {
 	GLint uniform;
 
-	uniform = glGetUniformLocation(s_program, "maxMagnitude");
+	uniform = glGetUniformLocation(s_program, "scroll");
 
 	if(uniform == -1)
 		return 0;
 
-	glUniform1f(uniform, m);
+	glUniform1f(uniform, s);
 
 	return 0;
 }
 
+/*!
+ * This function sets the area of the window the spectrogram is displayed in;
+ * our vertex shader uses it to map the spectrogram's texture onto its quad.
+ * The given values are the edges of the area's pixels, in window coordinates.
+ *
+ * \param left The left edge of the area.
+ * \param top The top edge of the area.
+ * \param right The right edge of the area.
+ * \param bottom The bottom edge of the area.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_set_viewport(GLfloat left, GLfloat top, GLfloat right, GLfloat bottom)
+{
+	GLint uniform;
+	GLfloat view[] = { left, top, right, bottom };
+
+	uniform = glGetUniformLocation(s_program, "viewport");
+
+	if(uniform == -1)
+		return 0;
+
+	glUniform4fv(uniform, 1, view);
+
+	return 0;
+}
+
+/*!
+ * This function creates a single-channel floating point texture from the given
+ * row-major grid of magnitudes. The caller is responsible for deleting the
+ * texture with glDeleteTextures when it is no longer needed.
+ *
+ * \param texture This will receive the new texture's name.
+ * \param data The texture's data, of w * h magnitudes.
+ * \param w The width of the texture, in texels.
+ * \param h The height of the texture, in texels.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_init_magnitude_texture(GLuint *texture, const GLfloat *data,
+	GLsizei w, GLsizei h)
+{
+	if(data == NULL)
+		return -EINVAL;
+
+	glGenTextures(1, texture);
+	glBindTexture(GL_TEXTURE_2D, *texture);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, sizeof(GLfloat));
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w, h, 0,
+		GL_RED, GL_FLOAT, data);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(glGetError() != GL_NO_ERROR)
+	{
+		glDeleteTextures(1, texture);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function replaces a single column of the given magnitude texture (see
+ * s_init_magnitude_texture) with the given h magnitudes, from the lowest row
+ * to the highest. Only that column is uploaded.
+ *
+ * \param texture The texture to update.
+ * \param x The column to replace.
+ * \param data The column's new magnitudes.
+ * \param h The height of the texture, in texels.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_update_magnitude_column(GLuint texture, GLint x, const GLfloat *data,
+	GLsizei h)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, sizeof(GLfloat));
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, 0, 1, h, GL_RED, GL_FLOAT, data);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(glGetError() != GL_NO_ERROR)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*!
+ * This function replaces the columns [x, x + w) of the given magnitude texture
+ * (see s_init_magnitude_texture) with the given magnitudes. The data is laid
+ * out like the texture itself: each row's values are stride texels apart, and
+ * rows are stored from the lowest to the highest. Only that region is
+ * uploaded.
+ *
+ * \param texture The texture to update.
+ * \param x The first column to replace.
+ * \param w The number of columns to replace.
+ * \param data The first new magnitude of the lowest row.
+ * \param stride The number of texels between the starts of adjacent rows.
+ * \param h The height of the texture, in texels.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_update_magnitude_columns(GLuint texture, GLint x, GLsizei w,
+	const GLfloat *data, GLsizei stride, GLsizei h)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, sizeof(GLfloat));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, 0, w, h, GL_RED, GL_FLOAT, data);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(glGetError() != GL_NO_ERROR)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*!
+ * This function wakes our event loop up from another thread, so our handler's
+ * update function is called. It does nothing if the event loop isn't running.
+ */
+void s_wake_gl()
+{
+	pthread_mutex_lock(&s_wake_lock);
+
+	if(s_wakeable)
+		glfwPostEmptyEvent();
+
+	pthread_mutex_unlock(&s_wake_lock);
+}
+
 /*!
  * This function initializes the OpenGL program we will link our shaders into
  * for rendering our spectrogram.
@@ -366,6 +683,52 @@ int s_init_program()
 	return 0;
 }
 
+/*!
+ * This function uploads our colormap (see s_colormap_table) into a 1D texture
+ * with S_COLORMAP_SIZE entries, which our fragment shader looks each pixel's
+ * color up in. The texture is filtered linearly, so the colors between its
+ * entries are blended just like the colormap's own colors are.
+ *
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_init_colormap()
+{
+	GLfloat table[S_COLORMAP_SIZE * 3];
+
+	s_colormap_table(table, S_COLORMAP_SIZE);
+
+	glGenTextures(1, &s_colormap_texture);
+	glBindTexture(GL_TEXTURE_1D, s_colormap_texture);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, sizeof(GLfloat));
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F, S_COLORMAP_SIZE, 0, GL_RGB,
+		GL_FLOAT, table);
+
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_1D, 0);
+
+	if(glGetError() != GL_NO_ERROR)
+	{
+		s_free_colormap();
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function releases the texture allocated by s_init_colormap.
+ */
+void s_free_colormap()
+{
+	glDeleteTextures(1, &s_colormap_texture);
+
+	s_colormap_texture = 0;
+}
+
 /*!
  * This function sets the uniforms used in our various shaders to the proper
  * default values so we can start rendering in 2D.
@@ -376,7 +739,8 @@ int s_set_uniforms()
 {
 	int r;
 	GLint resu;
-	GLfloat res[] = { S_WINDOW_W, S_WINDOW_H };
+	GLint texu;
+	GLfloat res[] = { (GLfloat) s_scene_w, (GLfloat) s_scene_h };
 
 	// Set our framebuffer resolution in our vertex shader.
 
@@ -387,9 +751,36 @@ int s_set_uniforms()
 
 	glUniform2fv(resu, 1, res);
 
-	// Set some default maximum magnitude.
+	// Set the texture units the spectrogram and our colormap are bound to.
+
+	texu = glGetUniformLocation(s_program, "spectrogram");
+
+	if(texu != -1)
+		glUniform1i(texu, 0);
+
+	texu = glGetUniformLocation(s_program, "colormap");
+
+	if(texu != -1)
+		glUniform1i(texu, 1);
+
+	// Set some default magnitude range, and don't scroll.
 
-	r = s_set_max_magnitude(0.0f);
+	r = s_set_magnitude_floor(0.0f);
+
+	if(r < 0)
+		return r;
+
+	r = s_set_magnitude_ceiling(0.0f);
+
+	if(r < 0)
+		return r;
+
+	r = s_set_gamma(1.0f);
+
+	if(r < 0)
+		return r;
+
+	r = s_set_scroll(0.0f);
 
 	if(r < 0)
 		return r;
@@ -446,3 +837,241 @@ int s_init_vbo(s_vbo_t *o, size_t l)
 
 	return 0;
 }
+
+/*!
+ * This function uploads the current contents of the given VBO's data to the
+ * GPU, after it has been changed. The VBO must have been initialized by
+ * s_init_gl already.
+ *
+ * \param o The s_vbo_t structure to upload.
+ */
+void s_update_vbo(const s_vbo_t *o)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, o->obj);
+	glBufferData(GL_ARRAY_BUFFER, o->length * sizeof(GLfloat),
+		o->data, o->usage);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*!
+ * This function allocates the offscreen framebuffer and color texture which
+ * cache our rendered scene between presentations.
+ *
+ * \param w The width of the cache, in pixels.
+ * \param h The height of the cache, in pixels.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_init_cache(int w, int h)
+{
+	glGenTextures(1, &s_cache_texture);
+	glBindTexture(GL_TEXTURE_2D, s_cache_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &s_cache_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, s_cache_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, s_cache_texture, 0);
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+		GL_FRAMEBUFFER_COMPLETE)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		s_free_cache();
+		return -EINVAL;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return 0;
+}
+
+/*!
+ * This function releases the framebuffer and texture allocated by
+ * s_init_cache.
+ */
+void s_free_cache()
+{
+	glDeleteFramebuffers(1, &s_cache_fbo);
+	glDeleteTextures(1, &s_cache_texture);
+
+	s_cache_fbo = 0;
+	s_cache_texture = 0;
+}
+
+/*!
+ * This function renders our scene into the cache, using our handler's render
+ * function.
+ *
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_render_cache()
+{
+	int r;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, s_cache_fbo);
+	glViewport(0, 0, s_scene_w, s_scene_h);
+
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glUseProgram(s_program);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_1D, s_colormap_texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	r = s_set_uniforms();
+
+	if(r >= 0)
+		r = s_handler->render(s_handler->ctx, s_vao);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_1D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUseProgram(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return r;
+}
+
+/*!
+ * This function copies our cached scene to the window's back buffer, scaling
+ * it to the window's current framebuffer size.
+ */
+void s_present_cache()
+{
+	glViewport(0, 0, s_framebuffer_w, s_framebuffer_h);
+
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, s_cache_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+	glBlitFramebuffer(0, 0, s_scene_w, s_scene_h,
+		0, 0, s_framebuffer_w, s_framebuffer_h,
+		GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+/*!
+ * This function records the result of one of our handler's event functions: a
+ * positive value means the scene has changed and must be rendered again, and
+ * a negative value is an error, which stops our event loop.
+ *
+ * \param r The value returned by the handler.
+ */
+void s_handle_event_result(int r)
+{
+	if(r < 0)
+	{
+		if(s_event_error == 0)
+			s_event_error = r;
+	}
+	else if(r > 0)
+	{
+		s_scene_dirty = 1;
+	}
+}
+
+/*!
+ * This is our GLFW window refresh callback, called when some part of the window
+ * has been damaged (e.g., exposed after being covered) and needs redrawing.
+ *
+ * \param window The window which needs to be refreshed.
+ */
+void s_window_refresh_callback(GLFWwindow *UNUSED(window))
+{
+	s_present_pending = 1;
+}
+
+/*!
+ * This is our GLFW framebuffer size callback, called when the size of the
+ * window's framebuffer changes. If the window's size changed too, we resize
+ * our cache and let our handler lay the scene out again.
+ *
+ * \param window The window whose framebuffer has been resized.
+ * \param w The new framebuffer width, in pixels.
+ * \param h The new framebuffer height, in pixels.
+ */
+void s_framebuffer_size_callback(GLFWwindow *window, int w, int h)
+{
+	int r;
+	int sw;
+	int sh;
+
+	s_framebuffer_w = w;
+	s_framebuffer_h = h;
+
+	s_present_pending = 1;
+
+	glfwGetWindowSize(window, &sw, &sh);
+
+	if(((sw == s_scene_w) && (sh == s_scene_h)) || (sw < 1) || (sh < 1))
+		return;
+
+	s_scene_w = sw;
+	s_scene_h = sh;
+
+	s_free_cache();
+
+	r = s_init_cache(s_scene_w, s_scene_h);
+
+	if(r < 0)
+	{
+		s_handle_event_result(r);
+		return;
+	}
+
+	s_handle_event_result(s_handler->resize(s_handler->ctx, sw, sh));
+	s_scene_dirty = 1;
+}
+
+/*!
+ * This is our GLFW key callback. Escape closes the window; every other key
+ * press is passed along to our handler.
+ *
+ * \param window The window which received the key event.
+ * \param key The GLFW key code of the key.
+ * \param scancode The platform-specific scancode of the key.
+ * \param action Whether the key was pressed, repeated or released.
+ * \param mods The modifier keys which were held down.
+ */
+void s_key_callback(GLFWwindow *window, int key, int UNUSED(scancode),
+	int action, int mods)
+{
+	if(action == GLFW_RELEASE)
+		return;
+
+	if(key == GLFW_KEY_ESCAPE)
+	{
+		glfwSetWindowShouldClose(window, GL_TRUE);
+		return;
+	}
+
+	s_handle_event_result(s_handler->key(s_handler->ctx, key, mods));
+}
+
+/*!
+ * This is our GLFW scroll callback, which passes the scroll offset along to
+ * our handler, together with the cursor's position.
+ *
+ * \param window The window which received the scroll event.
+ * \param xoff The horizontal scroll offset.
+ * \param yoff The vertical scroll offset.
+ */
+void s_scroll_callback(GLFWwindow *window, double UNUSED(xoff), double yoff)
+{
+	double x;
+	double y;
+
+	glfwGetCursorPos(window, &x, &y);
+
+	s_handle_event_result(s_handler->scroll(s_handler->ctx, x, yoff));
+}
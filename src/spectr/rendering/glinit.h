@@ -24,8 +24,19 @@
 
 #include "spectr/types.h"
 
-extern int s_init_gl(int (*)(const s_stft_t *, GLuint *),
-	s_vbo_t *, size_t, const s_stft_t *);
-extern int s_set_max_magnitude(GLfloat);
+extern int s_init_gl(const s_gl_handler_t *, s_vbo_t *, size_t);
+extern int s_set_magnitude_floor(GLfloat);
+extern int s_set_magnitude_ceiling(GLfloat);
+extern int s_set_gamma(GLfloat);
+extern int s_set_scroll(GLfloat);
+extern int s_set_viewport(GLfloat, GLfloat, GLfloat, GLfloat);
+extern void s_update_vbo(const s_vbo_t *);
+extern int s_init_magnitude_texture(GLuint *, const GLfloat *,
+	GLsizei, GLsizei);
+extern int s_update_magnitude_column(GLuint, GLint, const GLfloat *,
+	GLsizei);
+extern int s_update_magnitude_columns(GLuint, GLint, GLsizei,
+	const GLfloat *, GLsizei, GLsizei);
+extern void s_wake_gl();
 
 #endif
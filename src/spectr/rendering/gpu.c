@@ -0,0 +1,846 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gpu.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SPECTR_DEBUG
+	#include <stdio.h>
+#endif
+
+#include "spectr/config.h"
+#include "spectr/defines.h"
+#include "spectr/decoding/raw.h"
+#include "spectr/rendering/filterbank.h"
+#include "spectr/transform/attr.h"
+#include "spectr/transform/window.h"
+#include "spectr/util/math.h"
+#include "spectr/util/profile.h"
+
+int s_gpu_compile(GLuint *, const GLchar *);
+int s_gpu_upload_samples(s_gpu_stft_t *, const s_raw_audio_t *);
+int s_gpu_upload_frame_tables(s_gpu_stft_t *, size_t, size_t, size_t,
+	size_t);
+int s_gpu_upload_window(s_gpu_stft_t *, const s_window_t *);
+int s_gpu_upload_filterbank(s_gpu_stft_t *);
+void s_gpu_upload(const s_gpu_stft_t *, s_gpu_buffer_t, const void *, size_t);
+void s_gpu_bind(const s_gpu_stft_t *, const s_gpu_buffer_t *, size_t);
+int s_gpu_init_texture(GLuint *, size_t, size_t);
+float s_gpu_unordered(GLuint);
+
+/*!
+ * \brief This is the source code for the compute shader which transforms each
+ * frame of a spectrogram.
+ *
+ * Each workgroup transforms one frame, of size samples starting at the offset
+ * given for it in frames. The windowed samples are loaded into shared memory
+ * in bit-reversed order, transformed in place with one radix-2 stage per bit
+ * (with the twiddle factors for the full size), and then the magnitude of each
+ * bin (skipping the DC bin and the Nyquist bin) is stored.
+ */
+static const GLchar *s_gpu_fft_shader_src = {
+	"#version 440\n"
+
+	"layout(local_size_x = " S_STRINGIFY(S_GPU_FFT_THREADS) ") in;\n"
+
+	"layout(std430, binding = 0) readonly buffer Samples "
+		"{ float samples[]; };\n"
+	"layout(std430, binding = 1) readonly buffer Window "
+		"{ float window[]; };\n"
+	"layout(std430, binding = 2) readonly buffer Twiddle "
+		"{ vec2 twiddle[]; };\n"
+	"layout(std430, binding = 3) readonly buffer Frames "
+		"{ uint frames[]; };\n"
+	"layout(std430, binding = 4) writeonly buffer Magnitudes "
+		"{ float magnitudes[]; };\n"
+
+	"uniform uint size;\n"
+	"uniform uint bits;\n"
+	"uniform uint total;\n"
+
+	"shared vec2 data[" S_STRINGIFY(S_GPU_MAX_WINDOW) "];\n"
+
+	"void main()\n"
+	"{\n"
+		"\tuint frame = gl_WorkGroupID.x;\n"
+		"\tuint offset = frames[frame];\n"
+		"\tuint bins = size / 2u - 1u;\n"
+		"\tuint i;\n"
+		"\tuint span;\n"
+
+		"\tfor(i = gl_LocalInvocationID.x; i < size; "
+			"i += gl_WorkGroupSize.x)\n"
+		"\t{\n"
+			"\t\tfloat x = i < total - offset ? "
+				"samples[offset + i] * window[i] : 0.0;\n"
+			"\t\tdata[bitfieldReverse(i) >> (32u - bits)] = "
+				"vec2(x, 0.0);\n"
+		"\t}\n"
+
+		"\tmemoryBarrierShared();\n"
+		"\tbarrier();\n"
+
+		"\tfor(span = 1u; span < size; span <<= 1)\n"
+		"\t{\n"
+			"\t\tfor(i = gl_LocalInvocationID.x; i < size / 2u; "
+				"i += gl_WorkGroupSize.x)\n"
+			"\t\t{\n"
+				"\t\t\tuint k = i & (span - 1u);\n"
+				"\t\t\tuint a = ((i - k) << 1) + k;\n"
+				"\t\t\tvec2 w = twiddle[k * (size / (span << 1))];\n"
+				"\t\t\tvec2 u = data[a];\n"
+				"\t\t\tvec2 v = data[a + span];\n"
+				"\t\t\tvec2 t = vec2(v.x * w.x - v.y * w.y, "
+					"v.x * w.y + v.y * w.x);\n"
+				"\t\t\tdata[a] = u + t;\n"
+				"\t\t\tdata[a + span] = u - t;\n"
+			"\t\t}\n"
+
+			"\t\tmemoryBarrierShared();\n"
+			"\t\tbarrier();\n"
+		"\t}\n"
+
+		"\tfor(i = gl_LocalInvocationID.x; i < bins; "
+			"i += gl_WorkGroupSize.x)\n"
+		"\t{\n"
+			"\t\tmagnitudes[frame * bins + i] = length(data[i + 1u]);\n"
+		"\t}\n"
+	"}\n"
+};
+
+/*!
+ * \brief This is the source code for the compute shader which maps the
+ * transformed frames onto a spectrogram's pixels.
+ *
+ * Each invocation computes one pixel: the average, over the frames in its
+ * column (columns[x] through columns[x + 1] - 1), of the weighted average of
+ * the base-10 log-magnitudes of its row's bins (see s_filterbank_t). As on the
+ * CPU, bins whose log-magnitude isn't finite are skipped, and pixels without
+ * any values are -FLT_MAX (see s_spectrogram_texels). The pixel is stored in
+ * the spectrogram image, and the range of the pixels with values is
+ * accumulated in range, as unsigned integers which sort in the same order as
+ * the values do.
+ */
+static const GLchar *s_gpu_filter_shader_src = {
+	"#version 440\n"
+
+	"layout(local_size_x = " S_STRINGIFY(S_GPU_TILE) ", "
+		"local_size_y = " S_STRINGIFY(S_GPU_TILE) ") in;\n"
+
+	"layout(std430, binding = 0) readonly buffer Magnitudes "
+		"{ float magnitudes[]; };\n"
+	"layout(std430, binding = 1) readonly buffer Columns "
+		"{ uint columns[]; };\n"
+	"layout(std430, binding = 2) readonly buffer First "
+		"{ uint first[]; };\n"
+	"layout(std430, binding = 3) readonly buffer Offset "
+		"{ uint offset[]; };\n"
+	"layout(std430, binding = 4) readonly buffer Weight "
+		"{ float weight[]; };\n"
+	"layout(std430, binding = 5) buffer Range { uint range[]; };\n"
+
+	"layout(r32f, binding = 0) writeonly uniform image2D spectrogram;\n"
+
+	"uniform uint bins;\n"
+	"uniform uvec2 size;\n"
+
+	"uint ordered(float f)\n"
+	"{\n"
+		"\tuint u = floatBitsToUint(f);\n"
+		"\treturn (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;\n"
+	"}\n"
+
+	"void main()\n"
+	"{\n"
+		"\tuvec2 p = gl_GlobalInvocationID.xy;\n"
+		"\tfloat sum = 0.0;\n"
+		"\tuint count = 0u;\n"
+		"\tuint f;\n"
+		"\tuint k;\n"
+
+		"\tif((p.x >= size.x) || (p.y >= size.y))\n"
+			"\t\treturn;\n"
+
+		"\tfor(f = columns[p.x]; f < columns[p.x + 1u]; ++f)\n"
+		"\t{\n"
+			"\t\tfloat rsum = 0.0;\n"
+			"\t\tfloat total = 0.0;\n"
+			"\t\tuint bin = f * bins + first[p.y];\n"
+
+			"\t\tfor(k = offset[p.y]; k < offset[p.y + 1u]; "
+				"++k, ++bin)\n"
+			"\t\t{\n"
+				"\t\t\tfloat m = magnitudes[bin];\n"
+
+				"\t\t\tif(!(m > 0.0) || isinf(m))\n"
+					"\t\t\t\tcontinue;\n"
+
+				"\t\t\trsum += weight[k] * log2(m) * "
+					"0.30102999566;\n"
+				"\t\t\ttotal += weight[k];\n"
+			"\t\t}\n"
+
+			"\t\tif(total > 0.0)\n"
+			"\t\t{\n"
+				"\t\t\tsum += rsum / total;\n"
+				"\t\t\t++count;\n"
+			"\t\t}\n"
+		"\t}\n"
+
+		"\tif(count == 0u)\n"
+		"\t{\n"
+			"\t\timageStore(spectrogram, ivec2(p), "
+				"vec4(-3.402823466e38, 0.0, 0.0, 1.0));\n"
+			"\t\treturn;\n"
+		"\t}\n"
+
+		"\tsum /= float(count);\n"
+
+		"\timageStore(spectrogram, ivec2(p), vec4(sum, 0.0, 0.0, 1.0));\n"
+
+		"\tatomicMin(range[0], ordered(sum));\n"
+		"\tatomicMax(range[1], ordered(sum));\n"
+	"}\n"
+};
+
+/*!
+ * \brief The buffers bound to s_gpu_fft_shader_src's binding points, in order.
+ */
+static const s_gpu_buffer_t s_gpu_fft_buffers[] = {
+	GPU_BUFFER_SAMPLES,
+	GPU_BUFFER_WINDOW,
+	GPU_BUFFER_TWIDDLE,
+	GPU_BUFFER_FRAMES,
+	GPU_BUFFER_MAGNITUDES
+};
+
+/*!
+ * \brief The buffers bound to s_gpu_filter_shader_src's binding points, in
+ * order.
+ */
+static const s_gpu_buffer_t s_gpu_filter_buffers[] = {
+	GPU_BUFFER_MAGNITUDES,
+	GPU_BUFFER_COLUMNS,
+	GPU_BUFFER_FIRST,
+	GPU_BUFFER_OFFSET,
+	GPU_BUFFER_WEIGHT,
+	GPU_BUFFER_RANGE
+};
+
+/*!
+ * This function initializes (allocates) a s_gpu_stft_t variable for the given
+ * raw audio, compiling our compute shaders and uploading the audio's mono
+ * samples once. This must be called with a GL context current, which every
+ * later call must use as well. If the pointer is non-NULL, we will not
+ * allocate a new value on top of it.
+ *
+ * \param gpu The s_gpu_stft_t to allocate.
+ * \param raw The raw audio to upload.
+ * \return 0 on success, -ENOTSUP if the GL context doesn't support compute
+ * shaders, -E2BIG if the audio is too long to upload, or another error number.
+ */
+int s_init_gpu_stft(s_gpu_stft_t **gpu, const s_raw_audio_t *raw)
+{
+	int r;
+	GLint major = 0;
+	GLint minor = 0;
+	GLint64 limit = 0;
+
+	if(*gpu != NULL)
+		return -EINVAL;
+
+	// Compute shaders and shader storage buffers need OpenGL 4.3.
+
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	if((major < 4) || ((major == 4) && (minor < 3)))
+		return -ENOTSUP;
+
+	glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &limit);
+
+	if((raw->samples_length > UINT32_MAX) || (limit < 0) ||
+		((uint64_t) raw->samples_length * sizeof(GLfloat) >
+		(uint64_t) limit))
+	{
+		return -E2BIG;
+	}
+
+	*gpu = calloc(1, sizeof(s_gpu_stft_t));
+
+	if(*gpu == NULL)
+		return -ENOMEM;
+
+	(*gpu)->samples_length = raw->samples_length;
+	(*gpu)->sample_rate = raw->stat.sample_rate;
+	(*gpu)->filterbank = NULL;
+
+	glGenBuffers(GPU_BUFFER_INVALID, (*gpu)->buffers);
+
+	r = s_gpu_compile(&((*gpu)->fft_program), s_gpu_fft_shader_src);
+
+	if(r >= 0)
+	{
+		r = s_gpu_compile(&((*gpu)->filter_program),
+			s_gpu_filter_shader_src);
+	}
+
+	if(r >= 0)
+		r = s_gpu_upload_samples(*gpu, raw);
+
+	if(r < 0)
+		s_free_gpu_stft(gpu);
+
+	return r;
+}
+
+/*!
+ * This function frees the given s_gpu_stft_t structure, deleting its GL
+ * objects, so the GL context it was created in must still be current. Note
+ * that this function is safe against double-frees.
+ *
+ * \param gpu The s_gpu_stft_t to free.
+ */
+void s_free_gpu_stft(s_gpu_stft_t **gpu)
+{
+	if(*gpu == NULL)
+		return;
+
+	glDeleteBuffers(GPU_BUFFER_INVALID, (*gpu)->buffers);
+
+	if((*gpu)->fft_program != 0)
+		glDeleteProgram((*gpu)->fft_program);
+
+	if((*gpu)->filter_program != 0)
+		glDeleteProgram((*gpu)->filter_program);
+
+	s_free_filterbank(&((*gpu)->filterbank));
+
+	free(*gpu);
+	*gpu = NULL;
+}
+
+/*!
+ * This function computes a w x h spectrogram of only the samples [begin, end)
+ * of the audio uploaded to the GPU, straight into a new single-channel floating
+ * point texture: its frames are transformed and mapped onto its pixels by our
+ * compute shaders, and the magnitudes never leave the GPU.
+ *
+ * The frames are chosen the same way s_spectrogram_from_range chooses them,
+ * and each texel is the value s_spectrogram_value would return for its pixel
+ * (computed in single precision), or -FLT_MAX if the pixel has no values, as
+ * in s_spectrogram_texels. Only the range of those values is read back, so the
+ * caller can color them (see s_spectrogram_range).
+ *
+ * \param gpu The GPU STFT to use.
+ * \param texture This will receive the new texture. If it already holds one,
+ * that texture is deleted first.
+ * \param min This will receive the minimum value.
+ * \param max This will receive the maximum value.
+ * \param begin The offset of the first sample to include.
+ * \param end The offset one past the last sample to include.
+ * \param w The width of the spectrogram, in pixels.
+ * \param h The height of the spectrogram, in pixels.
+ * \param scale The scale of the spectrogram's frequency axis.
+ * \param fn The window function to use for the STFT.
+ * \return 0 on success, -E2BIG if the spectrogram is too large for us to
+ * compute on the GPU, or another error number.
+ */
+int s_gpu_spectrogram(s_gpu_stft_t *gpu, GLuint *texture, float *min,
+	float *max, size_t begin, size_t end, size_t w, size_t h,
+	s_scale_type_t scale, s_window_type_t fn)
+{
+	int r;
+	size_t window;
+	size_t per;
+	size_t n;
+	size_t bins;
+	GLuint bits;
+	GLint groups = 0;
+	GLint program = 0;
+	GLint64 limit = 0;
+	GLuint range[2] = { 0xFFFFFFFFu, 0u };
+	const s_window_t *coefficients = NULL;
+	double start = s_profile_begin();
+
+	if((w < 1) || (h < 1) || (end <= begin) || (end > gpu->samples_length))
+		return -EINVAL;
+
+	// Pick the same window size and number of frames as on the CPU.
+
+	r = s_get_window_size(&window, w, h, end - begin);
+
+	if(r < 0)
+		return r;
+
+	per = s_get_column_frames(window, w, end - begin);
+	n = w * per;
+	bins = window / 2 - 1;
+
+	for(bits = 0; ((size_t) 1 << bits) < window; ++bits)
+		;
+
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &groups);
+	glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &limit);
+
+	if((window > S_GPU_MAX_WINDOW) || (groups < 0) ||
+		(n > (size_t) groups) || (limit < 0) ||
+		((uint64_t) n * bins * sizeof(GLfloat) > (uint64_t) limit))
+	{
+		return -E2BIG;
+	}
+
+	r = s_get_window(&coefficients, fn, window);
+
+	if(r < 0)
+		return r;
+
+	r = s_get_filterbank(&(gpu->filterbank), scale, bins, h,
+		gpu->sample_rate);
+
+	if(r < 0)
+		return r;
+
+	// Upload everything the shaders need to know about this spectrogram.
+
+	r = s_gpu_upload_frame_tables(gpu, begin, end - begin, n, w);
+
+	if(r >= 0)
+		r = s_gpu_upload_window(gpu, coefficients);
+
+	if(r >= 0)
+		r = s_gpu_upload_filterbank(gpu);
+
+	if(r < 0)
+		return r;
+
+	s_gpu_upload(gpu, GPU_BUFFER_MAGNITUDES, NULL,
+		n * bins * sizeof(GLfloat));
+	s_gpu_upload(gpu, GPU_BUFFER_RANGE, range, sizeof(range));
+
+	r = s_gpu_init_texture(texture, w, h);
+
+	if(r < 0)
+		return r;
+
+	// Transform each frame, and then map the frames onto the texture.
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+	glUseProgram(gpu->fft_program);
+	s_gpu_bind(gpu, s_gpu_fft_buffers,
+		sizeof(s_gpu_fft_buffers) / sizeof(s_gpu_buffer_t));
+
+	glUniform1ui(glGetUniformLocation(gpu->fft_program, "size"),
+		(GLuint) window);
+	glUniform1ui(glGetUniformLocation(gpu->fft_program, "bits"), bits);
+	glUniform1ui(glGetUniformLocation(gpu->fft_program, "total"),
+		(GLuint) gpu->samples_length);
+
+	glDispatchCompute((GLuint) n, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUseProgram(gpu->filter_program);
+	s_gpu_bind(gpu, s_gpu_filter_buffers,
+		sizeof(s_gpu_filter_buffers) / sizeof(s_gpu_buffer_t));
+	glBindImageTexture(0, *texture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+		GL_R32F);
+
+	glUniform1ui(glGetUniformLocation(gpu->filter_program, "bins"),
+		(GLuint) bins);
+	glUniform2ui(glGetUniformLocation(gpu->filter_program, "size"),
+		(GLuint) w, (GLuint) h);
+
+	glDispatchCompute((GLuint) ((w + S_GPU_TILE - 1) / S_GPU_TILE),
+		(GLuint) ((h + S_GPU_TILE - 1) / S_GPU_TILE), 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+		GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glUseProgram((GLuint) program);
+
+	// Read back the range of the values (which waits for the shaders).
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER,
+		gpu->buffers[GPU_BUFFER_RANGE]);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(range), range);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if(glGetError() != GL_NO_ERROR)
+	{
+		glDeleteTextures(1, texture);
+		*texture = 0;
+
+		return -EINVAL;
+	}
+
+	/*
+	 * Both ends of the range start out at the opposite extreme of the
+	 * ordered values, so if no pixel had a value they are still there, and
+	 * both ends of the range are 0. As in s_spectrogram_range, the maximum
+	 * never goes below zero.
+	 */
+
+	if((range[0] == 0xFFFFFFFFu) || (range[1] == 0u))
+	{
+		*min = 0.0f;
+		*max = 0.0f;
+	}
+	else
+	{
+		*min = s_gpu_unordered(range[0]);
+		*max = fmaxf(s_gpu_unordered(range[1]), 0.0f);
+	}
+
+	s_profile_count(COUNTER_FRAMES, n);
+	s_profile_end(STAGE_STFT, start);
+
+	return 0;
+}
+
+/*!
+ * This function compiles the given compute shader, and links it into a new
+ * program on its own.
+ *
+ * \param program This will receive the new program.
+ * \param src The source code of the compute shader.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_gpu_compile(GLuint *program, const GLchar *src)
+{
+	GLint status;
+	GLuint shader;
+
+#ifdef SPECTR_DEBUG
+	GLchar buf[8192];
+	GLsizei bufl;
+#endif
+
+	shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader, 1, &src, NULL);
+	glCompileShader(shader);
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if(status == GL_FALSE)
+	{
+#ifdef SPECTR_DEBUG
+		glGetShaderInfoLog(shader, 8192, &bufl, buf);
+		printf("%s\n", buf);
+#endif
+
+		glDeleteShader(shader);
+		return -EINVAL;
+	}
+
+	*program = glCreateProgram();
+
+	glAttachShader(*program, shader);
+	glLinkProgram(*program);
+	glDetachShader(*program, shader);
+	glDeleteShader(shader);
+
+	glGetProgramiv(*program, GL_LINK_STATUS, &status);
+
+	if(status == GL_FALSE)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*!
+ * This function uploads the mono samples of the given raw audio to the GPU, as
+ * single-precision floats. The samples are converted and uploaded a block at a
+ * time, so we never hold a second copy of the whole track in memory.
+ *
+ * \param gpu The GPU STFT to upload the samples to.
+ * \param raw The raw audio to upload.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_gpu_upload_samples(s_gpu_stft_t *gpu, const s_raw_audio_t *raw)
+{
+	size_t o;
+	size_t l;
+	float *block;
+
+	block = malloc(S_GPU_UPLOAD_SAMPLES * sizeof(float));
+
+	if(block == NULL)
+		return -ENOMEM;
+
+	s_gpu_upload(gpu, GPU_BUFFER_SAMPLES, NULL,
+		raw->samples_length * sizeof(GLfloat));
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER,
+		gpu->buffers[GPU_BUFFER_SAMPLES]);
+
+	for(o = 0; o < raw->samples_length; o += l)
+	{
+		l = raw->samples_length - o;
+		l = l < S_GPU_UPLOAD_SAMPLES ? l : S_GPU_UPLOAD_SAMPLES;
+
+		s_load_mono_samples_f(block, raw, o, l);
+
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+			(GLintptr) (o * sizeof(GLfloat)),
+			(GLsizeiptr) (l * sizeof(GLfloat)), block);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	free(block);
+
+	if(glGetError() != GL_NO_ERROR)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*!
+ * This function uploads the offset of each of the n frames of a spectrogram w
+ * pixels wide, and the index of the first frame in each of its columns
+ * (followed by n). Frame i starts at sample begin + (i * span) / n, and is in
+ * the column s_spectrogram_add would put it in.
+ *
+ * \param gpu The GPU STFT to upload the tables to.
+ * \param begin The offset of the first frame.
+ * \param span The number of samples the frames' offsets are spread over.
+ * \param n The number of frames.
+ * \param w The width of the spectrogram, in pixels.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_gpu_upload_frame_tables(s_gpu_stft_t *gpu, size_t begin, size_t span,
+	size_t n, size_t w)
+{
+	size_t i;
+	size_t col;
+	size_t next = 0;
+	double x;
+	GLuint *frames;
+	GLuint *columns;
+
+	frames = malloc((n + w + 1) * sizeof(GLuint));
+
+	if(frames == NULL)
+		return -ENOMEM;
+
+	columns = frames + n;
+
+	for(i = 0; i < n; ++i)
+	{
+		frames[i] = (GLuint) (begin + (i * span) / n);
+
+		x = rint(s_scale(0, n, 0, w - 1, i));
+		x = fmin(fmax(x, 0.0), (double) (w - 1));
+
+		for(col = (size_t) x; next <= col; ++next)
+			columns[next] = (GLuint) i;
+	}
+
+	for(; next <= w; ++next)
+		columns[next] = (GLuint) n;
+
+	s_gpu_upload(gpu, GPU_BUFFER_FRAMES, frames, n * sizeof(GLuint));
+	s_gpu_upload(gpu, GPU_BUFFER_COLUMNS, columns,
+		(w + 1) * sizeof(GLuint));
+
+	free(frames);
+
+	return 0;
+}
+
+/*!
+ * This function uploads the coefficients of the given window function, and
+ * the twiddle factors of an FFT of the same length.
+ *
+ * \param gpu The GPU STFT to upload the window to.
+ * \param window The window function to upload.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_gpu_upload_window(s_gpu_stft_t *gpu, const s_window_t *window)
+{
+	size_t k;
+	size_t l = window->length;
+	GLfloat *twiddle;
+
+	twiddle = malloc(l * sizeof(GLfloat));
+
+	if(twiddle == NULL)
+		return -ENOMEM;
+
+	for(k = 0; k < l / 2; ++k)
+	{
+		twiddle[2 * k] = (GLfloat) cos(
+			-2.0 * M_PI * ((double) k) / ((double) l));
+		twiddle[2 * k + 1] = (GLfloat) sin(
+			-2.0 * M_PI * ((double) k) / ((double) l));
+	}
+
+	s_gpu_upload(gpu, GPU_BUFFER_WINDOW, window->fcoefficients,
+		l * sizeof(GLfloat));
+	s_gpu_upload(gpu, GPU_BUFFER_TWIDDLE, twiddle, l * sizeof(GLfloat));
+
+	free(twiddle);
+
+	return 0;
+}
+
+/*!
+ * This function uploads our filterbank (see s_filterbank_t), converting its
+ * indices to unsigned integers and its weights to single precision.
+ *
+ * \param gpu The GPU STFT whose filterbank should be uploaded.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_gpu_upload_filterbank(s_gpu_stft_t *gpu)
+{
+	size_t i;
+	size_t h = gpu->filterbank->height;
+	size_t weights = gpu->filterbank->offset[h];
+	size_t l = weights > h + 1 ? weights : h + 1;
+	GLuint *indices;
+	GLfloat *values;
+
+	indices = malloc(l * sizeof(GLuint));
+	values = malloc(l * sizeof(GLfloat));
+
+	if((indices == NULL) || (values == NULL))
+	{
+		free(indices);
+		free(values);
+		return -ENOMEM;
+	}
+
+	for(i = 0; i < h; ++i)
+		indices[i] = (GLuint) gpu->filterbank->first[i];
+
+	s_gpu_upload(gpu, GPU_BUFFER_FIRST, indices, h * sizeof(GLuint));
+
+	for(i = 0; i <= h; ++i)
+		indices[i] = (GLuint) gpu->filterbank->offset[i];
+
+	s_gpu_upload(gpu, GPU_BUFFER_OFFSET, indices, (h + 1) * sizeof(GLuint));
+
+	for(i = 0; i < weights; ++i)
+		values[i] = (GLfloat) gpu->filterbank->weight[i];
+
+	// Empty buffers can't be bound, so there is always at least one weight.
+
+	s_gpu_upload(gpu, GPU_BUFFER_WEIGHT, values,
+		(weights > 0 ? weights : 1) * sizeof(GLfloat));
+
+	free(indices);
+	free(values);
+
+	return 0;
+}
+
+/*!
+ * This function replaces the contents of one of our shader storage buffers.
+ *
+ * \param gpu The GPU STFT whose buffer should be replaced.
+ * \param buffer The buffer to replace.
+ * \param data The buffer's new contents, or NULL to leave it uninitialized.
+ * \param size The buffer's new size, in bytes.
+ */
+void s_gpu_upload(const s_gpu_stft_t *gpu, s_gpu_buffer_t buffer,
+	const void *data, size_t size)
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu->buffers[buffer]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) size, data,
+		GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/*!
+ * This function binds the given list of our shader storage buffers to the
+ * binding points 0 through l - 1, in order.
+ *
+ * \param gpu The GPU STFT whose buffers should be bound.
+ * \param buffers The buffers to bind.
+ * \param l The number of buffers to bind.
+ */
+void s_gpu_bind(const s_gpu_stft_t *gpu, const s_gpu_buffer_t *buffers,
+	size_t l)
+{
+	size_t i;
+
+	for(i = 0; i < l; ++i)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, (GLuint) i,
+			gpu->buffers[buffers[i]]);
+	}
+}
+
+/*!
+ * This function creates the single-channel floating point texture our filter
+ * shader stores a spectrogram's pixels in, replacing the given texture if it
+ * already exists. Its storage is immutable, so it can be bound as an image.
+ *
+ * \param texture The texture to create.
+ * \param w The width of the texture, in texels.
+ * \param h The height of the texture, in texels.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_gpu_init_texture(GLuint *texture, size_t w, size_t h)
+{
+	if(*texture != 0)
+		glDeleteTextures(1, texture);
+
+	glGenTextures(1, texture);
+	glBindTexture(GL_TEXTURE_2D, *texture);
+
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, (GLsizei) w, (GLsizei) h);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(glGetError() != GL_NO_ERROR)
+	{
+		glDeleteTextures(1, texture);
+		*texture = 0;
+
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function converts one of the values our filter shader accumulates its
+ * range in back into the float it was computed from.
+ *
+ * \param u The value to convert.
+ * \return The original float value.
+ */
+float s_gpu_unordered(GLuint u)
+{
+	float f;
+
+	u = (u & 0x80000000u) != 0 ? (u & 0x7FFFFFFFu) : ~u;
+	memcpy(&f, &u, sizeof(float));
+
+	return f;
+}
@@ -0,0 +1,115 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "spectr/rendering/colormap.h"
+#include "spectr/rendering/spectrogram.h"
+
+/*!
+ * This function renders the given spectrogram to an image file in binary PPM
+ * (netpbm "P6") format, without using OpenGL. The image has one pixel per
+ * spectrogram cell, with time increasing to the right and frequency
+ * increasing upwards, colored the same way as the interactive viewer: it is
+ * colored from the same texels the viewer uploads (see s_spectrogram_texels),
+ * with the colormap spanning their whole range.
+ *
+ * \param sg The spectrogram to render.
+ * \param f The path to the image file to write.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_write_spectrogram_ppm(const s_spectrogram_t *sg, const char *f)
+{
+	int ret = 0;
+	int r;
+	FILE *out;
+	float *texels;
+	uint8_t *row;
+	size_t x;
+	size_t y;
+	double min;
+	double max;
+	double z;
+
+	texels = malloc(sg->width * sg->height * sizeof(float));
+
+	if(texels == NULL)
+	{
+		ret = -ENOMEM;
+		goto done;
+	}
+
+	s_spectrogram_texels(texels, sg, &min, &max);
+
+	row = malloc(sg->width * 3);
+
+	if(row == NULL)
+	{
+		ret = -ENOMEM;
+		goto err_after_texels_alloc;
+	}
+
+	out = fopen(f, "wb");
+
+	if(out == NULL)
+	{
+		ret = -errno;
+		goto err_after_row_alloc;
+	}
+
+	r = fprintf(out, "P6\n%zu %zu\n255\n", sg->width, sg->height);
+
+	if(r < 0)
+	{
+		ret = -EIO;
+		goto err_after_fopen;
+	}
+
+	// Write the rows from the top (the highest frequency) down.
+
+	for(y = sg->height; y > 0; --y)
+	{
+		for(x = 0; x < sg->width; ++x)
+		{
+			z = texels[(y - 1) * sg->width + x];
+
+			s_colormap(&(row[x * 3]),
+				s_colormap_level(z, min, max, 1.0));
+		}
+
+		if(fwrite(row, 3, sg->width, out) != sg->width)
+		{
+			ret = -EIO;
+			goto err_after_fopen;
+		}
+	}
+
+err_after_fopen:
+	if((fclose(out) != 0) && (ret == 0))
+		ret = -EIO;
+err_after_row_alloc:
+	free(row);
+err_after_texels_alloc:
+	free(texels);
+done:
+	return ret;
+}
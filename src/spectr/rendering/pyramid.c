@@ -0,0 +1,659 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pyramid.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "spectr/config.h"
+#include "spectr/constants.h"
+#include "spectr/rendering/filterbank.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/transform/fourier.h"
+#include "spectr/util/arena.h"
+#include "spectr/util/profile.h"
+
+int s_pyramid_reserve(s_pyramid_t *, size_t, size_t);
+float *s_pyramid_cell(const s_pyramid_t *, size_t, size_t);
+void s_free_pyramid_level(s_pyramid_level_t *);
+
+/*!
+ * This function initializes (allocates) a s_pyramid_t variable, with the given
+ * number of rows and hop size. The pyramid starts out with an empty level 0;
+ * columns are added with s_pyramid_add. If the pointer is non-NULL, we will
+ * not allocate a new value on top of it.
+ *
+ * \param p The s_pyramid_t to allocate.
+ * \param h The number of rows in each level of the pyramid.
+ * \param hop The number of samples between the starts of adjacent frames.
+ * \param scale The scale of the pyramid's frequency axis.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_pyramid(s_pyramid_t **p, size_t h, size_t hop,
+	s_scale_type_t scale)
+{
+	if(*p != NULL)
+		return -EINVAL;
+
+	if((h < 1) || (hop < 1) || (scale >= SCALE_INVALID))
+		return -EINVAL;
+
+	*p = malloc(sizeof(s_pyramid_t));
+
+	if(*p == NULL)
+		return -ENOMEM;
+
+	(*p)->raw_stat.type = FTYPE_INVALID;
+	(*p)->raw_stat.bit_depth = 0;
+	(*p)->raw_stat.sample_rate = 0;
+	(*p)->raw_stat.samples = 0;
+	(*p)->raw_length = 0;
+
+	(*p)->hop = hop;
+	(*p)->height = h;
+
+	(*p)->scale = scale;
+	(*p)->filterbank = NULL;
+
+	(*p)->levels = 1;
+	(*p)->level = calloc(1, sizeof(s_pyramid_level_t));
+	(*p)->arena = NULL;
+
+	(*p)->map = NULL;
+	(*p)->map_length = 0;
+
+	if((*p)->level == NULL)
+	{
+		s_free_pyramid(p);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_pyramid_t structure, including all of its
+ * levels. Its tiles are released all at once, along with its arena; if the
+ * pyramid was loaded from our cache, the cache file is unmapped instead. Note
+ * that this function is safe against double-frees.
+ *
+ * \param p The s_pyramid_t to free.
+ */
+void s_free_pyramid(s_pyramid_t **p)
+{
+	size_t i;
+
+	if(*p == NULL)
+		return;
+
+	if((*p)->level != NULL)
+	{
+		for(i = 0; i < (*p)->levels; ++i)
+			s_free_pyramid_level(&((*p)->level[i]));
+	}
+
+	s_free_arena(&((*p)->arena));
+
+	if((*p)->map != NULL)
+		munmap((*p)->map, (*p)->map_length);
+
+	free((*p)->level);
+
+	s_free_filterbank(&((*p)->filterbank));
+
+	free(*p);
+	*p = NULL;
+}
+
+/*!
+ * This function adds one STFT frame's DFT to level 0 of the given pyramid, as
+ * the column with the frame's index. The DFT's bins are mapped onto the rows
+ * exactly as they are for a s_spectrogram_t (see s_spectrogram_add).
+ *
+ * Once all of the frames have been added, s_pyramid_finish must be called to
+ * build the pyramid's other levels.
+ *
+ * If level 0 already has a column for the frame, and the pyramid's filterbank
+ * has already been built for frames of this size, the only thing this
+ * function writes to is that column, so distinct frames can be added
+ * concurrently (see s_pyramid_from_raw).
+ *
+ * \param p The pyramid to add the frame to.
+ * \param frame The index of this frame in the STFT.
+ * \param dft The DFT of this frame.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_pyramid_add(s_pyramid_t *p, size_t frame, const s_dft_t *dft)
+{
+	int r;
+	size_t row;
+	float *cell;
+
+	if(p->map != NULL)
+		return -EINVAL;
+
+	r = s_get_filterbank(&(p->filterbank), p->scale,
+		dft->length < 2 ? 0 : dft->length - 2, p->height,
+		p->raw_stat.sample_rate);
+
+	if(r < 0)
+		return r;
+
+	r = s_pyramid_reserve(p, 0, frame + 1);
+
+	if(r < 0)
+		return r;
+
+	if(frame >= p->level[0].columns)
+		p->level[0].columns = frame + 1;
+
+	// Compute each row's value, leaving rows without any values empty.
+
+	cell = s_pyramid_cell(p, 0, frame);
+
+	s_filterbank_apply(cell, p->filterbank, dft);
+
+	for(row = 0; row < p->height; ++row)
+	{
+		if(isnan(cell[row]))
+			cell[row] = 0.0f;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function is an STFT sink (see s_stft_stream_t) which adds each frame it
+ * is given to level 0 of a pyramid.
+ *
+ * \param ctx The s_pyramid_t frames should be added to.
+ * \param frame The index of this frame in the STFT.
+ * \param dft The DFT of this frame.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_pyramid_sink(void *ctx, size_t frame, const s_dft_t *dft)
+{
+	return s_pyramid_add((s_pyramid_t *) ctx, frame, dft);
+}
+
+/*!
+ * This function (re)builds every level of the given pyramid above level 0.
+ * Each level has half as many columns as the level below it (rounding up),
+ * and each of its cells is the average of the two cells below it, ignoring
+ * empty cells. We stop once a level has only a single column. Levels which
+ * were built previously are rebuilt in place, reusing their tiles.
+ *
+ * \param p The pyramid to finish.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_pyramid_finish(s_pyramid_t *p)
+{
+	int r;
+	size_t i;
+	size_t levels;
+	size_t columns;
+	size_t col;
+	size_t row;
+	s_pyramid_level_t *level;
+	const float *a;
+	const float *b;
+	float *dst;
+
+	if(p->map != NULL)
+		return -EINVAL;
+
+	// Work out how many levels we need, and allocate any new ones.
+
+	levels = 1;
+
+	columns = p->level[0].columns;
+
+	while(columns > 1)
+	{
+		columns = (columns + 1) / 2;
+		++levels;
+	}
+
+	for(i = levels; i < p->levels; ++i)
+		s_free_pyramid_level(&(p->level[i]));
+
+	if(levels > p->levels)
+	{
+		level = realloc(p->level, levels * sizeof(s_pyramid_level_t));
+
+		if(level == NULL)
+			return -ENOMEM;
+
+		p->level = level;
+
+		memset(&(p->level[p->levels]), 0,
+			(levels - p->levels) * sizeof(s_pyramid_level_t));
+	}
+
+	p->levels = levels;
+
+	for(i = 1; i < levels; ++i)
+	{
+		columns = (p->level[i - 1].columns + 1) / 2;
+
+		r = s_pyramid_reserve(p, i, columns);
+
+		if(r < 0)
+			return r;
+
+		p->level[i].columns = columns;
+
+		// Average each pair of columns from the level below.
+
+		for(col = 0; col < columns; ++col)
+		{
+			a = s_pyramid_cell(p, i - 1, 2 * col);
+			b = 2 * col + 1 < p->level[i - 1].columns ?
+				s_pyramid_cell(p, i - 1, 2 * col + 1) : a;
+			dst = s_pyramid_cell(p, i, col);
+
+			for(row = 0; row < p->height; ++row)
+			{
+				if(a[row] == 0.0f)
+					dst[row] = b[row];
+				else if(b[row] == 0.0f)
+					dst[row] = a[row];
+				else
+					dst[row] = (a[row] + b[row]) * 0.5f;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * This function builds the pyramid of every frame of the given STFT.
+ *
+ * \param p This will receive the new pyramid.
+ * \param stft The STFT whose frames should be added.
+ * \param hop The number of samples between the starts of the STFT's windows.
+ * \param h The number of rows in each level of the pyramid.
+ * \param scale The scale of the pyramid's frequency axis.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_pyramid_from_stft(s_pyramid_t **p, const s_stft_t *stft, size_t hop,
+	size_t h, s_scale_type_t scale)
+{
+	int r;
+	size_t i;
+
+	s_free_pyramid(p);
+
+	r = s_init_pyramid(p, h, hop, scale);
+
+	if(r < 0)
+		return r;
+
+	(*p)->raw_stat = stft->raw_stat;
+	(*p)->raw_length = stft->raw_length;
+
+	for(i = 0; i < stft->length; ++i)
+	{
+		r = s_pyramid_add(*p, i, &(stft->dfts[i]));
+
+		if(r < 0)
+			break;
+	}
+
+	if(r >= 0)
+		r = s_pyramid_finish(*p);
+
+	if(r < 0)
+		s_free_pyramid(p);
+
+	return r;
+}
+
+/*!
+ * This function sets up a pyramid for the STFT of the given raw audio. Level 0
+ * is allocated with a column for each frame, and the filterbank is built up
+ * front, so the frames can then be added concurrently, in any order (e.g., by
+ * giving s_pyramid_sink to s_stft_sink_range). Once every frame has been
+ * added, s_pyramid_finish must be called to build the pyramid's other levels.
+ *
+ * \param p This will receive the new pyramid.
+ * \param raw The raw audio signal the pyramid is of.
+ * \param w The window function size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param h The number of rows in each level of the pyramid.
+ * \param scale The scale of the pyramid's frequency axis.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_pyramid_raw(s_pyramid_t **p, const s_raw_audio_t *raw, size_t w,
+	size_t hop, size_t h, s_scale_type_t scale)
+{
+	int r;
+	size_t n;
+
+	if(hop < 1)
+		return -EINVAL;
+
+	s_free_pyramid(p);
+
+	r = s_init_pyramid(p, h, hop, scale);
+
+	if(r < 0)
+		return r;
+
+	(*p)->raw_stat = raw->stat;
+	(*p)->raw_length = raw->samples_length;
+
+	n = raw->samples_length / hop;
+
+	// Each window's DFT has w / 2 - 1 bins, besides DC and Nyquist.
+
+	r = s_get_filterbank(&((*p)->filterbank), scale, w < 4 ? 0 : w / 2 - 1,
+		h, raw->stat.sample_rate);
+
+	if(r >= 0)
+		r = s_pyramid_reserve(*p, 0, n);
+
+	if(r < 0)
+	{
+		s_free_pyramid(p);
+		return r;
+	}
+
+	(*p)->level[0].columns = n;
+
+	return 0;
+}
+
+/*!
+ * This function builds the pyramid of the STFT of the given raw audio, without
+ * ever storing the STFT itself: each frame is added to level 0 as soon as it
+ * has been transformed, by whichever thread transformed it (see s_stft_sink).
+ * Level 0 and the filterbank are set up front (see s_init_pyramid_raw), so the
+ * frames can be added concurrently.
+ *
+ * \param p This will receive the new pyramid.
+ * \param raw The raw audio signal to process.
+ * \param w The window function size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param fn The window function to apply to each window.
+ * \param precision The precision to compute the DFT's in.
+ * \param h The number of rows in each level of the pyramid.
+ * \param scale The scale of the pyramid's frequency axis.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_pyramid_from_raw(s_pyramid_t **p, const s_raw_audio_t *raw, size_t w,
+	size_t hop, s_window_type_t fn, s_precision_t precision, size_t h,
+	s_scale_type_t scale, size_t threads)
+{
+	int r;
+
+	r = s_init_pyramid_raw(p, raw, w, hop, h, scale);
+
+	if(r < 0)
+		return r;
+
+	r = s_stft_sink(raw, w, hop, fn, precision, threads, s_pyramid_sink,
+		*p);
+
+	if(r >= 0)
+		r = s_pyramid_finish(*p);
+
+	if(r < 0)
+		s_free_pyramid(p);
+
+	return r;
+}
+
+/*!
+ * This function builds a w x h spectrogram of the samples [begin, end) of the
+ * input from the given pyramid. We read from the coarsest level which still
+ * has at least one column per pixel, so this only ever reads about as many
+ * cells as the spectrogram has pixels, regardless of the length of the range.
+ *
+ * If the range covers fewer frames than the spectrogram has columns, the
+ * frames of level 0 are stretched to cover the whole width.
+ *
+ * \param sg This will receive the new spectrogram.
+ * \param p The pyramid to read from.
+ * \param begin The offset of the first sample to include.
+ * \param end The offset one past the last sample to include.
+ * \param w The width of the spectrogram, in pixels.
+ * \param h The height of the spectrogram, in pixels.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_spectrogram_from_pyramid(s_spectrogram_t **sg, const s_pyramid_t *p,
+	size_t begin, size_t end, size_t w, size_t h)
+{
+	int r;
+	size_t first;
+	size_t last;
+	size_t span;
+	size_t lvl;
+	size_t x;
+	size_t y;
+	size_t c0;
+	size_t c1;
+	size_t ncols;
+	double z;
+	double start;
+
+	if((end <= begin) || (p->level[0].columns == 0))
+		return -EINVAL;
+
+	start = s_profile_begin();
+
+	s_free_spectrogram(sg);
+
+	r = s_init_spectrogram(sg, w, h, w, p->scale);
+
+	if(r < 0)
+		return r;
+
+	(*sg)->raw_stat = p->raw_stat;
+	(*sg)->raw_length = p->raw_length;
+	(*sg)->frames = w;
+
+	// Work out which frames the range covers.
+
+	first = begin / p->hop;
+	last = (end + p->hop - 1) / p->hop;
+
+	first = first < p->level[0].columns ? first : p->level[0].columns - 1;
+	last = last > p->level[0].columns ? p->level[0].columns : last;
+	last = last > first ? last : first + 1;
+
+	span = last - first;
+
+	// Pick the coarsest level which still has a column for every pixel.
+
+	for(lvl = 0; (lvl + 1 < p->levels) && ((span >> (lvl + 1)) >= w); ++lvl)
+		;
+
+	ncols = p->level[lvl].columns;
+
+	// Average the cells of that level which fall into each pixel.
+
+	for(x = 0; x < w; ++x)
+	{
+		c0 = (first + (x * span) / w) >> lvl;
+		c1 = (first + ((x + 1) * span) / w) >> lvl;
+
+		c0 = c0 < ncols ? c0 : ncols - 1;
+		c1 = c1 > c0 ? c1 : c0 + 1;
+		c1 = c1 < ncols ? c1 : ncols;
+
+		for(y = 0; y < h; ++y)
+		{
+			z = s_pyramid_average(p, lvl, c0, c1,
+				(y * p->height) / h, ((y + 1) * p->height) / h);
+
+			if(z == 0.0)
+				continue;
+
+			(*sg)->sum[x * h + y] = z;
+			(*sg)->count[x * h + y] = 1;
+		}
+	}
+
+	s_profile_end(STAGE_SPECTROGRAM, start);
+
+	return 0;
+}
+
+/*!
+ * This function makes sure the given level of a pyramid has tiles allocated
+ * for at least the given number of columns. Newly allocated tiles are zeroed
+ * (i.e., empty). Tiles are allocated from the pyramid's arena, which is
+ * created the first time it is needed.
+ *
+ * \param p The pyramid to grow.
+ * \param lvl The level of the pyramid to grow.
+ * \param columns The number of columns the level must be able to hold.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_pyramid_reserve(s_pyramid_t *p, size_t lvl, size_t columns)
+{
+	int r;
+	size_t tiles;
+	size_t capacity;
+	float **tile;
+	s_pyramid_level_t *level = &(p->level[lvl]);
+
+	tiles = (columns + S_PYRAMID_TILE_COLUMNS - 1) / S_PYRAMID_TILE_COLUMNS;
+
+	if(tiles <= level->tiles)
+		return 0;
+
+	// Grow the list of tiles geometrically, so appending stays cheap.
+
+	if(tiles > level->capacity)
+	{
+		capacity = level->capacity < 1 ? 1 : level->capacity;
+
+		while(capacity < tiles)
+			capacity *= 2;
+
+		tile = realloc(level->tile, capacity * sizeof(float *));
+
+		if(tile == NULL)
+			return -ENOMEM;
+
+		level->tile = tile;
+		level->capacity = capacity;
+	}
+
+	if(p->arena == NULL)
+	{
+		r = s_init_arena(&(p->arena));
+
+		if(r < 0)
+			return r;
+	}
+
+	while(level->tiles < tiles)
+	{
+		level->tile[level->tiles] = s_arena_alloc(p->arena,
+			S_PYRAMID_TILE_COLUMNS * p->height * sizeof(float));
+
+		if(level->tile[level->tiles] == NULL)
+			return -ENOMEM;
+
+		++level->tiles;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function returns a pointer to the given column of the given level of a
+ * pyramid. The column's rows are contiguous. The column must already have been
+ * allocated, with s_pyramid_reserve.
+ *
+ * \param p The pyramid to examine.
+ * \param lvl The level of the pyramid the column is in.
+ * \param col The index of the column in that level.
+ * \return A pointer to the column's first row.
+ */
+float *s_pyramid_cell(const s_pyramid_t *p, size_t lvl, size_t col)
+{
+	return p->level[lvl].tile[col / S_PYRAMID_TILE_COLUMNS] +
+		(col % S_PYRAMID_TILE_COLUMNS) * p->height;
+}
+
+/*!
+ * This function frees the list of tiles of the given pyramid level. The tiles
+ * themselves belong to the pyramid's arena (or to a mapped cache file), so
+ * they are released along with it.
+ *
+ * \param level The pyramid level to free.
+ */
+void s_free_pyramid_level(s_pyramid_level_t *level)
+{
+	free(level->tile);
+
+	level->tile = NULL;
+	level->columns = 0;
+	level->tiles = 0;
+	level->capacity = 0;
+}
+
+/*!
+ * This function computes the average of the non-empty cells in the given
+ * rectangle of one level of a pyramid.
+ *
+ * \param p The pyramid to examine.
+ * \param lvl The level of the pyramid to read.
+ * \param c0 The first column of the rectangle.
+ * \param c1 One past the last column of the rectangle.
+ * \param r0 The first row of the rectangle.
+ * \param r1 One past the last row of the rectangle.
+ * \return The average value, or 0 if every cell is empty.
+ */
+double s_pyramid_average(const s_pyramid_t *p, size_t lvl, size_t c0,
+	size_t c1, size_t r0, size_t r1)
+{
+	size_t col;
+	size_t row;
+	const float *cell;
+	double sum = 0.0;
+	size_t count = 0;
+
+	r1 = r1 > r0 ? r1 : r0 + 1;
+
+	for(col = c0; col < c1; ++col)
+	{
+		cell = s_pyramid_cell(p, lvl, col);
+
+		for(row = r0; row < r1; ++row)
+		{
+			if(cell[row] == 0.0f)
+				continue;
+
+			sum += cell[row];
+			++count;
+		}
+	}
+
+	return count == 0 ? 0.0 : sum / (double) count;
+}
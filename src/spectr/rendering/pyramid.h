@@ -0,0 +1,45 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_RENDERING_PYRAMID_H
+#define INCLUDE_SPECTR_RENDERING_PYRAMID_H
+
+#include <stddef.h>
+
+#include "spectr/types.h"
+
+extern int s_init_pyramid(s_pyramid_t **, size_t, size_t, s_scale_type_t);
+extern void s_free_pyramid(s_pyramid_t **);
+
+extern int s_pyramid_add(s_pyramid_t *, size_t, const s_dft_t *);
+extern int s_pyramid_sink(void *, size_t, const s_dft_t *);
+extern int s_pyramid_finish(s_pyramid_t *);
+extern int s_pyramid_from_stft(s_pyramid_t **, const s_stft_t *, size_t,
+	size_t, s_scale_type_t);
+extern int s_init_pyramid_raw(s_pyramid_t **, const s_raw_audio_t *, size_t,
+	size_t, size_t, s_scale_type_t);
+extern int s_pyramid_from_raw(s_pyramid_t **, const s_raw_audio_t *, size_t,
+	size_t, s_window_type_t, s_precision_t, size_t, s_scale_type_t,
+	size_t);
+
+extern double s_pyramid_average(const s_pyramid_t *, size_t, size_t, size_t,
+	size_t, size_t);
+extern int s_spectrogram_from_pyramid(s_spectrogram_t **,
+	const s_pyramid_t *, size_t, size_t, size_t, size_t);
+
+#endif
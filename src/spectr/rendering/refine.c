@@ -0,0 +1,551 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "refine.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+
+#include "spectr/config.h"
+#include "spectr/rendering/pyramid.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/transform/fourier.h"
+
+int s_refine_overview(s_refine_t *);
+void s_refine_frames(const s_refine_t *, size_t, size_t *, size_t *);
+void s_refine_update_range(s_refine_t *);
+void *s_refine_worker(void *);
+
+/*!
+ * This function initializes (allocates) a s_refine_t variable, for a width x
+ * height spectrogram of the whole of the given raw audio. Its coarse overview
+ * is computed straight away; the rest of the spectrogram is computed once it
+ * is started. If the pointer is non-NULL, we will not allocate a new value on
+ * top of it.
+ *
+ * \param refine The s_refine_t to allocate.
+ * \param raw The raw audio to compute the spectrogram of.
+ * \param w The STFT window size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param fn The window function to apply to each window.
+ * \param precision The precision to compute the DFT's in.
+ * \param width The width of the spectrogram, in pixels.
+ * \param height The height of the spectrogram (and its pyramid), in pixels.
+ * \param scale The scale of the spectrogram's frequency axis.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_refine(s_refine_t **refine, const s_raw_audio_t *raw, size_t w,
+	size_t hop, s_window_type_t fn, s_precision_t precision, size_t width,
+	size_t height, s_scale_type_t scale, size_t threads)
+{
+	int r;
+	size_t i;
+
+	if(*refine != NULL)
+		return -EINVAL;
+
+	if((hop < 1) || (raw->samples_length / hop < 1) || (width < 1) ||
+		(height < 1) || (scale >= SCALE_INVALID))
+	{
+		return -EINVAL;
+	}
+
+	*refine = malloc(sizeof(s_refine_t));
+
+	if(*refine == NULL)
+		return -ENOMEM;
+
+	(*refine)->raw = raw;
+	(*refine)->window = w;
+	(*refine)->hop = hop;
+	(*refine)->fn = fn;
+	(*refine)->precision = precision;
+	(*refine)->threads = threads;
+
+	(*refine)->width = width;
+	(*refine)->height = height;
+	(*refine)->scale = scale;
+	(*refine)->pyramid = NULL;
+	(*refine)->spectrogram = NULL;
+
+	(*refine)->texels = malloc(width * height * sizeof(float));
+	(*refine)->dirty_begin = 0;
+	(*refine)->dirty_end = 0;
+	(*refine)->min = FLT_MAX;
+	(*refine)->max = -FLT_MAX;
+	(*refine)->done = 0;
+	(*refine)->result = 0;
+
+	pthread_mutex_init(&((*refine)->lock), NULL);
+	(*refine)->started = 0;
+	(*refine)->stop = 0;
+	(*refine)->notify = NULL;
+
+	if((*refine)->texels == NULL)
+	{
+		s_free_refine(refine);
+		return -ENOMEM;
+	}
+
+	for(i = 0; i < width * height; ++i)
+		(*refine)->texels[i] = -FLT_MAX;
+
+	r = s_refine_overview(*refine);
+
+	if(r >= 0)
+	{
+		r = s_init_pyramid_raw(&((*refine)->pyramid), raw, w, hop,
+			height, scale);
+	}
+
+	if(r < 0)
+	{
+		s_free_refine(refine);
+		return r;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_refine_t structure, stopping its worker
+ * thread first if it is running. Note that this function is safe against
+ * double-frees.
+ *
+ * \param refine The s_refine_t to free.
+ */
+void s_free_refine(s_refine_t **refine)
+{
+	if(*refine == NULL)
+		return;
+
+	s_refine_stop(*refine);
+
+	s_free_pyramid(&((*refine)->pyramid));
+	s_free_spectrogram(&((*refine)->spectrogram));
+	free((*refine)->texels);
+
+	pthread_mutex_destroy(&((*refine)->lock));
+
+	free(*refine);
+	*refine = NULL;
+}
+
+/*!
+ * This function starts the given spectrogram's worker thread. The given
+ * function is called (on the worker thread) each time a block of columns has
+ * been refined, and once more when the worker is done.
+ *
+ * \param refine The spectrogram to start refining.
+ * \param notify The function to call when refined columns are available.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_refine_start(s_refine_t *refine, void (*notify)())
+{
+	int r;
+
+	if(refine->started || refine->done)
+		return -EINVAL;
+
+	refine->notify = notify;
+	refine->stop = 0;
+
+	r = pthread_create(&(refine->worker), NULL, s_refine_worker, refine);
+
+	if(r != 0)
+		return -r;
+
+	refine->started = 1;
+
+	return 0;
+}
+
+/*!
+ * This function stops the given spectrogram's worker thread, and waits for it
+ * to exit. The worker checks whether it should stop after each block of
+ * columns, so the spectrogram is left unfinished (see s_refine_result). It is
+ * safe to call this function if the worker was never started.
+ *
+ * \param refine The spectrogram to stop refining.
+ */
+void s_refine_stop(s_refine_t *refine)
+{
+	if(!refine->started)
+		return;
+
+	pthread_mutex_lock(&(refine->lock));
+	refine->stop = 1;
+	pthread_mutex_unlock(&(refine->lock));
+
+	pthread_join(refine->worker, NULL);
+
+	refine->started = 0;
+}
+
+/*!
+ * This function passes the columns of the given spectrogram which have been
+ * refined since they were last read (or all of its columns, if all is set) to
+ * the given function, as the range [x0, x1). The function is given all of the
+ * spectrogram's texels (see s_refine_t), not just those of the range.
+ *
+ * The spectrogram is locked while the function is called, so it should return
+ * quickly (e.g., by uploading the columns to a texture).
+ *
+ * \param refine The spectrogram to read.
+ * \param all Whether to pass every column, instead of only the changed ones.
+ * \param fn The function to pass the columns to.
+ * \param ctx The context pointer to pass to the function.
+ * \return 1 if any columns were passed, 0 if not, or an error number if the
+ *         worker (or the function) failed.
+ */
+int s_refine_read(s_refine_t *refine, int all,
+	int (*fn)(void *, size_t, size_t, const float *), void *ctx)
+{
+	int r = 0;
+
+	pthread_mutex_lock(&(refine->lock));
+
+	if(refine->result < 0)
+	{
+		r = refine->result;
+		goto done;
+	}
+
+	if(all)
+	{
+		refine->dirty_begin = 0;
+		refine->dirty_end = refine->width;
+	}
+
+	if(refine->dirty_begin < refine->dirty_end)
+	{
+		r = fn(ctx, refine->dirty_begin, refine->dirty_end,
+			refine->texels);
+
+		r = r < 0 ? r : 1;
+	}
+
+	refine->dirty_begin = 0;
+	refine->dirty_end = 0;
+
+done:
+	pthread_mutex_unlock(&(refine->lock));
+	return r;
+}
+
+/*!
+ * This function returns the range of the values the given spectrogram
+ * currently displays, ignoring empty pixels. Once it is done, this is the
+ * range of its finished spectrogram (see s_spectrogram_range), exactly as if
+ * it hadn't been refined. If there are no such values, both min and max
+ * receive 0.
+ *
+ * \param refine The spectrogram to examine.
+ * \param min This will receive the minimum value.
+ * \param max This will receive the maximum value.
+ */
+void s_refine_range(s_refine_t *refine, float *min, float *max)
+{
+	pthread_mutex_lock(&(refine->lock));
+
+	*min = refine->min <= refine->max ? refine->min : 0.0f;
+	*max = refine->min <= refine->max ? refine->max : 0.0f;
+
+	pthread_mutex_unlock(&(refine->lock));
+}
+
+/*!
+ * This function returns whether the given spectrogram has been completely
+ * refined. Once it has, its pyramid and spectrogram are finished, and are no
+ * longer touched by the worker thread.
+ *
+ * \param refine The spectrogram to examine.
+ * \return 1 if it is done, 0 if not, or an error number if the worker failed.
+ */
+int s_refine_result(s_refine_t *refine)
+{
+	int r;
+
+	pthread_mutex_lock(&(refine->lock));
+	r = refine->result < 0 ? refine->result : refine->done;
+	pthread_mutex_unlock(&(refine->lock));
+
+	return r;
+}
+
+/*!
+ * This function computes the given spectrogram's coarse overview: one STFT
+ * window for every S_REFINE_COARSE columns (or one per frame, for very short
+ * inputs), spread evenly across the input, each of which is stretched across
+ * its columns. Only the refined spectrogram is kept afterwards.
+ *
+ * \param refine The spectrogram to compute the overview of.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_refine_overview(s_refine_t *refine)
+{
+	int r;
+	size_t n;
+	size_t frames;
+	size_t x;
+	size_t y;
+	double z;
+	s_stft_t *stft = NULL;
+	s_spectrogram_t *sg = NULL;
+
+	frames = refine->raw->samples_length / refine->hop;
+
+	n = refine->width / S_REFINE_COARSE;
+	n = n < frames ? n : frames;
+	n = n > 1 ? n : 1;
+
+	r = s_stft_range(&stft, refine->raw, 0, frames * refine->hop, n,
+		refine->window, refine->fn, refine->precision, refine->threads);
+
+	if(r >= 0)
+	{
+		r = s_spectrogram_from_stft(&sg, stft, n, refine->height,
+			refine->scale);
+	}
+
+	s_free_stft(&stft);
+
+	if(r < 0)
+		return r;
+
+	for(y = 0; y < refine->height; ++y)
+	{
+		for(x = 0; x < refine->width; ++x)
+		{
+			z = s_spectrogram_value(sg, (x * n) / refine->width, y);
+
+			if(s_spectrogram_empty(z))
+				continue;
+
+			refine->texels[y * refine->width + x] = (float) z;
+		}
+	}
+
+	s_refine_update_range(refine);
+
+	s_free_spectrogram(&sg);
+
+	return 0;
+}
+
+/*!
+ * This function computes the range of frames [c0, c1) of the given
+ * spectrogram's STFT which fall into the given column, exactly as
+ * s_spectrogram_from_pyramid maps frames onto columns.
+ *
+ * \param refine The spectrogram being refined.
+ * \param x The column, in [0, width).
+ * \param c0 This will receive the first frame in the column.
+ * \param c1 This will receive the frame one past the last in the column.
+ */
+void s_refine_frames(const s_refine_t *refine, size_t x, size_t *c0,
+	size_t *c1)
+{
+	size_t n = refine->pyramid->level[0].columns;
+
+	*c0 = (x * n) / refine->width;
+	*c1 = ((x + 1) * n) / refine->width;
+
+	*c0 = *c0 < n ? *c0 : n - 1;
+	*c1 = *c1 > *c0 ? *c1 : *c0 + 1;
+	*c1 = *c1 < n ? *c1 : n;
+}
+
+/*!
+ * This function recomputes the range of the given spectrogram's texels,
+ * ignoring empty pixels. A refined column's values are averages over several
+ * frames, so they can span a narrower range than the overview's single frames
+ * did; the range is therefore recomputed from scratch, rather than widened,
+ * each time columns are replaced. The spectrogram's lock must be held, if its
+ * worker thread is running.
+ *
+ * \param refine The spectrogram whose range should be recomputed.
+ */
+void s_refine_update_range(s_refine_t *refine)
+{
+	size_t i;
+	float min = FLT_MAX;
+	float max = -FLT_MAX;
+
+	for(i = 0; i < refine->width * refine->height; ++i)
+	{
+		if(refine->texels[i] == -FLT_MAX)
+			continue;
+
+		min = fminf(min, refine->texels[i]);
+		max = fmaxf(max, refine->texels[i]);
+	}
+
+	refine->min = min;
+	refine->max = max;
+}
+
+/*!
+ * This function is the body of a refined spectrogram's worker thread. It
+ * computes the frames of the input's STFT in order, S_REFINE_BLOCK columns'
+ * worth at a time, adding them to the spectrogram's pyramid. Once each block's
+ * frames are done, its columns' texels are replaced with their refined values,
+ * and the viewer is notified. Finally, the pyramid is finished, and the
+ * spectrogram is built from it. It stops early if an error occurs, or when
+ * asked to (see s_refine_stop).
+ *
+ * \param arg The s_refine_t to refine.
+ * \return NULL, always. The result is stored in the s_refine_t.
+ */
+void *s_refine_worker(void *arg)
+{
+	int r = 0;
+	int stop;
+	double min;
+	double max;
+	size_t next = 0;
+	size_t x0;
+	size_t x1;
+	size_t x;
+	size_t y;
+	size_t c0;
+	size_t c1;
+	double z;
+	float *block;
+	s_refine_t *refine = arg;
+	s_pyramid_t *p = refine->pyramid;
+
+	block = malloc(S_REFINE_BLOCK * refine->height * sizeof(float));
+
+	if(block == NULL)
+	{
+		r = -ENOMEM;
+		goto done;
+	}
+
+	for(x0 = 0; x0 < refine->width; x0 = x1)
+	{
+		pthread_mutex_lock(&(refine->lock));
+		stop = refine->stop;
+		pthread_mutex_unlock(&(refine->lock));
+
+		if(stop)
+			goto stopped;
+
+		x1 = x0 + S_REFINE_BLOCK;
+		x1 = x1 < refine->width ? x1 : refine->width;
+
+		// Compute every frame this block's columns need.
+
+		s_refine_frames(refine, x1 - 1, &c0, &c1);
+
+		if(c1 > next)
+		{
+			r = s_stft_sink_range(refine->raw, refine->window,
+				refine->hop, next, c1, refine->fn,
+				refine->precision, refine->threads,
+				s_pyramid_sink, p);
+
+			if(r < 0)
+				goto done;
+
+			next = c1;
+		}
+
+		// Compute the columns unlocked, since the viewer may be reading.
+
+		for(x = x0; x < x1; ++x)
+		{
+			s_refine_frames(refine, x, &c0, &c1);
+
+			for(y = 0; y < refine->height; ++y)
+			{
+				z = s_pyramid_average(p, 0, c0, c1,
+					(y * p->height) / refine->height,
+					((y + 1) * p->height) / refine->height);
+
+				block[(x - x0) * refine->height + y] =
+					z == 0.0 ? -FLT_MAX : (float) z;
+			}
+		}
+
+		pthread_mutex_lock(&(refine->lock));
+
+		for(x = x0; x < x1; ++x)
+		{
+			for(y = 0; y < refine->height; ++y)
+			{
+				refine->texels[y * refine->width + x] =
+					block[(x - x0) * refine->height + y];
+			}
+		}
+
+		s_refine_update_range(refine);
+
+		if(refine->dirty_begin == refine->dirty_end)
+			refine->dirty_begin = x0;
+
+		refine->dirty_end = x1;
+
+		pthread_mutex_unlock(&(refine->lock));
+
+		if(refine->notify != NULL)
+			refine->notify();
+	}
+
+	/*
+	 * Build the rest of the pyramid, and the spectrogram we would have
+	 * displayed if we hadn't refined it, so the viewer can switch to it.
+	 */
+
+	r = s_pyramid_finish(p);
+
+	if(r >= 0)
+	{
+		r = s_spectrogram_from_pyramid(&(refine->spectrogram), p, 0,
+			p->raw_length, refine->width, refine->height);
+	}
+
+	if(r >= 0)
+		s_spectrogram_range(refine->spectrogram, &min, &max);
+
+done:
+	pthread_mutex_lock(&(refine->lock));
+
+	// From now on, report the range the viewer is about to switch to.
+
+	if(r >= 0)
+	{
+		refine->min = (float) min;
+		refine->max = (float) max;
+	}
+
+	refine->done = r >= 0;
+	refine->result = r;
+	pthread_mutex_unlock(&(refine->lock));
+
+	if(refine->notify != NULL)
+		refine->notify();
+
+stopped:
+	free(block);
+	return NULL;
+}
@@ -19,357 +19,1129 @@
 #include "render.h"
 
 #include <errno.h>
+#include <float.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <linux/limits.h>
-#include <fenv.h>
-#include <float.h>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <GLFW/glfw3.h>
 
 #include "spectr/config.h"
+#include "spectr/defines.h"
 #include "spectr/decoding/stat.h"
 #include "spectr/rendering/glinit.h"
+#include "spectr/rendering/gpu.h"
+#include "spectr/rendering/pyramid.h"
+#include "spectr/rendering/refine.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/transform/live.h"
 #include "spectr/util/complex.h"
 #include "spectr/util/fonts.h"
 #include "spectr/util/math.h"
+#include "spectr/util/profile.h"
+
+/*!
+ * \brief This structure stores the state of our interactive viewer.
+ *
+ * The viewer displays the samples [begin, end) of the track, out of length
+ * samples in total. Whenever that range or the size of the window changes, the
+ * visible range is read from the spectrogram's pyramid, if it has at least one
+ * frame per pixel, or transformed again from the raw audio at the resolution
+ * it is displayed at otherwise. If we have neither (e.g. because the audio was
+ * streamed), length is 0, and we can only display the spectrogram we were
+ * given, stretched to fit the window.
+ *
+ * If use_gpu is set, ranges are transformed again on the GPU instead (see
+ * s_gpu_spectrogram), straight into texture, whenever the GPU supports it.
+ *
+ * A live viewer instead displays the columns of a live spectrogram, which are
+ * uploaded into a persistent texture one by one as they arrive (live_next is
+ * the next frame to upload), and scrolled so the newest column is on the
+ * right. It can't be zoomed or panned.
+ *
+ * A progressive viewer displays a spectrogram which is refined in the
+ * background (see s_refine_t). Until it is done, there is no pyramid, and the
+ * whole track is displayed from a persistent texture (if refining is set),
+ * whose columns are uploaded again as they are refined. Once it is done, the
+ * viewer switches to the refined spectrogram and its pyramid.
+ *
+ * The texture holds the raw magnitudes of the spectrogram, whose range is
+ * [min_magnitude, max_magnitude]. Our colormap spans that range, with its
+ * floor and ceiling moved by floor_db and ceiling_db, and gamma applied, so
+ * changing the contrast never touches the texture.
+ */
+typedef struct s_viewer
+{
+	const s_spectrogram_t *initial;
+	s_live_t *live;
+	size_t live_next;
+	s_refine_t *refine;
+	int refining;
+	const s_raw_audio_t *raw;
+	const s_pyramid_t *pyramid;
+	s_window_type_t function;
+	s_precision_t precision;
+	s_scale_type_t scale;
+	size_t threads;
+	int use_gpu;
+	s_gpu_stft_t *gpu;
+
+	s_spectrogram_t *visible;
+	size_t length;
+	size_t begin;
+	size_t end;
+
+	int x_min;
+	int y_min;
+	int x_max;
+	int y_max;
+	size_t view_w;
+	size_t view_h;
+
+	int stale;
+	int relayout;
+
+	s_vbo_t vbo[2];
+	GLfloat frame[24];
+	GLfloat quad[18];
+
+	GLfloat *pixels;
+	size_t pixels_w;
+	size_t pixels_h;
+	double min_magnitude;
+	double max_magnitude;
+	double floor_db;
+	double ceiling_db;
+	double gamma;
+	GLuint texture;
+	GLfloat scroll;
+} s_viewer_t;
+
+int s_viewer_run(s_viewer_t *, const s_audio_stat_t *, size_t);
+int s_render_scene(void *, GLuint *);
+int s_viewer_resize(void *, int, int);
+int s_viewer_key(void *, int, int);
+int s_viewer_scroll(void *, double, double);
+int s_viewer_poll(void *);
+int s_viewer_column(void *, size_t, const float *);
+int s_viewer_refine(s_viewer_t *);
+int s_viewer_refined(void *, size_t, size_t, const float *);
+void s_viewer_close(void *);
+int s_viewer_zoom(s_viewer_t *, double, double);
+int s_viewer_pan(s_viewer_t *, double);
+int s_viewer_set_range(s_viewer_t *, size_t, size_t);
+int s_viewer_contrast(s_viewer_t *, double, double, double);
+int s_viewer_update(s_viewer_t *);
+int s_viewer_update_gpu(s_viewer_t *);
+void s_viewer_layout(s_viewer_t *);
+int s_alloc_spectrogram_pixels(s_viewer_t *, const s_spectrogram_t *);
+int s_render_legend_frame(const s_viewer_t *, GLuint *);
+int s_init_legend_labels(const s_audio_stat_t *, size_t);
+void s_free_legend_labels();
+int s_render_legend_labels();
+int s_render_stft(s_viewer_t *, GLuint *);
 
-int s_render_loop(const s_stft_t *, GLuint *);
-void s_set_spectrogram_vec3(GLfloat *, size_t, uint32_t *,
-	size_t, size_t, GLfloat, GLfloat, GLfloat);
-int s_alloc_stft_vbo(s_vbo_t *, const s_stft_t *);
-int s_render_legend_frame(GLuint *);
-int s_render_legend_labels(const s_stft_t *);
-int s_render_stft(GLuint *);
+/*!
+ * \brief The FreeType library instance used to render our legend labels.
+ */
+static FT_Library s_legend_library;
 
 /*!
- * \brief This list stores all of the VBO's we use for rendering.
+ * \brief The font face used to render our legend labels.
  */
-static s_vbo_t *s_vbo_list = NULL;
+static FT_Face s_legend_font;
 
 /*!
- * \brief This stores the length of s_vbo_list.
+ * \brief The track duration label, formatted once before rendering starts.
  */
-static size_t s_vbo_list_length = 0;
+static char s_legend_duration[32];
 
 /*!
- * \brief This stores our maximum DFT magnitude.
+ * \brief The Nyquist frequency label, formatted once before rendering starts.
  */
-static double s_max_magnitude = 0.0f;
+static char s_legend_nyquist[32];
 
 /*!
- * This function starts our OpenGL rendering loop, to render the given STFT's
+ * This function starts our OpenGL rendering loop, to render the given
  * spectrogram.
  *
- * \param stft The STFT whose spectrogram should be rendered.
+ * If the raw audio the spectrogram was computed from, or its pyramid, is
+ * given, the viewer can be zoomed and panned: only the visible range is read
+ * from the pyramid or transformed again, at the resolution of the window.
+ * Otherwise, the given spectrogram is displayed as-is.
+ *
+ * \param sg The spectrogram which should be rendered.
+ * \param raw The raw audio the spectrogram was computed from, or NULL.
+ * \param pyramid The pyramid of the spectrogram's STFT, or NULL.
+ * \param fn The window function to use for the visible range's STFT.
+ * \param precision The precision to compute the visible range's STFT in.
+ * \param scale The scale of the spectrogram's frequency axis.
+ * \param threads The number of STFT threads to use, or 0 for one per CPU.
+ * \param gpu Whether to transform the visible range on the GPU, if possible.
  * \return 0 on success, or an error number if something goes wrong.
  */
-int s_render(const s_stft_t *stft)
+int s_render(const s_spectrogram_t *sg, const s_raw_audio_t *raw,
+	const s_pyramid_t *pyramid, s_window_type_t fn,
+	s_precision_t precision, s_scale_type_t scale, size_t threads,
+	int gpu)
 {
 	int ret = 0;
 	int r;
+	s_viewer_t viewer;
+
+	memset(&viewer, 0, sizeof(s_viewer_t));
+
+	viewer.initial = sg;
+	viewer.raw = raw;
+	viewer.pyramid = pyramid;
+	viewer.function = fn;
+	viewer.precision = precision;
+	viewer.scale = scale;
+	viewer.threads = threads;
+	viewer.use_gpu = gpu && (raw != NULL);
+
+	if(raw != NULL)
+		viewer.length = raw->samples_length;
+	else if(pyramid != NULL)
+		viewer.length = pyramid->raw_length;
 
-	// Allocate the list of VBO objects we'll use.
+	viewer.begin = 0;
+	viewer.end = viewer.length;
 
-	s_vbo_list_length = 2;
-	s_vbo_list = (s_vbo_t *) malloc(sizeof(s_vbo_t) * s_vbo_list_length);
+	// Compute the texture for the spectrogram we were given.
 
-	if(s_vbo_list == NULL)
+	r = s_alloc_spectrogram_pixels(&viewer, sg);
+
+	if(r < 0)
 	{
-		ret = -ENOMEM;
+		ret = r;
 		goto done;
 	}
 
-	// Set the values of the legend frame vertices.
+	r = s_viewer_run(&viewer, &(sg->raw_stat), sg->raw_length);
 
-	s_vbo_list[0].data = (GLfloat[24]) {
-		S_VIEW_X_MIN - S_SPEC_LGND_TICK_SIZE, S_VIEW_Y_MIN, -1.0f,
-		S_VIEW_X_MAX, S_VIEW_Y_MIN, -1.0f,
+	if(r < 0)
+		ret = r;
 
-		S_VIEW_X_MAX, S_VIEW_Y_MIN, -1.0f,
-		S_VIEW_X_MAX, S_VIEW_Y_MAX + S_SPEC_LGND_TICK_SIZE, -1.0f,
+	free(viewer.pixels);
+	s_free_spectrogram(&(viewer.visible));
+done:
+	return ret;
+}
 
-		S_VIEW_X_MAX, S_VIEW_Y_MAX, -1.0f,
-		S_VIEW_X_MIN - S_SPEC_LGND_TICK_SIZE, S_VIEW_Y_MAX, -1.0f,
+/*!
+ * This function starts our OpenGL rendering loop, to render the given live
+ * spectrogram as it is computed. The live spectrogram's reader is started
+ * once the viewer is ready, and stopped again when the viewer is closed.
+ *
+ * Each new frame is uploaded on its own, as a single column of a persistent
+ * texture, and the scene is rendered again as soon as it arrives, so a frame
+ * is displayed within a hop of its last sample being read.
+ *
+ * \param live The live spectrogram which should be rendered.
+ * \param hop The number of samples between the starts of adjacent frames.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_render_live(s_live_t *live, size_t hop)
+{
+	int ret = 0;
+	int r;
+	size_t i;
+	s_viewer_t viewer;
+
+	memset(&viewer, 0, sizeof(s_viewer_t));
+
+	viewer.live = live;
+	viewer.live_next = 0;
+	viewer.scale = live->scale;
+
+	/*
+	 * The texture starts out empty, and is created from these pixels the
+	 * first time the viewer is updated (once the GL context exists).
+	 */
+
+	viewer.pixels = malloc(live->width * live->height * sizeof(GLfloat));
 
-		S_VIEW_X_MIN, S_VIEW_Y_MAX + S_SPEC_LGND_TICK_SIZE, -1.0f,
-		S_VIEW_X_MIN, S_VIEW_Y_MIN, -1.0f
-	};
+	if(viewer.pixels == NULL)
+		return -ENOMEM;
 
-	s_vbo_list[0].length = 24;
-	s_vbo_list[0].usage = GL_STATIC_DRAW;
-	s_vbo_list[0].mode = GL_LINES;
+	viewer.pixels_w = live->width;
+	viewer.pixels_h = live->height;
 
-	// Initialize the structure for the spectrogram itself.
+	for(i = 0; i < live->width * live->height; ++i)
+		viewer.pixels[i] = -FLT_MAX;
 
-	r = s_alloc_stft_vbo(&(s_vbo_list[1]), stft);
+	r = s_live_start(live, s_wake_gl);
 
 	if(r < 0)
 	{
 		ret = r;
-		goto err_after_vbo_alloc;
+		goto done;
 	}
 
-	// Initialize the GL context, and start the rendering loop.
+	// The legend's duration is how far back the spectrogram reaches.
+
+	r = s_viewer_run(&viewer, &(live->stat), live->width * hop);
+
+	if(r < 0)
+		ret = r;
+
+	s_live_stop(live);
+
+done:
+	free(viewer.pixels);
+	return ret;
+}
+
+/*!
+ * This function starts our OpenGL rendering loop, to render the given
+ * spectrogram while it is refined. Its coarse overview is displayed straight
+ * away, and its worker is started once the viewer is ready, and stopped again
+ * when the viewer is closed (whether or not it is done).
+ *
+ * Each block of refined columns is uploaded on its own, as a region of a
+ * persistent texture. While the spectrogram is being refined, zoomed-in ranges
+ * are transformed again from the raw audio (see s_viewer_update).
+ *
+ * \param refine The spectrogram which should be refined and rendered.
+ * \param gpu Whether to transform the visible range on the GPU, if possible.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_render_refine(s_refine_t *refine, int gpu)
+{
+	int ret = 0;
+	int r;
+	s_viewer_t viewer;
+
+	memset(&viewer, 0, sizeof(s_viewer_t));
+
+	viewer.refine = refine;
+	viewer.raw = refine->raw;
+	viewer.function = refine->fn;
+	viewer.precision = refine->precision;
+	viewer.scale = refine->scale;
+	viewer.threads = refine->threads;
+	viewer.use_gpu = gpu;
+
+	viewer.length = refine->raw->samples_length;
+	viewer.begin = 0;
+	viewer.end = viewer.length;
+
+	// The texture is created the first time the scene is rendered.
+
+	viewer.stale = 1;
+
+	r = s_refine_start(refine, s_wake_gl);
+
+	if(r < 0)
+		return r;
+
+	r = s_viewer_run(&viewer, &(refine->raw->stat),
+		refine->raw->samples_length);
+
+	if(r < 0)
+		ret = r;
+
+	s_refine_stop(refine);
+
+	free(viewer.pixels);
+	s_free_spectrogram(&(viewer.visible));
+	return ret;
+}
+
+/*!
+ * This function lays out the given viewer, and then runs our OpenGL rendering
+ * loop with it until the window is closed.
+ *
+ * \param viewer The viewer to run.
+ * \param stat The properties of the audio being displayed.
+ * \param length The number of samples the viewer spans, for the legend.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_viewer_run(s_viewer_t *viewer, const s_audio_stat_t *stat,
+	size_t length)
+{
+	int ret = 0;
+	int r;
+	s_gl_handler_t handler;
 
-	r = s_init_gl(s_render_loop, s_vbo_list, s_vbo_list_length, stft);
+	// Set up the VBO's for the legend frame and the spectrogram's quad.
+
+	viewer->vbo[0].data = viewer->frame;
+	viewer->vbo[0].length = 24;
+	viewer->vbo[0].usage = GL_STATIC_DRAW;
+	viewer->vbo[0].mode = GL_LINES;
+
+	viewer->vbo[1].data = viewer->quad;
+	viewer->vbo[1].length = 18;
+	viewer->vbo[1].usage = GL_STATIC_DRAW;
+	viewer->vbo[1].mode = GL_TRIANGLES;
+
+	viewer->view_w = S_VIEW_W;
+	viewer->view_h = S_VIEW_H;
+	viewer->gamma = 1.0;
+
+	s_viewer_layout(viewer);
+
+	// Load our font and format the legend labels.
+
+	r = s_init_legend_labels(stat, length);
 
 	if(r < 0)
 	{
 		ret = r;
-		goto err_after_stft_alloc;
+		goto done;
 	}
 
+	// Initialize the GL context, and start the rendering loop.
+
+	handler.ctx = viewer;
+	handler.render = s_render_scene;
+	handler.resize = s_viewer_resize;
+	handler.key = s_viewer_key;
+	handler.scroll = s_viewer_scroll;
+	handler.update = (viewer->live != NULL) || (viewer->refine != NULL) ?
+		s_viewer_poll : NULL;
+	handler.close = s_viewer_close;
+
+	r = s_init_gl(&handler, viewer->vbo, 2);
+
+	if(r < 0)
+		ret = r;
+
 	// Clean up and return.
 
-err_after_stft_alloc:
-	free(s_vbo_list[1].data);
-err_after_vbo_alloc:
-	free(s_vbo_list);
+	s_free_legend_labels();
 done:
 	return ret;
 }
 
 /*!
- * This function is passed to our OpenGL initialization function, and is called
- * during each render loop. See s_init_gl for details.
+ * This function is our viewer's render function (see s_gl_handler_t). It
+ * brings the spectrogram and the layout up to date if they have changed, and
+ * then renders the scene.
  *
- * \param stft The STFT whose spectrogram should be rendered.
+ * \param ctx The s_viewer_t being rendered.
  * \param vao The VAO which has been configured for each of our VBO's.
  * \return 0 on success, or an error number if something goes wrong.
  */
-int s_render_loop(const s_stft_t *stft, GLuint *vao)
+int s_render_scene(void *ctx, GLuint *vao)
 {
 	int r;
+	s_viewer_t *viewer = ctx;
+	double begin = s_profile_begin();
+
+	// Bring our state up to date.
+
+	if(viewer->stale)
+	{
+		r = s_viewer_update(viewer);
+
+		if(r < 0)
+			return r;
+
+		viewer->stale = 0;
+	}
+
+	if(viewer->relayout)
+	{
+		s_update_vbo(&(viewer->vbo[0]));
+		s_update_vbo(&(viewer->vbo[1]));
+
+		viewer->relayout = 0;
+	}
+
+	r = s_set_viewport(viewer->x_min + 1, viewer->y_min + 1,
+		viewer->x_max, viewer->y_max);
+
+	if(r < 0)
+		return r;
 
 	// Render the frame / legend around the output.
 
-	r = s_render_legend_frame(vao);
+	r = s_render_legend_frame(viewer, vao);
 
 	if(r < 0)
 		return r;
 
-	r = s_render_legend_labels(stft);
+	r = s_render_legend_labels();
 
 	if(r < 0)
 		return r;
 
 	// Render the actual graphical STFT output.
 
-	r = s_render_stft(vao);
+	r = s_render_stft(viewer, vao);
 
 	if(r < 0)
 		return r;
 
 	// Done!
 
+	s_profile_count(COUNTER_RENDERED, 1);
+	s_profile_end(STAGE_RENDER, begin);
+
 	return 0;
 }
 
 /*!
- * This is a small convenience function which sets the values of a 3-vector
- * at a given position in our list of spectrogram points.
- *
- * \param arr The list of spectrogram points.
- * \param arrw The width of a "row" in the array; the maximum y value, incl.
- * \param avg The number of values being averaged in each array cell.
- * \param ix The X index of the pixel being set.
- * \param iy The Y index of the pixel being set.
- * \param x The X-component of the 3-vector.
- * \param y The Y-component of the 3-vector.
- * \param z The Z-component of the 3-vector.
- */
-void s_set_spectrogram_vec3(GLfloat *arr, size_t arrw,
-	uint32_t *avg, size_t ix, size_t iy, GLfloat x, GLfloat y, GLfloat z)
+ * This function is our viewer's resize function (see s_gl_handler_t). The
+ * spectrogram's frame keeps its margins, and the spectrogram itself fills the
+ * rest of the window.
+ *
+ * \param ctx The s_viewer_t being resized.
+ * \param w The new width of the window.
+ * \param h The new height of the window.
+ * \return 1, since the scene must always be rendered again.
+ */
+int s_viewer_resize(void *ctx, int w, int h)
 {
-	size_t aidx;
-	size_t idx;
+	s_viewer_t *viewer = ctx;
+	int vw = w - S_VIEW_X_MIN - 1 - S_VIEW_PAD_RIGHT;
+	int vh = h - S_VIEW_Y_MIN - 1 - S_VIEW_PAD_BOTTOM;
 
-	aidx = arrw * iy + ix;
-	idx = aidx * 3;
+	viewer->view_w = vw < 1 ? 1 : (size_t) vw;
+	viewer->view_h = vh < 1 ? 1 : (size_t) vh;
 
-	arr[idx] = x;
-	arr[idx + 1] = y;
+	s_viewer_layout(viewer);
 
-	arr[idx + 2] = (arr[idx + 2] * (avg[aidx] / (avg[aidx] + 1.0))) +
-		(z / (avg[aidx] + 1.0));;
+	viewer->stale = 1;
 
-	++avg[aidx];
+	return 1;
 }
 
 /*!
- * This function allocates and computes the vertices for the buffer which will
- * render our spectrogram.
+ * This function is our viewer's key function (see s_gl_handler_t). The plus
+ * and minus keys zoom in and out around the middle of the visible range, the
+ * left and right arrow keys pan, and 0 or Home resets the view to the whole
+ * track. The bracket keys lower and raise the colormap's floor, the comma and
+ * period keys lower and raise its ceiling, the semicolon and apostrophe keys
+ * lower and raise its gamma, and R resets the contrast.
  *
- * \param vbo The VBO being populated with spectrogram vertices.
- * \param stft The STFT data being rendered.
- * \return 0 on success, or an error number if something goes wrong.
+ * \param ctx The s_viewer_t which received the key press.
+ * \param key The GLFW key code of the key which was pressed.
+ * \param mods The modifier keys which were held down.
+ * \return 1 if the view changed, 0 if not, or an error number.
+ */
+int s_viewer_key(void *ctx, int key, int UNUSED(mods))
+{
+	s_viewer_t *viewer = ctx;
+
+	switch(key)
+	{
+		case GLFW_KEY_EQUAL:
+			return s_viewer_zoom(viewer,
+				1.0 / S_VIEW_ZOOM_FACTOR, 0.5);
+
+		case GLFW_KEY_MINUS:
+			return s_viewer_zoom(viewer, S_VIEW_ZOOM_FACTOR, 0.5);
+
+		case GLFW_KEY_LEFT:
+			return s_viewer_pan(viewer, -S_VIEW_PAN_FRACTION);
+
+		case GLFW_KEY_RIGHT:
+			return s_viewer_pan(viewer, S_VIEW_PAN_FRACTION);
+
+		case GLFW_KEY_0:
+		case GLFW_KEY_HOME:
+			return s_viewer_set_range(viewer, 0, viewer->length);
+
+		case GLFW_KEY_LEFT_BRACKET:
+			return s_viewer_contrast(viewer, -S_VIEW_RANGE_STEP,
+				0.0, 1.0);
+
+		case GLFW_KEY_RIGHT_BRACKET:
+			return s_viewer_contrast(viewer, S_VIEW_RANGE_STEP,
+				0.0, 1.0);
+
+		case GLFW_KEY_COMMA:
+			return s_viewer_contrast(viewer, 0.0,
+				-S_VIEW_RANGE_STEP, 1.0);
+
+		case GLFW_KEY_PERIOD:
+			return s_viewer_contrast(viewer, 0.0,
+				S_VIEW_RANGE_STEP, 1.0);
+
+		case GLFW_KEY_SEMICOLON:
+			return s_viewer_contrast(viewer, 0.0, 0.0,
+				1.0 / S_VIEW_GAMMA_STEP);
+
+		case GLFW_KEY_APOSTROPHE:
+			return s_viewer_contrast(viewer, 0.0, 0.0,
+				S_VIEW_GAMMA_STEP);
+
+		case GLFW_KEY_R:
+			viewer->floor_db = 0.0;
+			viewer->ceiling_db = 0.0;
+			viewer->gamma = 1.0;
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+/*!
+ * This function is our viewer's scroll function (see s_gl_handler_t). The
+ * scroll wheel zooms in and out around the sample under the cursor.
+ *
+ * \param ctx The s_viewer_t which received the scroll event.
+ * \param x The X position of the cursor, in window coordinates.
+ * \param off The vertical scroll offset.
+ * \return 1 if the view changed, 0 if not, or an error number.
+ */
+int s_viewer_scroll(void *ctx, double x, double off)
+{
+	s_viewer_t *viewer = ctx;
+	double anchor;
+
+	anchor = (x - (double) (viewer->x_min + 1)) / (double) viewer->view_w;
+	anchor = fmin(fmax(anchor, 0.0), 1.0);
+
+	return s_viewer_zoom(viewer, pow(S_VIEW_ZOOM_FACTOR, -off), anchor);
+}
+
+/*!
+ * This function is a live or progressive viewer's update function (see
+ * s_gl_handler_t). A live viewer uploads each frame which has been added to
+ * the live spectrogram since the last update into its column of our texture
+ * (creating the texture the first time), and scrolls the texture so the
+ * newest column is on the right. A progressive viewer is updated by
+ * s_viewer_refine instead.
+ *
+ * \param ctx The s_viewer_t being updated.
+ * \return 1 if there were new frames, 0 if not, or an error number.
  */
-int s_alloc_stft_vbo(s_vbo_t *vbo, const s_stft_t *stft)
+int s_viewer_poll(void *ctx)
 {
 	int r;
+	float min;
+	float max;
+	s_viewer_t *viewer = ctx;
 
-	size_t idx;
-	size_t stfti;
-	size_t dfti;
+	if(viewer->refine != NULL)
+		return s_viewer_refine(viewer);
 
-	double x;
-	double y;
-	double z;
+	if(viewer->live == NULL)
+		return 0;
 
-	double minz = DBL_MAX;
-	double maxz = 0.0;
+	if(viewer->texture == 0)
+	{
+		r = s_init_magnitude_texture(&(viewer->texture),
+			viewer->pixels, (GLsizei) viewer->pixels_w,
+			(GLsizei) viewer->pixels_h);
 
-	// Set our rounding mode.
+		if(r < 0)
+			return r;
 
-	r = fesetround(FE_TONEAREST);
+		// Wrap around horizontally, so the texture can be scrolled.
 
-	if(r != 0)
-		return -EINVAL;
+		glBindTexture(GL_TEXTURE_2D, viewer->texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
 
-	/*
-	 * Allocate memory for the points. Note that spectrogram points are
-	 * 3-vectors of (time, frequency, magnitude).
-	 */
+	r = s_live_read(viewer->live, &(viewer->live_next), s_viewer_column,
+		viewer);
 
-	vbo->data = (GLfloat *)
-		calloc(S_VIEW_W * S_VIEW_W * 3, sizeof(GLfloat));
+	if(r <= 0)
+		return r;
 
-	if(vbo->data == NULL)
-		return -ENOMEM;
+	s_live_range(viewer->live, &min, &max);
 
-	vbo->length = S_VIEW_W * S_VIEW_H * 3;
-	vbo->usage = GL_STATIC_DRAW;
-	vbo->mode = GL_POINTS;
+	viewer->min_magnitude = min;
+	viewer->max_magnitude = max;
 
-	/*
-	 * Allocate an array to keep track of average counts, so we can compute
-	 * the average of DFT results that all fall in the same pixel.
-	 */
+	// The oldest column is the one the next frame will overwrite.
+
+	viewer->scroll = (GLfloat) (viewer->live_next % viewer->pixels_w) /
+		(GLfloat) viewer->pixels_w;
+
+	return 1;
+}
+
+/*!
+ * This function uploads a single column of a live spectrogram (see
+ * s_live_read) into our texture.
+ *
+ * \param ctx The s_viewer_t whose texture should be updated.
+ * \param x The column to update.
+ * \param column The column's values, from the lowest row to the highest.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_viewer_column(void *ctx, size_t x, const float *column)
+{
+	s_viewer_t *viewer = ctx;
+
+	return s_update_magnitude_column(viewer->texture, (GLint) x, column,
+		(GLsizei) viewer->pixels_h);
+}
+
+/*!
+ * This function updates a progressive viewer (see s_viewer_poll). While the
+ * spectrogram is being refined, each block of columns which has been refined
+ * since the last update is uploaded into our texture, if it is displayed.
+ * Once it is done, the viewer switches to the refined spectrogram and its
+ * pyramid, exactly as if they had been computed up front.
+ *
+ * \param viewer The viewer to update.
+ * \return 1 if the view changed, 0 if not, or an error number.
+ */
+int s_viewer_refine(s_viewer_t *viewer)
+{
+	int r;
+	float min;
+	float max;
 
-	uint32_t *averageCount = (uint32_t *)
-		calloc(S_VIEW_W * S_VIEW_H, sizeof(uint32_t));
+	r = s_refine_result(viewer->refine);
 
-	if(averageCount == NULL)
+	if(r < 0)
+		return r;
+
+	if(r > 0)
 	{
-		free(vbo->data);
-		return -ENOMEM;
+		viewer->initial = viewer->refine->spectrogram;
+		viewer->pyramid = viewer->refine->pyramid;
+		viewer->refine = NULL;
+		viewer->stale = 1;
+
+		return 1;
 	}
 
-	// Compute the value of each point we'll render.
+	if(!viewer->refining)
+		return 0;
+
+	r = s_refine_read(viewer->refine, 0, s_viewer_refined, viewer);
+
+	if(r <= 0)
+		return r;
+
+	s_refine_range(viewer->refine, &min, &max);
+
+	viewer->min_magnitude = min;
+	viewer->max_magnitude = max;
+
+	return 1;
+}
 
-	for(stfti = 0; stfti < stft->length; ++stfti)
+/*!
+ * This function uploads the columns [x0, x1) of a refined spectrogram (see
+ * s_refine_read) into our texture, creating the texture from all of them if
+ * we don't have one yet.
+ *
+ * \param ctx The s_viewer_t whose texture should be updated.
+ * \param x0 The first column to update.
+ * \param x1 The column one past the last to update.
+ * \param texels All of the spectrogram's texels.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_viewer_refined(void *ctx, size_t x0, size_t x1, const float *texels)
+{
+	s_viewer_t *viewer = ctx;
+	const s_refine_t *refine = viewer->refine;
+
+	if(viewer->texture == 0)
 	{
-		for(dfti = 1; dfti < stft->dfts[stfti]->length / 2; ++dfti)
-		{
-			/*
-			 * Scale the X value to the range of pixels in our
-			 * spectrogram viewport. For the Y value, we can just
-			 * shift it up to be inside the spectrogram viewport,
-			 * since our viewport's rows are mapped 1-1 to DFT
-			 * frequency bins.
-			 */
+		return s_init_magnitude_texture(&(viewer->texture), texels,
+			(GLsizei) refine->width, (GLsizei) refine->height);
+	}
 
-			x = s_scale(0, stft->length, S_VIEW_X_MIN + 1,
-				S_VIEW_X_MAX - 1, stfti);
+	return s_update_magnitude_columns(viewer->texture, (GLint) x0,
+		(GLsizei) (x1 - x0), texels + x0, (GLsizei) refine->width,
+		(GLsizei) refine->height);
+}
 
-			y = (double) (dfti + S_VIEW_Y_MIN);
+/*!
+ * This function is our viewer's close function (see s_gl_handler_t). It
+ * deletes the viewer's persistent texture (if it has one), and its GPU STFT.
+ *
+ * \param ctx The s_viewer_t being closed.
+ */
+void s_viewer_close(void *ctx)
+{
+	s_viewer_t *viewer = ctx;
 
-			// Round the X value to the nearest integer pixel.
+	s_free_gpu_stft(&(viewer->gpu));
 
-			x = rint(x);
+	if(viewer->texture != 0)
+	{
+		glDeleteTextures(1, &(viewer->texture));
+		viewer->texture = 0;
+	}
+}
 
-			// Clip the X value to be inside our viewport.
+/*!
+ * This function scales the visible range of the viewer by the given factor,
+ * keeping the sample at the given fraction of the range in place. The range is
+ * kept within the track, and is never shorter than S_VIEW_MIN_SAMPLES.
+ *
+ * \param viewer The viewer to zoom.
+ * \param factor The factor to scale the visible range by.
+ * \param anchor The fraction of the visible range which stays in place.
+ * \return 1 if the view changed, or 0 if not.
+ */
+int s_viewer_zoom(s_viewer_t *viewer, double factor, double anchor)
+{
+	double length;
+	double span;
+	double center;
+	double begin;
 
-			x = fmax(x, S_VIEW_X_MIN + 1);
-			x = fmin(x, S_VIEW_X_MAX - 1);
+	if(viewer->length == 0)
+		return 0;
 
-			/*
-			 * Compute the Z value of this DFT result. We take the
-			 * base-10 logarithm of the value, since e.g. decibels
-			 * are a logarithmic scale, so our output will map more
-			 * directly to e.g. human hearing.
-			 */
+	length = (double) viewer->length;
 
-			z = s_magnitude(&(stft->dfts[stfti]->dft[dfti]));
-			z = log10(z);
+	span = (double) (viewer->end - viewer->begin);
+	center = (double) viewer->begin + anchor * span;
 
-			// If we got a bogus Z value, just skip it.
+	span = fmin(fmax(span * factor, fmin(S_VIEW_MIN_SAMPLES, length)),
+		length);
 
-			if(isinf(z) || isnan(z))
-				continue;
+	begin = fmin(fmax(center - anchor * span, 0.0), length - span);
 
-			// Set the value in our list.
+	return s_viewer_set_range(viewer, (size_t) begin,
+		(size_t) (begin + span));
+}
 
-			s_set_spectrogram_vec3(
-				vbo->data,
-				S_VIEW_W,
-				averageCount,
+/*!
+ * This function moves the visible range of the viewer by the given fraction
+ * of its width, keeping it within the track.
+ *
+ * \param viewer The viewer to pan.
+ * \param fraction The fraction of the visible range to move it by.
+ * \return 1 if the view changed, or 0 if not.
+ */
+int s_viewer_pan(s_viewer_t *viewer, double fraction)
+{
+	double length;
+	double span;
+	double begin;
 
-				/*
-				 * The X and Y positions *in the array* need to
-				 * be 0-indexed, not S_VIEW_Y_MIN + 1 indexed.
-				 */
-				x - ((double) S_VIEW_X_MIN) - 1.0,
-				y - ((double) S_VIEW_Y_MIN) - 1.0,
+	if(viewer->length == 0)
+		return 0;
 
-				x,
+	length = (double) viewer->length;
+	span = (double) (viewer->end - viewer->begin);
 
-				/*
-				 * Shift our Y value to be inside the
-				 * spectrogram viewport area. We are reversing
-				 * it, since in our OpenGL projection pixel
-				 * (0,0) is at the top left of the window,
-				 * instead of the bottom left.
-				 */
-				((double) S_VIEW_Y_MAX) - y +
-					((double) S_VIEW_Y_MIN),
+	begin = (double) viewer->begin + fraction * span;
+	begin = fmin(fmax(begin, 0.0), length - span);
 
-				z
-			);
-		}
+	return s_viewer_set_range(viewer, (size_t) begin,
+		(size_t) begin + (viewer->end - viewer->begin));
+}
+
+/*!
+ * This function sets the visible range of the viewer, marking its spectrogram
+ * as stale if the range has changed.
+ *
+ * \param viewer The viewer whose range is being set.
+ * \param begin The offset of the first visible sample.
+ * \param end The offset one past the last visible sample.
+ * \return 1 if the view changed, or 0 if not.
+ */
+int s_viewer_set_range(s_viewer_t *viewer, size_t begin, size_t end)
+{
+	if((begin == viewer->begin) && (end == viewer->end))
+		return 0;
+
+	viewer->begin = begin;
+	viewer->end = end;
+	viewer->stale = 1;
+
+	return 1;
+}
+
+/*!
+ * This function adjusts the viewer's contrast: the given amounts (in dB) are
+ * added to the colormap's floor and ceiling, and its gamma is scaled by the
+ * given factor. Only our fragment shader's uniforms change, so the scene is
+ * rendered again without recomputing (or uploading) the spectrogram. The
+ * floor is never raised to the ceiling, or above it.
+ *
+ * \param viewer The viewer whose contrast is being adjusted.
+ * \param lower The amount to move the floor by, in dB.
+ * \param upper The amount to move the ceiling by, in dB.
+ * \param factor The factor to scale the gamma by.
+ * \return 1 if the contrast changed, or 0 if not.
+ */
+int s_viewer_contrast(s_viewer_t *viewer, double lower, double upper,
+	double factor)
+{
+	double range = (viewer->max_magnitude - viewer->min_magnitude) * 20.0;
+
+	if(viewer->ceiling_db + upper - (viewer->floor_db + lower) <= -range)
+		return 0;
+
+	viewer->floor_db += lower;
+	viewer->ceiling_db += upper;
+	viewer->gamma *= factor;
+
+	return 1;
+}
+
+/*!
+ * This function recomputes the viewer's spectrogram for its current visible
+ * range and size, and the texture we'll render it with.
+ *
+ * When the whole track is visible at the size the initial spectrogram was
+ * computed at, we just display that spectrogram again, instead. Otherwise, we
+ * read the range from our pyramid if it has at least one frame per pixel, and
+ * only transform the raw audio again when zoomed in further than that (on the
+ * GPU, if we can).
+ *
+ * A live viewer's texture is only ever updated as frames arrive (see
+ * s_viewer_poll), and is just stretched to fit the window. While a progressive
+ * viewer's spectrogram is being refined, the whole track is displayed from the
+ * texels refined so far, at the size they are refined at.
+ *
+ * \param viewer The viewer to update.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_viewer_update(s_viewer_t *viewer)
+{
+	int r;
+	float min;
+	float max;
+	const s_pyramid_t *p = viewer->pyramid;
+
+	if(viewer->live != NULL)
+		return 0;
+
+	// The texture of the last range (or size) is out of date.
+
+	if(viewer->texture != 0)
+	{
+		glDeleteTextures(1, &(viewer->texture));
+		viewer->texture = 0;
 	}
 
-	// Get the minimum and maximum Z values.
+	viewer->refining = 0;
 
-	for(idx = 2; idx < vbo->length; idx += 3)
+	if((viewer->refine != NULL) && (viewer->begin == 0) &&
+		(viewer->end == viewer->length) &&
+		(viewer->view_w == viewer->refine->width) &&
+		(viewer->view_h == viewer->refine->height))
 	{
-		/*
-		 * If this value is still zero (i.e., it was never set in the
-		 * loop above), then don't include it in the range computation.
-		 */
+		s_free_spectrogram(&(viewer->visible));
+
+		r = s_refine_read(viewer->refine, 1, s_viewer_refined, viewer);
+
+		if(r < 0)
+			return r;
 
-		if(fabs(vbo->data[idx]) < 0.0001)
-			continue;
+		s_refine_range(viewer->refine, &min, &max);
+
+		viewer->min_magnitude = min;
+		viewer->max_magnitude = max;
+		viewer->refining = 1;
+
+		return 0;
+	}
+
+	if((viewer->length == 0) || ((viewer->initial != NULL) &&
+		(viewer->begin == 0) && (viewer->end == viewer->length) &&
+		(viewer->view_w == viewer->initial->width) &&
+		(viewer->view_h == viewer->initial->height)))
+	{
+		s_free_spectrogram(&(viewer->visible));
 
-		minz = fmin(minz, vbo->data[idx]);
-		maxz = fmax(maxz, vbo->data[idx]);
+		return s_alloc_spectrogram_pixels(viewer, viewer->initial);
 	}
 
+	if((p != NULL) && ((viewer->raw == NULL) ||
+		(viewer->end - viewer->begin >= viewer->view_w * p->hop)))
+	{
+		r = s_spectrogram_from_pyramid(&(viewer->visible), p,
+			viewer->begin, viewer->end, viewer->view_w,
+			viewer->view_h);
+	}
+	else
+	{
+		r = viewer->use_gpu ? s_viewer_update_gpu(viewer) : -ENOTSUP;
+
+		if(r != -ENOTSUP)
+			return r;
+
+		r = s_spectrogram_from_range(&(viewer->visible), viewer->raw,
+			viewer->begin, viewer->end, viewer->view_w,
+			viewer->view_h, viewer->scale, viewer->function,
+			viewer->precision, viewer->threads);
+	}
+
+	if(r < 0)
+		return r;
+
+	return s_alloc_spectrogram_pixels(viewer, viewer->visible);
+}
+
+/*!
+ * This function computes the viewer's visible range on the GPU, straight into
+ * its texture (see s_gpu_spectrogram). The raw audio is uploaded the first
+ * time this is done. If the GPU can't do this at all (e.g., the GL context is
+ * older than 4.3, or the track is too long), we stop trying; if it only can't
+ * for this range (e.g., the window is too tall), we'll try again next time.
+ *
+ * \param viewer The viewer to update.
+ * \return 0 on success, -ENOTSUP if the range must be transformed on the CPU
+ * instead, or another error number if something goes wrong.
+ */
+int s_viewer_update_gpu(s_viewer_t *viewer)
+{
+	int r;
+	float min;
+	float max;
+
+	if(viewer->gpu == NULL)
+	{
+		r = s_init_gpu_stft(&(viewer->gpu), viewer->raw);
+
+		if((r == -ENOTSUP) || (r == -E2BIG))
+		{
+			viewer->use_gpu = 0;
+			return -ENOTSUP;
+		}
+
+		if(r < 0)
+			return r;
+	}
+
+	r = s_gpu_spectrogram(viewer->gpu, &(viewer->texture), &min, &max,
+		viewer->begin, viewer->end, viewer->view_w, viewer->view_h,
+		viewer->scale, viewer->function);
+
+	if(r == -E2BIG)
+		return -ENOTSUP;
+
+	if(r < 0)
+		return r;
+
+	viewer->min_magnitude = min;
+	viewer->max_magnitude = max;
+
+	s_free_spectrogram(&(viewer->visible));
+
+	return 0;
+}
+
+/*!
+ * This function computes the positions of the viewer's legend frame and of the
+ * spectrogram's quad, from the current size of the spectrogram's area. The
+ * VBO's are uploaded again the next time the scene is rendered.
+ *
+ * \param viewer The viewer to lay out.
+ */
+void s_viewer_layout(s_viewer_t *viewer)
+{
+	GLfloat xmin;
+	GLfloat ymin;
+	GLfloat xmax;
+	GLfloat ymax;
+	GLfloat tick = (GLfloat) S_SPEC_LGND_TICK_SIZE;
+
+	viewer->x_min = S_VIEW_X_MIN;
+	viewer->y_min = S_VIEW_Y_MIN;
+	viewer->x_max = viewer->x_min + (int) viewer->view_w + 1;
+	viewer->y_max = viewer->y_min + (int) viewer->view_h + 1;
+
+	xmin = (GLfloat) viewer->x_min;
+	ymin = (GLfloat) viewer->y_min;
+	xmax = (GLfloat) viewer->x_max;
+	ymax = (GLfloat) viewer->y_max;
+
+	// Set the values of the legend frame vertices.
+
+	memcpy(viewer->frame, (GLfloat[24]) {
+		xmin - tick, ymin, -1.0f,
+		xmax, ymin, -1.0f,
+
+		xmax, ymin, -1.0f,
+		xmax, ymax + tick, -1.0f,
+
+		xmax, ymax, -1.0f,
+		xmin - tick, ymax, -1.0f,
+
+		xmin, ymax + tick, -1.0f,
+		xmin, ymin, -1.0f
+	}, sizeof(viewer->frame));
+
 	/*
-	 * Shift the values down so they are in the range [0, maxz]. This makes
-	 * it easier to color the pixels. See our fragment shader in glinit.c
-	 * for more details.
+	 * The quad's corners are the edges of the viewport's pixels. Our
+	 * vertex shader offsets every vertex by half a pixel (so points and
+	 * lines land on pixel centers), so we undo that offset here.
 	 */
 
-	for(idx = 2; idx < vbo->length; idx += 3)
-		vbo->data[idx] = fmax(vbo->data[idx] - minz, 0.0f);
+	xmin += 0.5f;
+	ymin += 0.5f;
+	xmax -= 0.5f;
+	ymax -= 0.5f;
+
+	memcpy(viewer->quad, (GLfloat[18]) {
+		xmin, ymin, 0.0f,
+		xmax, ymin, 0.0f,
+		xmin, ymax, 0.0f,
+
+		xmin, ymax, 0.0f,
+		xmax, ymin, 0.0f,
+		xmax, ymax, 0.0f
+	}, sizeof(viewer->quad));
 
-	maxz -= minz;
+	viewer->relayout = 1;
+}
+
+/*!
+ * This function computes the magnitude grid which will be uploaded as the
+ * spectrogram's texture. The texture has one texel per pixel of the given
+ * spectrogram's grid, storing that pixel's average log-magnitude as-is (see
+ * s_spectrogram_texels).
+ *
+ * \param viewer The viewer whose texture is being computed.
+ * \param sg The spectrogram being rendered.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_alloc_spectrogram_pixels(s_viewer_t *viewer, const s_spectrogram_t *sg)
+{
+	GLfloat *pixels;
+	double begin = s_profile_begin();
+
+	// Allocate memory for the texture.
+
+	if((viewer->pixels == NULL) || (viewer->pixels_w != sg->width) ||
+		(viewer->pixels_h != sg->height))
+	{
+		pixels = (GLfloat *) realloc(viewer->pixels,
+			sg->width * sg->height * sizeof(GLfloat));
+
+		if(pixels == NULL)
+			return -ENOMEM;
+
+		viewer->pixels = pixels;
+		viewer->pixels_w = sg->width;
+		viewer->pixels_h = sg->height;
+
+		s_profile_alloc(sg->width * sg->height * sizeof(GLfloat));
+	}
 
 	/*
-	 * Set the variable containing our maximum magnitude. The fragment
-	 * shader's uniform will be set to this value later, in the rendering
-	 * loop, since we can't set uniform values until glUseProgram() is
+	 * Compute the value of each texel. Texture rows are stored from the
+	 * lowest frequency to the highest; our vertex shader maps the bottom
+	 * of the viewport to the texture's first row.
+	 *
+	 * This also gives us the range of the magnitudes. The fragment
+	 * shader's uniforms will be set from it later, when the scene is
+	 * rendered, since we can't set uniform values until glUseProgram() is
 	 * called.
 	 */
 
-	s_max_magnitude = maxz;
+	s_spectrogram_texels(viewer->pixels, sg, &(viewer->min_magnitude),
+		&(viewer->max_magnitude));
 
 	// Done!
 
-	free(averageCount);
+	s_profile_end(STAGE_TEXTURE, begin);
 
 	return 0;
 }
@@ -379,31 +1151,37 @@ int s_alloc_stft_vbo(s_vbo_t *vbo, const s_stft_t *stft)
  * frame around the spectrogram, as well as the frequency and time labels for
  * the loaded track.
  *
+ * \param viewer The viewer being rendered.
  * \param vao The VAO which contains our legend frame VBO's state.
  * \return 0 on success, or an error number if something goes wrong.
  */
-int s_render_legend_frame(GLuint *vao)
+int s_render_legend_frame(const s_viewer_t *viewer, GLuint *vao)
 {
 	glBindVertexArray(vao[0]);
-	glDrawArrays(s_vbo_list[0].mode, 0, s_vbo_list[0].length / 3);
+	glDrawArrays(viewer->vbo[0].mode, 0, viewer->vbo[0].length / 3);
 
 	return 0;
 }
 
-int s_render_legend_labels(const s_stft_t *stft)
+/*!
+ * This function initializes the FreeType state and label strings used to
+ * render our legend. This is done once, before rendering starts, and must be
+ * cleaned up with s_free_legend_labels.
+ *
+ * \param stat The properties of the audio whose legend is being rendered.
+ * \param length The number of samples the legend spans.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_init_legend_labels(const s_audio_stat_t *stat, size_t length)
 {
 	int r;
-	FT_Library ft;
 	char fontpath[PATH_MAX];
-	FT_Face font;
-	char fnstr[32];
-	char durstr[32];
 
 	int ret = 0;
 
 	// Initialize the FreeType library, and get the font we'll use.
 
-	if(FT_Init_FreeType(&ft))
+	if(FT_Init_FreeType(&s_legend_library))
 	{
 		ret = -ELIBACC;
 		goto done;
@@ -417,13 +1195,13 @@ int s_render_legend_labels(const s_stft_t *stft)
 		goto err_after_lib_alloc;
 	}
 
-	if(FT_New_Face(ft, fontpath, 0, &font))
+	if(FT_New_Face(s_legend_library, fontpath, 0, &s_legend_font))
 	{
 		ret= -EIO;
 		goto err_after_lib_alloc;
 	}
 
-	if(FT_Set_Pixel_Sizes(font, 0, 20))
+	if(FT_Set_Pixel_Sizes(s_legend_font, 0, 20))
 	{
 		ret = -ELIBACC;
 		goto err_after_font_alloc;
@@ -431,8 +1209,7 @@ int s_render_legend_labels(const s_stft_t *stft)
 
 	// Get the frequency and duration labels.
 
-	r = s_audio_duration_str(fnstr, 32,
-		&(stft->raw_stat), stft->raw_length);
+	r = s_audio_duration_str(s_legend_duration, 32, stat, length);
 
 	if(r < 0)
 	{
@@ -440,7 +1217,7 @@ int s_render_legend_labels(const s_stft_t *stft)
 		goto err_after_font_alloc;
 	}
 
-	r = s_nyquist_frequency_str(durstr, 32, &(stft->raw_stat));
+	r = s_nyquist_frequency_str(s_legend_nyquist, 32, stat);
 
 	if(r < 0)
 	{
@@ -448,36 +1225,93 @@ int s_render_legend_labels(const s_stft_t *stft)
 		goto err_after_font_alloc;
 	}
 
-
-
 	// Done!
 
+	return 0;
+
 err_after_font_alloc:
-	FT_Done_Face(font);
+	FT_Done_Face(s_legend_font);
 err_after_lib_alloc:
-	FT_Done_FreeType(ft);
+	FT_Done_FreeType(s_legend_library);
 done:
 	return ret;
 }
 
 /*!
- * This function renders our spectrogram by binding the given VAO which is
- * associated with its VBO and then drawing the points to the screen.
+ * This function releases the FreeType state allocated by
+ * s_init_legend_labels.
+ */
+void s_free_legend_labels()
+{
+	FT_Done_Face(s_legend_font);
+	FT_Done_FreeType(s_legend_library);
+}
+
+/*!
+ * This function renders the text labels of our spectrogram legend, using the
+ * state set up by s_init_legend_labels.
  *
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_render_legend_labels()
+{
+	return 0;
+}
+
+/*!
+ * This function renders our spectrogram by drawing the quad from the given VAO
+ * with its magnitude texture, which is uploaded from the viewer's magnitude
+ * grid the first time it is drawn. The texture is kept until the spectrogram
+ * itself changes (see s_viewer_update), so when only the contrast changes, the
+ * scene is rendered again by updating our fragment shader's uniforms alone.
+ * A live or progressive viewer's texture, or one computed on the GPU, is
+ * created elsewhere, and is drawn as-is.
+ *
+ * Our magnitudes are base-10 logs, so the viewer's floor and ceiling (which
+ * are in dB) move the ends of the colormap by a twentieth of their value.
+ *
+ * \param viewer The viewer being rendered.
  * \param vao The VAO containing our spectrogram's draw state information.
  * \return 0 on success, or an error number otherwise.
  */
-int s_render_stft(GLuint *vao)
+int s_render_stft(s_viewer_t *viewer, GLuint *vao)
 {
 	int r;
 
-	r = s_set_max_magnitude(s_max_magnitude);
+	r = s_set_magnitude_floor((GLfloat) (viewer->min_magnitude +
+		viewer->floor_db / 20.0));
+
+	if(r >= 0)
+	{
+		r = s_set_magnitude_ceiling((GLfloat) (viewer->max_magnitude +
+			viewer->ceiling_db / 20.0));
+	}
+
+	if(r >= 0)
+		r = s_set_gamma((GLfloat) viewer->gamma);
+
+	if(r >= 0)
+		r = s_set_scroll(viewer->scroll);
 
 	if(r < 0)
 		return r;
 
+	if(viewer->texture == 0)
+	{
+		r = s_init_magnitude_texture(&(viewer->texture), viewer->pixels,
+			(GLsizei) viewer->pixels_w, (GLsizei) viewer->pixels_h);
+
+		if(r < 0)
+			return r;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, viewer->texture);
+
 	glBindVertexArray(vao[1]);
-	glDrawArrays(s_vbo_list[1].mode, 0, s_vbo_list[1].length / 3);
+	glDrawArrays(viewer->vbo[1].mode, 0, viewer->vbo[1].length / 3);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
 
 	return 0;
 }
@@ -21,6 +21,10 @@
 
 #include "spectr/types.h"
 
-extern int s_render(const s_stft_t *stft);
+extern int s_render(const s_spectrogram_t *, const s_raw_audio_t *,
+	const s_pyramid_t *, s_window_type_t, s_precision_t, s_scale_type_t,
+	size_t, int);
+extern int s_render_live(s_live_t *, size_t);
+extern int s_render_refine(s_refine_t *, int);
 
 #endif
@@ -0,0 +1,473 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spectrogram.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <float.h>
+
+#include "spectr/config.h"
+#include "spectr/constants.h"
+#include "spectr/rendering/filterbank.h"
+#include "spectr/transform/attr.h"
+#include "spectr/transform/fourier.h"
+#include "spectr/util/arena.h"
+#include "spectr/util/math.h"
+
+void s_spectrogram_merge(s_spectrogram_t *);
+
+/*!
+ * This function initializes (allocates) a s_spectrogram_t variable with a grid
+ * of the given size. The grid is allocated from the spectrogram's own arena,
+ * so rebuilding a spectrogram (e.g., on every zoom, or for every file in batch
+ * mode) reuses the same few blocks. If the pointer is non-NULL, we will not
+ * allocate a new value on top of it.
+ *
+ * \param sg The s_spectrogram_t to allocate.
+ * \param w The width of the grid (the number of columns), in pixels.
+ * \param h The height of the grid (the number of rows), in pixels.
+ * \param expected The total number of frames to be added, or 0 if unknown.
+ * \param scale The scale of the grid's frequency axis.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_spectrogram(s_spectrogram_t **sg, size_t w, size_t h,
+	size_t expected, s_scale_type_t scale)
+{
+	if(*sg != NULL)
+		return -EINVAL;
+
+	if((w < 1) || (h < 1) || (scale >= SCALE_INVALID))
+		return -EINVAL;
+
+	*sg = malloc(sizeof(s_spectrogram_t));
+
+	if(*sg == NULL)
+		return -ENOMEM;
+
+	(*sg)->raw_stat.type = FTYPE_INVALID;
+	(*sg)->raw_stat.bit_depth = 0;
+	(*sg)->raw_stat.sample_rate = 0;
+	(*sg)->raw_stat.samples = 0;
+	(*sg)->raw_length = 0;
+
+	(*sg)->width = w;
+	(*sg)->height = h;
+
+	(*sg)->expected = expected;
+	(*sg)->frames = 0;
+	(*sg)->frames_per_column = 1;
+
+	(*sg)->scale = scale;
+	(*sg)->filterbank = NULL;
+	(*sg)->arena = NULL;
+
+	if(s_init_arena(&((*sg)->arena)) < 0)
+	{
+		s_free_spectrogram(sg);
+		return -ENOMEM;
+	}
+
+	(*sg)->row = s_arena_alloc((*sg)->arena, h * sizeof(float));
+
+	(*sg)->sum = s_arena_alloc((*sg)->arena, w * h * sizeof(double));
+	(*sg)->count = s_arena_alloc((*sg)->arena, w * h * sizeof(uint32_t));
+
+	if(((*sg)->row == NULL) || ((*sg)->sum == NULL) ||
+		((*sg)->count == NULL))
+	{
+		s_free_spectrogram(sg);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_spectrogram_t structure, including the grid
+ * it contains (which is released along with its arena). Note that this
+ * function is safe against double-frees.
+ *
+ * \param sg The s_spectrogram_t to free.
+ */
+void s_free_spectrogram(s_spectrogram_t **sg)
+{
+	if(*sg == NULL)
+		return;
+
+	s_free_filterbank(&((*sg)->filterbank));
+	s_free_arena(&((*sg)->arena));
+
+	free(*sg);
+	*sg = NULL;
+}
+
+/*!
+ * This function adds one STFT frame's DFT to the given spectrogram. The DFT's
+ * bins (skipping the DC bin and the Nyquist bin) are mapped onto the
+ * spectrogram's rows by a filterbank in the spectrogram's frequency scale
+ * (see s_init_filterbank), and the frame is mapped onto a column based upon
+ * its index. The filterbank is built the first time it is needed, for the
+ * spectrogram's sample rate (raw_stat), which must be set by then.
+ *
+ * We accumulate the base-10 logarithm of each bin's magnitude, since e.g.
+ * decibels are a logarithmic scale, so our output will map more directly to
+ * e.g. human hearing.
+ *
+ * \param sg The spectrogram to add the frame to.
+ * \param frame The index of this frame in the STFT.
+ * \param dft The DFT of this frame.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_spectrogram_add(s_spectrogram_t *sg, size_t frame, const s_dft_t *dft)
+{
+	int r;
+	size_t col;
+	size_t row;
+	size_t bins;
+	size_t idx;
+	double x;
+
+	bins = dft->length < 2 ? 0 : dft->length - 2;
+
+	r = s_get_filterbank(&(sg->filterbank), sg->scale, bins, sg->height,
+		sg->raw_stat.sample_rate);
+
+	if(r < 0)
+		return r;
+
+	// Work out which column of the grid this frame falls in.
+
+	if(sg->expected > 0)
+	{
+		x = s_scale(0, sg->expected, 0, sg->width - 1, frame);
+		x = rint(x);
+
+		x = fmax(x, 0.0);
+		x = fmin(x, (double) (sg->width - 1));
+
+		col = (size_t) x;
+	}
+	else
+	{
+		while(frame / sg->frames_per_column >= sg->width)
+			s_spectrogram_merge(sg);
+
+		col = frame / sg->frames_per_column;
+	}
+
+	if(frame >= sg->frames)
+		sg->frames = frame + 1;
+
+	// Accumulate each row's log-magnitude into its pixel.
+
+	s_filterbank_apply(sg->row, sg->filterbank, dft);
+
+	for(row = 0; row < sg->height; ++row)
+	{
+		// Skip rows which didn't get any valid values.
+
+		if(isnan(sg->row[row]))
+			continue;
+
+		idx = col * sg->height + row;
+
+		sg->sum[idx] += sg->row[row];
+		++sg->count[idx];
+	}
+
+	return 0;
+}
+
+/*!
+ * This function is an STFT sink (see s_stft_stream_t) which adds each frame it
+ * is given to a spectrogram.
+ *
+ * \param ctx The s_spectrogram_t frames should be added to.
+ * \param frame The index of this frame in the STFT.
+ * \param dft The DFT of this frame.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_spectrogram_sink(void *ctx, size_t frame, const s_dft_t *dft)
+{
+	return s_spectrogram_add((s_spectrogram_t *) ctx, frame, dft);
+}
+
+/*!
+ * This function builds a w x h spectrogram from every frame of the given STFT.
+ *
+ * \param sg This will receive the new spectrogram.
+ * \param stft The STFT whose frames should be accumulated.
+ * \param w The width of the spectrogram, in pixels.
+ * \param h The height of the spectrogram, in pixels.
+ * \param scale The scale of the spectrogram's frequency axis.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_spectrogram_from_stft(s_spectrogram_t **sg, const s_stft_t *stft,
+	size_t w, size_t h, s_scale_type_t scale)
+{
+	int r;
+	size_t i;
+
+	s_free_spectrogram(sg);
+
+	r = s_init_spectrogram(sg, w, h, stft->length, scale);
+
+	if(r < 0)
+		return r;
+
+	(*sg)->raw_stat = stft->raw_stat;
+	(*sg)->raw_length = stft->raw_length;
+
+	for(i = 0; i < stft->length; ++i)
+	{
+		r = s_spectrogram_add(*sg, i, &(stft->dfts[i]));
+
+		if(r < 0)
+		{
+			s_free_spectrogram(sg);
+			return r;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * This function builds a w x h spectrogram of only the samples [begin, end) of
+ * the given raw audio. Rather than transforming the whole range at a fixed
+ * resolution, we pick the window size from the spectrogram's height, and
+ * compute only as many windows as the spectrogram has columns (or a few per
+ * column, if the windows would otherwise leave gaps between them).
+ *
+ * This makes the cost of this function depend only on the size of the
+ * spectrogram, and not on the length of the range being displayed.
+ *
+ * \param sg This will receive the new spectrogram.
+ * \param raw The raw audio to compute the spectrogram of.
+ * \param begin The offset of the first sample to include.
+ * \param end The offset one past the last sample to include.
+ * \param w The width of the spectrogram, in pixels.
+ * \param h The height of the spectrogram, in pixels.
+ * \param scale The scale of the spectrogram's frequency axis.
+ * \param fn The window function to use for the STFT.
+ * \param precision The precision to compute the STFT in.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_spectrogram_from_range(s_spectrogram_t **sg, const s_raw_audio_t *raw,
+	size_t begin, size_t end, size_t w, size_t h, s_scale_type_t scale,
+	s_window_type_t fn, s_precision_t precision, size_t threads)
+{
+	int r;
+	size_t window;
+	size_t per;
+	s_stft_t *stft = NULL;
+
+	if((w < 1) || (end <= begin))
+		return -EINVAL;
+
+	r = s_get_window_size(&window, w, h, end - begin);
+
+	if(r < 0)
+		return r;
+
+	// Use enough windows per column to cover each column's samples.
+
+	per = s_get_column_frames(window, w, end - begin);
+
+	r = s_stft_range(&stft, raw, begin, end, w * per, window, fn,
+		precision, threads);
+
+	if(r < 0)
+		return r;
+
+	r = s_spectrogram_from_stft(sg, stft, w, h, scale);
+
+	s_free_stft(&stft);
+
+	return r;
+}
+
+/*!
+ * This function returns the average log-magnitude of the given pixel in the
+ * spectrogram, or 0 if no values fell inside that pixel.
+ *
+ * If the number of frames wasn't known in advance, the columns which actually
+ * received frames are stretched to cover the whole width of the grid.
+ *
+ * \param sg The spectrogram to examine.
+ * \param x The column of the pixel, in [0, width).
+ * \param y The row of the pixel, in [0, height).
+ * \return The value of the given pixel.
+ */
+double s_spectrogram_value(const s_spectrogram_t *sg, size_t x, size_t y)
+{
+	size_t col = x;
+	size_t used;
+	size_t idx;
+
+	if(sg->expected == 0)
+	{
+		used = (sg->frames + sg->frames_per_column - 1) /
+			sg->frames_per_column;
+
+		col = (x * used) / sg->width;
+	}
+
+	idx = col * sg->height + y;
+
+	if(sg->count[idx] == 0)
+		return 0.0;
+
+	return sg->sum[idx] / ((double) sg->count[idx]);
+}
+
+/*!
+ * This function returns whether the given value (see s_spectrogram_value)
+ * belongs to an empty pixel, i.e. one which no values fell into. Every test
+ * for empty pixels should go through this, so they all agree on the sentinel.
+ *
+ * \param z The value to examine.
+ * \return 1 if the value is the empty sentinel (0), or 0 otherwise.
+ */
+int s_spectrogram_empty(double z)
+{
+	return z == 0.0;
+}
+
+/*!
+ * This function computes the range of the values in the given spectrogram.
+ * Empty pixels (see s_spectrogram_empty) are ignored. If there are no other
+ * pixels at all, both min and max receive 0.
+ *
+ * Note that the maximum never goes below zero, so our renderers always color
+ * a spectrogram of very quiet audio as being quiet.
+ *
+ * \param sg The spectrogram to examine.
+ * \param min This will receive the minimum value.
+ * \param max This will receive the maximum value.
+ */
+void s_spectrogram_range(const s_spectrogram_t *sg, double *min, double *max)
+{
+	size_t x;
+	size_t y;
+	double z;
+
+	*min = DBL_MAX;
+	*max = 0.0;
+
+	for(x = 0; x < sg->width; ++x)
+	{
+		for(y = 0; y < sg->height; ++y)
+		{
+			z = s_spectrogram_value(sg, x, y);
+
+			if(s_spectrogram_empty(z))
+				continue;
+
+			*min = fmin(*min, z);
+			*max = fmax(*max, z);
+		}
+	}
+
+	if(*min == DBL_MAX)
+		*min = 0.0;
+}
+
+/*!
+ * This function halves the time resolution of a spectrogram whose number of
+ * frames wasn't known in advance, by merging each pair of adjacent columns.
+ * This frees up the upper half of the grid for new frames.
+ *
+ * \param sg The spectrogram to merge.
+ */
+void s_spectrogram_merge(s_spectrogram_t *sg)
+{
+	size_t col;
+	size_t row;
+	size_t dst;
+	size_t src;
+
+	for(col = 0; col < sg->width; ++col)
+	{
+		for(row = 0; row < sg->height; ++row)
+		{
+			dst = (col / 2) * sg->height + row;
+			src = col * sg->height + row;
+
+			if(col % 2 == 0)
+			{
+				sg->sum[dst] = sg->sum[src];
+				sg->count[dst] = sg->count[src];
+			}
+			else
+			{
+				sg->sum[dst] += sg->sum[src];
+				sg->count[dst] += sg->count[src];
+			}
+		}
+	}
+
+	for(col = (sg->width + 1) / 2; col < sg->width; ++col)
+	{
+		for(row = 0; row < sg->height; ++row)
+		{
+			sg->sum[col * sg->height + row] = 0.0;
+			sg->count[col * sg->height + row] = 0;
+		}
+	}
+
+	sg->frames_per_column *= 2;
+}
+
+/*!
+ * This function computes the texels our viewer displays the given spectrogram
+ * with (and our images are colored from), one per pixel. Rows are stored from
+ * the lowest frequency to the highest. Each texel is its pixel's raw
+ * log-magnitude, or -FLT_MAX if the pixel is empty (see s_spectrogram_empty);
+ * they are mapped onto our colormap when they are drawn (see
+ * s_colormap_level), so the range they are mapped from can change without
+ * computing them again.
+ *
+ * \param dst This will receive the width * height texels.
+ * \param sg The spectrogram to compute the texels of.
+ * \param min This will receive the minimum value (see s_spectrogram_range).
+ * \param max This will receive the maximum value.
+ */
+void s_spectrogram_texels(float *dst, const s_spectrogram_t *sg, double *min,
+	double *max)
+{
+	size_t ix;
+	size_t iy;
+	double z;
+
+	s_spectrogram_range(sg, min, max);
+
+	for(iy = 0; iy < sg->height; ++iy)
+	{
+		for(ix = 0; ix < sg->width; ++ix)
+		{
+			z = s_spectrogram_value(sg, ix, iy);
+
+			dst[iy * sg->width + ix] = s_spectrogram_empty(z) ?
+				-FLT_MAX : (float) z;
+		}
+	}
+}
@@ -20,60 +20,76 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "spectr/config.h"
 #include "spectr/types.h"
-#include "spectr/decoding/raw.h"
-#include "spectr/rendering/render.h"
-#include "spectr/transform/attr.h"
-#include "spectr/transform/fourier.h"
-#include "spectr/util/math.h"
+#include "spectr/driver/analyze.h"
+#include "spectr/driver/batch.h"
+#include "spectr/driver/live.h"
+#include "spectr/driver/progressive.h"
+#include "spectr/rendering/filterbank.h"
+#include "spectr/transform/decimate.h"
+#include "spectr/transform/plan.h"
+#include "spectr/transform/window.h"
+#include "spectr/util/arena.h"
+#include "spectr/util/bitwise.h"
+#include "spectr/util/profile.h"
 
 #ifdef SPECTR_DEBUG
-	#include <assert.h>
-	#include <inttypes.h>
-	#include <math.h>
-	#include <sys/time.h>
-
-	#include "decoding/stat.h"
+	#include "spectr/test.h"
 #endif
 
+int s_parse_options(s_options_t *, int, char *[]);
+void s_print_usage();
 void s_print_error(int);
 
-#ifdef SPECTR_DEBUG
-	void s_test();
-#endif
-
 int main(int argc, char *argv[])
 {
 	int ret = EXIT_SUCCESS;
 	int r;
-	s_raw_audio_t *audio = NULL;
-	size_t window;
-	s_stft_t *stft = NULL;
-
-#ifdef SPECTR_DEBUG
-	uint32_t duration;
-
-	struct timeval prof;
-	double elapsed;
-#endif
+	s_options_t opts;
 
 #ifdef SPECTR_DEBUG
 	s_test();
 #endif
 
-	if(argc < 2)
+	r = s_parse_options(&opts, argc, argv);
+
+	if(r < 0)
 	{
-		printf("Usage: spectr <file to analyze>\n");
+		s_print_usage();
 
 		ret = EXIT_FAILURE;
 		goto done;
 	}
 
-	// Decode the input file we were given.
+	/*
+	 * In batch mode, each input file's spectrogram is written to an image
+	 * in the batch directory, and any errors are reported for each file.
+	 */
 
-	r = s_init_raw_audio(&audio);
+	if(opts.batch != NULL)
+	{
+		if(s_batch(&opts) < 0)
+			ret = EXIT_FAILURE;
+
+		goto report;
+	}
+
+	/*
+	 * In live mode, the input is displayed as it arrives, until the viewer
+	 * is closed. In progressive mode, the viewer opens as soon as the input
+	 * has been decoded, and the spectrogram is refined while it is
+	 * displayed. Otherwise, we analyze the input file we were given.
+	 */
+
+	if(opts.rate > 0)
+		r = s_live(&opts);
+	else if(opts.progressive)
+		r = s_progressive(&opts);
+	else
+		r = s_analyze(&opts);
 
 	if(r < 0)
 	{
@@ -82,88 +98,356 @@ int main(int argc, char *argv[])
 		goto done;
 	}
 
-	r = s_decode_raw_audio(audio, argv[1]);
+report:
+	// Report where the time went, if we were asked to.
 
-	if(r < 0)
+	if(opts.profile != PFORMAT_INVALID)
+		s_profile_report(stderr, opts.profile);
+
+done:
+	s_free_windows();
+	s_free_rfft_plans();
+	s_free_arena_pool();
+	return ret;
+}
+
+/*!
+ * This function parses our command-line arguments into the given options
+ * structure.
+ *
+ * \param opts The options structure to populate.
+ * \param argc The number of command-line arguments.
+ * \param argv The list of command-line arguments.
+ * \return 0 on success, or an error number if the arguments are invalid.
+ */
+int s_parse_options(s_options_t *opts, int argc, char *argv[])
+{
+	int opt;
+	char *end;
+
+	opts->threads = 0;
+	opts->window = S_DEFAULT_WINDOW;
+	opts->precision = PRECISION_DOUBLE;
+	opts->scale = S_DEFAULT_SCALE;
+	opts->window_size = 0;
+	opts->hop = 0;
+	opts->decimation = 1;
+	opts->stream = 0;
+	opts->lazy = 0;
+	opts->progressive = 0;
+	opts->gpu = 0;
+	opts->rate = 0;
+	opts->channels = 2;
+	opts->cache = 1;
+	opts->output = NULL;
+	opts->export = NULL;
+	opts->format = SFORMAT_FLOAT32;
+	opts->profile = PFORMAT_INVALID;
+	opts->batch = NULL;
+	opts->list = NULL;
+	opts->path = NULL;
+	opts->inputs = NULL;
+	opts->inputs_length = 0;
+
+	while((opt = getopt(argc, argv, "b:c:d:e:fgHi:j:l:no:p:Pr:st:w:y:z")) != -1)
 	{
-		s_print_error(r);
-		ret = EXIT_FAILURE;
-		goto err_after_raw_alloc;
+		switch(opt)
+		{
+			case 'b':
+				opts->batch = optarg;
+				break;
+
+			case 'c':
+				opts->channels = (size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0') ||
+					(opts->channels < 1) ||
+					(opts->channels > 2))
+				{
+					return -EINVAL;
+				}
+				break;
+
+			case 'd':
+				opts->decimation =
+					(size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0') ||
+					!s_is_decimation_factor(
+					opts->decimation))
+				{
+					return -EINVAL;
+				}
+				break;
+
+			case 'e':
+				opts->export = optarg;
+				break;
+
+			case 'f':
+				opts->precision = PRECISION_FLOAT;
+				break;
+
+			case 'g':
+				opts->gpu = 1;
+				break;
+
+			case 'H':
+				opts->format = SFORMAT_FLOAT16;
+				break;
+
+			case 'i':
+				opts->list = optarg;
+				break;
+
+			case 'j':
+				opts->threads = (size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0'))
+					return -EINVAL;
+				break;
+
+			case 'l':
+				opts->window_size =
+					(size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0') ||
+					(opts->window_size < 4) ||
+					!s_is_pow_2(opts->window_size))
+				{
+					return -EINVAL;
+				}
+				break;
+
+			case 'n':
+				opts->cache = 0;
+				break;
+
+			case 'o':
+				opts->output = optarg;
+				break;
+
+			case 'p':
+				opts->hop = (size_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0') ||
+					(opts->hop < 1))
+				{
+					return -EINVAL;
+				}
+				break;
+
+			case 'P':
+				opts->progressive = 1;
+				break;
+
+			case 'r':
+				opts->rate = (uint32_t) strtoul(optarg, &end, 10);
+
+				if((*optarg == '\0') || (*end != '\0') ||
+					(opts->rate < 1))
+				{
+					return -EINVAL;
+				}
+				break;
+
+			case 's':
+				opts->stream = 1;
+				break;
+
+			case 't':
+				opts->profile =
+					s_profile_format_from_name(optarg);
+
+				if(opts->profile == PFORMAT_INVALID)
+					return -EINVAL;
+
+				s_profile_enable();
+				break;
+
+			case 'w':
+				opts->window = s_window_type_from_name(optarg);
+
+				if(opts->window == WINDOW_INVALID)
+					return -EINVAL;
+				break;
+
+			case 'y':
+				opts->scale = s_scale_type_from_name(optarg);
+
+				if(opts->scale == SCALE_INVALID)
+					return -EINVAL;
+				break;
+
+			case 'z':
+				opts->lazy = 1;
+				break;
+
+			default:
+				return -EINVAL;
+		}
 	}
 
-#ifdef SPECTR_DEBUG
-	printf("Loaded input file - %" PRIu32 " Hz / %" PRIu32 "-bit.\n",
-		audio->stat.sample_rate, audio->stat.bit_depth);
-
-	duration = s_audio_duration_sec(&(audio->stat), audio->samples_length);
+	opts->inputs = argv + optind;
+	opts->inputs_length = (size_t) (argc - optind);
 
-	printf("\t%zu samples yields duration of %" PRIu32 "m %" PRIu32 "s\n",
-		audio->samples_length, duration / 60, duration % 60);
-#endif
+	/*
+	 * Streaming never stores the whole STFT, so we can't export it, and
+	 * it transforms the decoder's samples directly, without decimating.
+	 */
 
-	// Compute the STFT of the raw audio input.
+	if(opts->stream && ((opts->export != NULL) || (opts->decimation > 1)))
+		return -EINVAL;
 
-#ifdef SPECTR_DEBUG
-	gettimeofday(&prof, NULL);
+	/*
+	 * Lazily decoded audio is never stored as a whole, so it can't be
+	 * decimated, and streaming never stores it at all.
+	 */
 
-	elapsed = (double) prof.tv_sec;
-	elapsed += ((double) prof.tv_usec) / 1000000.0;
-	elapsed = -elapsed;
-#endif
+	if(opts->lazy && (opts->stream || (opts->decimation > 1)))
+		return -EINVAL;
 
-	r = s_get_window_size(&window, S_VIEW_W,
-		S_VIEW_H, audio->samples_length);
+	/*
+	 * Live mode reads raw PCM until the viewer is closed, so it can only be
+	 * displayed in the viewer, and it is transformed as it arrives.
+	 */
 
-	if(r < 0)
+	if((opts->rate > 0) && (opts->stream || (opts->batch != NULL) ||
+		(opts->output != NULL) || (opts->export != NULL) ||
+		(opts->decimation > 1) || opts->gpu || opts->lazy))
 	{
-		s_print_error(r);
-		ret = EXIT_FAILURE;
-		goto err_after_raw_alloc;
+		return -EINVAL;
 	}
 
-#ifdef SPECTR_DEBUG
-	printf("DEBUG: Window size: %" PRIu64 "\n", (uint64_t) window);
-#endif
+	/*
+	 * Progressive mode refines the spectrogram while the viewer displays
+	 * it, so it can only be displayed in the viewer, and it needs the
+	 * decoded audio (which streaming and live mode never keep).
+	 */
+
+	if(opts->progressive && (opts->stream || (opts->rate > 0) ||
+		(opts->batch != NULL) || (opts->output != NULL) ||
+		(opts->export != NULL)))
+	{
+		return -EINVAL;
+	}
 
-	r = s_stft(&stft, audio, window, (size_t) (0.05 * ((double) window)));
+	/*
+	 * The GPU is only used to transform the viewer's visible range when it
+	 * is zoomed in, so it is of no use without the viewer.
+	 */
 
-	if(r < 0)
+	if(opts->gpu && ((opts->batch != NULL) || (opts->output != NULL) ||
+		(opts->export != NULL)))
 	{
-		s_print_error(r);
-		ret = EXIT_FAILURE;
-		goto err_after_raw_alloc;
+		return -EINVAL;
 	}
 
-#ifdef SPECTR_DEBUG
-	gettimeofday(&prof, NULL);
+	/*
+	 * In batch mode, every spectrogram is written to the batch directory,
+	 * so neither the viewer nor any other output can be used. The input
+	 * files may all be given in a list file instead of on the command line.
+	 */
 
-	elapsed += (double) prof.tv_sec;
-	elapsed += ((double) prof.tv_usec) / 1000000.0;
+	if(opts->batch != NULL)
+	{
+		if(opts->stream || (opts->output != NULL) ||
+			(opts->export != NULL))
+		{
+			return -EINVAL;
+		}
 
-	printf("DEBUG: Computing STFT took: %f sec\n", elapsed);
-#endif
+		if((opts->inputs_length == 0) && (opts->list == NULL))
+			return -EINVAL;
 
-	// Render the processed audio.
+		return 0;
+	}
 
-#ifdef SPECTR_DEBUG
-	printf("Entering rendering loop...\n");
-#endif
+	if((opts->inputs_length == 0) || (opts->list != NULL))
+		return -EINVAL;
 
-	r = s_render(stft);
+	opts->path = opts->inputs[0];
 
-	if(r < 0)
-	{
-		s_print_error(r);
-		ret = EXIT_FAILURE;
-		goto err_after_stft_alloc;
-	}
+	return 0;
+}
 
-err_after_stft_alloc:
-	s_free_stft(&stft);
-err_after_raw_alloc:
-	s_free_raw_audio(&audio);
-done:
-	return ret;
+void s_print_usage()
+{
+	printf("Usage: spectr [options] <file to analyze>\n");
+	printf("       spectr -b <directory> [options] [files to analyze]\n");
+	printf("       spectr -r <rate> [options] <PCM input, or - for stdin>\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-b <dir>      Batch mode: write the spectrogram of each file\n");
+	printf("\t              to <dir>/<file name>.ppm, decoding each file\n");
+	printf("\t              while the previous one is transformed (a\n");
+	printf("\t              file with the same name as an earlier one\n");
+	printf("\t              fails, rather than overwrite its image)\n");
+	printf("\t-c <count>    In live mode, the number of interleaved\n");
+	printf("\t              channels in the input: 1 or 2 (default)\n");
+	printf("\t-d <factor>   Decimate the audio by 2, 4 or 8 before its\n");
+	printf("\t              STFT, to look at the low end of the spectrum\n");
+	printf("\t              in more detail (default: 1, not decimated)\n");
+	printf("\t-e <file>     Export the STFT's frames (magnitudes) to a\n");
+	printf("\t              binary file and exit, instead of opening the\n");
+	printf("\t              viewer\n");
+	printf("\t-f            Compute the STFT in single precision, which\n");
+	printf("\t              is faster and uses half as much memory\n");
+	printf("\t              (-s always uses double precision)\n");
+	printf("\t-g            When zoomed in, transform the visible range\n");
+	printf("\t              on the GPU, with compute shaders (needs\n");
+	printf("\t              OpenGL 4.3; falls back to the CPU otherwise)\n");
+	printf("\t-H            Export half-precision (float16) magnitudes\n");
+	printf("\t              instead of float32\n");
+	printf("\t-i <file>     In batch mode, also analyze each file listed\n");
+	printf("\t              (one per line) in the given file, or stdin\n");
+	printf("\t              if it is -\n");
+	printf("\t-j <threads>  Number of decoding and STFT threads (default:\n");
+	printf("\t              one per CPU)\n");
+	printf("\t-l <samples>  The STFT window size, a power of two (default:\n");
+	printf("\t              enough frequency bins for each row)\n");
+	printf("\t-n            Don't read or write the STFT cache\n");
+	printf("\t-o <file>     Write the spectrogram to a PPM image and exit,\n");
+	printf("\t              instead of opening the viewer\n");
+	printf("\t-p <samples>  The STFT hop size (default: a few windows per\n");
+	printf("\t              pixel column, over the whole file)\n");
+	printf("\t-P            Progressive mode: open the viewer as soon as\n");
+	printf("\t              the file is decoded, with a coarse overview\n");
+	printf("\t              which is refined in the background\n");
+	printf("\t-r <rate>     Live mode: display the spectrogram of raw\n");
+	printf("\t              signed 16-bit little-endian PCM at the given\n");
+	printf("\t              sample rate as it is read (e.g., piped from\n");
+	printf("\t              a capture device), scrolling as it arrives\n");
+	printf("\t-s            Stream the file through the STFT, in bounded\n");
+	printf("\t              memory (single-threaded)\n");
+	printf("\t-t <format>   Report how long each stage took, and how much\n");
+	printf("\t              memory was used, to stderr: summary or json\n");
+	printf("\t-w <window>   The window function to use: hann (default),\n");
+	printf("\t              hamming, blackman-harris, kaiser or flat-top\n");
+	printf("\t-y <scale>    The frequency axis scale: linear (default),\n");
+	printf("\t              log, mel or bark\n");
+	printf("\t-z            Decode the file lazily, a few seconds at a\n");
+	printf("\t              time, only where the STFT or the viewer\n");
+	printf("\t              read it, keeping only the most recently\n");
+	printf("\t              used parts in memory\n");
+	printf("\n");
+	printf("Viewer controls:\n");
+	printf("\tScroll, +/-   Zoom in / out (the scroll wheel zooms around\n");
+	printf("\t              the cursor)\n");
+	printf("\tLeft/Right    Pan through the track\n");
+	printf("\t0, Home       Show the whole track again\n");
+	printf("\t[ / ]         Lower / raise the colors' floor (in dB)\n");
+	printf("\t, / .         Lower / raise the colors' ceiling (in dB)\n");
+	printf("\t; / '         Lower / raise the colors' gamma\n");
+	printf("\tR             Reset the contrast\n");
+	printf("\tEscape        Quit\n");
+	printf("\n");
+	printf("Zooming and panning are not available with -s, and neither\n");
+	printf("is -e, since streaming never stores the whole STFT. Neither\n");
+	printf("is -d, since streaming transforms the decoded audio as-is.\n");
+	printf("Lazily decoded audio (-z) can't be decimated (-d) either.\n");
+	printf("Live mode (-r) can't be zoomed either. Both it and\n");
+	printf("progressive mode (-P) can only be displayed in the viewer.\n");
 }
 
 void s_print_error(int error)
@@ -171,79 +455,3 @@ void s_print_error(int error)
 	printf("Fatal error %d: %s\n", -error, strerror(-error));
 }
 
-#ifdef SPECTR_DEBUG
-void s_test()
-{
-	s_raw_audio_t *test = NULL;
-	s_dft_t *fft = NULL;
-	int r;
-	int32_t i;
-
-	double expr[8] = {
-		28.0,
-		-4.0,
-		-4.0,
-		-4.0,
-		-4.0,
-		-4.0,
-		-4.0,
-		-4.0
-	};
-
-	double expi[8] = {
-		0.0,
-		9.6569,
-		4.0,
-		1.6569,
-		0.0,
-		-1.6569,
-		-4.0,
-		-9.6569
-	};
-
-	printf("DEBUG: Testing DFT computation...\n");
-
-	// Populate our test audio with our test data.
-
-	r = s_init_raw_audio(&test);
-	assert(r == 0);
-
-	test->stat.type = FTYPE_MP3;
-	test->stat.bit_depth = 32;
-	test->stat.sample_rate = 44100;
-
-	test->samples_length = 8;
-	test->samples = malloc(sizeof(s_stereo_sample_t) *
-		test->samples_length);
-	assert(test->samples != NULL);
-
-	for(i = 0; i < 8; ++i)
-	{
-		test->samples[i].l = i;
-		test->samples[i].r = i;
-	}
-
-	for(i = 0; i < 8; ++i)
-		assert(s_mono_sample(test->samples[i]) == i);
-
-	// Compute the DFT of the test audio.
-
-	r = s_fft(&fft, test);
-	assert(r == 0);
-
-	// Verify that the naive FFT algorithm got the same results.
-
-	for(i = 0; i < 8; ++i)
-	{
-		printf("\tX(%d): %f + %fi\n", i, fft->dft[i].r, fft->dft[i].i);
-
-		assert(fabs(fft->dft[i].r - expr[i]) < 0.0001);
-		assert(fabs(fft->dft[i].i - expi[i]) < 0.0001);
-	}
-
-	printf("DEBUG: DFT computation verified successfully!\n\n");
-
-	s_free_raw_audio(&test);
-	s_free_dft(&fft);
-}
-#endif
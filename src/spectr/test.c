@@ -0,0 +1,816 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#include "spectr/config.h"
+#include "spectr/types.h"
+#include "spectr/decoding/raw.h"
+#include "spectr/decoding/quirks/flac.h"
+#include "spectr/rendering/spectrogram.h"
+#include "spectr/transform/fourier.h"
+#include "spectr/transform/plan.h"
+#include "spectr/transform/window.h"
+#include "spectr/util/arena.h"
+#include "spectr/util/complex.h"
+#include "spectr/util/math.h"
+#include "spectr/util/simd.h"
+
+void s_test_dft();
+void s_test_engines();
+void s_test_kernels();
+void s_test_engine(double *, size_t, s_window_type_t, int);
+double s_test_error(const s_dft_t *, const s_dft_t *, size_t);
+void s_test_texels();
+void s_test_arena();
+void s_test_flac();
+uint32_t s_test_crc(const uint8_t *, size_t, unsigned int, uint32_t);
+int s_test_flac_sink(void *, const s_stereo_sample_t *, size_t);
+
+/*!
+ * This function runs our self-test, which checks our transforms against known
+ * results. Any failure is fatal (this is only built into debug builds).
+ */
+void s_test()
+{
+	s_test_dft();
+	s_test_engines();
+	s_test_kernels();
+	s_test_texels();
+	s_test_arena();
+	s_test_flac();
+}
+
+/*!
+ * This function checks the FFT of a single 8-sample signal against its known
+ * DFT.
+ */
+void s_test_dft()
+{
+	s_raw_audio_t *test = NULL;
+	s_dft_t *fft = NULL;
+	int r;
+	int32_t i;
+
+	double expr[8] = {
+		28.0,
+		-4.0,
+		-4.0,
+		-4.0,
+		-4.0,
+		-4.0,
+		-4.0,
+		-4.0
+	};
+
+	double expi[8] = {
+		0.0,
+		9.6569,
+		4.0,
+		1.6569,
+		0.0,
+		-1.6569,
+		-4.0,
+		-9.6569
+	};
+
+	printf("DEBUG: Testing DFT computation...\n");
+
+	// Populate our test audio with our test data.
+
+	r = s_init_raw_audio(&test);
+	assert(r == 0);
+
+	test->stat.type = FTYPE_MP3;
+	test->stat.bit_depth = 32;
+	test->stat.sample_rate = 44100;
+
+	test->samples_length = 8;
+	test->samples = malloc(sizeof(s_stereo_sample_t) *
+		test->samples_length);
+	assert(test->samples != NULL);
+
+	for(i = 0; i < 8; ++i)
+	{
+		test->samples[i].l = i;
+		test->samples[i].r = i;
+	}
+
+	for(i = 0; i < 8; ++i)
+		assert(s_mono_sample(test->samples[i]) == i);
+
+	// Compute the DFT of the test audio.
+
+	r = s_fft(&fft, test);
+	assert(r == 0);
+
+	// Verify that the naive FFT algorithm got the same results.
+
+	for(i = 0; i < 8; ++i)
+	{
+		printf("\tX(%d): %f + %fi\n", i, fft->dft[i].r, fft->dft[i].i);
+
+		assert(fabs(fft->dft[i].r - expr[i]) < 0.0001);
+		assert(fabs(fft->dft[i].i - expi[i]) < 0.0001);
+	}
+
+	printf("DEBUG: DFT computation verified successfully!\n\n");
+
+	s_free_raw_audio(&test);
+	s_free_dft(&fft);
+}
+
+/*!
+ * This function checks each of our FFT engines against the naive reference
+ * DFT (s_dft_part), for every power-of-two window size up to
+ * S_TEST_MAX_WINDOW, with every window function, on both a random signal and
+ * a sinusoid. This is repeated with every set of vectorized kernels this CPU
+ * supports (see s_simd_force), and the largest error of each engine is
+ * printed for each size.
+ */
+void s_test_engines()
+{
+	int r;
+	size_t set;
+	size_t w;
+	size_t i;
+	int fn;
+	int sinusoid;
+	double err[4];
+
+	for(set = 0; (r = s_simd_force(set)) != -EINVAL; ++set)
+	{
+		if(r == -ENOTSUP)
+			continue;
+
+		printf("DEBUG: Testing FFT engines (%s) against the reference "
+			"DFT...\n", s_simd_name());
+		printf("\t   N  fft       real      stft      stft (float)\n");
+
+		for(w = 4; w <= S_TEST_MAX_WINDOW; w *= 2)
+		{
+			for(i = 0; i < 4; ++i)
+				err[i] = 0.0;
+
+			for(fn = 0; fn < WINDOW_INVALID; ++fn)
+			{
+				for(sinusoid = 0; sinusoid < 2; ++sinusoid)
+				{
+					s_test_engine(err, w,
+						(s_window_type_t) fn, sinusoid);
+				}
+			}
+
+			printf("\t%4zu  %.2e  %.2e  %.2e  %.2e\n", w,
+				err[0], err[1], err[2], err[3]);
+
+			assert(err[0] < S_TEST_TOLERANCE);
+			assert(err[1] < S_TEST_TOLERANCE);
+			assert(err[2] < S_TEST_TOLERANCE);
+			assert(err[3] < S_TEST_FTOLERANCE);
+		}
+
+		printf("DEBUG: FFT engines verified successfully!\n\n");
+	}
+
+	s_simd_force(SIZE_MAX);
+}
+
+/*!
+ * This function checks the log-magnitude, multiply and mixdown kernels of
+ * every set of vectorized kernels this CPU supports against the portable
+ * (scalar) ones, for every length up to S_TEST_KERNEL_LENGTH, so each
+ * vectorized loop's remainder is covered too. The inputs include zeros,
+ * subnormals, values whose squares overflow and full-scale samples, which the
+ * vectorized kernels must handle exactly as the portable ones do.
+ */
+void s_test_kernels()
+{
+	int r;
+	size_t set;
+	size_t n;
+	size_t i;
+	uint32_t seed = 54321;
+	s_complex_t c[S_TEST_KERNEL_LENGTH];
+	s_fcomplex_t fc[S_TEST_KERNEL_LENGTH];
+	double a[S_TEST_KERNEL_LENGTH];
+	double b[S_TEST_KERNEL_LENGTH];
+	float fa[S_TEST_KERNEL_LENGTH];
+	float fb[S_TEST_KERNEL_LENGTH];
+	s_stereo_sample_t stereo[S_TEST_KERNEL_LENGTH];
+	double ref[4][S_TEST_KERNEL_LENGTH];
+	float fref[S_TEST_KERNEL_LENGTH];
+	int32_t mono_ref[S_TEST_KERNEL_LENGTH];
+	double out[4][S_TEST_KERNEL_LENGTH];
+	float fout[S_TEST_KERNEL_LENGTH];
+	int32_t mono[S_TEST_KERNEL_LENGTH];
+
+	printf("DEBUG: Testing vectorized kernels against the portable "
+		"ones...\n");
+
+	for(i = 0; i < S_TEST_KERNEL_LENGTH; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		c[i].r = ((double) (seed >> 8) - 8388608.0) / 1024.0;
+		c[i].i = ((double) (seed & 0xFFFF) - 32768.0) / 64.0;
+
+		if(i % 7 == 0)
+			c[i].r = c[i].i = 0.0;
+		else if(i % 11 == 3)
+			c[i].r = c[i].i = DBL_MIN / 4.0;
+		else if(i % 13 == 5)
+			c[i].r = 1e200;
+
+		fc[i].r = (float) c[i].r;
+		fc[i].i = (float) c[i].i;
+
+		if(i % 11 == 3)
+			fc[i].r = fc[i].i = FLT_MIN / 4.0f;
+		else if(i % 13 == 5)
+			fc[i].r = 1e30f;
+
+		a[i] = c[i].r;
+		b[i] = c[i].i;
+		fa[i] = fc[i].r;
+		fb[i] = fc[i].i;
+
+		stereo[i].l = (int32_t) seed;
+		stereo[i].r = (int32_t) (seed * 2654435761u);
+
+		if(i % 5 == 1)
+			stereo[i].l = stereo[i].r = INT32_MAX;
+		else if(i % 5 == 2)
+			stereo[i].l = stereo[i].r = INT32_MIN;
+	}
+
+	for(set = 1; (r = s_simd_force(set)) != -EINVAL; ++set)
+	{
+		if(r == -ENOTSUP)
+			continue;
+
+		for(n = 1; n <= S_TEST_KERNEL_LENGTH; ++n)
+		{
+			s_simd_force(0);
+
+			s_simd_log_magnitudes(ref[0], c, n);
+			s_simd_log_magnitudes_f(ref[1], fc, n);
+			s_simd_multiply(ref[2], a, b, n);
+			s_simd_multiply_f(fref, fa, fb, n);
+			s_simd_mixdown(mono_ref, stereo, n);
+
+			s_simd_force(set);
+
+			s_simd_log_magnitudes(out[0], c, n);
+			s_simd_log_magnitudes_f(out[1], fc, n);
+			s_simd_multiply(out[2], a, b, n);
+			s_simd_multiply_f(fout, fa, fb, n);
+			s_simd_mixdown(mono, stereo, n);
+
+			for(i = 0; i < n; ++i)
+			{
+				assert(out[0][i] == ref[0][i] ||
+					fabs(out[0][i] - ref[0][i]) <
+					S_TEST_TOLERANCE);
+				assert(out[1][i] == ref[1][i] ||
+					fabs(out[1][i] - ref[1][i]) <
+					S_TEST_FTOLERANCE);
+				assert(out[2][i] == ref[2][i]);
+				assert(fout[i] == fref[i]);
+				assert(mono[i] == mono_ref[i]);
+			}
+		}
+
+		printf("\t%s: verified\n", s_simd_name());
+	}
+
+	s_simd_force(SIZE_MAX);
+
+	printf("DEBUG: Vectorized kernels verified successfully!\n\n");
+}
+
+/*!
+ * This function checks each of our FFT engines against the reference DFT for
+ * one window size and window function, on a signal 2w samples long. The
+ * engines are s_fft_part, s_rfft_real_plan (which the streaming STFT uses),
+ * and s_stft in both double and single precision, with hops of w, w / 2 and
+ * w / 4. The windows near the end of the signal are partly zero-padded.
+ *
+ * \param err The largest error of each engine, which is updated in place.
+ * \param w The window size to test.
+ * \param fn The window function to test.
+ * \param sinusoid Whether to test a sinusoid, instead of a random signal.
+ */
+void s_test_engine(double *err, size_t w, s_window_type_t fn, int sinusoid)
+{
+	int r;
+	size_t i;
+	size_t k;
+	size_t d;
+	int p;
+	uint32_t seed = 12345;
+	int32_t v;
+	s_raw_audio_t *raw = NULL;
+	const s_window_t *window = NULL;
+	s_rfft_plan_t *plan = NULL;
+	s_dft_t *ref[8] = {NULL};
+	s_dft_t *dft = NULL;
+	s_stft_t *stft = NULL;
+	double *x;
+
+	// Build the test signal, and mix it down like decoded audio.
+
+	r = s_init_raw_audio(&raw);
+	assert(r == 0);
+
+	raw->stat.type = FTYPE_FLAC;
+	raw->stat.bit_depth = 24;
+	raw->stat.sample_rate = 44100;
+	raw->stat.samples = 2 * w;
+
+	raw->samples_length = 2 * w;
+	raw->samples = malloc(sizeof(s_stereo_sample_t) * raw->samples_length);
+	assert(raw->samples != NULL);
+
+	for(i = 0; i < raw->samples_length; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		if(sinusoid)
+			v = (int32_t) lround(4194304.0 * sin(0.7753 * i));
+		else
+			v = (int32_t) (seed >> 8) - 8388608;
+
+		raw->samples[i].l = v;
+		raw->samples[i].r = v;
+	}
+
+	r = s_mixdown_raw_audio(raw);
+	assert(r == 0);
+
+	// Compute the reference DFT's of the windows at multiples of w / 4.
+
+	r = s_get_window(&window, fn, w);
+	assert(r == 0);
+
+	for(k = 0; k < 8; ++k)
+	{
+		r = s_dft_part(&(ref[k]), raw, k * (w / 4), w, window);
+		assert(r == 0);
+	}
+
+	// Check the complex FFT, and the real-input FFT of arbitrary values.
+
+	x = malloc(sizeof(double) * w);
+	assert(x != NULL);
+
+	r = s_init_rfft_plan(&plan, w);
+	assert(r == 0);
+
+	for(k = 0; k < 8; ++k)
+	{
+		r = s_fft_part(&dft, raw, k * (w / 4), w, window);
+		assert(r == 0);
+
+		err[0] = fmax(err[0], s_test_error(dft, ref[k], w));
+
+		s_free_dft(&dft);
+
+		r = s_init_dft(&dft);
+		assert(r == 0);
+
+		r = s_init_dft_result(dft, s_rfft_bins(plan));
+		assert(r == 0);
+
+		s_load_mono_samples(x, raw, k * (w / 4), w);
+
+		r = s_rfft_real_plan(dft, x, plan, window);
+		assert(r == 0);
+
+		err[1] = fmax(err[1], s_test_error(dft, ref[k], dft->length));
+
+		s_free_dft(&dft);
+	}
+
+	// Check the STFT, with increasing overlaps, in both precisions.
+
+	for(p = 0; p < PRECISION_INVALID; ++p)
+	{
+		for(d = 1; d <= 4; d *= 2)
+		{
+			r = s_stft(&stft, raw, w, w / d, fn,
+				(s_precision_t) p, 0);
+			assert(r == 0);
+			assert(stft->length == 2 * d);
+
+			for(i = 0; i < stft->length; ++i)
+			{
+				err[2 + p] = fmax(err[2 + p], s_test_error(
+					&(stft->dfts[i]), ref[i * (4 / d)],
+					stft->bins));
+			}
+
+			s_free_stft(&stft);
+		}
+	}
+
+	for(k = 0; k < 8; ++k)
+		s_free_dft(&(ref[k]));
+
+	s_free_rfft_plan(&plan);
+	free(x);
+	s_free_raw_audio(&raw);
+}
+
+/*!
+ * This function computes the error of the first n values of the given DFT
+ * (in either precision), relative to the given reference DFT: the largest
+ * distance between any of its values and the reference's, divided by the
+ * largest magnitude in the reference.
+ *
+ * \param dft The DFT to check.
+ * \param ref The reference DFT to check it against.
+ * \param n The number of values to check.
+ * \return The relative error of the DFT.
+ */
+double s_test_error(const s_dft_t *dft, const s_dft_t *ref, size_t n)
+{
+	size_t k;
+	s_complex_t c;
+	double peak = 0.0;
+	double err = 0.0;
+
+	for(k = 0; k < n; ++k)
+	{
+		if(dft->precision == PRECISION_FLOAT)
+		{
+			c.r = (double) dft->fdft[k].r;
+			c.i = (double) dft->fdft[k].i;
+		}
+		else
+		{
+			c = dft->dft[k];
+		}
+
+		c.r -= ref->dft[k].r;
+		c.i -= ref->dft[k].i;
+
+		err = fmax(err, s_magnitude(&c));
+		peak = fmax(peak, s_magnitude(&(ref->dft[k])));
+	}
+
+	return peak > 0.0 ? err / peak : err;
+}
+
+/*!
+ * This function checks the texels our viewer displays against known outputs:
+ * first for a small spectrogram whose pixels are set by hand (including an
+ * empty one), and then for the spectrogram of a pure tone, whose brightest
+ * row should be the same in every column, and match the tone's frequency.
+ */
+void s_test_texels()
+{
+	int r;
+	size_t i;
+	size_t x;
+	size_t y;
+	size_t peak;
+	double min;
+	double max;
+	float texels[6];
+	float *tone;
+	s_spectrogram_t *sg = NULL;
+	s_raw_audio_t *raw = NULL;
+	s_stft_t *stft = NULL;
+
+	// Pixel (x, y)'s value is sum[x * h + y] / count[x * h + y].
+
+	const double sum[6] = {4.0, 9.0, 0.0, 5.0, 3.0, 8.0};
+	const uint32_t count[6] = {2, 3, 0, 1, 2, 2};
+
+	// The raw values, by row. Empty pixels are -FLT_MAX.
+
+	const float expected[6] = {2.0f, -FLT_MAX, 1.5f, 3.0f, 5.0f, 4.0f};
+
+	printf("DEBUG: Testing spectrogram texels...\n");
+
+	r = s_init_spectrogram(&sg, 3, 2, 3, SCALE_LINEAR);
+	assert(r == 0);
+
+	sg->frames = 3;
+
+	for(i = 0; i < 6; ++i)
+	{
+		sg->sum[i] = sum[i];
+		sg->count[i] = count[i];
+	}
+
+	s_spectrogram_texels(texels, sg, &min, &max);
+	assert(fabs(min - 1.5) < 0.0001);
+	assert(fabs(max - 5.0) < 0.0001);
+
+	for(i = 0; i < 6; ++i)
+	{
+		assert((texels[i] == expected[i]) ||
+			(fabs(texels[i] - expected[i]) < 0.0001));
+	}
+
+	s_free_spectrogram(&sg);
+
+	/*
+	 * A tone at 3/8 of the Nyquist frequency should be brightest in row
+	 * 3/8 of the way up a linear spectrogram, give or take a row.
+	 */
+
+	r = s_init_raw_audio(&raw);
+	assert(r == 0);
+
+	raw->stat.type = FTYPE_FLAC;
+	raw->stat.bit_depth = 16;
+	raw->stat.sample_rate = 44100;
+	raw->stat.samples = 65536;
+
+	raw->samples_length = 65536;
+	raw->samples = malloc(sizeof(s_stereo_sample_t) * raw->samples_length);
+	assert(raw->samples != NULL);
+
+	for(i = 0; i < raw->samples_length; ++i)
+	{
+		raw->samples[i].l = (int32_t) lround(16384.0 *
+			sin(M_PI * 0.375 * i));
+		raw->samples[i].r = raw->samples[i].l;
+	}
+
+	r = s_mixdown_raw_audio(raw);
+	assert(r == 0);
+
+	r = s_stft(&stft, raw, 1024, 1024, WINDOW_HANN, PRECISION_DOUBLE, 0);
+	assert(r == 0);
+
+	r = s_spectrogram_from_stft(&sg, stft, 16, 64, SCALE_LINEAR);
+	assert(r == 0);
+
+	tone = malloc(sizeof(float) * sg->width * sg->height);
+	assert(tone != NULL);
+
+	s_spectrogram_texels(tone, sg, &min, &max);
+	assert(max > min);
+
+	for(x = 0; x < sg->width; ++x)
+	{
+		peak = 0;
+
+		for(y = 1; y < sg->height; ++y)
+		{
+			if(tone[y * sg->width + x] > tone[peak * sg->width + x])
+				peak = y;
+		}
+
+		assert((peak + 1 >= 24) && (peak <= 24 + 1));
+	}
+
+	printf("DEBUG: Spectrogram texels verified successfully!\n\n");
+
+	free(tone);
+	s_free_spectrogram(&sg);
+	s_free_stft(&stft);
+	s_free_raw_audio(&raw);
+}
+
+/*!
+ * This function checks our arena allocator: every allocation must be zeroed
+ * and aligned, even one larger than a block, and the blocks of a freed arena
+ * must be reused by the next one.
+ */
+void s_test_arena()
+{
+	int r;
+	size_t i;
+	uint8_t *small;
+	uint8_t *large;
+	uint8_t *reused;
+	s_arena_t *arena = NULL;
+
+	printf("DEBUG: Testing arena allocator...\n");
+
+	r = s_init_arena(&arena);
+	assert(r == 0);
+
+	small = s_arena_alloc(arena, 3);
+	large = s_arena_alloc(arena, 2 * S_ARENA_BLOCK_SIZE);
+	assert((small != NULL) && (large != NULL));
+
+	assert(((uintptr_t) small) % S_ARENA_ALIGNMENT == 0);
+	assert(((uintptr_t) large) % S_ARENA_ALIGNMENT == 0);
+
+	for(i = 0; i < 2 * S_ARENA_BLOCK_SIZE; ++i)
+		assert(large[i] == 0);
+
+	memset(small, 0xff, 3);
+
+	s_free_arena(&arena);
+	assert(arena == NULL);
+
+	// The freed block should be handed out again, zeroed.
+
+	r = s_init_arena(&arena);
+	assert(r == 0);
+
+	reused = s_arena_alloc(arena, 3);
+	assert(reused == small);
+
+	for(i = 0; i < 3; ++i)
+		assert(reused[i] == 0);
+
+	s_free_arena(&arena);
+	s_free_arena_pool();
+
+	printf("DEBUG: Arena allocator verified successfully!\n\n");
+}
+
+/*!
+ * This function checks that a FLAC file with corrupt frames is decoded the
+ * same way whether it is streamed or decoded all at once: the corrupt frames
+ * (including the last one) must be replaced with silence, so every other
+ * sample stays in its place.
+ */
+void s_test_flac()
+{
+	int r;
+	size_t i;
+	size_t f;
+	size_t off;
+	uint64_t v;
+	uint32_t crc;
+	int32_t expected;
+	uint8_t file[42 + 8 * 11];
+	s_input_t in;
+	s_stereo_sample_t *samples = NULL;
+	size_t length = 0;
+	s_raw_audio_t *streamed = NULL;
+
+	printf("DEBUG: Testing FLAC decoding of corrupt frames...\n");
+
+	/*
+	 * The file has just a STREAMINFO block, describing 8 frames of 192 mono
+	 * 16-bit samples. Frame f holds a CONSTANT subframe of 100 * (f + 1).
+	 */
+
+	memset(file, 0, sizeof(file));
+	memcpy(file, "fLaC", 4);
+
+	file[4] = 0x80;
+	file[7] = 34;
+	file[9] = 192;
+	file[11] = 192;
+
+	v = (((uint64_t) 44100) << 44) | (((uint64_t) 15) << 36) | (8 * 192);
+
+	for(i = 0; i < 8; ++i)
+		file[18 + i] = (uint8_t) (v >> (56 - 8 * i));
+
+	for(f = 0; f < 8; ++f)
+	{
+		off = 42 + f * 11;
+
+		file[off] = 0xFF;
+		file[off + 1] = 0xF8;
+		file[off + 2] = 0x10;
+		file[off + 3] = 0x08;
+		file[off + 4] = (uint8_t) f;
+		file[off + 5] = (uint8_t) s_test_crc(file + off, 5, 8, 0x07);
+
+		file[off + 7] = (uint8_t) ((100 * (f + 1)) >> 8);
+		file[off + 8] = (uint8_t) (100 * (f + 1));
+
+		crc = s_test_crc(file + off, 9, 16, 0x8005);
+		file[off + 9] = (uint8_t) (crc >> 8);
+		file[off + 10] = (uint8_t) crc;
+	}
+
+	// Corrupt the samples of frame 2, and of the last frame.
+
+	file[42 + 2 * 11 + 8] ^= 0x01;
+	file[42 + 7 * 11 + 8] ^= 0x01;
+
+	in.map = NULL;
+	in.data = file;
+	in.length = sizeof(file);
+	in.type = FTYPE_FLAC;
+
+	r = s_find_flac_frames(&(in.offset), file, sizeof(file));
+	assert(r == 0);
+	assert(in.offset == 42);
+
+	r = s_decode_flac(&samples, &length, &in, 1);
+	assert(r == 0);
+
+	r = s_init_raw_audio(&streamed);
+	assert(r == 0);
+
+	streamed->samples = malloc(sizeof(s_stereo_sample_t) * length);
+	assert(streamed->samples != NULL);
+
+	r = s_decode_flac_stream(&in, s_test_flac_sink, streamed);
+	assert(r == 0);
+
+	assert(length == 8 * 192);
+	assert(streamed->samples_length == length);
+
+	for(i = 0; i < length; ++i)
+	{
+		f = i / 192;
+		expected = (int32_t) (100 * (f + 1));
+
+		if((f == 2) || (f == 7))
+			expected = 0;
+
+		assert(samples[i].l == expected);
+		assert(samples[i].r == expected);
+		assert(streamed->samples[i].l == samples[i].l);
+		assert(streamed->samples[i].r == samples[i].r);
+	}
+
+	free(samples);
+	s_free_raw_audio(&streamed);
+
+	printf("DEBUG: FLAC decoding of corrupt frames verified "
+		"successfully!\n\n");
+}
+
+/*!
+ * This function computes the (MSB-first, unreflected) CRC of the given bytes,
+ * with the given width and polynomial, as a reference for the CRCs which
+ * protect FLAC frames.
+ *
+ * \param buf The bytes to compute the CRC of.
+ * \param n The number of bytes.
+ * \param bits The width of the CRC, in bits (at least 8).
+ * \param poly The CRC's polynomial.
+ * \return The CRC of the given bytes.
+ */
+uint32_t s_test_crc(const uint8_t *buf, size_t n, unsigned int bits,
+	uint32_t poly)
+{
+	size_t i;
+	unsigned int b;
+	uint32_t crc = 0;
+	uint32_t top = ((uint32_t) 1) << (bits - 1);
+
+	for(i = 0; i < n; ++i)
+	{
+		crc ^= ((uint32_t) buf[i]) << (bits - 8);
+
+		for(b = 0; b < 8; ++b)
+			crc = (crc & top) ? (crc << 1) ^ poly : crc << 1;
+
+		crc &= (top << 1) - 1;
+	}
+
+	return crc;
+}
+
+/*!
+ * This function is the sink s_test_flac streams its file into. It appends
+ * each block of samples to the given raw audio, which must have room for them.
+ *
+ * \param ctx The s_raw_audio_t to append the samples to.
+ * \param samples The block of decoded samples.
+ * \param n The number of samples in the block.
+ * \return 0 on success.
+ */
+int s_test_flac_sink(void *ctx, const s_stereo_sample_t *samples, size_t n)
+{
+	s_raw_audio_t *raw = ctx;
+
+	assert(raw->samples_length + n <= 8 * 192);
+
+	memcpy(raw->samples + raw->samples_length, samples,
+		sizeof(s_stereo_sample_t) * n);
+	raw->samples_length += n;
+
+	return 0;
+}
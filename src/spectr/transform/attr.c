@@ -20,13 +20,20 @@
 
 #include <errno.h>
 
+#include "spectr/config.h"
 #include "spectr/defines.h"
 #include "spectr/util/bitwise.h"
 
 /*!
  * This function computes the STFT window size we should be using, assuming
- * that our spectrogram will be w pixels wide, and assuming that our input
- * audio file contains s samples.
+ * that our spectrogram will be w pixels wide and h pixels tall, and assuming
+ * that our input audio file contains s samples.
+ *
+ * Each row of the spectrogram displays (at least) one of the window's
+ * non-redundant DFT bins, excluding the DC bin and the bin at the Nyquist
+ * frequency. So, we use the smallest power of two window which yields at least
+ * h such bins. The window's size only determines the frequency resolution;
+ * the time resolution is determined by the hop (see s_get_hop_size).
  *
  * \param o This will receive the computed window size.
  * \param w The width of the spectrogram, in pixels.
@@ -35,8 +42,84 @@
  * \return 0 on success, or an error number if something goes wrong.
  */
 int s_get_window_size(size_t *o, size_t UNUSED(w),
-	size_t UNUSED(h), size_t UNUSED(s))
+	size_t h, size_t UNUSED(s))
 {
-	*o = 512;
+	uint64_t window;
+
+	if(h < 1)
+		return -EINVAL;
+
+	window = 2 * ((uint64_t) h + 1);
+
+	if(!s_is_pow_2(window))
+		window = s_flp2(window) << 1;
+
+	*o = (size_t) window;
+	return 0;
+}
+
+/*!
+ * This function computes how many STFT windows should be averaged into each
+ * column of a spectrogram w pixels wide, which displays s samples using
+ * windows of the given size. We use enough windows to cover each column's
+ * samples, but never more than S_VIEW_MAX_COLUMN_FRAMES, since the extra
+ * windows would only be averaged away.
+ *
+ * \param window The STFT's window size.
+ * \param w The width of the spectrogram, in pixels.
+ * \param s The number of samples the spectrogram displays.
+ * \return The number of windows per column (always at least 1).
+ */
+size_t s_get_column_frames(size_t window, size_t w, size_t s)
+{
+	size_t per;
+
+	if((window < 1) || (w < 1))
+		return 1;
+
+	per = s / (w * window);
+	per = per < 1 ? 1 : per;
+	per = per > S_VIEW_MAX_COLUMN_FRAMES ? S_VIEW_MAX_COLUMN_FRAMES : per;
+
+	return per;
+}
+
+/*!
+ * This function computes the STFT hop size (the number of samples between the
+ * starts of adjacent windows) we should be using, for a spectrogram w pixels
+ * wide of s samples, using windows of the given size.
+ *
+ * We compute only as many windows as the spectrogram can display (see
+ * s_get_column_frames), so the cost of the STFT is bounded by the size of the
+ * spectrogram instead of the length of the input. For long inputs, this means
+ * the hop is longer than the window, so not every sample is transformed.
+ *
+ * If the number of samples isn't known (s is 0), we fall back to a fixed
+ * overlap of S_STFT_DEFAULT_OVERLAP of the window instead.
+ *
+ * \param o This will receive the computed hop size.
+ * \param window The STFT's window size.
+ * \param w The width of the spectrogram, in pixels.
+ * \param s The number of samples in the input file, or 0 if unknown.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_get_hop_size(size_t *o, size_t window, size_t w, size_t s)
+{
+	size_t hop;
+
+	if((window < 1) || (w < 1))
+		return -EINVAL;
+
+	if(s == 0)
+	{
+		hop = window - (size_t) (S_STFT_DEFAULT_OVERLAP *
+			(double) window);
+	}
+	else
+	{
+		hop = s / (w * s_get_column_frames(window, w, s));
+	}
+
+	*o = hop < 1 ? 1 : hop;
 	return 0;
 }
@@ -22,5 +22,7 @@
 #include <stddef.h>
 
 extern int s_get_window_size(size_t *, size_t, size_t, size_t);
+extern size_t s_get_column_frames(size_t, size_t, size_t);
+extern int s_get_hop_size(size_t *, size_t, size_t, size_t);
 
 #endif
@@ -0,0 +1,345 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decimate.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#include "spectr/config.h"
+#include "spectr/constants.h"
+#include "spectr/defines.h"
+#include "spectr/decoding/raw.h"
+#include "spectr/transform/window.h"
+#include "spectr/util/bitwise.h"
+#include "spectr/util/profile.h"
+#include "spectr/util/thread.h"
+
+/*!
+ * \brief This structure stores the shared, read-only state of a decimation.
+ */
+typedef struct s_decimate_job
+{
+	const s_raw_audio_t *src;
+	int16_t *dst16;
+	int32_t *dst32;
+	const double *filter;
+	size_t taps;
+	size_t factor;
+	double min;
+	double max;
+} s_decimate_job_t;
+
+int s_init_decimation_filter(double **, size_t *, size_t);
+int32_t s_decimate_quantize(double, double, double);
+int s_decimate_worker(void *, size_t, size_t, size_t);
+
+/*!
+ * This function returns whether or not the given value is a decimation factor
+ * we support: a power of two, no larger than S_DECIMATE_MAX_FACTOR. A factor
+ * of 1 means the audio isn't decimated at all.
+ *
+ * \param factor The decimation factor to examine.
+ * \return Whether or not the given factor is supported.
+ */
+int s_is_decimation_factor(size_t factor)
+{
+	return s_is_pow_2(factor) && (factor <= S_DECIMATE_MAX_FACTOR);
+}
+
+/*!
+ * This function updates the given stat structure to describe its audio after
+ * decimation by the given factor (see s_decimate_raw_audio). Note that the
+ * decimated sample rate is rounded down to a whole number of Hz (e.g., 44.1
+ * KHz decimated by 8 is 5512 Hz, rather than 5512.5 Hz).
+ *
+ * \param stat The stat structure to update.
+ * \param factor The decimation factor.
+ */
+void s_decimate_stat(s_audio_stat_t *stat, size_t factor)
+{
+	if(factor <= 1)
+		return;
+
+	stat->sample_rate /= (uint32_t) factor;
+	stat->samples = (stat->samples + factor - 1) / factor;
+}
+
+/*!
+ * This function decimates the given raw audio by the given factor, replacing
+ * its samples with the decimated ones, and updating its stat structure to
+ * match (see s_decimate_stat). The audio is mixed down to mono first (see
+ * s_mixdown_raw_audio), if it isn't already. This lets the STFT of audio whose
+ * interesting content is all at low frequencies run on proportionally fewer
+ * samples, with proportionally finer frequency resolution for the same window
+ * size.
+ *
+ * The audio is low-pass filtered before being downsampled, so frequencies
+ * above the decimated audio's Nyquist frequency don't alias into it. Only
+ * the filter outputs we keep (every factor'th one) are ever computed, which
+ * is the same amount of work as a polyphase decimator. The filter passes
+ * frequencies up to S_DECIMATE_CUTOFF of the new Nyquist frequency; content
+ * just below the new Nyquist frequency is attenuated. Each decimated sample
+ * is centered on the input sample it replaces, so the audio doesn't shift in
+ * time.
+ *
+ * \param raw The raw audio to decimate.
+ * \param factor The decimation factor (see s_is_decimation_factor).
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_decimate_raw_audio(s_raw_audio_t *raw, size_t factor, size_t threads)
+{
+	int r;
+	s_decimate_job_t job;
+	double *filter = NULL;
+	void *dst = NULL;
+	size_t size;
+	size_t length;
+	double begin;
+
+	if(!s_is_decimation_factor(factor))
+		return -EINVAL;
+
+	if(factor == 1)
+		return 0;
+
+	// Lazily decoded audio is never stored whole, so it can't be replaced.
+
+	if(raw->storage == STORAGE_SOURCE)
+		return -EINVAL;
+
+	begin = s_profile_begin();
+
+	r = s_mixdown_raw_audio(raw);
+
+	if(r < 0)
+		return r;
+
+	size = raw->storage == STORAGE_MONO16 ? sizeof(int16_t) :
+		sizeof(int32_t);
+	length = (raw->samples_length + factor - 1) / factor;
+
+	dst = malloc(size * (length > 0 ? length : 1));
+
+	if(dst == NULL)
+		return -ENOMEM;
+
+	s_profile_alloc(size * length);
+
+	if(length > 0)
+	{
+		r = s_init_decimation_filter(&filter, &job.taps, factor);
+
+		if(r < 0)
+		{
+			free(dst);
+			return r;
+		}
+
+		job.src = raw;
+		job.dst16 = raw->storage == STORAGE_MONO16 ? dst : NULL;
+		job.dst32 = raw->storage == STORAGE_MONO16 ? NULL : dst;
+		job.filter = filter;
+		job.factor = factor;
+
+		// Clamp the filtered samples to the input's bit depth.
+
+		if((raw->stat.bit_depth >= 1) && (raw->stat.bit_depth <= 32))
+		{
+			job.max = ldexp(1.0, (int) raw->stat.bit_depth - 1);
+			job.min = -job.max;
+			job.max -= 1.0;
+		}
+		else
+		{
+			job.min = (double) INT32_MIN;
+			job.max = (double) INT32_MAX;
+		}
+
+		r = s_parallel_for(length, s_get_thread_count(threads),
+			s_decimate_worker, &job);
+
+		free(filter);
+
+		if(r < 0)
+		{
+			free(dst);
+			return r;
+		}
+	}
+
+	if(raw->storage == STORAGE_MONO16)
+	{
+		free(raw->mono16);
+		raw->mono16 = dst;
+	}
+	else
+	{
+		free(raw->mono32);
+		raw->mono32 = dst;
+	}
+
+	raw->samples_length = length;
+
+	s_decimate_stat(&(raw->stat), factor);
+
+	s_profile_end(STAGE_DECIMATE, begin);
+
+	return 0;
+}
+
+/*!
+ * This function computes the coefficients of our decimation filter, for the
+ * given decimation factor. This is a Kaiser-windowed sinc low-pass filter,
+ * with S_DECIMATE_PHASE_TAPS taps for each of its factor phases, plus one so
+ * that it is centered on a whole sample. Its coefficients are normalized so
+ * that its gain at DC is exactly 1.
+ *
+ * \param filter This will receive the filter's coefficients.
+ * \param taps This will receive the number of coefficients.
+ * \param factor The decimation factor.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_decimation_filter(double **filter, size_t *taps, size_t factor)
+{
+	size_t k;
+	double t;
+	double sum = 0.0;
+	double fc = S_DECIMATE_CUTOFF / (2.0 * (double) factor);
+
+	*taps = S_DECIMATE_PHASE_TAPS * factor + 1;
+	*filter = malloc(sizeof(double) * (*taps));
+
+	if(*filter == NULL)
+		return -ENOMEM;
+
+	for(k = 0; k < *taps; ++k)
+	{
+		t = (double) k - (double) (*taps / 2);
+
+		if(k == *taps / 2)
+			(*filter)[k] = 2.0 * fc;
+		else
+			(*filter)[k] = sin(2.0 * M_PI * fc * t) / (M_PI * t);
+
+		(*filter)[k] *= s_window_coefficient(WINDOW_KAISER, k, *taps);
+		sum += (*filter)[k];
+	}
+
+	for(k = 0; k < *taps; ++k)
+		(*filter)[k] /= sum;
+
+	return 0;
+}
+
+/*!
+ * This function rounds a single filtered value to the nearest integer sample,
+ * clamping it to the given range.
+ *
+ * \param v The filtered value.
+ * \param min The smallest sample value.
+ * \param max The largest sample value.
+ * \return The quantized sample.
+ */
+int32_t s_decimate_quantize(double v, double min, double max)
+{
+	v = round(v);
+
+	if(v < min)
+		v = min;
+	else if(v > max)
+		v = max;
+
+	return (int32_t) v;
+}
+
+/*!
+ * This is the s_parallel_for worker for s_decimate_raw_audio, which computes
+ * the decimated samples in the range [begin, end). The input samples each
+ * block of S_SIMD_BLOCK_LENGTH decimated samples needs are loaded once, and
+ * samples beyond either end of the input are treated as silence.
+ *
+ * \param ctx The decimation's s_decimate_job_t.
+ * \param id The index of this worker (unused).
+ * \param begin The first decimated sample to compute.
+ * \param end One past the last decimated sample to compute.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_decimate_worker(void *ctx, size_t UNUSED(id), size_t begin, size_t end)
+{
+	const s_decimate_job_t *job = ctx;
+	size_t half = job->taps / 2;
+	size_t o;
+	size_t l;
+	size_t m;
+	size_t k;
+	size_t c;
+	size_t lead;
+	double *x;
+	double v;
+	int32_t q;
+
+	x = malloc(sizeof(double) *
+		(S_SIMD_BLOCK_LENGTH * job->factor + job->taps));
+
+	if(x == NULL)
+		return -ENOMEM;
+
+	for(o = begin; o < end; o += l)
+	{
+		l = end - o < S_SIMD_BLOCK_LENGTH ? end - o :
+			S_SIMD_BLOCK_LENGTH;
+
+		/*
+		 * Decimated sample m is centered on input sample m * factor.
+		 * Since the filter is symmetric, tap k applies to input sample
+		 * m * factor - half + k, so x[0] is input sample
+		 * o * factor - half.
+		 */
+
+		c = o * job->factor;
+		lead = c < half ? half - c : 0;
+
+		for(k = 0; k < lead; ++k)
+			x[k] = 0.0;
+
+		s_load_mono_samples(x + lead, job->src, c + lead - half,
+			(l - 1) * job->factor + job->taps - lead);
+
+		for(m = 0; m < l; ++m)
+		{
+			v = 0.0;
+
+			for(k = 0; k < job->taps; ++k)
+				v += job->filter[k] * x[m * job->factor + k];
+
+			q = s_decimate_quantize(v, job->min, job->max);
+
+			if(job->dst16 != NULL)
+				job->dst16[o + m] = (int16_t) q;
+			else
+				job->dst32[o + m] = q;
+		}
+	}
+
+	free(x);
+
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "export.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+
+#include "spectr/constants.h"
+#include "spectr/util/bitwise.h"
+#include "spectr/transform/fourier.h"
+
+void s_encode_frames_header(uint8_t *, const s_stft_t *, size_t,
+	s_window_type_t, s_sample_format_t, size_t);
+void s_encode_frame(uint8_t *, const s_dft_t *, s_sample_format_t);
+
+/*!
+ * This function writes the magnitudes of every frame of the given STFT to the
+ * given file, in a format meant to be memory-mapped by other tools. The file
+ * consists of:
+ *
+ * - A fixed-size header (S_FRAMES_HEADER_LENGTH bytes), describing the input
+ *   audio, the STFT's parameters, the number of frames and bins, and the
+ *   layout of the data. See the S_FRAMES_HDR_* constants for its fields.
+ * - The frames, in order, starting at the header's data offset. Each frame is
+ *   the magnitudes of its bins (0 through window / 2), as float32 or float16
+ *   values, zero-padded to a stride which is a multiple of S_FRAMES_ALIGNMENT
+ *   bytes. Frame i starts at data + i * stride.
+ *
+ * Every value is stored little-endian, regardless of our own byte order. The
+ * file is written under a temporary name and renamed into place, so readers
+ * never see a partially written file.
+ *
+ * \param stft The STFT to export.
+ * \param hop The number of samples between the starts of adjacent frames.
+ * \param fn The window function the STFT was computed with.
+ * \param format The format to store the magnitudes in.
+ * \param path The path to write the frames to.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_export_stft(const s_stft_t *stft, size_t hop, s_window_type_t fn,
+	s_sample_format_t format, const char *path)
+{
+	int r;
+	int ret = 0;
+	size_t i;
+	size_t size;
+	size_t stride;
+	uint8_t header[S_FRAMES_HEADER_LENGTH];
+	uint8_t *frame;
+	char tmp[PATH_MAX];
+	FILE *out;
+
+	switch(format)
+	{
+		case SFORMAT_FLOAT32:
+			size = 4;
+			break;
+
+		case SFORMAT_FLOAT16:
+			size = 2;
+			break;
+
+		default:
+			return -EINVAL;
+	}
+
+	stride = ((stft->bins * size + S_FRAMES_ALIGNMENT - 1) /
+		S_FRAMES_ALIGNMENT) * S_FRAMES_ALIGNMENT;
+
+	frame = calloc(stride, 1);
+
+	if(frame == NULL)
+		return -ENOMEM;
+
+	r = snprintf(tmp, PATH_MAX, "%s.%ld.tmp", path, (long) getpid());
+
+	if((r < 0) || (r >= PATH_MAX))
+	{
+		ret = -ENAMETOOLONG;
+		goto err_after_frame_alloc;
+	}
+
+	out = fopen(tmp, "wb");
+
+	if(out == NULL)
+	{
+		ret = -errno;
+		goto err_after_frame_alloc;
+	}
+
+	// Write the header, followed by each frame.
+
+	s_encode_frames_header(header, stft, hop, fn, format, stride);
+
+	if(fwrite(header, 1, S_FRAMES_HEADER_LENGTH, out) !=
+		S_FRAMES_HEADER_LENGTH)
+	{
+		ret = -EIO;
+		goto err_after_open;
+	}
+
+	for(i = 0; i < stft->length; ++i)
+	{
+		s_encode_frame(frame, &(stft->dfts[i]), format);
+
+		if(fwrite(frame, 1, stride, out) != stride)
+		{
+			ret = -EIO;
+			goto err_after_open;
+		}
+	}
+
+	if(fclose(out) != 0)
+	{
+		ret = -errno;
+		goto err_after_close;
+	}
+
+	if(rename(tmp, path) < 0)
+	{
+		ret = -errno;
+		goto err_after_close;
+	}
+
+	free(frame);
+	return 0;
+
+err_after_open:
+	fclose(out);
+err_after_close:
+	unlink(tmp);
+err_after_frame_alloc:
+	free(frame);
+	return ret;
+}
+
+/*!
+ * This function encodes the header of an STFT frame export. Every field is
+ * stored little-endian, at the offsets defined by the S_FRAMES_HDR_*
+ * constants; unused bytes are zeroed.
+ *
+ * \param buf The buffer to encode into, of S_FRAMES_HEADER_LENGTH bytes.
+ * \param stft The STFT being exported.
+ * \param hop The number of samples between the starts of adjacent frames.
+ * \param fn The window function the STFT was computed with.
+ * \param format The format the magnitudes are stored in.
+ * \param stride The number of bytes between the starts of adjacent frames.
+ */
+void s_encode_frames_header(uint8_t *buf, const s_stft_t *stft, size_t hop,
+	s_window_type_t fn, s_sample_format_t format, size_t stride)
+{
+	memset(buf, 0, S_FRAMES_HEADER_LENGTH);
+	memcpy(buf + S_FRAMES_HDR_MAGIC, S_FRAMES_MAGIC, 8);
+
+	s_store_le_uint32(buf, S_FRAMES_HDR_VERSION, S_FRAMES_VERSION);
+	s_store_le_uint32(buf, S_FRAMES_HDR_LENGTH, S_FRAMES_HEADER_LENGTH);
+
+	s_store_le_uint32(buf, S_FRAMES_HDR_FTYPE,
+		(uint32_t) stft->raw_stat.type);
+	s_store_le_uint32(buf, S_FRAMES_HDR_BIT_DEPTH,
+		stft->raw_stat.bit_depth);
+	s_store_le_uint32(buf, S_FRAMES_HDR_SAMPLE_RATE,
+		stft->raw_stat.sample_rate);
+	s_store_le_uint32(buf, S_FRAMES_HDR_FUNCTION, (uint32_t) fn);
+
+	s_store_le_uint64(buf, S_FRAMES_HDR_RAW_LENGTH, stft->raw_length);
+	s_store_le_uint64(buf, S_FRAMES_HDR_WINDOW, stft->window);
+	s_store_le_uint64(buf, S_FRAMES_HDR_HOP, hop);
+	s_store_le_uint64(buf, S_FRAMES_HDR_BINS, stft->bins);
+	s_store_le_uint64(buf, S_FRAMES_HDR_FRAMES, stft->length);
+
+	s_store_le_uint32(buf, S_FRAMES_HDR_FORMAT, (uint32_t) format);
+	s_store_le_uint32(buf, S_FRAMES_HDR_STRIDE, (uint32_t) stride);
+	s_store_le_uint64(buf, S_FRAMES_HDR_DATA, S_FRAMES_HEADER_LENGTH);
+}
+
+/*!
+ * This function encodes the magnitudes of one frame's bins into the given
+ * buffer, as little-endian values of the given format. Any padding after the
+ * last bin is left untouched.
+ *
+ * \param buf The buffer to encode into.
+ * \param dft The frame's DFT.
+ * \param format The format to store the magnitudes in.
+ */
+void s_encode_frame(uint8_t *buf, const s_dft_t *dft, s_sample_format_t format)
+{
+	size_t i;
+	float v;
+	uint32_t bits;
+
+	for(i = 0; i < dft->length; ++i)
+	{
+		v = (float) s_dft_magnitude(dft, i);
+
+		if(format == SFORMAT_FLOAT16)
+		{
+			bits = s_float_to_half(v);
+
+			buf[i * 2 + 0] = (uint8_t) (bits & 0xFF);
+			buf[i * 2 + 1] = (uint8_t) ((bits >> 8) & 0xFF);
+		}
+		else
+		{
+			memcpy(&bits, &v, sizeof(float));
+			s_store_le_uint32(buf, i * 4, bits);
+		}
+	}
+}
@@ -23,43 +23,47 @@
 #include <math.h>
 #include <string.h>
 
-#ifdef SPECTR_DEBUG
-	#include <assert.h>
-#endif
-
+#include "spectr/constants.h"
+#include "spectr/defines.h"
 #include "spectr/decoding/raw.h"
-#include "spectr/util/math.h"
+#include "spectr/transform/plan.h"
+#include "spectr/transform/window.h"
 #include "spectr/util/bitwise.h"
 #include "spectr/util/complex.h"
-
-int s_fft_r(s_dft_t *, size_t, const s_raw_audio_t *, size_t, size_t, size_t,
-	double (*)(int32_t, size_t), size_t, size_t);
+#include "spectr/util/profile.h"
+#include "spectr/util/simd.h"
+#include "spectr/util/thread.h"
 
 /*!
- * This function implements the Hann windowing function. For more information,
- * see:
- *
- *     http://en.wikipedia.org/wiki/Hann_function
- *     http://en.wikipedia.org/wiki/Window_function
+ * \brief This structure stores the shared, read-only state of an STFT.
  *
- * \param n The index of the sample to window.
- * \param N the total number of samples in this window's range.
- * \return The Hann window coefficient for the given sample.
+ * Window i starts at sample begin + (i * span) / length. A sink is given each
+ * window's index plus first, so windows keep their indices in the whole STFT
+ * when only some of them are computed.
  */
-double s_hann_function(int32_t n, size_t N)
+typedef struct s_stft_job
 {
-	double nd = (double) n;
-	double Nd = (double) N;
-	double ret;
-
-	ret = 2.0 * M_PI * nd;
-	ret /= (Nd - 1.0);
-	ret = cos(ret);
-	ret = 1.0 - ret;
-	ret = 0.5 * ret;
-
-	return ret;
-}
+	s_stft_t *stft;
+	const s_raw_audio_t *raw;
+	const s_rfft_plan_t *plan;
+	const s_window_t *window;
+	size_t begin;
+	size_t span;
+	size_t length;
+	size_t first;
+
+	size_t w;
+	s_precision_t precision;
+	int (*sink)(void *, size_t, const s_dft_t *);
+	void *ctx;
+} s_stft_job_t;
+
+int s_init_stft_frames(s_stft_t *, const s_raw_audio_t *, size_t, size_t,
+	s_precision_t);
+int s_stft_compute(s_stft_t **, const s_raw_audio_t *, size_t, size_t,
+	size_t, size_t, s_window_type_t, s_precision_t, size_t);
+int s_stft_worker(void *, size_t, size_t, size_t);
+int s_stft_sink_worker(void *, size_t, size_t, size_t);
 
 /*!
  * This function initializes (allocates) a s_dft_t variable. If the pointer is
@@ -79,6 +83,7 @@ int s_init_dft(s_dft_t **dft)
 		return -ENOMEM;
 
 	(*dft)->length = 0;
+	(*dft)->precision = PRECISION_DOUBLE;
 	(*dft)->dft = NULL;
 
 	return 0;
@@ -108,7 +113,8 @@ void s_free_dft(s_dft_t **dft)
 
 /*!
  * This is a utility function which initializes the contents of the given DFT
- * structure to be able to store a result of the given length.
+ * structure to be able to store a (double precision) result of the given
+ * length.
  *
  * \param dft The DFT whose contents will be initialized.
  * \param length The length of the result that is to be stored.
@@ -132,6 +138,7 @@ int s_init_dft_result(s_dft_t *dft, size_t length)
 	// Allocate memory for the new result.
 
 	dft->length = length;
+	dft->precision = PRECISION_DOUBLE;
 
 	dft->dft = malloc(sizeof(s_complex_t) * dft->length);
 
@@ -164,6 +171,8 @@ int s_init_dft_result(s_dft_t *dft, size_t length)
 int s_copy_dft(s_dft_t **dst, const s_dft_t *src)
 {
 	int r;
+	size_t size = src->precision == PRECISION_FLOAT ?
+		sizeof(s_fcomplex_t) : sizeof(s_complex_t);
 
 	// Make sure the destination is a newly-initialized s_dft_t.
 
@@ -177,10 +186,11 @@ int s_copy_dft(s_dft_t **dst, const s_dft_t *src)
 	// Copy the length values from the original.
 
 	(*dst)->length = src->length;
+	(*dst)->precision = src->precision;
 
 	// Allocate memory for the list of DFT values.
 
-	(*dst)->dft = malloc(sizeof(s_complex_t) * src->length);
+	(*dst)->dft = malloc(size * src->length);
 
 	if((*dst)->dft == NULL)
 	{
@@ -190,61 +200,241 @@ int s_copy_dft(s_dft_t **dst, const s_dft_t *src)
 
 	// Copy the DFT values from the original.
 
-	memcpy((*dst)->dft, src->dft, sizeof(s_complex_t) * src->length);
+	memcpy((*dst)->dft, src->dft, size * src->length);
 
 	// We're done!
 
 	return 0;
 }
 
+/*!
+ * This function computes the DFT of a part of the given raw audio data using
+ * the given FFT plan, storing the result in the given (already initialized)
+ * DFT structure. The length of the part being transformed is the length of
+ * the plan, and the given DFT must have been initialized to that length with
+ * s_init_dft_result.
+ *
+ * Any part of the window which extends past the end of the raw audio data is
+ * treated as silence.
+ *
+ * \param dft The s_dft_t to store the result in.
+ * \param raw The raw audio data to process.
+ * \param o The offset to start processing the raw audio data from.
+ * \param plan The FFT plan to use; this determines the window length.
+ * \param window The window function to use (see s_get_window), or NULL.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_fft_part_plan(s_dft_t *dft, const s_raw_audio_t *raw, size_t o,
+	const s_fft_plan_t *plan, const s_window_t *window)
+{
+	size_t i;
+	size_t l = plan->length;
+	s_complex_t *dst;
+
+	if((dft->length != l) || (dft->precision != PRECISION_DOUBLE))
+		return -EINVAL;
+
+	if((window != NULL) && (window->length != l))
+		return -EINVAL;
+
+	/*
+	 * Load the (windowed) samples into the result buffer, in the
+	 * bit-reversed order our iterative FFT expects.
+	 */
+
+	for(i = 0; i < l; ++i)
+	{
+		dst = &(dft->dft[plan->bitrev[i]]);
+
+		dst->r = o + i < raw->samples_length ?
+			(double) s_get_mono_sample(raw, o + i) : 0.0;
+		dst->i = 0.0;
+
+		if(window != NULL)
+			dst->r *= window->coefficients[i];
+	}
+
+	// Compute the DFT in place.
+
+	s_fft_execute(plan, dft->dft);
+
+	return 0;
+}
+
+/*!
+ * This function computes the non-redundant half of the DFT of a part of the
+ * given raw audio data using the given real-input FFT plan, storing the result
+ * in the given (already initialized) DFT structure. Since audio samples are
+ * real, the upper half of their DFT is just the complex conjugate of the lower
+ * half, so we only compute (and store) bins 0 through N / 2.
+ *
+ * The given DFT must have been initialized to s_rfft_bins(plan) values with
+ * s_init_dft_result. Any part of the window which extends past the end of the
+ * raw audio data is treated as silence.
+ *
+ * The samples are loaded in order directly into the result buffer (which has
+ * room for N + 2 real values), multiplied by the window's coefficients with
+ * s_simd_multiply, and only then reordered for the FFT. Pairs of adjacent
+ * samples $x_{2n}, x_{2n + 1}$ then already form the packed complex values
+ * $z_n$ the half-length FFT expects.
+ *
+ * \param dft The s_dft_t to store the result in.
+ * \param raw The raw audio data to process.
+ * \param o The offset to start processing the raw audio data from.
+ * \param plan The real-input FFT plan to use; this determines the length.
+ * \param window The window function to use (see s_get_window), or NULL.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_rfft_part_plan(s_dft_t *dft, const s_raw_audio_t *raw, size_t o,
+	const s_rfft_plan_t *plan, const s_window_t *window)
+{
+	size_t l = plan->length;
+	float *fx;
+	double *x;
+
+	if(dft->length != s_rfft_bins(plan))
+		return -EINVAL;
+
+	if((window != NULL) && (window->length != l))
+		return -EINVAL;
+
+	// Load and window the frame, and then compute its DFT in place.
+
+	if(dft->precision == PRECISION_FLOAT)
+	{
+		fx = (float *) dft->fdft;
+
+		s_load_mono_samples_f(fx, raw, o, l);
+
+		if(window != NULL)
+			s_simd_multiply_f(fx, fx, window->fcoefficients, l);
+
+		s_fft_permute_f(plan->half, dft->fdft);
+		s_rfft_execute_f(plan, dft->fdft);
+
+		return 0;
+	}
+
+	x = (double *) dft->dft;
+
+	s_load_mono_samples(x, raw, o, l);
+
+	if(window != NULL)
+		s_simd_multiply(x, x, window->coefficients, l);
+
+	s_fft_permute(plan->half, dft->dft);
+	s_rfft_execute(plan, dft->dft);
+
+	return 0;
+}
+
+/*!
+ * This function computes the non-redundant half of the DFT of the given list
+ * of real values, which is plan->length values long. This is equivalent to
+ * s_rfft_part_plan, except the input is an arbitrary signal rather than a
+ * part of a raw audio file.
+ *
+ * \param dft The s_dft_t to store the result in.
+ * \param x The plan->length real values to transform.
+ * \param plan The real-input FFT plan to use; this determines the length.
+ * \param window The window function to use (see s_get_window), or NULL.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_rfft_real_plan(s_dft_t *dft, const double *x,
+	const s_rfft_plan_t *plan, const s_window_t *window)
+{
+	size_t l = plan->length;
+	double *dst = (double *) dft->dft;
+
+	if((dft->length != s_rfft_bins(plan)) ||
+		(dft->precision != PRECISION_DOUBLE))
+	{
+		return -EINVAL;
+	}
+
+	if(window == NULL)
+		memcpy(dst, x, sizeof(double) * l);
+	else if(window->length == l)
+		s_simd_multiply(dst, x, window->coefficients, l);
+	else
+		return -EINVAL;
+
+	s_fft_permute(plan->half, dft->dft);
+	s_rfft_execute(plan, dft->dft);
+
+	return 0;
+}
+
 /*!
  * This function computes the DFT of a part of the given raw audio data using a
  * classic fast Fourier transform algorithm, assuming that the length of the
  * raw audio data is a power of two.
  *
- * Note that this function will free any existing contents in the given result
- * destination, and will allocate memory for the new result. It is up to our
- * caller to free that memory later.
+ * If the given destination already holds a result of length l, it is
+ * overwritten in place. Otherwise, any existing contents are freed, and memory
+ * is allocated for the new result. It is up to our caller to free that memory
+ * later.
+ *
+ * This builds a new FFT plan for each call; when transforming many parts of
+ * the same length, callers should create a plan once and use
+ * s_fft_part_plan instead.
  *
  * \param dft The s_dft_t to store the result in.
  * \param raw The raw audio data to process.
  * \param o The offset to start processing the raw audio data from.
  * \param l The length of the raw audio data to process.
- * \param wfn The window function to use, or NULL.
+ * \param window The window function to use (see s_get_window), or NULL.
  * \return 0 on success, or an error number otherwise.
  */
 int s_fft_part(s_dft_t **dft, const s_raw_audio_t *raw, size_t o, size_t l,
-	double (*wfn)(int32_t, size_t))
+	const s_window_t *window)
 {
 	int r;
+	s_fft_plan_t *plan = NULL;
 
 	// The length of the input must be a power of two for the FFT.
 
 	if(!s_is_pow_2(l))
 		return -EINVAL;
 
-	// Allocate space for the output values.
-
-	s_free_dft(dft);
-
-	r = s_init_dft(dft);
+	r = s_init_fft_plan(&plan, l);
 
 	if(r < 0)
 		return r;
 
-	s_init_dft_result(*dft, l);
+	/*
+	 * Allocate space for the output values. If the destination already
+	 * holds a result of the right length, we just overwrite it in place.
+	 */
+
+	if((*dft == NULL) || ((*dft)->length != l))
+	{
+		s_free_dft(dft);
+
+		r = s_init_dft(dft);
+
+		if(r < 0)
+			goto done;
+
+		r = s_init_dft_result(*dft, l);
+
+		if(r < 0)
+		{
+			s_free_dft(dft);
+			goto done;
+		}
+	}
 
 	// Compute the DFT using our FFT algorithm.
 
-	r = s_fft_r(*dft, o, raw, 1, o, l, wfn, o, l);
+	r = s_fft_part_plan(*dft, raw, o, plan, window);
 
 	if(r < 0)
-	{
 		s_free_dft(dft);
-		return r;
-	}
 
-	return 0;
+done:
+	s_free_fft_plan(&plan);
+	return r;
 }
 
 /*!
@@ -261,6 +451,148 @@ int s_fft(s_dft_t **dft, const s_raw_audio_t *raw)
 	return s_fft_part(dft, raw, 0, raw->samples_length, NULL);
 }
 
+/*!
+ * This function computes the DFT of a part of the given raw audio data
+ * directly from its definition, in $O(N^2)$ time:
+ *
+ *     X_k = \sum_{n = 0}^{N - 1} x_n e^{-2 \pi i k n / N}
+ *
+ * This is far too slow to use for real inputs, but it shares none of the FFT's
+ * machinery (plans, bit reversal, SIMD kernels), so it serves as a reference
+ * which our FFT's (in any precision) can be checked against. Unlike s_fft_part,
+ * the length doesn't need to be a power of two. Any part of the window which
+ * extends past the end of the raw audio data is treated as silence.
+ *
+ * Any existing contents of the destination are freed, and memory is allocated
+ * for the new (double precision) result. It is up to our caller to free that
+ * memory later.
+ *
+ * \param dft The s_dft_t to store the result in.
+ * \param raw The raw audio data to process.
+ * \param o The offset to start processing the raw audio data from.
+ * \param l The length of the raw audio data to process.
+ * \param window The window function to use (see s_get_window), or NULL.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_dft_part(s_dft_t **dft, const s_raw_audio_t *raw, size_t o, size_t l,
+	const s_window_t *window)
+{
+	int r;
+	size_t n;
+	size_t k;
+	double *x;
+	s_complex_t *twiddle;
+	s_complex_t *dst;
+
+	if((l < 1) || ((window != NULL) && (window->length != l)))
+		return -EINVAL;
+
+	x = malloc(sizeof(double) * l);
+	twiddle = malloc(sizeof(s_complex_t) * l);
+
+	if((x == NULL) || (twiddle == NULL))
+	{
+		r = -ENOMEM;
+		goto done;
+	}
+
+	// Load the (windowed) samples, one at a time.
+
+	for(n = 0; n < l; ++n)
+	{
+		x[n] = o + n < raw->samples_length ?
+			(double) s_get_mono_sample(raw, o + n) : 0.0;
+
+		if(window != NULL)
+			x[n] *= window->coefficients[n];
+	}
+
+	/*
+	 * Since e^{-2 \pi i k n / N} only depends on kn mod N, we compute each
+	 * of the N distinct values once, exactly, instead of accumulating them
+	 * with a recurrence (whose error would grow with N).
+	 */
+
+	for(k = 0; k < l; ++k)
+	{
+		s_cexp(&(twiddle[k]),
+			-2.0 * M_PI * ((double) k) / ((double) l));
+	}
+
+	s_free_dft(dft);
+
+	r = s_init_dft(dft);
+
+	if(r < 0)
+		goto done;
+
+	r = s_init_dft_result(*dft, l);
+
+	if(r < 0)
+	{
+		s_free_dft(dft);
+		goto done;
+	}
+
+	for(k = 0; k < l; ++k)
+	{
+		dst = &((*dft)->dft[k]);
+
+		dst->r = 0.0;
+		dst->i = 0.0;
+
+		for(n = 0; n < l; ++n)
+		{
+			dst->r += x[n] * twiddle[(k * n) % l].r;
+			dst->i += x[n] * twiddle[(k * n) % l].i;
+		}
+	}
+
+done:
+	free(twiddle);
+	free(x);
+	return r;
+}
+
+/*!
+ * This function returns the magnitude of one of the values of the given DFT,
+ * regardless of the DFT's precision.
+ *
+ * \param dft The DFT to read from.
+ * \param i The index of the value.
+ * \return The magnitude of the given value.
+ */
+double s_dft_magnitude(const s_dft_t *dft, size_t i)
+{
+	s_complex_t c;
+
+	if(dft->precision != PRECISION_FLOAT)
+		return s_magnitude(&(dft->dft[i]));
+
+	c.r = (double) dft->fdft[i].r;
+	c.i = (double) dft->fdft[i].i;
+
+	return s_magnitude(&c);
+}
+
+/*!
+ * This function computes $log_{10}$ of the magnitudes of n consecutive values
+ * of the given DFT, starting at index o, regardless of the DFT's precision.
+ * See s_simd_log_magnitudes for details.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param dft The DFT to read from.
+ * \param o The index of the first value.
+ * \param n The number of values.
+ */
+void s_dft_log_magnitudes(double *dst, const s_dft_t *dft, size_t o, size_t n)
+{
+	if(dft->precision == PRECISION_FLOAT)
+		s_simd_log_magnitudes_f(dst, &(dft->fdft[o]), n);
+	else
+		s_simd_log_magnitudes(dst, &(dft->dft[o]), n);
+}
+
 /*!
  * This function initializes (allocates) a s_stft_t variable. If the pointer
  * is non-NULL, we will not allocate a new value on top of it.
@@ -283,10 +615,15 @@ int s_init_stft(s_stft_t **stft)
 	(*stft)->raw_stat.type = FTYPE_INVALID;
 	(*stft)->raw_stat.bit_depth = 0;
 	(*stft)->raw_stat.sample_rate = 0;
+	(*stft)->raw_stat.samples = 0;
 
 	(*stft)->window = 0;
 	(*stft)->length = 0;
+	(*stft)->bins = 0;
+	(*stft)->stride = 0;
+	(*stft)->precision = PRECISION_DOUBLE;
 	(*stft)->dfts = NULL;
+	(*stft)->arena = NULL;
 
 	return 0;
 }
@@ -312,62 +649,118 @@ void s_free_stft(s_stft_t **stft)
 /*!
  * This is a utility function which initializes the contents of the given STFT
  * structure to be able to store a result computed from the given raw audio
- * structure, and using the given window size.
+ * structure, and using the given window size. Each window's DFT is sized to
+ * hold the w / 2 + 1 bins produced by a real-input FFT, in the given
+ * precision.
+ *
+ * All of the DFT results are stored in a single, contiguous, aligned arena of
+ * length x stride values, in time-major order; each window's s_dft_t is just a
+ * view into its row of the arena. This avoids an allocation per window, and
+ * keeps the whole result local in memory when we walk it later. Because of
+ * this, the s_dft_t's in stft->dfts must never be passed to s_free_dft.
  *
  * \param stft The STFT whose contents will be initialized.
  * \param raw The raw audio structure to be processed.
  * \param w The size of the STFT window. Must be a power of two.
- * \param o The amount of overlap of each window.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param precision The precision the DFT's will be computed in.
  * \return 0 on success, or an error number otherwise.
  */
 int s_init_stft_result(s_stft_t *stft, const s_raw_audio_t *raw,
-	size_t w, size_t o)
+	size_t w, size_t hop, s_precision_t precision)
 {
-	int r;
-	size_t i;
-	s_dft_t **dft;
-
 	// The length of the window must be a power of two for the FFT.
 
-	if(!s_is_pow_2(w))
+	if(!s_is_pow_2(w) || (hop < 1))
 		return -EINVAL;
 
-	// Allocate memory for the list of DFT results.
+	return s_init_stft_frames(stft, raw, w, raw->samples_length / hop,
+		precision);
+}
+
+/*!
+ * This function initializes the contents of the given STFT structure to hold
+ * exactly n windows of size w, computed from the given raw audio structure.
+ * See s_init_stft_result for details on the layout of the result.
+ *
+ * \param stft The STFT whose contents will be initialized.
+ * \param raw The raw audio structure to be processed.
+ * \param w The size of the STFT window. Must be a power of two.
+ * \param n The number of windows the STFT will contain.
+ * \param precision The precision the DFT's will be computed in.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_stft_frames(s_stft_t *stft, const s_raw_audio_t *raw,
+	size_t w, size_t n, s_precision_t precision)
+{
+	size_t i;
+	size_t size;
+	size_t align;
+
+	if(!s_is_pow_2(w) || (precision >= PRECISION_INVALID))
+		return -EINVAL;
+
+	size = precision == PRECISION_FLOAT ?
+		sizeof(s_fcomplex_t) : sizeof(s_complex_t);
+	align = S_STFT_ALIGNMENT / size;
+
+	s_free_stft_result(stft);
 
 	stft->raw_length = raw->samples_length;
 	stft->raw_stat = raw->stat;
 
 	stft->window = w;
-	stft->length = raw->samples_length / (w - o);
+	stft->length = n;
+	stft->bins = w / 2 + 1;
+	stft->precision = precision;
 
-	stft->dfts = malloc(sizeof(s_dft_t *) * stft->length);
+	/*
+	 * Pad each row of the arena out to a multiple of the alignment, so
+	 * every window's result starts on its own cache line.
+	 */
+
+	stft->stride = ((stft->bins + align - 1) / align) * align;
+
+	if(stft->length == 0)
+		return 0;
+
+	// Allocate memory for the list of DFT results.
+
+	stft->dfts = malloc(sizeof(s_dft_t) * stft->length);
 
 	if(stft->dfts == NULL)
+	{
+		s_free_stft_result(stft);
 		return -ENOMEM;
+	}
 
-	for(i = 0; i < stft->length; ++i)
-		stft->dfts[i] = NULL;
+	stft->arena = aligned_alloc(S_STFT_ALIGNMENT,
+		size * stft->stride * stft->length);
 
-	// Allocate each of the DFT result structures.
+	if(stft->arena == NULL)
+	{
+		s_free_stft_result(stft);
+		return -ENOMEM;
+	}
+
+	s_profile_alloc(size * stft->stride * stft->length);
+
+	// Point each of the DFT result structures at its row of the arena.
 
 	for(i = 0; i < stft->length; ++i)
 	{
-		dft = &(stft->dfts[i]);
+		stft->dfts[i].length = stft->bins;
+		stft->dfts[i].precision = precision;
 
-		r = s_init_dft(dft);
-
-		if(r < 0)
+		if(precision == PRECISION_FLOAT)
 		{
-			s_free_stft_result(stft);
-			return r;
+			stft->dfts[i].fdft = (s_fcomplex_t *) stft->arena +
+				i * stft->stride;
 		}
-
-		r = s_init_dft_result(*dft, w);
-
-		if(r < 0)
+		else
 		{
-			s_free_stft_result(stft);
-			return r;
+			stft->dfts[i].dft = (s_complex_t *) stft->arena +
+				i * stft->stride;
 		}
 	}
 
@@ -382,31 +775,41 @@ int s_init_stft_result(s_stft_t *stft, const s_raw_audio_t *raw,
  */
 void s_free_stft_result(s_stft_t *stft)
 {
-	size_t i;
+	free(stft->dfts);
+	stft->dfts = NULL;
 
-	if(stft->dfts != NULL)
-	{
-		for(i = 0; i < stft->length; ++i)
-			if(stft->dfts[i] != NULL)
-				s_free_dft(&(stft->dfts[i]));
-
-		free(stft->dfts);
-		stft->dfts = NULL;
-	}
+	free(stft->arena);
+	stft->arena = NULL;
 
 	stft->raw_length = 0;
 
 	stft->raw_stat.type = FTYPE_INVALID;
 	stft->raw_stat.bit_depth = 0;
 	stft->raw_stat.sample_rate = 0;
+	stft->raw_stat.samples = 0;
 
 	stft->length = 0;
+	stft->bins = 0;
+	stft->stride = 0;
+	stft->precision = PRECISION_DOUBLE;
 }
 
 /*!
  * This function computes a set of short-time Fourier transforms of the given
  * raw signal, using the given window function size.
  *
+ * Since our input is real, each window's DFT only stores its non-redundant
+ * bins, 0 through w / 2 (see s_rfft_part_plan).
+ *
+ * The transform can be computed (and stored) in single precision instead of
+ * double precision. This is more than precise enough for display, and it
+ * halves the size of the result, and the memory bandwidth the FFT needs.
+ *
+ * The windows are independent of each other, so they are divided between the
+ * given number of worker threads. Every window is transformed in place in its
+ * own pre-allocated result slot, and the FFT plan is only ever read, so the
+ * workers share nothing which is written to.
+ *
  * Note that this function will free any existing contents in the given result
  * destination, and will allocate memory for the new result. It is up to our
  * caller to free that memory later.
@@ -414,13 +817,87 @@ void s_free_stft_result(s_stft_t *stft)
  * \param stft This will receive the result of our computations.
  * \param raw The raw audio signal to process.
  * \param w The window function size. Must be a power of two.
- * \param o The overlap of each window.
+ * \param hop The number of samples between the starts of adjacent windows.
+ *            This may be longer than the window.
+ * \param fn The window function to apply to each window.
+ * \param precision The precision to compute the DFT's in.
+ * \param threads The number of threads to use, or 0 for one per CPU.
  * \return 0 on success, or an error number otherwise.
  */
-int s_stft(s_stft_t **stft, const s_raw_audio_t *raw, size_t w, size_t o)
+int s_stft(s_stft_t **stft, const s_raw_audio_t *raw, size_t w, size_t hop,
+	s_window_type_t fn, s_precision_t precision, size_t threads)
+{
+	size_t n;
+
+	if(!s_is_pow_2(w) || (hop < 1))
+		return -EINVAL;
+
+	n = raw->samples_length / hop;
+
+	return s_stft_compute(stft, raw, w, 0, n * hop, n, fn, precision,
+		threads);
+}
+
+/*!
+ * This function computes the STFT of only part of the given raw signal: n
+ * windows of size w, whose starting offsets are spread evenly over the samples
+ * [begin, end). This lets us transform just the range of a track which is
+ * visible, at a resolution matching the number of pixels it is displayed in.
+ *
+ * Windows which extend past the end of the signal are zero-padded. See s_stft
+ * for details on how the work is divided, and on the ownership of the result.
+ *
+ * \param stft This will receive the result of our computations.
+ * \param raw The raw audio signal to process.
+ * \param begin The offset of the first sample in the range.
+ * \param end The offset one past the last sample in the range.
+ * \param n The number of windows to compute.
+ * \param w The window function size. Must be a power of two.
+ * \param fn The window function to apply to each window.
+ * \param precision The precision to compute the DFT's in.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_range(s_stft_t **stft, const s_raw_audio_t *raw, size_t begin,
+	size_t end, size_t n, size_t w, s_window_type_t fn,
+	s_precision_t precision, size_t threads)
+{
+	if((end <= begin) || (end > raw->samples_length))
+		return -EINVAL;
+
+	return s_stft_compute(stft, raw, w, begin, end - begin, n, fn,
+		precision, threads);
+}
+
+/*!
+ * This function implements s_stft and s_stft_range. It computes n windows of
+ * size w, where window i starts at sample begin + (i * span) / n.
+ *
+ * \param stft This will receive the result of our computations.
+ * \param raw The raw audio signal to process.
+ * \param w The window function size. Must be a power of two.
+ * \param begin The offset of the first window.
+ * \param span The number of samples the windows' offsets are spread over.
+ * \param n The number of windows to compute.
+ * \param fn The window function to apply to each window.
+ * \param precision The precision to compute the DFT's in.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_compute(s_stft_t **stft, const s_raw_audio_t *raw, size_t w,
+	size_t begin, size_t span, size_t n, s_window_type_t fn,
+	s_precision_t precision, size_t threads)
 {
 	int r;
-	size_t i;
+	const s_rfft_plan_t *plan = NULL;
+	const s_window_t *window = NULL;
+	s_stft_job_t job;
+	double start = s_profile_begin();
+
+	r = s_get_window(&window, fn, w);
+
+	if(r < 0)
+		return r;
 
 	// Allocate space for the result.
 
@@ -431,7 +908,7 @@ int s_stft(s_stft_t **stft, const s_raw_audio_t *raw, size_t w, size_t o)
 	if(r < 0)
 		return r;
 
-	r = s_init_stft_result(*stft, raw, w, o);
+	r = s_init_stft_frames(*stft, raw, w, n, precision);
 
 	if(r < 0)
 	{
@@ -439,200 +916,215 @@ int s_stft(s_stft_t **stft, const s_raw_audio_t *raw, size_t w, size_t o)
 		return r;
 	}
 
-	// Compute the DFT of each individual window.
+	// Get the FFT plan we'll share between all of the windows.
+
+	r = s_get_rfft_plan(&plan, w);
 
-	for(i = 0; i < (*stft)->length; ++i)
+	if(r < 0)
 	{
-		// Compute the DFT of this raw audio window.
+		s_free_stft(stft);
+		return r;
+	}
 
-		r = s_fft_part(&((*stft)->dfts[i]), raw, i * (w - o), w,
-			s_hann_function);
+	// Compute the DFT of each individual window.
 
-		if(r < 0)
-		{
-			s_free_stft(stft);
-			return r;
-		}
-	}
+	job.stft = *stft;
+	job.raw = raw;
+	job.plan = plan;
+	job.window = window;
+	job.begin = begin;
+	job.span = span;
+	job.length = n;
+	job.first = 0;
+
+	r = s_parallel_for((*stft)->length, s_get_thread_count(threads),
+		s_stft_worker, &job);
+
+	if(r < 0)
+		s_free_stft(stft);
+	else
+		s_profile_count(COUNTER_FRAMES, n);
 
 	// Done!
 
-	return 0;
+	s_profile_end(STAGE_STFT, start);
+
+	return r;
 }
 
 /*!
- * This function uses the Danielson-Lanczos lemma to compute the Fourier
- * transform of the even and odd sections of the set of items in the list whose
- * index is denoted by s * k + o, where s and o are the given stride and
- * offset, and k is an integer starting from 0.
- *
- * This function is recursive, and assumes that its inputs have already been
- * setup for it in advance. One should call s_naive_fft() first, to ensure that
- * this function is called correctly.
- *
- * \param dft The dft to store the result in.
- * \param dfto The amount to subtract from the offset for the DFT.
- * \param raw The raw data to transform.
- * \param s The stride to iterate over the list with.
- * \param o The offset to iterate over the list with.
- * \param bign the length of the list being iterated over.
- * \param wfn The window function to use, or NULL.
- * \param orgO The offset given to the first call in this recursive chain.
- * \param orgN The N length given to the first call in this recursive chain.
+ * This function computes the DFT's of a contiguous range of an STFT's windows.
+ * This is the s_parallel_for worker used by s_stft.
+ *
+ * \param ctx The s_stft_job_t describing the STFT being computed.
+ * \param id The index of this worker (unused).
+ * \param begin The index of the first window to compute.
+ * \param end The index one past the last window to compute.
  * \return 0 on success, or an error number otherwise.
  */
-int s_fft_r(s_dft_t *dft, size_t dfto, const s_raw_audio_t *raw,
-	size_t s, size_t o, size_t bign, double (*wfn)(int32_t, size_t),
-	size_t orgO, size_t orgN)
+int s_stft_worker(void *ctx, size_t UNUSED(id), size_t begin, size_t end)
 {
 	int r;
+	size_t i;
+	s_stft_job_t *job = ctx;
 
-	double window;
-
-	size_t es;
-	size_t eo;
-	size_t os;
-	size_t oo;
-
-	size_t half;
+	for(i = begin; i < end; ++i)
+	{
+		// Compute the DFT of this raw audio window.
 
-	size_t idx;
+		r = s_rfft_part_plan(&(job->stft->dfts[i]), job->raw,
+			job->begin + (i * job->span) / job->length,
+			job->plan, job->window);
 
-	double bigw;
-	s_complex_t bigwl;
-	s_complex_t bigwu;
+		if(r < 0)
+			return r;
+	}
 
-	const s_complex_t *even = NULL;
-	const s_complex_t *odd = NULL;
+	return 0;
+}
 
-	s_complex_t *dstl = NULL;
-	s_complex_t *dstu = NULL;
+/*!
+ * This function computes the same windows as s_stft, but instead of storing
+ * them, it hands each window's DFT to the given sink as soon as it has been
+ * computed. Each worker thread only ever holds the one window it is working
+ * on, so the STFT is never stored in full.
+ *
+ * The sink is called from the worker threads, so it may be called concurrently
+ * (for distinct windows), and the windows are not given to it in order. The
+ * DFT it is given is only valid until it returns. If the sink returns an
+ * error, no more windows are computed, and that error is returned.
+ *
+ * \param raw The raw audio signal to process.
+ * \param w The window function size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param fn The window function to apply to each window.
+ * \param precision The precision to compute the DFT's in.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \param sink The function each window's DFT is given to.
+ * \param ctx The context to pass to the sink.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_sink(const s_raw_audio_t *raw, size_t w, size_t hop,
+	s_window_type_t fn, s_precision_t precision, size_t threads,
+	int (*sink)(void *, size_t, const s_dft_t *), void *ctx)
+{
+	if(hop < 1)
+		return -EINVAL;
 
-	/*
-	 * Noting that fft(x) = x when x is of length 1, so if we've divided to
-	 * the point where we have a list of length 1, just copy the value from
-	 * our raw list.
-	 */
+	return s_stft_sink_range(raw, w, hop, 0, raw->samples_length / hop,
+		fn, precision, threads, sink, ctx);
+}
 
-	if(bign == 1)
+/*!
+ * This function is like s_stft_sink, but it only computes the windows
+ * [first, last) of the STFT. Each window is given to the sink with its index
+ * in the whole STFT, so the STFT can be computed a few windows at a time.
+ *
+ * \param raw The raw audio signal to process.
+ * \param w The window function size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param first The index of the first window to compute.
+ * \param last The index one past the last window to compute.
+ * \param fn The window function to apply to each window.
+ * \param precision The precision to compute the DFT's in.
+ * \param threads The number of threads to use, or 0 for one per CPU.
+ * \param sink The function each window's DFT is given to.
+ * \param ctx The context to pass to the sink.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_sink_range(const s_raw_audio_t *raw, size_t w, size_t hop,
+	size_t first, size_t last, s_window_type_t fn, s_precision_t precision,
+	size_t threads, int (*sink)(void *, size_t, const s_dft_t *),
+	void *ctx)
+{
+	int r;
+	size_t n;
+	const s_rfft_plan_t *plan = NULL;
+	const s_window_t *window = NULL;
+	s_stft_job_t job;
+	double begin = s_profile_begin();
+
+	if(!s_is_pow_2(w) || (hop < 1) || (precision >= PRECISION_INVALID) ||
+		(last < first))
 	{
-		dft->dft[o - dfto].r = (double) s_mono_sample(raw->samples[o]);
-		dft->dft[o - dfto].i = 0.0;
-
-		if(wfn != NULL)
-		{
-			window = wfn(o - orgO, orgN);
-			dft->dft[o - dfto].r *= window;
-		}
-
-		return 0;
+		return -EINVAL;
 	}
 
-	// Compute the stride and offset for the even and odd elements.
+	n = last - first;
 
-	es = 2 * s;
-	eo = o;
-
-	os = 2 * s;
-	oo = o + s;
-
-	// Compute the DFT of the even elements.
-
-	r = s_fft_r(dft, dfto, raw, es, eo, bign / 2, wfn, orgO, orgN);
+	r = s_get_window(&window, fn, w);
 
 	if(r < 0)
 		return r;
 
-	// Compute the DFT of the odd elements.
-
-	r = s_fft_r(dft, dfto, raw, os, oo, bign / 2, wfn, orgO, orgN);
+	r = s_get_rfft_plan(&plan, w);
 
 	if(r < 0)
 		return r;
 
-	half = bign / 2;
+	job.stft = NULL;
+	job.raw = raw;
+	job.plan = plan;
+	job.window = window;
+	job.begin = first * hop;
+	job.span = n * hop;
+	job.length = n;
+	job.first = first;
+	job.w = w;
+	job.precision = precision;
+	job.sink = sink;
+	job.ctx = ctx;
 
-	/*
-	 * We need to create a copy of the DFT values as-is, since we need to
-	 * use them to combine the even and odd DFT's so that we'll have
-	 * computed the correct DFT for this level.
-	 */
+	r = s_parallel_for(n, s_get_thread_count(threads),
+		s_stft_sink_worker, &job);
 
-	s_complex_t *dftprime = malloc(sizeof(s_complex_t) * bign);
+	if(r >= 0)
+		s_profile_count(COUNTER_FRAMES, n);
 
-	if(dftprime == NULL)
-		return -ENOMEM;
-
-	for(idx = 0; idx < bign; ++idx)
-		dftprime[idx] = dft->dft[s * idx + o - dfto];
-
-	/*
-	 * Per the Danielson-Lanczos lemma, we have that:
-	 *
-	 *     $F_n = F^e_n + W^n F^o_n$
-	 *
-	 * Where:
-	 *
-	 *     $W = e^{-2\pi i/N}$
-	 *
-	 * Also, because our inputs are real, the DFT is symmetric, so the
-	 * result values in the lower and upper halves are based upon the same
-	 * values of $F^e_N$ and $F^o_n$. Because of this, we set 2 values per
-	 * iteration, using different values of $W$ for each.
-	 */
+	s_profile_end(STAGE_STFT, begin);
 
-	for(idx = 0; idx < half; ++idx)
-	{
-		/*
-		 * Compute the two $W$ values we'll use, according to the
-		 * aforementioned formula.
-		 */
-
-		bigw = -2.0 * M_PI / ((double) bign);
-
-		s_cexp(&bigwl, bigw * ((double) idx));
-		s_cexp(&bigwu, bigw * ((double) (idx + half)));
-
-		/*
-		 * For brevity later on, get pointers to the even and odd
-		 * values we will use in our computation.
-		 */
-
-		even = &(dftprime[2 * idx]);
-		odd = &(dftprime[2 * idx + 1]);
-
-		// Compute the lower-half result value.
-
-		dstl = &(dft->dft[s * idx + o - dfto]);
-		s_cmul(dstl, &bigwl, odd);
-		s_cadd(dstl, even, dstl);
+	return r;
+}
 
-		// Compute the upper-half result value.
+/*!
+ * This function computes the DFT's of a contiguous range of an STFT's windows,
+ * one at a time, and gives each of them to the job's sink. This is the
+ * s_parallel_for worker used by s_stft_sink.
+ *
+ * \param ctx The s_stft_job_t describing the STFT being computed.
+ * \param id The index of this worker (unused).
+ * \param begin The index of the first window to compute.
+ * \param end The index one past the last window to compute.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_sink_worker(void *ctx, size_t UNUSED(id), size_t begin, size_t end)
+{
+	int r;
+	size_t i;
+	s_stft_job_t *job = ctx;
+	s_stft_t *frame = NULL;
 
-		dstu = &(dft->dft[s * (idx + half) + o - dfto]);
-		s_cmul(dstu, &bigwu, odd);
-		s_cadd(dstu, even, dstu);
+	// Allocate a single window, which we'll reuse for each of ours.
 
-#ifdef SPECTR_DEBUG
-		// Make sure we didn't overflow or do anything wrong.
+	r = s_init_stft(&frame);
 
-		assert(!isnan(even->r));
-		assert(!isinf(even->r));
+	if(r < 0)
+		return r;
 
-		assert(!isnan(even->i));
-		assert(!isinf(even->i));
+	r = s_init_stft_frames(frame, job->raw, job->w, 1, job->precision);
 
-		assert(!isnan(odd->r));
-		assert(!isinf(odd->r));
+	for(i = begin; (r >= 0) && (i < end); ++i)
+	{
+		r = s_rfft_part_plan(&(frame->dfts[0]), job->raw,
+			job->begin + (i * job->span) / job->length,
+			job->plan, job->window);
 
-		assert(!isnan(odd->i));
-		assert(!isinf(odd->i));
-#endif
+		if(r >= 0)
+			r = job->sink(job->ctx, job->first + i,
+				&(frame->dfts[0]));
 	}
 
-	// Done!
+	s_free_stft(&frame);
 
-	free(dftprime);
-
-	return 0;
+	return r;
 }
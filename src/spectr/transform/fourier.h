@@ -23,25 +23,43 @@
 
 #include "spectr/types.h"
 
-extern double s_hann_function(int32_t n, size_t N);
-
 extern int s_init_dft(s_dft_t **);
 extern void s_free_dft(s_dft_t **);
 
 extern int s_init_dft_result(s_dft_t *, size_t);
 extern int s_copy_dft(s_dft_t **, const s_dft_t *);
 
+extern int s_fft_part_plan(s_dft_t *, const s_raw_audio_t *, size_t,
+	const s_fft_plan_t *, const s_window_t *);
+extern int s_rfft_part_plan(s_dft_t *, const s_raw_audio_t *, size_t,
+	const s_rfft_plan_t *, const s_window_t *);
+extern int s_rfft_real_plan(s_dft_t *, const double *,
+	const s_rfft_plan_t *, const s_window_t *);
 extern int s_fft_part(s_dft_t **, const s_raw_audio_t *, size_t, size_t,
-	double (*)(int32_t, size_t));
+	const s_window_t *);
 extern int s_fft(s_dft_t **, const s_raw_audio_t *);
+extern int s_dft_part(s_dft_t **, const s_raw_audio_t *, size_t, size_t,
+	const s_window_t *);
+
+extern double s_dft_magnitude(const s_dft_t *, size_t);
+extern void s_dft_log_magnitudes(double *, const s_dft_t *, size_t, size_t);
 
 extern int s_init_stft(s_stft_t **);
 extern void s_free_stft(s_stft_t **);
 
 extern int s_init_stft_result(s_stft_t *, const s_raw_audio_t *,
-	size_t, size_t);
+	size_t, size_t, s_precision_t);
 extern void s_free_stft_result(s_stft_t *);
 
-extern int s_stft(s_stft_t **, const s_raw_audio_t *, size_t, size_t);
+extern int s_stft(s_stft_t **, const s_raw_audio_t *, size_t, size_t,
+	s_window_type_t, s_precision_t, size_t);
+extern int s_stft_range(s_stft_t **, const s_raw_audio_t *, size_t, size_t,
+	size_t, size_t, s_window_type_t, s_precision_t, size_t);
+extern int s_stft_sink(const s_raw_audio_t *, size_t, size_t,
+	s_window_type_t, s_precision_t, size_t,
+	int (*)(void *, size_t, const s_dft_t *), void *);
+extern int s_stft_sink_range(const s_raw_audio_t *, size_t, size_t, size_t,
+	size_t, s_window_type_t, s_precision_t, size_t,
+	int (*)(void *, size_t, const s_dft_t *), void *);
 
 #endif
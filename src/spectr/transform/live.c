@@ -0,0 +1,538 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "live.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spectr/config.h"
+#include "spectr/defines.h"
+#include "spectr/rendering/filterbank.h"
+#include "spectr/transform/stream.h"
+#include "spectr/util/profile.h"
+
+void s_live_update_range(s_live_t *);
+int s_live_sink(void *, size_t, const s_dft_t *);
+void *s_live_reader(void *);
+size_t s_live_samples(s_stereo_sample_t *, const uint8_t *, size_t, size_t);
+
+/*!
+ * This function initializes (allocates) a s_live_t variable, which reads raw
+ * PCM from the given path ("-" for stdin) once it is started. The path can be
+ * anything which can be read from as it is written, e.g. a FIFO, or a capture
+ * device's output piped to stdin. If the pointer is non-NULL, we will not
+ * allocate a new value on top of it.
+ *
+ * \param live The s_live_t to allocate.
+ * \param path The path to read PCM from, or "-" for stdin.
+ * \param rate The sample rate of the input, in Hz.
+ * \param channels The number of interleaved channels in the input (1 or 2).
+ * \param w The STFT window size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param fn The window function to apply to each window.
+ * \param width The number of frames (columns) to keep.
+ * \param height The number of rows in each column.
+ * \param scale The scale of the columns' frequency axis.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_live(s_live_t **live, const char *path, uint32_t rate,
+	size_t channels, size_t w, size_t hop, s_window_type_t fn,
+	size_t width, size_t height, s_scale_type_t scale)
+{
+	int r;
+	size_t i;
+
+	if(*live != NULL)
+		return -EINVAL;
+
+	if((rate < 1) || (channels < 1) || (channels > 2) || (width < 1) ||
+		(height < 1) || (scale >= SCALE_INVALID))
+	{
+		return -EINVAL;
+	}
+
+	*live = malloc(sizeof(s_live_t));
+
+	if(*live == NULL)
+		return -ENOMEM;
+
+	(*live)->stat.type = FTYPE_INVALID;
+	(*live)->stat.bit_depth = 16;
+	(*live)->stat.sample_rate = rate;
+	(*live)->stat.samples = 0;
+	(*live)->channels = channels;
+	(*live)->fd = -1;
+
+	(*live)->width = width;
+	(*live)->height = height;
+	(*live)->scale = scale;
+	(*live)->stream = NULL;
+	(*live)->filterbank = NULL;
+	(*live)->row = malloc(height * sizeof(float));
+
+	(*live)->columns = malloc(width * height * sizeof(float));
+	(*live)->frames = 0;
+	(*live)->min = FLT_MAX;
+	(*live)->max = -FLT_MAX;
+	(*live)->done = 0;
+	(*live)->result = 0;
+
+	pthread_mutex_init(&((*live)->lock), NULL);
+	(*live)->started = 0;
+	(*live)->stop = 0;
+	(*live)->notify = NULL;
+
+	if(((*live)->row == NULL) || ((*live)->columns == NULL))
+	{
+		s_free_live(live);
+		return -ENOMEM;
+	}
+
+	for(i = 0; i < width * height; ++i)
+		(*live)->columns[i] = -FLT_MAX;
+
+	r = s_init_stft_stream(&((*live)->stream), w, hop, fn, s_live_sink,
+		*live);
+
+	if(r < 0)
+	{
+		s_free_live(live);
+		return r;
+	}
+
+	if(strcmp(path, "-") == 0)
+		(*live)->fd = STDIN_FILENO;
+	else
+		(*live)->fd = open(path, O_RDONLY);
+
+	if((*live)->fd < 0)
+	{
+		r = -errno;
+		s_free_live(live);
+		return r;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_live_t structure, stopping its reader
+ * thread first if it is running. Note that this function is safe against
+ * double-frees.
+ *
+ * \param live The s_live_t to free.
+ */
+void s_free_live(s_live_t **live)
+{
+	if(*live == NULL)
+		return;
+
+	s_live_stop(*live);
+
+	if(((*live)->fd >= 0) && ((*live)->fd != STDIN_FILENO))
+		close((*live)->fd);
+
+	s_free_stft_stream(&((*live)->stream));
+	s_free_filterbank(&((*live)->filterbank));
+	free((*live)->row);
+	free((*live)->columns);
+
+	pthread_mutex_destroy(&((*live)->lock));
+
+	free(*live);
+	*live = NULL;
+}
+
+/*!
+ * This function starts the given live spectrogram's reader thread. The given
+ * function is called (on the reader thread) each time new frames have been
+ * added, and once more when the input ends.
+ *
+ * \param live The live spectrogram to start.
+ * \param notify The function to call when new frames are available.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_live_start(s_live_t *live, void (*notify)())
+{
+	int r;
+
+	if(live->started)
+		return -EINVAL;
+
+	live->notify = notify;
+	live->stop = 0;
+
+	r = pthread_create(&(live->reader), NULL, s_live_reader, live);
+
+	if(r != 0)
+		return -r;
+
+	live->started = 1;
+
+	return 0;
+}
+
+/*!
+ * This function stops the given live spectrogram's reader thread, and waits
+ * for it to exit. The reader checks whether it should stop at least every
+ * S_LIVE_POLL_MS milliseconds, even if no input arrives. It is safe to call
+ * this function if the reader was never started.
+ *
+ * \param live The live spectrogram to stop.
+ */
+void s_live_stop(s_live_t *live)
+{
+	if(!live->started)
+		return;
+
+	pthread_mutex_lock(&(live->lock));
+	live->stop = 1;
+	pthread_mutex_unlock(&(live->lock));
+
+	pthread_join(live->reader, NULL);
+
+	live->started = 0;
+}
+
+/*!
+ * This function passes each of the given live spectrogram's frames which has
+ * been added since frame *next to the given function, oldest first, together
+ * with the column it is stored in. Frames which have already been overwritten
+ * by newer ones are skipped. Afterwards, *next is the number of frames added
+ * so far.
+ *
+ * The spectrogram is locked while the function is called, so it should return
+ * quickly (e.g., by copying the column somewhere).
+ *
+ * \param live The live spectrogram to read.
+ * \param next The first frame which hasn't been read yet.
+ * \param fn The function to pass each new column to.
+ * \param ctx The context pointer to pass to the function.
+ * \return The number of frames passed, or an error number if the reader
+ *         failed.
+ */
+int s_live_read(s_live_t *live, size_t *next,
+	int (*fn)(void *, size_t, const float *), void *ctx)
+{
+	int r = 0;
+	int ret;
+	size_t frame;
+
+	pthread_mutex_lock(&(live->lock));
+
+	if(live->result < 0)
+	{
+		ret = live->result;
+		goto done;
+	}
+
+	frame = *next;
+
+	if(live->frames - frame > live->width)
+		frame = live->frames - live->width;
+
+	ret = (int) (live->frames - frame);
+
+	for(; (r >= 0) && (frame < live->frames); ++frame)
+	{
+		r = fn(ctx, frame % live->width, live->columns +
+			(frame % live->width) * live->height);
+	}
+
+	*next = live->frames;
+
+	if(r < 0)
+		ret = r;
+
+done:
+	pthread_mutex_unlock(&(live->lock));
+	return ret;
+}
+
+/*!
+ * This function returns the range of the values in the given live
+ * spectrogram's retained columns, ignoring empty rows. If there are no such values yet,
+ * both min and max receive 0.
+ *
+ * \param live The live spectrogram to examine.
+ * \param min This will receive the minimum value.
+ * \param max This will receive the maximum value.
+ */
+void s_live_range(s_live_t *live, float *min, float *max)
+{
+	pthread_mutex_lock(&(live->lock));
+
+	*min = live->min <= live->max ? live->min : 0.0f;
+	*max = live->min <= live->max ? live->max : 0.0f;
+
+	pthread_mutex_unlock(&(live->lock));
+}
+
+/*!
+ * This function recomputes the range of the given live spectrogram's retained
+ * columns, ignoring empty rows. The spectrogram's lock must be held.
+ *
+ * \param live The live spectrogram whose range should be recomputed.
+ */
+void s_live_update_range(s_live_t *live)
+{
+	size_t i;
+	float min = FLT_MAX;
+	float max = -FLT_MAX;
+
+	for(i = 0; i < live->width * live->height; ++i)
+	{
+		if(live->columns[i] == -FLT_MAX)
+			continue;
+
+		min = fminf(min, live->columns[i]);
+		max = fmaxf(max, live->columns[i]);
+	}
+
+	live->min = min;
+	live->max = max;
+}
+
+/*!
+ * This function is an STFT sink (see s_stft_stream_t) which maps each frame
+ * onto the rows of a live spectrogram, and stores it as the spectrogram's
+ * newest column, overwriting its oldest one.
+ *
+ * \param ctx The s_live_t frames should be added to.
+ * \param frame The index of this frame in the STFT.
+ * \param dft The DFT of this frame.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_live_sink(void *ctx, size_t UNUSED(frame), const s_dft_t *dft)
+{
+	int r;
+	size_t row;
+	float *column;
+	int stale = 0;
+	s_live_t *live = ctx;
+
+	r = s_get_filterbank(&(live->filterbank), live->scale,
+		dft->length < 2 ? 0 : dft->length - 2, live->height,
+		live->stat.sample_rate);
+
+	if(r < 0)
+		return r;
+
+	// Compute the rows outside of the lock, since the viewer may be reading.
+
+	s_filterbank_apply(live->row, live->filterbank, dft);
+
+	pthread_mutex_lock(&(live->lock));
+
+	column = live->columns + (live->frames % live->width) * live->height;
+
+	/*
+	 * If the column we are about to overwrite holds one of the range's
+	 * bounds, the range may narrow once it is gone, so it has to be
+	 * recomputed from the retained columns. Otherwise, the new column can
+	 * only widen it.
+	 */
+
+	for(row = 0; row < live->height; ++row)
+	{
+		if(column[row] == -FLT_MAX)
+			continue;
+
+		if((column[row] <= live->min) || (column[row] >= live->max))
+			stale = 1;
+	}
+
+	for(row = 0; row < live->height; ++row)
+	{
+		if(isnan(live->row[row]))
+		{
+			column[row] = -FLT_MAX;
+			continue;
+		}
+
+		column[row] = live->row[row];
+
+		live->min = fminf(live->min, column[row]);
+		live->max = fmaxf(live->max, column[row]);
+	}
+
+	if(stale)
+		s_live_update_range(live);
+
+	++live->frames;
+
+	pthread_mutex_unlock(&(live->lock));
+
+	return 0;
+}
+
+/*!
+ * This function is the body of a live spectrogram's reader thread. It reads
+ * whatever input is available (up to S_LIVE_READ_SAMPLES samples at a time),
+ * pushes it through the spectrogram's streaming STFT (which adds every frame
+ * it completes to the spectrogram), and then notifies the viewer. It stops at
+ * the end of the input, if an error occurs, or when asked to (see
+ * s_live_stop).
+ *
+ * \param arg The s_live_t to read input for.
+ * \return NULL, always. The result is stored in the s_live_t.
+ */
+void *s_live_reader(void *arg)
+{
+	int r = 0;
+	int stop;
+	ssize_t n;
+	size_t stride;
+	size_t have = 0;
+	size_t length;
+	struct pollfd pfd;
+	uint8_t *buffer;
+	s_stereo_sample_t *samples;
+	s_live_t *live = arg;
+
+	stride = live->channels * sizeof(int16_t);
+
+	buffer = malloc(S_LIVE_READ_SAMPLES * stride);
+	samples = malloc(S_LIVE_READ_SAMPLES * sizeof(s_stereo_sample_t));
+
+	if((buffer == NULL) || (samples == NULL))
+	{
+		r = -ENOMEM;
+		goto done;
+	}
+
+	pfd.fd = live->fd;
+	pfd.events = POLLIN;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&(live->lock));
+		stop = live->stop;
+		pthread_mutex_unlock(&(live->lock));
+
+		if(stop)
+			break;
+
+		// Wait for input, but check whether we should stop regularly.
+
+		n = poll(&pfd, 1, S_LIVE_POLL_MS);
+
+		if((n < 0) && (errno != EINTR))
+		{
+			r = -errno;
+			break;
+		}
+
+		if(n <= 0)
+			continue;
+
+		n = read(live->fd, buffer + have,
+			S_LIVE_READ_SAMPLES * stride - have);
+
+		if(n < 0)
+		{
+			if((errno == EINTR) || (errno == EAGAIN))
+				continue;
+
+			r = -errno;
+			break;
+		}
+
+		if(n == 0)
+			break;
+
+		// Convert the whole samples we have, and keep any partial one.
+
+		have += (size_t) n;
+		length = s_live_samples(samples, buffer, have, live->channels);
+
+		have -= length * stride;
+		memmove(buffer, buffer + length * stride, have);
+
+		r = s_stft_stream_push(live->stream, samples, length);
+
+		if(r < 0)
+			break;
+
+		if((length > 0) && (live->notify != NULL))
+			live->notify();
+	}
+
+	s_profile_count(COUNTER_SAMPLES, live->stream->samples);
+	s_profile_count(COUNTER_FRAMES, live->stream->frames);
+
+done:
+	free(buffer);
+	free(samples);
+
+	pthread_mutex_lock(&(live->lock));
+	live->done = 1;
+	live->result = r;
+	pthread_mutex_unlock(&(live->lock));
+
+	if(live->notify != NULL)
+		live->notify();
+
+	return NULL;
+}
+
+/*!
+ * This function converts as many whole samples as possible from the given
+ * buffer of raw PCM (signed 16-bit little-endian, with the given number of
+ * interleaved channels) to stereo samples. Mono samples are copied to both
+ * channels.
+ *
+ * \param dst This will receive the converted samples.
+ * \param src The raw PCM to convert.
+ * \param length The length of the raw PCM, in bytes.
+ * \param channels The number of interleaved channels (1 or 2).
+ * \return The number of samples converted.
+ */
+size_t s_live_samples(s_stereo_sample_t *dst, const uint8_t *src,
+	size_t length, size_t channels)
+{
+	size_t i;
+	size_t n = length / (channels * sizeof(int16_t));
+	const uint8_t *s;
+
+	for(i = 0; i < n; ++i)
+	{
+		s = src + i * channels * sizeof(int16_t);
+
+		dst[i].l = (int16_t) ((uint16_t) s[0] | ((uint16_t) s[1] << 8));
+
+		if(channels == 2)
+		{
+			dst[i].r = (int16_t) ((uint16_t) s[2] |
+				((uint16_t) s[3] << 8));
+		}
+		else
+		{
+			dst[i].r = dst[i].l;
+		}
+	}
+
+	return n;
+}
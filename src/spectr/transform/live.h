@@ -0,0 +1,38 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_TRANSFORM_LIVE_H
+#define INCLUDE_SPECTR_TRANSFORM_LIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spectr/types.h"
+
+extern int s_init_live(s_live_t **, const char *, uint32_t, size_t, size_t,
+	size_t, s_window_type_t, size_t, size_t, s_scale_type_t);
+extern void s_free_live(s_live_t **);
+
+extern int s_live_start(s_live_t *, void (*)());
+extern void s_live_stop(s_live_t *);
+
+extern int s_live_read(s_live_t *, size_t *,
+	int (*)(void *, size_t, const float *), void *);
+extern void s_live_range(s_live_t *, float *, float *);
+
+#endif
@@ -0,0 +1,570 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "plan.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "spectr/util/bitwise.h"
+#include "spectr/util/complex.h"
+#include "spectr/util/simd.h"
+
+/*!
+ * \brief This structure is one entry in our cache of real-input FFT plans.
+ */
+typedef struct s_rfft_plan_entry
+{
+	s_rfft_plan_t *plan;
+	struct s_rfft_plan_entry *next;
+} s_rfft_plan_entry_t;
+
+void s_rfft_split(s_complex_t *, const s_complex_t *, const s_complex_t *,
+	const s_complex_t *);
+void s_rfft_split_f(s_fcomplex_t *, const s_fcomplex_t *,
+	const s_fcomplex_t *, const s_fcomplex_t *);
+
+/*
+ * Our cache of real-input FFT plans. Each plan is built the first time it is
+ * requested, and kept until s_free_rfft_plans is called.
+ */
+static s_rfft_plan_entry_t *s_rfft_plan_cache = NULL;
+
+/*
+ * This guards s_rfft_plan_cache, since each of our STFT callers may request a
+ * plan from its own thread.
+ */
+static pthread_mutex_t s_rfft_plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * This function initializes (allocates) a s_fft_plan_t for transforms of the
+ * given length. If the pointer is non-NULL, we will not allocate a new value
+ * on top of it.
+ *
+ * A plan caches everything about an FFT which depends only on its length: the
+ * bit-reversal permutation of the input indices, and the "twiddle factors"
+ * $W^k = e^{-2\pi ik/N}$ used by each butterfly. Computing a plan once and
+ * reusing it for every window of an STFT means the transform itself does no
+ * allocation, and no trigonometry. The twiddle factors are stored in both
+ * double and single precision, so the plan serves transforms of either.
+ *
+ * \param plan The s_fft_plan_t to allocate.
+ * \param n The length of the transforms to plan for. Must be a power of two.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_fft_plan(s_fft_plan_t **plan, size_t n)
+{
+	size_t i;
+	size_t bits;
+	size_t j;
+	size_t v;
+
+	if(*plan != NULL)
+		return -EINVAL;
+
+	if(!s_is_pow_2(n))
+		return -EINVAL;
+
+	*plan = malloc(sizeof(s_fft_plan_t));
+
+	if(*plan == NULL)
+		return -ENOMEM;
+
+	(*plan)->length = n;
+	(*plan)->bitrev = malloc(sizeof(size_t) * n);
+	(*plan)->twiddle = malloc(sizeof(s_complex_t) * (n > 1 ? n / 2 : 1));
+	(*plan)->ftwiddle = malloc(sizeof(s_fcomplex_t) * (n > 1 ? n / 2 : 1));
+
+	if(((*plan)->bitrev == NULL) || ((*plan)->twiddle == NULL) ||
+		((*plan)->ftwiddle == NULL))
+	{
+		s_free_fft_plan(plan);
+		return -ENOMEM;
+	}
+
+	// Compute the bit-reversal permutation of [0, n).
+
+	for(bits = 0; ((size_t) 1 << bits) < n; ++bits)
+		;
+
+	for(i = 0; i < n; ++i)
+	{
+		v = 0;
+
+		for(j = 0; j < bits; ++j)
+			v |= ((i >> j) & 1) << (bits - 1 - j);
+
+		(*plan)->bitrev[i] = v;
+	}
+
+	// Compute the twiddle factors for the largest butterfly stage.
+
+	for(i = 0; i < n / 2; ++i)
+	{
+		s_cexp(&((*plan)->twiddle[i]),
+			-2.0 * M_PI * ((double) i) / ((double) n));
+
+		(*plan)->ftwiddle[i].r = (float) (*plan)->twiddle[i].r;
+		(*plan)->ftwiddle[i].i = (float) (*plan)->twiddle[i].i;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_fft_plan_t structure, including the tables
+ * it contains. Note that this function is safe against double-frees.
+ *
+ * \param plan The s_fft_plan_t to free.
+ */
+void s_free_fft_plan(s_fft_plan_t **plan)
+{
+	if(*plan == NULL)
+		return;
+
+	free((*plan)->bitrev);
+	free((*plan)->twiddle);
+	free((*plan)->ftwiddle);
+
+	free(*plan);
+	*plan = NULL;
+}
+
+/*!
+ * This function reorders the given list of values in place, from natural
+ * order into the bit-reversed order s_fft_execute expects. Since bit-reversal
+ * is its own inverse, this just swaps each pair of values (k, bitrev[k]).
+ *
+ * \param plan The plan for transforms of this length.
+ * \param data The plan->length values to reorder.
+ */
+void s_fft_permute(const s_fft_plan_t *plan, s_complex_t *data)
+{
+	size_t i;
+	size_t j;
+	s_complex_t t;
+
+	for(i = 0; i < plan->length; ++i)
+	{
+		j = plan->bitrev[i];
+
+		if(i < j)
+		{
+			t = data[i];
+			data[i] = data[j];
+			data[j] = t;
+		}
+	}
+}
+
+/*!
+ * This function is the single-precision equivalent of s_fft_permute.
+ *
+ * \param plan The plan for transforms of this length.
+ * \param data The plan->length values to reorder.
+ */
+void s_fft_permute_f(const s_fft_plan_t *plan, s_fcomplex_t *data)
+{
+	size_t i;
+	size_t j;
+	s_fcomplex_t t;
+
+	for(i = 0; i < plan->length; ++i)
+	{
+		j = plan->bitrev[i];
+
+		if(i < j)
+		{
+			t = data[i];
+			data[i] = data[j];
+			data[j] = t;
+		}
+	}
+}
+
+/*!
+ * This function computes the DFT of the given list of values in place, using
+ * an iterative radix-2 Cooley-Tukey FFT.
+ *
+ * The input must already be stored in bit-reversed order (i.e., input value k
+ * must be stored at index plan->bitrev[k]); our callers either do this as
+ * they load each frame, or load (and window) it in natural order and then
+ * reorder it with s_fft_permute. The output is produced in natural order.
+ *
+ * Each stage combines pairs of DFT's of length half into DFT's of length
+ * 2 * half, using the Danielson-Lanczos lemma:
+ *
+ *     $F_k = F^e_k + W^k F^o_k$
+ *     $F_{k + half} = F^e_k - W^k F^o_k$
+ *
+ * The twiddle factor for a stage of length m is $W^k_m = W^{kN/m}_N$, so a
+ * single table for the full length serves every stage. Each stage is computed
+ * by s_simd_butterflies, using the fastest instruction set this CPU supports.
+ *
+ * \param plan The plan for transforms of this length.
+ * \param data The plan->length values to transform, in bit-reversed order.
+ */
+void s_fft_execute(const s_fft_plan_t *plan, s_complex_t *data)
+{
+	size_t n = plan->length;
+	size_t half;
+
+	for(half = 1; half < n; half *= 2)
+	{
+		s_simd_butterflies(data, plan->twiddle, n, half,
+			n / (2 * half));
+	}
+}
+
+/*!
+ * This function is the single-precision equivalent of s_fft_execute.
+ *
+ * \param plan The plan for transforms of this length.
+ * \param data The plan->length values to transform, in bit-reversed order.
+ */
+void s_fft_execute_f(const s_fft_plan_t *plan, s_fcomplex_t *data)
+{
+	size_t n = plan->length;
+	size_t half;
+
+	for(half = 1; half < n; half *= 2)
+	{
+		s_simd_butterflies_f(data, plan->ftwiddle, n, half,
+			n / (2 * half));
+	}
+}
+
+/*!
+ * This function initializes (allocates) a s_rfft_plan_t for real-input
+ * transforms of the given length. If the pointer is non-NULL, we will not
+ * allocate a new value on top of it.
+ *
+ * \param plan The s_rfft_plan_t to allocate.
+ * \param n The length of the real input. Must be a power of two, at least 2.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_rfft_plan(s_rfft_plan_t **plan, size_t n)
+{
+	int r;
+	size_t i;
+
+	if(*plan != NULL)
+		return -EINVAL;
+
+	if((n < 2) || !s_is_pow_2(n))
+		return -EINVAL;
+
+	*plan = malloc(sizeof(s_rfft_plan_t));
+
+	if(*plan == NULL)
+		return -ENOMEM;
+
+	(*plan)->length = n;
+	(*plan)->half = NULL;
+	(*plan)->split = malloc(sizeof(s_complex_t) * (n / 2));
+	(*plan)->fsplit = malloc(sizeof(s_fcomplex_t) * (n / 2));
+
+	if(((*plan)->split == NULL) || ((*plan)->fsplit == NULL))
+	{
+		s_free_rfft_plan(plan);
+		return -ENOMEM;
+	}
+
+	r = s_init_fft_plan(&((*plan)->half), n / 2);
+
+	if(r < 0)
+	{
+		s_free_rfft_plan(plan);
+		return r;
+	}
+
+	// The split pass uses the twiddle factors for the full length.
+
+	for(i = 0; i < n / 2; ++i)
+	{
+		s_cexp(&((*plan)->split[i]),
+			-2.0 * M_PI * ((double) i) / ((double) n));
+
+		(*plan)->fsplit[i].r = (float) (*plan)->split[i].r;
+		(*plan)->fsplit[i].i = (float) (*plan)->split[i].i;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_rfft_plan_t structure, including the tables
+ * it contains. Note that this function is safe against double-frees.
+ *
+ * \param plan The s_rfft_plan_t to free.
+ */
+void s_free_rfft_plan(s_rfft_plan_t **plan)
+{
+	if(*plan == NULL)
+		return;
+
+	s_free_fft_plan(&((*plan)->half));
+	free((*plan)->split);
+	free((*plan)->fsplit);
+
+	free(*plan);
+	*plan = NULL;
+}
+
+/*!
+ * This function returns the real-input FFT plan for transforms of the given
+ * length. Plans are built once, the first time they are requested, and are then
+ * shared by every caller (plans are only ever read while transforming), so the
+ * returned plan must never be modified or freed. This way, transforming many
+ * inputs with the same window size builds its plan only once.
+ *
+ * This function is safe to call from multiple threads at once.
+ *
+ * \param plan This will receive the plan.
+ * \param n The length of the real input. Must be a power of two, at least 2.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_get_rfft_plan(const s_rfft_plan_t **plan, size_t n)
+{
+	int r = 0;
+	s_rfft_plan_entry_t *entry;
+
+	pthread_mutex_lock(&s_rfft_plan_lock);
+
+	for(entry = s_rfft_plan_cache; entry != NULL; entry = entry->next)
+	{
+		if(entry->plan->length == n)
+			break;
+	}
+
+	if(entry == NULL)
+	{
+		entry = malloc(sizeof(s_rfft_plan_entry_t));
+
+		if(entry == NULL)
+		{
+			r = -ENOMEM;
+		}
+		else
+		{
+			entry->plan = NULL;
+			r = s_init_rfft_plan(&(entry->plan), n);
+
+			if(r < 0)
+			{
+				free(entry);
+				entry = NULL;
+			}
+			else
+			{
+				entry->next = s_rfft_plan_cache;
+				s_rfft_plan_cache = entry;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&s_rfft_plan_lock);
+
+	if(r < 0)
+		return r;
+
+	*plan = entry->plan;
+	return 0;
+}
+
+/*!
+ * This function frees all of the plans returned by s_get_rfft_plan. None of
+ * them may be used after this function is called.
+ */
+void s_free_rfft_plans()
+{
+	s_rfft_plan_entry_t *entry;
+
+	pthread_mutex_lock(&s_rfft_plan_lock);
+
+	while(s_rfft_plan_cache != NULL)
+	{
+		entry = s_rfft_plan_cache;
+		s_rfft_plan_cache = entry->next;
+
+		s_free_rfft_plan(&(entry->plan));
+		free(entry);
+	}
+
+	pthread_mutex_unlock(&s_rfft_plan_lock);
+}
+
+/*!
+ * This function returns the number of non-redundant output bins produced by a
+ * real-input transform using the given plan (N / 2 + 1, for input length N).
+ * The remaining bins of the full DFT are the complex conjugates of these.
+ *
+ * \param plan The real-input FFT plan.
+ * \return The number of bins the transform produces.
+ */
+size_t s_rfft_bins(const s_rfft_plan_t *plan)
+{
+	return plan->length / 2 + 1;
+}
+
+/*!
+ * This function computes the non-redundant half of the DFT of a real signal of
+ * length N, in place.
+ *
+ * On input, the N / 2 first values of data must contain the signal packed as
+ * complex values, $z_n = x_{2n} + x_{2n + 1}i$, stored in bit-reversed order
+ * for the half-length plan (i.e., $z_n$ at index plan->half->bitrev[n]). The
+ * buffer must have room for s_rfft_bins() values, which receive bins 0
+ * through N / 2 of the DFT of x.
+ *
+ * After the half-length complex FFT gives us Z, we split it into the DFT's of
+ * the even and odd samples, and combine them as usual:
+ *
+ *     $E_k = (Z_k + \overline{Z_{N/2 - k}}) / 2$
+ *     $O_k = -i (Z_k - \overline{Z_{N/2 - k}}) / 2$
+ *     $X_k = E_k + W^k O_k$
+ *
+ * \param plan The real-input FFT plan.
+ * \param data The packed input, which will be replaced by the result.
+ */
+void s_rfft_execute(const s_rfft_plan_t *plan, s_complex_t *data)
+{
+	size_t half = plan->length / 2;
+	size_t k;
+
+	s_complex_t a;
+	s_complex_t b;
+	double z0r;
+	double z0i;
+
+	s_fft_execute(plan->half, data);
+
+	/*
+	 * Bins 0 and N / 2 depend only on $Z_0$, and are purely real. Compute
+	 * them first, so that we can then process the remaining bins in pairs
+	 * (k, N / 2 - k), which depend on the same two values of Z.
+	 */
+
+	z0r = data[0].r;
+	z0i = data[0].i;
+
+	data[0].r = z0r + z0i;
+	data[0].i = 0.0;
+
+	data[half].r = z0r - z0i;
+	data[half].i = 0.0;
+
+	for(k = 1; k <= half / 2; ++k)
+	{
+		a = data[k];
+		b = data[half - k];
+
+		s_rfft_split(&(data[k]), &a, &b, &(plan->split[k]));
+
+		if(k != half - k)
+		{
+			s_rfft_split(&(data[half - k]), &b, &a,
+				&(plan->split[half - k]));
+		}
+	}
+}
+
+/*!
+ * This function is the single-precision equivalent of s_rfft_execute.
+ *
+ * \param plan The real-input FFT plan.
+ * \param data The packed input, which will be replaced by the result.
+ */
+void s_rfft_execute_f(const s_rfft_plan_t *plan, s_fcomplex_t *data)
+{
+	size_t half = plan->length / 2;
+	size_t k;
+
+	s_fcomplex_t a;
+	s_fcomplex_t b;
+	float z0r;
+	float z0i;
+
+	s_fft_execute_f(plan->half, data);
+
+	z0r = data[0].r;
+	z0i = data[0].i;
+
+	data[0].r = z0r + z0i;
+	data[0].i = 0.0f;
+
+	data[half].r = z0r - z0i;
+	data[half].i = 0.0f;
+
+	for(k = 1; k <= half / 2; ++k)
+	{
+		a = data[k];
+		b = data[half - k];
+
+		s_rfft_split_f(&(data[k]), &a, &b, &(plan->fsplit[k]));
+
+		if(k != half - k)
+		{
+			s_rfft_split_f(&(data[half - k]), &b, &a,
+				&(plan->fsplit[half - k]));
+		}
+	}
+}
+
+/*!
+ * This function computes a single output bin of the real-input FFT split
+ * pass. See s_rfft_execute for details.
+ *
+ * \param dst This will receive $X_k$.
+ * \param a The value $Z_k$.
+ * \param b The value $Z_{N/2 - k}$.
+ * \param w The twiddle factor $W^k$.
+ */
+void s_rfft_split(s_complex_t *dst, const s_complex_t *a,
+	const s_complex_t *b, const s_complex_t *w)
+{
+	double evr = 0.5 * (a->r + b->r);
+	double evi = 0.5 * (a->i - b->i);
+	double odr = 0.5 * (a->i + b->i);
+	double odi = -0.5 * (a->r - b->r);
+
+	dst->r = evr + w->r * odr - w->i * odi;
+	dst->i = evi + w->r * odi + w->i * odr;
+}
+
+/*!
+ * This function is the single-precision equivalent of s_rfft_split.
+ *
+ * \param dst This will receive $X_k$.
+ * \param a The value $Z_k$.
+ * \param b The value $Z_{N/2 - k}$.
+ * \param w The twiddle factor $W^k$.
+ */
+void s_rfft_split_f(s_fcomplex_t *dst, const s_fcomplex_t *a,
+	const s_fcomplex_t *b, const s_fcomplex_t *w)
+{
+	float evr = 0.5f * (a->r + b->r);
+	float evi = 0.5f * (a->i - b->i);
+	float odr = 0.5f * (a->i + b->i);
+	float odi = -0.5f * (a->r - b->r);
+
+	dst->r = evr + w->r * odr - w->i * odi;
+	dst->i = evi + w->r * odi + w->i * odr;
+}
@@ -0,0 +1,44 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_TRANSFORM_PLAN_H
+#define INCLUDE_SPECTR_TRANSFORM_PLAN_H
+
+#include <stddef.h>
+
+#include "spectr/types.h"
+
+extern int s_init_fft_plan(s_fft_plan_t **, size_t);
+extern void s_free_fft_plan(s_fft_plan_t **);
+
+extern void s_fft_permute(const s_fft_plan_t *, s_complex_t *);
+extern void s_fft_permute_f(const s_fft_plan_t *, s_fcomplex_t *);
+
+extern void s_fft_execute(const s_fft_plan_t *, s_complex_t *);
+extern void s_fft_execute_f(const s_fft_plan_t *, s_fcomplex_t *);
+
+extern int s_init_rfft_plan(s_rfft_plan_t **, size_t);
+extern void s_free_rfft_plan(s_rfft_plan_t **);
+extern int s_get_rfft_plan(const s_rfft_plan_t **, size_t);
+extern void s_free_rfft_plans();
+
+extern size_t s_rfft_bins(const s_rfft_plan_t *);
+extern void s_rfft_execute(const s_rfft_plan_t *, s_complex_t *);
+extern void s_rfft_execute_f(const s_rfft_plan_t *, s_fcomplex_t *);
+
+#endif
@@ -0,0 +1,520 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stream.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "spectr/config.h"
+#include "spectr/decoding/decode.h"
+#include "spectr/transform/fourier.h"
+#include "spectr/transform/plan.h"
+#include "spectr/transform/window.h"
+#include "spectr/util/math.h"
+#include "spectr/util/profile.h"
+
+/*!
+ * \brief This structure is a bounded queue of decoded blocks of samples.
+ *
+ * A decoder thread appends blocks to the queue, and the STFT consumes them.
+ * If the queue is full, the decoder waits, so at most S_STREAM_QUEUE_BLOCKS
+ * blocks of decoded audio are ever held in memory.
+ */
+typedef struct s_stream_queue
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	s_stereo_sample_t *blocks;
+	size_t lengths[S_STREAM_QUEUE_BLOCKS];
+	size_t head;
+	size_t count;
+
+	const s_input_t *input;
+	int done;
+	int result;
+	int cancel;
+} s_stream_queue_t;
+
+int s_stft_stream_put(s_stft_stream_t *, double);
+int s_stft_stream_emit(s_stft_stream_t *);
+int s_stream_queue_push(void *, const s_stereo_sample_t *, size_t);
+void *s_stream_decoder(void *);
+
+/*!
+ * This function initializes (allocates) a s_stft_stream_t variable. If the
+ * pointer is non-NULL, we will not allocate a new value on top of it.
+ *
+ * \param st The s_stft_stream_t to allocate.
+ * \param w The window size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param fn The window function to apply to each window.
+ * \param sink The function each finished frame's DFT is passed to.
+ * \param ctx The context pointer to pass to the sink.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_stft_stream(s_stft_stream_t **st, size_t w, size_t hop,
+	s_window_type_t fn, int (*sink)(void *, size_t, const s_dft_t *),
+	void *ctx)
+{
+	int r;
+
+	if(*st != NULL)
+		return -EINVAL;
+
+	if(hop < 1)
+		return -EINVAL;
+
+	*st = malloc(sizeof(s_stft_stream_t));
+
+	if(*st == NULL)
+		return -ENOMEM;
+
+	(*st)->window = w;
+	(*st)->hop = hop;
+	(*st)->plan = NULL;
+	(*st)->function = NULL;
+
+	(*st)->ring = malloc(sizeof(double) * w);
+	(*st)->head = 0;
+	(*st)->filled = 0;
+	(*st)->skip = 0;
+
+	(*st)->frame = malloc(sizeof(double) * w);
+	(*st)->dft = NULL;
+
+	(*st)->samples = 0;
+	(*st)->frames = 0;
+
+	(*st)->sink = sink;
+	(*st)->sink_ctx = ctx;
+
+	if(((*st)->ring == NULL) || ((*st)->frame == NULL))
+	{
+		s_free_stft_stream(st);
+		return -ENOMEM;
+	}
+
+	r = s_get_window(&((*st)->function), fn, w);
+
+	if(r < 0)
+	{
+		s_free_stft_stream(st);
+		return r;
+	}
+
+	r = s_init_rfft_plan(&((*st)->plan), w);
+
+	if(r < 0)
+	{
+		s_free_stft_stream(st);
+		return r;
+	}
+
+	r = s_init_dft(&((*st)->dft));
+
+	if(r == 0)
+		r = s_init_dft_result((*st)->dft, s_rfft_bins((*st)->plan));
+
+	if(r < 0)
+	{
+		s_free_stft_stream(st);
+		return r;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_stft_stream_t structure, including all of
+ * the buffers it contains. Note that this function is safe against
+ * double-frees.
+ *
+ * \param st The s_stft_stream_t to free.
+ */
+void s_free_stft_stream(s_stft_stream_t **st)
+{
+	if(*st == NULL)
+		return;
+
+	s_free_rfft_plan(&((*st)->plan));
+	s_free_dft(&((*st)->dft));
+
+	free((*st)->ring);
+	free((*st)->frame);
+
+	free(*st);
+	*st = NULL;
+}
+
+/*!
+ * This function pushes the given samples into the given streaming STFT. Each
+ * window which is completed by these samples is transformed and passed to the
+ * stream's sink before this function returns.
+ *
+ * \param st The streaming STFT to push samples into.
+ * \param samples The samples to push.
+ * \param n The number of samples to push.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_stream_push(s_stft_stream_t *st, const s_stereo_sample_t *samples,
+	size_t n)
+{
+	int r;
+	size_t i;
+
+	for(i = 0; i < n; ++i)
+	{
+		r = s_stft_stream_put(st,
+			(double) s_mono_sample(samples[i]));
+
+		if(r < 0)
+			return r;
+
+		++st->samples;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function should be called after the last samples have been pushed into
+ * the given streaming STFT. It emits the final windows, which extend past the
+ * end of the input (which is treated as silence), so a streaming STFT produces
+ * exactly the same frames as s_stft would for the same input.
+ *
+ * \param st The streaming STFT to finish.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_stream_finish(s_stft_stream_t *st)
+{
+	int r;
+	size_t total = st->samples / st->hop;
+
+	while(st->frames < total)
+	{
+		r = s_stft_stream_put(st, 0.0);
+
+		if(r < 0)
+			return r;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function decodes the given file and computes its STFT incrementally,
+ * passing each frame to the given sink as soon as it is computed. Decoding
+ * runs on a separate thread, and is connected to the STFT by a bounded queue,
+ * so decoding and transforming overlap and memory use does not depend on the
+ * length of the file.
+ *
+ * \param in The input file to analyze.
+ * \param w The window size. Must be a power of two.
+ * \param hop The number of samples between the starts of adjacent windows.
+ * \param fn The window function to apply to each window.
+ * \param sink The function each finished frame's DFT is passed to.
+ * \param ctx The context pointer to pass to the sink.
+ * \param samples If non-NULL, receives the number of samples decoded.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_stream_file(const s_input_t *in, size_t w, size_t hop,
+	s_window_type_t fn, int (*sink)(void *, size_t, const s_dft_t *),
+	void *ctx, size_t *samples)
+{
+	int ret = 0;
+	int r;
+	s_stft_stream_t *st = NULL;
+	s_stream_queue_t queue;
+	pthread_t decoder;
+	const s_stereo_sample_t *block;
+	size_t length;
+	double begin = s_profile_begin();
+
+	r = s_init_stft_stream(&st, w, hop, fn, sink, ctx);
+
+	if(r < 0)
+		return r;
+
+	// Initialize the queue, and start decoding into it.
+
+	queue.blocks = malloc(sizeof(s_stereo_sample_t) *
+		S_STREAM_BLOCK_SAMPLES * S_STREAM_QUEUE_BLOCKS);
+
+	if(queue.blocks == NULL)
+	{
+		ret = -ENOMEM;
+		goto err_after_stream_alloc;
+	}
+
+	queue.head = 0;
+	queue.count = 0;
+	queue.input = in;
+	queue.done = 0;
+	queue.result = 0;
+	queue.cancel = 0;
+
+	pthread_mutex_init(&(queue.lock), NULL);
+	pthread_cond_init(&(queue.cond), NULL);
+
+	r = pthread_create(&decoder, NULL, s_stream_decoder, &queue);
+
+	if(r != 0)
+	{
+		ret = -r;
+		goto err_after_queue_alloc;
+	}
+
+	// Consume the decoded blocks as they arrive.
+
+	for(;;)
+	{
+		pthread_mutex_lock(&(queue.lock));
+
+		while((queue.count == 0) && !queue.done)
+			pthread_cond_wait(&(queue.cond), &(queue.lock));
+
+		if(queue.count == 0)
+		{
+			pthread_mutex_unlock(&(queue.lock));
+			break;
+		}
+
+		block = queue.blocks + queue.head * S_STREAM_BLOCK_SAMPLES;
+		length = queue.lengths[queue.head];
+
+		pthread_mutex_unlock(&(queue.lock));
+
+		/*
+		 * The decoder never writes to a block which is still counted
+		 * in the queue, so we can process it without holding the lock.
+		 */
+
+		r = s_stft_stream_push(st, block, length);
+
+		pthread_mutex_lock(&(queue.lock));
+
+		queue.head = (queue.head + 1) % S_STREAM_QUEUE_BLOCKS;
+		--queue.count;
+
+		if(r < 0)
+			queue.cancel = 1;
+
+		pthread_cond_broadcast(&(queue.cond));
+		pthread_mutex_unlock(&(queue.lock));
+
+		if(r < 0)
+		{
+			ret = r;
+			break;
+		}
+	}
+
+	pthread_join(decoder, NULL);
+
+	if((ret == 0) && (queue.result < 0))
+		ret = queue.result;
+
+	if(ret == 0)
+		ret = s_stft_stream_finish(st);
+
+	if((ret == 0) && (samples != NULL))
+		*samples = st->samples;
+
+	if(ret == 0)
+	{
+		s_profile_count(COUNTER_INPUT_BYTES, in->length);
+		s_profile_count(COUNTER_SAMPLES, st->samples);
+		s_profile_count(COUNTER_FRAMES, st->frames);
+		s_profile_end(STAGE_STREAM, begin);
+	}
+
+err_after_queue_alloc:
+	pthread_cond_destroy(&(queue.cond));
+	pthread_mutex_destroy(&(queue.lock));
+	free(queue.blocks);
+err_after_stream_alloc:
+	s_free_stft_stream(&st);
+	return ret;
+}
+
+/*!
+ * This function adds a single mono sample to the given streaming STFT's ring
+ * buffer, emitting a frame if this completes a window.
+ *
+ * \param st The streaming STFT to add the sample to.
+ * \param v The value of the sample.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_stream_put(s_stft_stream_t *st, double v)
+{
+	int r;
+
+	/*
+	 * If the hop is longer than the window, the samples between windows are
+	 * skipped. Each window is only emitted once its whole hop has been
+	 * pushed, so we produce exactly the same frames as s_stft.
+	 */
+
+	if(st->skip == 0)
+	{
+		st->ring[(st->head + st->filled) % st->window] = v;
+		++st->filled;
+
+		if(st->filled < st->window)
+			return 0;
+
+		if(st->hop > st->window)
+		{
+			st->skip = st->hop - st->window;
+			return 0;
+		}
+	}
+	else if(--st->skip > 0)
+	{
+		return 0;
+	}
+
+	r = s_stft_stream_emit(st);
+
+	if(r < 0)
+		return r;
+
+	// Drop the oldest hop samples, to make room for the next window.
+
+	if(st->hop < st->window)
+	{
+		st->head = (st->head + st->hop) % st->window;
+		st->filled -= st->hop;
+	}
+	else
+	{
+		st->filled = 0;
+	}
+
+	return 0;
+}
+
+/*!
+ * This function transforms the (full) window currently in the given streaming
+ * STFT's ring buffer, and passes the result to the stream's sink.
+ *
+ * \param st The streaming STFT whose current window should be emitted.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stft_stream_emit(s_stft_stream_t *st)
+{
+	int r;
+	size_t first = st->window - st->head;
+
+	// Copy the ring buffer out in order, so the window is contiguous.
+
+	memcpy(st->frame, st->ring + st->head, sizeof(double) * first);
+	memcpy(st->frame + first, st->ring, sizeof(double) * st->head);
+
+	r = s_rfft_real_plan(st->dft, st->frame, st->plan, st->function);
+
+	if(r < 0)
+		return r;
+
+	r = st->sink(st->sink_ctx, st->frames, st->dft);
+
+	if(r < 0)
+		return r;
+
+	++st->frames;
+
+	return 0;
+}
+
+/*!
+ * This function is the decoder's sink when streaming a file. It copies the
+ * given samples into the queue, waiting for the STFT to make room as needed.
+ *
+ * \param ctx The s_stream_queue_t to add the samples to.
+ * \param samples The decoded samples.
+ * \param n The number of decoded samples.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_stream_queue_push(void *ctx, const s_stereo_sample_t *samples, size_t n)
+{
+	s_stream_queue_t *queue = ctx;
+	size_t tail;
+	size_t length;
+	int ret = 0;
+
+	pthread_mutex_lock(&(queue->lock));
+
+	while(n > 0)
+	{
+		while((queue->count == S_STREAM_QUEUE_BLOCKS) && !queue->cancel)
+			pthread_cond_wait(&(queue->cond), &(queue->lock));
+
+		if(queue->cancel)
+		{
+			ret = -ECANCELED;
+			break;
+		}
+
+		tail = (queue->head + queue->count) % S_STREAM_QUEUE_BLOCKS;
+		length = n < S_STREAM_BLOCK_SAMPLES ? n : S_STREAM_BLOCK_SAMPLES;
+
+		memcpy(queue->blocks + tail * S_STREAM_BLOCK_SAMPLES, samples,
+			sizeof(s_stereo_sample_t) * length);
+
+		queue->lengths[tail] = length;
+		++queue->count;
+
+		samples += length;
+		n -= length;
+
+		pthread_cond_broadcast(&(queue->cond));
+	}
+
+	pthread_mutex_unlock(&(queue->lock));
+
+	return ret;
+}
+
+/*!
+ * This is the thread entry point for the decoder when streaming a file. It
+ * decodes the queue's file into the queue, and then marks the queue as done.
+ *
+ * \param arg The s_stream_queue_t to decode into.
+ * \return Always NULL; the result is stored in the queue.
+ */
+void *s_stream_decoder(void *arg)
+{
+	int r;
+	s_stream_queue_t *queue = arg;
+
+	r = s_decode_stream(queue->input, s_stream_queue_push, queue);
+
+	pthread_mutex_lock(&(queue->lock));
+
+	queue->done = 1;
+	queue->result = r;
+
+	pthread_cond_broadcast(&(queue->cond));
+	pthread_mutex_unlock(&(queue->lock));
+
+	return NULL;
+}
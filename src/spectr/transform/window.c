@@ -0,0 +1,351 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "window.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "spectr/config.h"
+
+/*!
+ * \brief This structure is one entry in our cache of window tables.
+ */
+typedef struct s_window_entry
+{
+	s_window_t window;
+	struct s_window_entry *next;
+} s_window_entry_t;
+
+double s_cosine_window(const double *, size_t, size_t, size_t);
+double s_kaiser_window(size_t, size_t);
+double s_bessel_i0(double);
+int s_init_window(s_window_entry_t **, s_window_type_t, size_t);
+
+/*
+ * The names of each of our window functions, as accepted on the command line,
+ * indexed by s_window_type_t.
+ */
+static const char *s_window_names[WINDOW_INVALID] = {
+	"hann",
+	"hamming",
+	"blackman-harris",
+	"kaiser",
+	"flat-top"
+};
+
+/*
+ * The coefficients of each of the generalized cosine windows we support. See
+ * s_cosine_window for details.
+ */
+static const double s_hann_terms[] = {0.5, 0.5};
+static const double s_hamming_terms[] = {0.54, 0.46};
+static const double s_blackman_harris_terms[] = {
+	0.35875, 0.48829, 0.14128, 0.01168
+};
+static const double s_flat_top_terms[] = {
+	0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368
+};
+
+/*
+ * Our cache of window tables. Each table is computed the first time it is
+ * requested, and kept until s_free_windows is called.
+ */
+static s_window_entry_t *s_window_cache = NULL;
+
+/*
+ * This guards s_window_cache, since each of our STFT callers may request a
+ * window table from its own thread.
+ */
+static pthread_mutex_t s_window_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * This function returns the name of the given window function, as accepted by
+ * s_window_type_from_name.
+ *
+ * \param type The window function.
+ * \return The window function's name, or NULL if it is invalid.
+ */
+const char *s_window_name(s_window_type_t type)
+{
+	if(type >= WINDOW_INVALID)
+		return NULL;
+
+	return s_window_names[type];
+}
+
+/*!
+ * This function returns the window function with the given name.
+ *
+ * \param name The name of the window function (e.g., "hann").
+ * \return The window function, or WINDOW_INVALID if the name is unknown.
+ */
+s_window_type_t s_window_type_from_name(const char *name)
+{
+	int i;
+
+	for(i = 0; i < WINDOW_INVALID; ++i)
+	{
+		if(strcmp(name, s_window_names[i]) == 0)
+			return (s_window_type_t) i;
+	}
+
+	return WINDOW_INVALID;
+}
+
+/*!
+ * This function computes a single coefficient of the given window function.
+ * For more information, see:
+ *
+ *     http://en.wikipedia.org/wiki/Window_function
+ *
+ * All of our windows are symmetric, so the first and last coefficients of a
+ * window of length N are equal.
+ *
+ * \param type The window function.
+ * \param n The index of the sample to window.
+ * \param N The total number of samples in this window's range.
+ * \return The window coefficient for the given sample.
+ */
+double s_window_coefficient(s_window_type_t type, size_t n, size_t N)
+{
+	if(N < 2)
+		return 1.0;
+
+	switch(type)
+	{
+		case WINDOW_HANN:
+			return s_cosine_window(s_hann_terms, 2, n, N);
+
+		case WINDOW_HAMMING:
+			return s_cosine_window(s_hamming_terms, 2, n, N);
+
+		case WINDOW_BLACKMAN_HARRIS:
+			return s_cosine_window(s_blackman_harris_terms, 4,
+				n, N);
+
+		case WINDOW_KAISER:
+			return s_kaiser_window(n, N);
+
+		case WINDOW_FLAT_TOP:
+			return s_cosine_window(s_flat_top_terms, 5, n, N);
+
+		default:
+			return 1.0;
+	}
+}
+
+/*!
+ * This function returns the table of coefficients of the given window
+ * function, for windows of the given length. Tables are computed once, the
+ * first time they are requested, and are then shared by every caller, so the
+ * returned table must never be modified or freed.
+ *
+ * This function is safe to call from multiple threads at once.
+ *
+ * \param window This will receive the window table.
+ * \param type The window function.
+ * \param length The length of the window.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_get_window(const s_window_t **window, s_window_type_t type,
+	size_t length)
+{
+	int r = 0;
+	s_window_entry_t *entry;
+
+	if((type >= WINDOW_INVALID) || (length < 1))
+		return -EINVAL;
+
+	pthread_mutex_lock(&s_window_lock);
+
+	for(entry = s_window_cache; entry != NULL; entry = entry->next)
+	{
+		if((entry->window.type == type) &&
+			(entry->window.length == length))
+		{
+			break;
+		}
+	}
+
+	if(entry == NULL)
+	{
+		r = s_init_window(&entry, type, length);
+
+		if(r == 0)
+		{
+			entry->next = s_window_cache;
+			s_window_cache = entry;
+		}
+	}
+
+	pthread_mutex_unlock(&s_window_lock);
+
+	if(r < 0)
+		return r;
+
+	*window = &(entry->window);
+	return 0;
+}
+
+/*!
+ * This function frees all of the window tables returned by s_get_window.
+ * None of them may be used after this function is called.
+ */
+void s_free_windows()
+{
+	s_window_entry_t *entry;
+
+	pthread_mutex_lock(&s_window_lock);
+
+	while(s_window_cache != NULL)
+	{
+		entry = s_window_cache;
+		s_window_cache = entry->next;
+
+		free(entry->window.coefficients);
+		free(entry->window.fcoefficients);
+		free(entry);
+	}
+
+	pthread_mutex_unlock(&s_window_lock);
+}
+
+/*!
+ * This function computes a single coefficient of a generalized cosine window,
+ * which is defined by its terms $a_k$ as:
+ *
+ *     $w(n) = \sum_k (-1)^k a_k cos(2 \pi k n / (N - 1))$
+ *
+ * Hann, Hamming, Blackman-Harris and flat-top windows are all of this form.
+ *
+ * \param terms The window's terms.
+ * \param count The number of terms.
+ * \param n The index of the sample to window.
+ * \param N The total number of samples in this window's range.
+ * \return The window coefficient for the given sample.
+ */
+double s_cosine_window(const double *terms, size_t count, size_t n, size_t N)
+{
+	size_t k;
+	double x = 2.0 * M_PI * ((double) n) / ((double) (N - 1));
+	double ret = 0.0;
+
+	for(k = 0; k < count; ++k)
+	{
+		if(k % 2 == 0)
+			ret += terms[k] * cos(((double) k) * x);
+		else
+			ret -= terms[k] * cos(((double) k) * x);
+	}
+
+	return ret;
+}
+
+/*!
+ * This function computes a single coefficient of a Kaiser window, with shape
+ * parameter S_WINDOW_KAISER_BETA:
+ *
+ *     $w(n) = I_0(\beta \sqrt{1 - (2n / (N - 1) - 1)^2}) / I_0(\beta)$
+ *
+ * \param n The index of the sample to window.
+ * \param N The total number of samples in this window's range.
+ * \return The window coefficient for the given sample.
+ */
+double s_kaiser_window(size_t n, size_t N)
+{
+	double x = 2.0 * ((double) n) / ((double) (N - 1)) - 1.0;
+	double r = sqrt(fmax(0.0, 1.0 - x * x));
+
+	return s_bessel_i0(S_WINDOW_KAISER_BETA * r) /
+		s_bessel_i0(S_WINDOW_KAISER_BETA);
+}
+
+/*!
+ * This function computes the zeroth-order modified Bessel function of the first
+ * kind, using its power series:
+ *
+ *     $I_0(x) = \sum_k ((x / 2)^k / k!)^2$
+ *
+ * \param x The value to evaluate the function at.
+ * \return The value $I_0(x)$.
+ */
+double s_bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	double k;
+
+	for(k = 1.0; term > sum * 1e-16; k += 1.0)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+/*!
+ * This function allocates a new window cache entry, and computes its table of
+ * coefficients.
+ *
+ * \param entry This will receive the new entry.
+ * \param type The window function.
+ * \param length The length of the window.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_window(s_window_entry_t **entry, s_window_type_t type,
+	size_t length)
+{
+	size_t i;
+
+	*entry = malloc(sizeof(s_window_entry_t));
+
+	if(*entry == NULL)
+		return -ENOMEM;
+
+	(*entry)->window.type = type;
+	(*entry)->window.length = length;
+	(*entry)->window.coefficients = malloc(sizeof(double) * length);
+	(*entry)->window.fcoefficients = malloc(sizeof(float) * length);
+	(*entry)->next = NULL;
+
+	if(((*entry)->window.coefficients == NULL) ||
+		((*entry)->window.fcoefficients == NULL))
+	{
+		free((*entry)->window.coefficients);
+		free((*entry)->window.fcoefficients);
+		free(*entry);
+		*entry = NULL;
+
+		return -ENOMEM;
+	}
+
+	for(i = 0; i < length; ++i)
+	{
+		(*entry)->window.coefficients[i] =
+			s_window_coefficient(type, i, length);
+		(*entry)->window.fcoefficients[i] =
+			(float) (*entry)->window.coefficients[i];
+	}
+
+	return 0;
+}
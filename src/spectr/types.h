@@ -21,10 +21,14 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <pthread.h>
+#include <linux/limits.h>
 
 #include <GLFW/glfw3.h>
 #include <GL/gl.h>
 
+#include "spectr/config.h"
+
 /*!
  * \brief This enum contains all of our supported file types.
  */
@@ -36,16 +40,233 @@ typedef enum {
 	FTYPE_INVALID
 } s_ftype_t;
 
+/*!
+ * \brief This enum contains all of the STFT window functions we support.
+ */
+typedef enum {
+	WINDOW_HANN,
+	WINDOW_HAMMING,
+	WINDOW_BLACKMAN_HARRIS,
+	WINDOW_KAISER,
+	WINDOW_FLAT_TOP,
+	WINDOW_INVALID
+} s_window_type_t;
+
+/*!
+ * \brief This enum contains the scales the frequency axis of a spectrogram
+ * can be displayed in.
+ */
+typedef enum {
+	SCALE_LINEAR,
+	SCALE_LOG,
+	SCALE_MEL,
+	SCALE_BARK,
+	SCALE_INVALID
+} s_scale_type_t;
+
+/*!
+ * \brief This enum contains the ways a s_raw_audio_t can store its samples.
+ *
+ * Audio is decoded in stereo, but it is mixed down to mono (see
+ * s_mixdown_raw_audio) as soon as it is loaded, since that is all the STFT
+ * uses. Mono audio is stored in 16 bits per sample if its bit depth allows,
+ * or 32 bits otherwise. Audio which is decoded lazily (see s_open_raw_audio)
+ * isn't stored as a whole at all; its samples are read from a s_source_t.
+ */
+typedef enum {
+	STORAGE_STEREO,
+	STORAGE_MONO16,
+	STORAGE_MONO32,
+	STORAGE_SOURCE
+} s_storage_t;
+
+/*!
+ * \brief This struct stores the coefficients of one window function, for
+ * windows of one length, in both double and single precision.
+ */
+typedef struct s_window
+{
+	s_window_type_t type;
+	size_t length;
+	double *coefficients;
+	float *fcoefficients;
+} s_window_t;
+
+/*!
+ * \brief This enum contains the floating point precisions we can compute
+ * transforms in.
+ */
+typedef enum {
+	PRECISION_DOUBLE,
+	PRECISION_FLOAT,
+	PRECISION_INVALID
+} s_precision_t;
+
+/*!
+ * \brief This enum contains the sample formats we can export STFT frames in.
+ */
+typedef enum {
+	SFORMAT_FLOAT32,
+	SFORMAT_FLOAT16,
+	SFORMAT_INVALID
+} s_sample_format_t;
+
+/*!
+ * \brief This enum contains the stages of our pipeline which s_profile_end can
+ * time. Some stages contain others (e.g., decoding an MP3 file is part of
+ * decoding the raw audio).
+ */
+typedef enum {
+	STAGE_DECODE,
+	STAGE_DECODE_MP3,
+	STAGE_DECODE_FLAC,
+	STAGE_DECIMATE,
+	STAGE_STFT,
+	STAGE_STREAM,
+	STAGE_CACHE,
+	STAGE_SPECTROGRAM,
+	STAGE_TEXTURE,
+	STAGE_RENDER,
+	STAGE_INVALID
+} s_profile_stage_t;
+
+/*!
+ * \brief This enum contains the quantities s_profile_count can count.
+ */
+typedef enum {
+	COUNTER_INPUT_BYTES,
+	COUNTER_SAMPLES,
+	COUNTER_FRAMES,
+	COUNTER_ALLOCATIONS,
+	COUNTER_ALLOCATED_BYTES,
+	COUNTER_RENDERED,
+	COUNTER_INVALID
+} s_profile_counter_t;
+
+/*!
+ * \brief This enum contains the formats s_profile_report can write in.
+ */
+typedef enum {
+	PFORMAT_SUMMARY,
+	PFORMAT_JSON,
+	PFORMAT_INVALID
+} s_profile_format_t;
+
 /*!
  * \brief This struct defines the various properties of an audio stream.
+ *
+ * The number of samples in the stream is determined without decoding it, if
+ * the format allows; otherwise, it is 0.
  */
 typedef struct s_audio_stat
 {
 	s_ftype_t type;
 	uint32_t bit_depth;
 	uint32_t sample_rate;
+	size_t samples;
 } s_audio_stat_t;
 
+/*!
+ * \brief This struct stores the properties of a single MPEG audio frame, as
+ * described by its header.
+ *
+ * The version is the raw two-bit MPEG audio version ID from the header, and
+ * samples is the number of samples (per channel) the frame decodes to.
+ */
+typedef struct s_mp3_frame
+{
+	uint8_t version;
+	uint8_t layer;
+	int crc;
+	uint32_t bitrate;
+	uint32_t sample_rate;
+	uint32_t channels;
+	size_t length;
+	size_t samples;
+} s_mp3_frame_t;
+
+/*!
+ * \brief This enum lists the kinds of informational MP3 tags we understand.
+ */
+typedef enum
+{
+	MP3_TAG_NONE,
+	MP3_TAG_XING,
+	MP3_TAG_INFO,
+	MP3_TAG_VBRI
+} s_mp3_tag_type_t;
+
+/*!
+ * \brief This struct stores the contents of a Xing, Info or VBRI tag.
+ *
+ * These tags are stored in place of the audio data of a file's first frame.
+ * The frame and byte counts exclude the tag's own frame, and are 0 if the
+ * tag doesn't include them. The encoder delay and padding (the number of
+ * samples the encoder added at the start and end of the stream) come from the
+ * LAME extension of a Xing / Info tag, or from a VBRI tag.
+ */
+typedef struct s_mp3_tag
+{
+	s_mp3_tag_type_t type;
+	size_t frames;
+	size_t bytes;
+	size_t delay;
+	size_t padding;
+} s_mp3_tag_t;
+
+/*!
+ * \brief This struct indexes the frames of an MP3 file.
+ *
+ * For each of the length frames, we store the offset of its header in the
+ * file, and the position (in samples) of its first decoded sample. The index
+ * covers every frame the decoder would output, including the frame which
+ * holds an informational tag (if any), so these positions match the decoded
+ * audio exactly.
+ */
+typedef struct s_mp3_index
+{
+	s_mp3_frame_t first;
+	s_mp3_tag_t tag;
+
+	size_t length;
+	size_t *offsets;
+	size_t *positions;
+	size_t samples;
+} s_mp3_index_t;
+
+/*!
+ * \brief This struct stores a single point of a FLAC file's seek table.
+ *
+ * The offset is relative to the file's first frame, and points to the frame
+ * which starts with the given sample.
+ */
+typedef struct s_flac_seek_point
+{
+	size_t sample;
+	size_t offset;
+} s_flac_seek_point_t;
+
+/*!
+ * \brief This struct stores the properties of a FLAC stream.
+ *
+ * These come from the file's STREAMINFO metadata block. The number of samples
+ * is 0 if the encoder didn't know it. The seek table is taken from the file's
+ * SEEKTABLE metadata block (without its placeholder points), and is empty if
+ * the file doesn't have one.
+ */
+typedef struct s_flac_info
+{
+	uint32_t min_block;
+	uint32_t max_block;
+	uint32_t sample_rate;
+	uint32_t channels;
+	uint32_t bit_depth;
+	size_t samples;
+
+	size_t seek_length;
+	s_flac_seek_point_t *seek_points;
+} s_flac_info_t;
+
 /*!
  * \brief This struct defines a single stereo audio sample.
  *
@@ -59,14 +280,85 @@ typedef struct s_stereo_sample
 	int32_t r;
 } s_stereo_sample_t;
 
+/*!
+ * \brief This struct stores an input file, mapped into memory.
+ *
+ * Each input file is mapped (and its format detected) only once, and then
+ * shared by everything which reads it. The offset is the start of the
+ * file's audio data (e.g., the first MP3 frame, after any tags), as found by
+ * format detection. The mapping itself is kept in map, so it can be unmapped.
+ */
+typedef struct s_input
+{
+	void *map;
+	const uint8_t *data;
+	size_t length;
+	s_ftype_t type;
+	size_t offset;
+} s_input_t;
+
+/*!
+ * \brief This struct stores one decoded chunk of a s_source_t.
+ *
+ * The chunk holds the length mono samples starting at sample
+ * index * S_SOURCE_CHUNK_SAMPLES, or nothing if index is SIZE_MAX. While
+ * loading is set, the chunk is being decoded, and while refs is non-zero, its
+ * samples are being read, so it can't be evicted. used is the value of the
+ * source's clock when the chunk was last acquired.
+ */
+typedef struct s_source_chunk
+{
+	size_t index;
+	int32_t *samples;
+	size_t length;
+	int loading;
+	size_t refs;
+	uint64_t used;
+} s_source_chunk_t;
+
+/*!
+ * \brief This struct stores the state of a lazily decoded audio file.
+ *
+ * The file stays mapped, and it is decoded in chunks of S_SOURCE_CHUNK_SAMPLES
+ * mono samples as they are needed. The most recently used chunks_length chunks
+ * are kept; the least recently used one is replaced when another is needed.
+ * An MP3 file's frames are indexed once, so each chunk can be found without
+ * scanning the file again. error is the first error hit decoding a chunk.
+ *
+ * Everything from chunks on is guarded by lock, and ready is signalled
+ * whenever a chunk finishes loading or stops being read.
+ */
+typedef struct s_source
+{
+	s_input_t *input;
+	s_audio_stat_t stat;
+	s_mp3_index_t *index;
+
+	s_source_chunk_t *chunks;
+	size_t chunks_length;
+	uint64_t clock;
+	int error;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+} s_source_t;
+
 /*!
  * \brief This struct stores the contents of a raw audio file.
+ *
+ * Only the list of samples matching the storage type is used (the others are
+ * NULL): samples for stereo audio, mono16 or mono32 for mono audio, or source
+ * for audio which is decoded lazily.
  */
 typedef struct s_raw_audio
 {
 	s_audio_stat_t stat;
 	size_t samples_length;
+	s_storage_t storage;
 	s_stereo_sample_t *samples;
+	int16_t *mono16;
+	int32_t *mono32;
+	s_source_t *source;
 } s_raw_audio_t;
 
 /*!
@@ -78,17 +370,66 @@ typedef struct s_complex
 	double i;
 } s_complex_t;
 
+/*!
+ * \brief This struct stores a single single-precision complex value.
+ */
+typedef struct s_fcomplex
+{
+	float r;
+	float i;
+} s_fcomplex_t;
+
 /*!
  * \brief This struct stores the result of a discrete Fourier transform.
+ *
+ * Depending on its precision, the result's values are stored either in dft
+ * (PRECISION_DOUBLE), or in fdft (PRECISION_FLOAT).
  */
 typedef struct s_dft
 {
 	size_t length;
-	s_complex_t *dft;
+	s_precision_t precision;
+
+	union
+	{
+		s_complex_t *dft;
+		s_fcomplex_t *fdft;
+	};
 } s_dft_t;
 
+/*!
+ * \brief This struct stores the precomputed tables for an FFT of one length.
+ */
+typedef struct s_fft_plan
+{
+	size_t length;
+	size_t *bitrev;
+	s_complex_t *twiddle;
+	s_fcomplex_t *ftwiddle;
+} s_fft_plan_t;
+
+/*!
+ * \brief This struct stores the precomputed tables for a real-input FFT.
+ *
+ * A real-input transform of length N is computed as a complex transform of
+ * length N / 2, followed by a "split" pass which separates the result into
+ * the N / 2 + 1 non-redundant bins of the real signal's DFT.
+ */
+typedef struct s_rfft_plan
+{
+	size_t length;
+	s_fft_plan_t *half;
+	s_complex_t *split;
+	s_fcomplex_t *fsplit;
+} s_rfft_plan_t;
+
 /*!
  * \brief This struct stores the result of a short-time Fourier Transform.
+ *
+ * The DFT's of all of the windows are stored in one contiguous arena, with
+ * each window's values starting every stride values. The entries in dfts are
+ * views into this arena. The arena holds s_complex_t or s_fcomplex_t values,
+ * depending on the STFT's precision.
  */
 typedef struct s_stft
 {
@@ -97,9 +438,334 @@ typedef struct s_stft
 
 	size_t window;
 	size_t length;
-	s_dft_t **dfts;
+	size_t bins;
+	size_t stride;
+	s_precision_t precision;
+	s_dft_t *dfts;
+	void *arena;
 } s_stft_t;
 
+/*!
+ * \brief This struct stores the state of an incremental (streaming) STFT.
+ *
+ * Samples are pushed into a ring buffer one window long. Whenever the ring
+ * buffer fills up, the window it contains is transformed and handed to the
+ * sink, and then the oldest hop samples are dropped. If the hop is longer
+ * than the window, the skip samples pushed after each window are dropped,
+ * and the window is only transformed once they have been.
+ */
+typedef struct s_stft_stream
+{
+	size_t window;
+	size_t hop;
+	s_rfft_plan_t *plan;
+	const s_window_t *function;
+
+	double *ring;
+	size_t head;
+	size_t filled;
+	size_t skip;
+
+	double *frame;
+	s_dft_t *dft;
+
+	size_t samples;
+	size_t frames;
+
+	int (*sink)(void *, size_t, const s_dft_t *);
+	void *sink_ctx;
+} s_stft_stream_t;
+
+/*!
+ * \brief This structure maps the bins of a DFT onto the rows of a spectrogram.
+ *
+ * The mapping is a sparse matrix of weights, stored row by row: row r covers
+ * the consecutive bins starting at first[r], and their weights are
+ * weight[offset[r]] through weight[offset[r + 1] - 1]. A row's value is the
+ * weighted average of its bins' log-magnitudes. Bins are numbered from 0,
+ * starting after the DC bin, and the Nyquist bin isn't included.
+ */
+typedef struct s_filterbank
+{
+	s_scale_type_t scale;
+	size_t bins;
+	size_t height;
+	uint32_t sample_rate;
+
+	size_t *first;
+	size_t *offset;
+	double *weight;
+} s_filterbank_t;
+
+/*!
+ * \brief This structure stores the state of a live spectrogram.
+ *
+ * A reader thread reads raw PCM (signed 16-bit little-endian, with the given
+ * number of interleaved channels) from fd as it arrives, and pushes it through
+ * a streaming STFT. Each frame is mapped onto height rows by a filterbank, and
+ * written into columns, a ring of the width most recent frames (frame i is in
+ * column i % width, and each column's rows are contiguous). Rows without any
+ * values are -FLT_MAX. min and max are the range of every other value in
+ * columns.
+ *
+ * Everything from columns through result is guarded by lock, since it is read
+ * by the viewer while the reader thread writes it.
+ */
+typedef struct s_live
+{
+	s_audio_stat_t stat;
+	size_t channels;
+	int fd;
+
+	size_t width;
+	size_t height;
+	s_scale_type_t scale;
+	s_stft_stream_t *stream;
+	s_filterbank_t *filterbank;
+	float *row;
+
+	float *columns;
+	size_t frames;
+	float min;
+	float max;
+	int done;
+	int result;
+
+	pthread_mutex_t lock;
+	pthread_t reader;
+	int started;
+	int stop;
+	void (*notify)();
+} s_live_t;
+
+/*!
+ * \brief This enum lists the shader storage buffers our GPU STFT uses.
+ */
+typedef enum {
+	GPU_BUFFER_SAMPLES,
+	GPU_BUFFER_WINDOW,
+	GPU_BUFFER_TWIDDLE,
+	GPU_BUFFER_FRAMES,
+	GPU_BUFFER_MAGNITUDES,
+	GPU_BUFFER_COLUMNS,
+	GPU_BUFFER_FIRST,
+	GPU_BUFFER_OFFSET,
+	GPU_BUFFER_WEIGHT,
+	GPU_BUFFER_RANGE,
+	GPU_BUFFER_INVALID
+} s_gpu_buffer_t;
+
+/*!
+ * \brief This structure stores the state of an STFT computed on the GPU.
+ *
+ * The mono samples of a raw audio file are uploaded once, and each spectrogram
+ * is then computed from them by two compute shaders: fft_program transforms
+ * each frame and stores its bins' magnitudes, and filter_program maps them
+ * onto the spectrogram's rows (with filterbank) and averages them into its
+ * columns. Every GL object belongs to the context the state was created in.
+ */
+typedef struct s_gpu_stft
+{
+	size_t samples_length;
+	uint32_t sample_rate;
+
+	GLuint fft_program;
+	GLuint filter_program;
+	GLuint buffers[GPU_BUFFER_INVALID];
+
+	s_filterbank_t *filterbank;
+} s_gpu_stft_t;
+
+/*!
+ * \brief This structure is one of the blocks a s_arena_t allocates from.
+ *
+ * The block's header is stored at the start of the block itself, and its
+ * allocations follow it. used is the offset of the first free byte.
+ */
+typedef struct s_arena_block
+{
+	struct s_arena_block *next;
+	size_t size;
+	size_t used;
+} s_arena_block_t;
+
+/*!
+ * \brief This structure is an arena, which many buffers are allocated from.
+ *
+ * Buffers allocated from an arena are never freed one by one; instead, all of
+ * them are released at once when the arena is freed. This replaces many small
+ * allocations with a few large blocks, which are then reused (see
+ * s_free_arena) rather than returned to the allocator.
+ */
+typedef struct s_arena
+{
+	s_arena_block_t *blocks;
+	size_t allocated;
+} s_arena_t;
+
+/*!
+ * \brief This struct accumulates STFT results into a grid of pixels.
+ *
+ * Each of the DFT's bins is mapped onto the grid's rows by a filterbank, in
+ * the given frequency scale. Each cell of the grid stores the sum of the row
+ * values of the frames which fall inside that pixel, and how many values
+ * there were, so the cell's value is their average. The grid is stored
+ * column-major (i.e., the cells for each column (point in time) are
+ * contiguous).
+ *
+ * If the total number of frames is known in advance (expected > 0), frames
+ * are mapped directly onto the columns. Otherwise, each column covers
+ * frames_per_column frames; whenever we run out of columns, adjacent pairs of
+ * columns are merged, and frames_per_column doubles. This means the grid's
+ * size never depends on the length of the input.
+ *
+ * The grid (and row, the scratch space for one frame's row values) is
+ * allocated from the spectrogram's arena.
+ */
+typedef struct s_spectrogram
+{
+	s_audio_stat_t raw_stat;
+	size_t raw_length;
+
+	size_t width;
+	size_t height;
+
+	size_t expected;
+	size_t frames;
+	size_t frames_per_column;
+
+	s_scale_type_t scale;
+	s_filterbank_t *filterbank;
+	s_arena_t *arena;
+	float *row;
+
+	double *sum;
+	uint32_t *count;
+} s_spectrogram_t;
+
+/*!
+ * \brief This structure stores one level of a s_pyramid_t.
+ *
+ * The level's columns are stored in tiles of S_PYRAMID_TILE_COLUMNS columns
+ * each, which are allocated as the level grows. Each tile is column-major,
+ * like a s_spectrogram_t's grid, and each cell stores an average
+ * log-magnitude, or 0 if no values fell inside it.
+ */
+typedef struct s_pyramid_level
+{
+	size_t columns;
+	size_t tiles;
+	size_t capacity;
+	float **tile;
+} s_pyramid_level_t;
+
+/*!
+ * \brief This structure stores a multi-resolution pyramid of a spectrogram.
+ *
+ * Level 0 has one column per STFT frame (each hop samples long), and each
+ * level above it halves the time resolution of the one below, by averaging
+ * pairs of adjacent columns. Every level has the same number of rows. This
+ * lets us build a spectrogram of any range of the input, at any zoom level,
+ * by reading only about as many cells as the spectrogram has pixels.
+ *
+ * The tiles of a pyramid we build are all allocated from its arena, and are
+ * released together when the pyramid is freed. A pyramid loaded from our
+ * on-disk cache is read-only: its tiles point into the cache file, which is
+ * mapped at map (and is map_length bytes long), and it has no arena.
+ */
+typedef struct s_pyramid
+{
+	s_audio_stat_t raw_stat;
+	size_t raw_length;
+
+	size_t hop;
+	size_t height;
+
+	s_scale_type_t scale;
+	s_filterbank_t *filterbank;
+
+	size_t levels;
+	s_pyramid_level_t *level;
+	s_arena_t *arena;
+
+	void *map;
+	size_t map_length;
+} s_pyramid_t;
+
+/*!
+ * \brief This structure stores the state of a spectrogram which is refined in
+ * the background.
+ *
+ * A coarse overview of the raw audio, computed from a single frame for every
+ * S_REFINE_COARSE columns, is available straight away. A worker thread then
+ * builds the pyramid of the audio's whole STFT, S_REFINE_BLOCK columns at a
+ * time, replacing the overview's columns as each block is completed. Once the
+ * pyramid is finished, spectrogram is built from it, exactly as it would have
+ * been if it hadn't been refined.
+ *
+ * texels holds the width * height values of the spectrogram displayed so far,
+ * row-major from the lowest row, as our viewer's textures store them (empty
+ * pixels are -FLT_MAX). The columns [dirty_begin, dirty_end) have changed since
+ * they were last read, and min and max are the range of the other values.
+ *
+ * Everything from texels on is guarded by lock, since it is read by the viewer
+ * while the worker thread writes it. The worker owns pyramid and spectrogram
+ * until it sets done.
+ */
+typedef struct s_refine
+{
+	const s_raw_audio_t *raw;
+	size_t window;
+	size_t hop;
+	s_window_type_t fn;
+	s_precision_t precision;
+	size_t threads;
+
+	size_t width;
+	size_t height;
+	s_scale_type_t scale;
+	s_pyramid_t *pyramid;
+	s_spectrogram_t *spectrogram;
+
+	float *texels;
+	size_t dirty_begin;
+	size_t dirty_end;
+	float min;
+	float max;
+	int done;
+	int result;
+
+	pthread_mutex_t lock;
+	pthread_t worker;
+	int started;
+	int stop;
+	void (*notify)();
+} s_refine_t;
+
+/*!
+ * \brief This structure identifies a cached pyramid.
+ *
+ * A cached pyramid is only valid for the exact same input file (identified by
+ * its device, inode, size and modification time), computed with the exact
+ * same STFT parameters (and decimation factor, see s_decimate_raw_audio).
+ */
+typedef struct s_cache_key
+{
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	uint64_t mtime_sec;
+	uint64_t mtime_nsec;
+
+	uint64_t window;
+	uint64_t hop;
+	uint32_t function;
+	uint32_t precision;
+	uint64_t height;
+	uint32_t scale;
+	uint64_t decimation;
+} s_cache_key_t;
+
 /*!
  * \brief This structure stores the state of an OpenGL VBO.
  */
@@ -112,4 +778,98 @@ typedef struct s_vbo_t
 	GLenum mode;
 } s_vbo_t;
 
+/*!
+ * \brief This structure stores the functions which drive our OpenGL viewer.
+ *
+ * The render function draws the scene. The resize function is given the new
+ * size of the window, the key function is given a key (and its modifiers) which
+ * was pressed, and the scroll function is given the cursor's X position and
+ * the vertical scroll offset. The update function (which may be NULL) is called
+ * each time the event loop wakes up, including when another thread wakes it
+ * with s_wake_gl. Each event function returns a positive value if the scene
+ * must be rendered again, 0 if not, or an error number. The close function
+ * (which may also be NULL) is called once the event loop has stopped, while
+ * the GL context still exists, so the handler can delete its GL objects.
+ */
+typedef struct s_gl_handler
+{
+	void *ctx;
+	int (*render)(void *, GLuint *);
+	int (*resize)(void *, int, int);
+	int (*key)(void *, int, int);
+	int (*scroll)(void *, double, double);
+	int (*update)(void *);
+	void (*close)(void *);
+} s_gl_handler_t;
+
+/*!
+ * \brief This structure stores the options given on our command line.
+ */
+typedef struct s_options
+{
+	size_t threads;
+	s_window_type_t window;
+	s_precision_t precision;
+	s_scale_type_t scale;
+	size_t window_size;
+	size_t hop;
+	size_t decimation;
+	int stream;
+	int lazy;
+	int progressive;
+	int gpu;
+	uint32_t rate;
+	size_t channels;
+	int cache;
+	const char *output;
+	const char *export;
+	s_sample_format_t format;
+	s_profile_format_t profile;
+	const char *batch;
+	const char *list;
+	const char *path;
+	char **inputs;
+	size_t inputs_length;
+} s_options_t;
+
+/*!
+ * \brief This structure stores the state of one input file being loaded by
+ * s_load_spectrogram, between decoding it and transforming it.
+ *
+ * If the file's pyramid was found in the cache, pyramid is set instead of
+ * audio, and the file isn't decoded at all.
+ */
+typedef struct s_load_job
+{
+	const char *path;
+	size_t window;
+	size_t hop;
+	s_cache_key_t key;
+	char cache[PATH_MAX];
+	int cacheable;
+	s_raw_audio_t *audio;
+	s_pyramid_t *pyramid;
+	int result;
+} s_load_job_t;
+
+/*!
+ * \brief This structure stores the state of a batch of input files, which
+ * are decoded (on their own thread) ahead of being transformed.
+ *
+ * Job i is stored in jobs[i % (S_BATCH_AHEAD + 1)]. The decoder never starts
+ * decoding a file more than S_BATCH_AHEAD files ahead of the one being
+ * transformed, so it never overwrites a job which is still in use.
+ */
+typedef struct s_batch
+{
+	const s_options_t *opts;
+	char **paths;
+	size_t length;
+	s_load_job_t jobs[S_BATCH_AHEAD + 1];
+	size_t decoded;
+	size_t transformed;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} s_batch_t;
+
 #endif
@@ -0,0 +1,249 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "spectr/config.h"
+#include "spectr/util/profile.h"
+
+size_t s_arena_round(size_t);
+s_arena_block_t *s_alloc_arena_block(size_t);
+
+/*
+ * Our pool of free arena blocks. Freed arenas return their (standard-sized)
+ * blocks here, so the next arena can reuse them instead of allocating new
+ * ones. At most S_ARENA_POOL_BLOCKS blocks are kept.
+ */
+static s_arena_block_t *s_arena_pool = NULL;
+static size_t s_arena_pool_length = 0;
+
+/*
+ * This guards s_arena_pool, since arenas may be created and freed by several
+ * threads at once (e.g., by the decoder thread in batch mode).
+ */
+static pthread_mutex_t s_arena_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * This function initializes (allocates) a new, empty s_arena_t. Memory is
+ * allocated from an arena with s_arena_alloc, and is all released at once when
+ * the arena is freed. If the pointer is non-NULL, we will not allocate a new
+ * value on top of it.
+ *
+ * Note that an arena is not safe to allocate from on several threads at once.
+ *
+ * \param a The s_arena_t to allocate.
+ * \return 0 on success, or an error number otherwise.
+ */
+int s_init_arena(s_arena_t **a)
+{
+	if(*a != NULL)
+		return -EINVAL;
+
+	*a = malloc(sizeof(s_arena_t));
+
+	if(*a == NULL)
+		return -ENOMEM;
+
+	(*a)->blocks = NULL;
+	(*a)->allocated = 0;
+
+	return 0;
+}
+
+/*!
+ * This function frees the given s_arena_t, along with everything which was
+ * allocated from it. Its standard-sized blocks are returned to our pool, for
+ * reuse by later arenas. Note that this function is safe against
+ * double-frees.
+ *
+ * \param a The s_arena_t to free.
+ */
+void s_free_arena(s_arena_t **a)
+{
+	s_arena_block_t *block;
+
+	if(*a == NULL)
+		return;
+
+	pthread_mutex_lock(&s_arena_pool_lock);
+
+	while((*a)->blocks != NULL)
+	{
+		block = (*a)->blocks;
+		(*a)->blocks = block->next;
+
+		if((block->size == S_ARENA_BLOCK_SIZE) &&
+			(s_arena_pool_length < S_ARENA_POOL_BLOCKS))
+		{
+			block->used = s_arena_round(sizeof(s_arena_block_t));
+			block->next = s_arena_pool;
+			s_arena_pool = block;
+			++s_arena_pool_length;
+		}
+		else
+		{
+			free(block);
+		}
+	}
+
+	pthread_mutex_unlock(&s_arena_pool_lock);
+
+	free(*a);
+	*a = NULL;
+}
+
+/*!
+ * This function allocates the given number of bytes from the given arena. The
+ * returned memory is zeroed, and aligned to S_ARENA_ALIGNMENT bytes. It must
+ * not be free()'d; it is released when the arena itself is freed.
+ *
+ * Allocations are carved out of large blocks, which are taken from our pool if
+ * possible. An allocation larger than a block is given a block of its own.
+ *
+ * \param a The arena to allocate from.
+ * \param size The number of bytes to allocate.
+ * \return The allocated memory, or NULL if it could not be allocated.
+ */
+void *s_arena_alloc(s_arena_t *a, size_t size)
+{
+	uint8_t *data;
+	s_arena_block_t *block = a->blocks;
+
+	size = s_arena_round(size < 1 ? 1 : size);
+
+	if((block == NULL) || (block->size - block->used < size))
+	{
+		block = NULL;
+
+		if(size <= S_ARENA_BLOCK_SIZE -
+			s_arena_round(sizeof(s_arena_block_t)))
+		{
+			pthread_mutex_lock(&s_arena_pool_lock);
+
+			if(s_arena_pool != NULL)
+			{
+				block = s_arena_pool;
+				s_arena_pool = block->next;
+				--s_arena_pool_length;
+			}
+
+			pthread_mutex_unlock(&s_arena_pool_lock);
+
+			if(block == NULL)
+				block = s_alloc_arena_block(S_ARENA_BLOCK_SIZE);
+		}
+		else
+		{
+			block = s_alloc_arena_block(size +
+				s_arena_round(sizeof(s_arena_block_t)));
+		}
+
+		if(block == NULL)
+			return NULL;
+
+		/*
+		 * A block of its own is full right away, so keep allocating
+		 * from the block we were using before, if any.
+		 */
+
+		if((block->size != S_ARENA_BLOCK_SIZE) && (a->blocks != NULL))
+		{
+			block->next = a->blocks->next;
+			a->blocks->next = block;
+		}
+		else
+		{
+			block->next = a->blocks;
+			a->blocks = block;
+		}
+	}
+
+	data = (uint8_t *) block + block->used;
+	block->used += size;
+	a->allocated += size;
+
+	memset(data, 0, size);
+
+	return data;
+}
+
+/*!
+ * This function frees all of the blocks in our pool (see s_free_arena). Arenas
+ * may still be used afterwards; they will simply allocate new blocks.
+ */
+void s_free_arena_pool()
+{
+	s_arena_block_t *block;
+
+	pthread_mutex_lock(&s_arena_pool_lock);
+
+	while(s_arena_pool != NULL)
+	{
+		block = s_arena_pool;
+		s_arena_pool = block->next;
+		free(block);
+	}
+
+	s_arena_pool_length = 0;
+
+	pthread_mutex_unlock(&s_arena_pool_lock);
+}
+
+/*!
+ * This function rounds the given size up to a multiple of S_ARENA_ALIGNMENT.
+ *
+ * \param size The size to round.
+ * \return The rounded size.
+ */
+size_t s_arena_round(size_t size)
+{
+	return (size + S_ARENA_ALIGNMENT - 1) & ~((size_t) S_ARENA_ALIGNMENT - 1);
+}
+
+/*!
+ * This function allocates a new arena block of the given total size (which
+ * includes the block's header). Its first allocation starts just after the
+ * header, rounded up to S_ARENA_ALIGNMENT.
+ *
+ * \param size The size of the block, in bytes.
+ * \return The new block, or NULL if it could not be allocated.
+ */
+s_arena_block_t *s_alloc_arena_block(size_t size)
+{
+	s_arena_block_t *block;
+
+	size = s_arena_round(size);
+	block = aligned_alloc(S_ARENA_ALIGNMENT, size);
+
+	if(block == NULL)
+		return NULL;
+
+	s_profile_alloc(size);
+
+	block->next = NULL;
+	block->size = size;
+	block->used = s_arena_round(sizeof(s_arena_block_t));
+
+	return block;
+}
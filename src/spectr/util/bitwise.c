@@ -18,6 +18,8 @@
 
 #include "bitwise.h"
 
+#include <string.h>
+
 /*!
  * This function converts a "32-bit synchsafe integer" found e.g. in MP3
  * headers, and converts it to a standard 32-bit integer type.
@@ -43,6 +45,179 @@ uint32_t s_from_synchsafe_int32(const uint8_t *buf, size_t o)
 	return result;
 }
 
+/*!
+ * This function reads a 32-bit little-endian unsigned integer from the given
+ * buffer, regardless of our own byte order.
+ *
+ * \param buf The buffer containing the raw data.
+ * \param o The offset in the buffer to start at.
+ * \return The value read from the buffer.
+ */
+uint32_t s_load_le_uint32(const uint8_t *buf, size_t o)
+{
+	return ((uint32_t) buf[o + 0]) |
+		(((uint32_t) buf[o + 1]) << 8) |
+		(((uint32_t) buf[o + 2]) << 16) |
+		(((uint32_t) buf[o + 3]) << 24);
+}
+
+/*!
+ * This function reads a 32-bit big-endian unsigned integer from the given
+ * buffer, regardless of our own byte order.
+ *
+ * \param buf The buffer containing the raw data.
+ * \param o The offset in the buffer to start at.
+ * \return The value read from the buffer.
+ */
+uint32_t s_load_be_uint32(const uint8_t *buf, size_t o)
+{
+	return (((uint32_t) buf[o + 0]) << 24) |
+		(((uint32_t) buf[o + 1]) << 16) |
+		(((uint32_t) buf[o + 2]) << 8) |
+		((uint32_t) buf[o + 3]);
+}
+
+/*!
+ * This function reads a 64-bit big-endian unsigned integer from the given
+ * buffer, regardless of our own byte order.
+ *
+ * \param buf The buffer containing the raw data.
+ * \param o The offset in the buffer to start at.
+ * \return The value read from the buffer.
+ */
+uint64_t s_load_be_uint64(const uint8_t *buf, size_t o)
+{
+	return (((uint64_t) s_load_be_uint32(buf, o)) << 32) |
+		((uint64_t) s_load_be_uint32(buf, o + 4));
+}
+
+/*!
+ * This function reads a 64-bit little-endian unsigned integer from the given
+ * buffer, regardless of our own byte order.
+ *
+ * \param buf The buffer containing the raw data.
+ * \param o The offset in the buffer to start at.
+ * \return The value read from the buffer.
+ */
+uint64_t s_load_le_uint64(const uint8_t *buf, size_t o)
+{
+	return ((uint64_t) s_load_le_uint32(buf, o)) |
+		(((uint64_t) s_load_le_uint32(buf, o + 4)) << 32);
+}
+
+/*!
+ * This function writes the given value to the buffer as a 32-bit
+ * little-endian unsigned integer, regardless of our own byte order.
+ *
+ * \param buf The buffer to write to.
+ * \param o The offset in the buffer to start at.
+ * \param v The value to write.
+ */
+void s_store_le_uint32(uint8_t *buf, size_t o, uint32_t v)
+{
+	buf[o + 0] = (uint8_t) (v & 0xFF);
+	buf[o + 1] = (uint8_t) ((v >> 8) & 0xFF);
+	buf[o + 2] = (uint8_t) ((v >> 16) & 0xFF);
+	buf[o + 3] = (uint8_t) ((v >> 24) & 0xFF);
+}
+
+/*!
+ * This function writes the given value to the buffer as a 64-bit
+ * little-endian unsigned integer, regardless of our own byte order.
+ *
+ * \param buf The buffer to write to.
+ * \param o The offset in the buffer to start at.
+ * \param v The value to write.
+ */
+void s_store_le_uint64(uint8_t *buf, size_t o, uint64_t v)
+{
+	s_store_le_uint32(buf, o, (uint32_t) (v & 0xFFFFFFFF));
+	s_store_le_uint32(buf, o + 4, (uint32_t) (v >> 32));
+}
+
+/*!
+ * This function converts the given single-precision float to an IEEE 754
+ * half-precision float, rounding to the nearest representable value (ties to
+ * even). Values too large for a half become infinity, and values too small
+ * become (signed) zero or a subnormal.
+ *
+ * \param v The value to convert.
+ * \return The bits of the half-precision value.
+ */
+uint16_t s_float_to_half(float v)
+{
+	uint32_t bits;
+	uint32_t sign;
+	uint32_t mant;
+	int32_t exp;
+	uint32_t half;
+	uint32_t shift;
+	uint32_t rem;
+
+	memcpy(&bits, &v, sizeof(float));
+
+	sign = (bits >> 16) & 0x8000;
+	exp = (int32_t) ((bits >> 23) & 0xFF);
+	mant = bits & 0x7FFFFF;
+
+	// Infinities and NaNs (keeping NaNs quiet).
+
+	if(exp == 0xFF)
+		return (uint16_t) (sign | 0x7C00 | (mant != 0 ? 0x200 : 0));
+
+	exp = exp - 127 + 15;
+
+	// Overflow to infinity.
+
+	if(exp >= 0x1F)
+		return (uint16_t) (sign | 0x7C00);
+
+	// Normal values: round the mantissa from 23 bits to 10.
+
+	if(exp > 0)
+	{
+		half = sign | ((uint32_t) exp << 10) | (mant >> 13);
+		rem = mant & 0x1FFF;
+
+		if((rem > 0x1000) || ((rem == 0x1000) && (half & 1)))
+			++half;
+
+		return (uint16_t) half;
+	}
+
+	// Subnormal values (or zero), including the implicit leading bit.
+
+	if(exp < -10)
+		return (uint16_t) sign;
+
+	mant |= 0x800000;
+	shift = (uint32_t) (14 - exp);
+
+	half = sign | (mant >> shift);
+	rem = mant & ((1U << shift) - 1);
+
+	if((rem > (1U << (shift - 1))) ||
+		((rem == (1U << (shift - 1))) && (half & 1)))
+	{
+		++half;
+	}
+
+	return (uint16_t) half;
+}
+
+/*!
+ * This function returns whether or not we are running on a little-endian
+ * machine.
+ *
+ * \return Whether or not our byte order is little-endian.
+ */
+int s_is_little_endian()
+{
+	const uint16_t v = 1;
+
+	return *((const uint8_t *) &v) == 1;
+}
+
 /*!
  * This function turns the right-most one bit of the given value off, returning
  * the result.
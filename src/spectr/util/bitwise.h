@@ -24,6 +24,15 @@
 
 extern uint32_t s_from_synchsafe_int32(const uint8_t *, size_t);
 
+extern uint32_t s_load_le_uint32(const uint8_t *, size_t);
+extern uint64_t s_load_le_uint64(const uint8_t *, size_t);
+extern uint32_t s_load_be_uint32(const uint8_t *, size_t);
+extern uint64_t s_load_be_uint64(const uint8_t *, size_t);
+extern void s_store_le_uint32(uint8_t *, size_t, uint32_t);
+extern void s_store_le_uint64(uint8_t *, size_t, uint64_t);
+extern uint16_t s_float_to_half(float);
+extern int s_is_little_endian();
+
 extern uint64_t s_rmo_off(uint64_t);
 extern int s_is_pow_2(uint64_t);
 extern uint64_t s_flp2(uint64_t);
@@ -23,18 +23,19 @@
 /*!
  * This function returns the mono version of the given stereo sample. This is
  * computed by averaging the two channels of the given sample, without
- * overflowing.
+ * overflowing, rounding down (towards negative infinity). This matches
+ * s_simd_mixdown exactly.
  *
  * \param s The sample to convert to a mono sample.
  * \return The mono sample value as close as possible to the given sample.
  */
 int32_t s_mono_sample(s_stereo_sample_t s)
 {
-	double l = (double) s.l;
-	double r = (double) s.r;
-	double m = (l / 2.0) + (r / 2.0);
+	int64_t m = (int64_t) s.l + (int64_t) s.r;
 
-	return (int32_t) floor(m);
+	// Subtracting the low bit first makes the division exact.
+
+	return (int32_t) ((m - (m & 1)) / 2);
 }
 
 /*!
@@ -20,7 +20,12 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#include "spectr/config.h"
 
 /*!
  * This function places the absolute path to our own executable in the given
@@ -93,3 +98,53 @@ int s_get_own_dir(char *buf, size_t bufsiz)
 
 	return 0;
 }
+
+/*!
+ * This function places the absolute path to the directory we store our cache
+ * files in in the given buffer, creating the directory if it doesn't exist.
+ * Following the XDG base directory specification, this is a subdirectory of
+ * $XDG_CACHE_HOME, or of $HOME/.cache if that isn't set.
+ *
+ * \param buf The buf to store the path to our cache directory in.
+ * \param bufsiz The size of the given buffer.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_get_cache_dir(char *buf, size_t bufsiz)
+{
+	int l;
+	size_t o;
+	const char *base;
+
+	base = getenv("XDG_CACHE_HOME");
+
+	if((base != NULL) && (*base != '\0'))
+	{
+		l = snprintf(buf, bufsiz, "%s", base);
+	}
+	else
+	{
+		base = getenv("HOME");
+
+		if((base == NULL) || (*base == '\0'))
+			return -ENOENT;
+
+		l = snprintf(buf, bufsiz, "%s/.cache", base);
+	}
+
+	if((l < 0) || ((size_t) l >= bufsiz))
+		return -ENAMETOOLONG;
+
+	if((mkdir(buf, 0700) < 0) && (errno != EEXIST))
+		return -errno;
+
+	o = (size_t) l;
+	l = snprintf(buf + o, bufsiz - o, "/%s", S_CACHE_DIRECTORY);
+
+	if((l < 0) || ((size_t) l >= bufsiz - o))
+		return -ENAMETOOLONG;
+
+	if((mkdir(buf, 0700) < 0) && (errno != EEXIST))
+		return -errno;
+
+	return 0;
+}
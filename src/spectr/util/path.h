@@ -23,5 +23,6 @@
 
 extern int s_get_own_path(char *, size_t);
 extern int s_get_own_dir(char *, size_t);
+extern int s_get_cache_dir(char *, size_t);
 
 #endif
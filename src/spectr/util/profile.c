@@ -0,0 +1,345 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profile.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+/*!
+ * \brief This structure stores everything we've measured so far.
+ */
+typedef struct s_profile
+{
+	int enabled;
+	double seconds[STAGE_INVALID];
+	uint64_t calls[STAGE_INVALID];
+	uint64_t counters[COUNTER_INVALID];
+} s_profile_t;
+
+int s_profile_report_summary(FILE *, const s_profile_t *, long);
+int s_profile_report_json(FILE *, const s_profile_t *, long);
+
+/*
+ * The names of each of our report formats, as accepted on the command line,
+ * indexed by s_profile_format_t.
+ */
+static const char *s_profile_format_names[PFORMAT_INVALID] = {
+	"summary",
+	"json"
+};
+
+/*
+ * The names each stage and counter are reported under, indexed by
+ * s_profile_stage_t and s_profile_counter_t respectively.
+ */
+static const char *s_profile_stage_names[STAGE_INVALID] = {
+	"decode",
+	"decode_mp3",
+	"decode_flac",
+	"decimate",
+	"stft",
+	"stream",
+	"cache",
+	"spectrogram",
+	"texture",
+	"render"
+};
+static const char *s_profile_counter_names[COUNTER_INVALID] = {
+	"input_bytes",
+	"samples",
+	"frames",
+	"allocations",
+	"allocated_bytes",
+	"rendered"
+};
+
+/*
+ * Our measurements. Nothing is measured until s_profile_enable is called, so
+ * the instrumentation costs (almost) nothing unless it was asked for.
+ */
+static s_profile_t s_profile = {0, {0.0}, {0}, {0}};
+
+/*
+ * This guards s_profile's measurements, since stages may be run (and counted)
+ * on any of our worker threads.
+ */
+static pthread_mutex_t s_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * This function turns on our instrumentation. It must be called before any of
+ * the stages to be measured are run (and before any worker threads are
+ * started), since the stages don't lock s_profile to check whether it is on.
+ */
+void s_profile_enable()
+{
+	s_profile.enabled = 1;
+}
+
+/*!
+ * This function returns the current time, in seconds, from a monotonic clock.
+ * Only differences between these times are meaningful.
+ *
+ * \return The current time.
+ */
+double s_profile_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((double) ts.tv_sec) + ((double) ts.tv_nsec) / 1000000000.0;
+}
+
+/*!
+ * This function starts timing a stage. The value it returns should be given to
+ * s_profile_end once the stage is done. If our instrumentation is off, this
+ * doesn't even read the clock.
+ *
+ * \return The time the stage started, or 0 if we aren't measuring anything.
+ */
+double s_profile_begin()
+{
+	if(!s_profile.enabled)
+		return 0.0;
+
+	return s_profile_now();
+}
+
+/*!
+ * This function stops timing a stage, adding the time since it began to the
+ * stage's total. Each stage's total is the sum of all of its calls, even if
+ * they overlapped (on different threads).
+ *
+ * \param stage The stage which is done.
+ * \param begin The value s_profile_begin returned when the stage began.
+ */
+void s_profile_end(s_profile_stage_t stage, double begin)
+{
+	double elapsed;
+
+	if(!s_profile.enabled || (stage >= STAGE_INVALID))
+		return;
+
+	elapsed = s_profile_now() - begin;
+
+	pthread_mutex_lock(&s_profile_lock);
+	s_profile.seconds[stage] += elapsed;
+	++s_profile.calls[stage];
+	pthread_mutex_unlock(&s_profile_lock);
+}
+
+/*!
+ * This function adds the given amount to one of our counters.
+ *
+ * \param counter The counter to add to.
+ * \param n The amount to add.
+ */
+void s_profile_count(s_profile_counter_t counter, uint64_t n)
+{
+	if(!s_profile.enabled || (counter >= COUNTER_INVALID))
+		return;
+
+	pthread_mutex_lock(&s_profile_lock);
+	s_profile.counters[counter] += n;
+	pthread_mutex_unlock(&s_profile_lock);
+}
+
+/*!
+ * This function counts one allocation of the given size. Only the buffers
+ * whose size depends on the input (decoded audio, STFT frames, arena blocks,
+ * textures) are counted, not every small allocation we make.
+ *
+ * \param size The size of the allocation, in bytes.
+ */
+void s_profile_alloc(size_t size)
+{
+	if(!s_profile.enabled)
+		return;
+
+	pthread_mutex_lock(&s_profile_lock);
+	++s_profile.counters[COUNTER_ALLOCATIONS];
+	s_profile.counters[COUNTER_ALLOCATED_BYTES] += (uint64_t) size;
+	pthread_mutex_unlock(&s_profile_lock);
+}
+
+/*!
+ * This function returns our process' peak resident memory so far.
+ *
+ * \return The peak resident memory, in KiB, or -1 if it isn't available.
+ */
+long s_profile_peak_rss_kb()
+{
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+
+	return usage.ru_maxrss;
+}
+
+/*!
+ * This function returns the report format with the given name.
+ *
+ * \param name The name of the format (e.g., "json").
+ * \return The format, or PFORMAT_INVALID if the name is unknown.
+ */
+s_profile_format_t s_profile_format_from_name(const char *name)
+{
+	int i;
+
+	for(i = 0; i < PFORMAT_INVALID; ++i)
+	{
+		if(strcmp(name, s_profile_format_names[i]) == 0)
+			return (s_profile_format_t) i;
+	}
+
+	return PFORMAT_INVALID;
+}
+
+/*!
+ * This function writes everything we've measured so far to the given stream,
+ * in the given format: either a single human-readable summary line, or a
+ * single line of JSON.
+ *
+ * \param out The stream to write the report to.
+ * \param format The format to write the report in.
+ * \return 0 on success, or an error number if something goes wrong.
+ */
+int s_profile_report(FILE *out, s_profile_format_t format)
+{
+	int r;
+	s_profile_t profile;
+	long rss = s_profile_peak_rss_kb();
+
+	pthread_mutex_lock(&s_profile_lock);
+	profile = s_profile;
+	pthread_mutex_unlock(&s_profile_lock);
+
+	switch(format)
+	{
+		case PFORMAT_SUMMARY:
+			r = s_profile_report_summary(out, &profile, rss);
+			break;
+
+		case PFORMAT_JSON:
+			r = s_profile_report_json(out, &profile, rss);
+			break;
+
+		default:
+			return -EINVAL;
+	}
+
+	if((r < 0) || (fflush(out) != 0))
+		return -EIO;
+
+	return 0;
+}
+
+/*!
+ * This function writes the given measurements as a single summary line. Only
+ * the stages which were actually run are listed, each with its total time and
+ * number of calls.
+ *
+ * \param out The stream to write the summary to.
+ * \param profile The measurements to write.
+ * \param rss Our peak resident memory, in KiB, or -1 if it isn't available.
+ * \return 0 on success, or a negative value if writing fails.
+ */
+int s_profile_report_summary(FILE *out, const s_profile_t *profile, long rss)
+{
+	int i;
+
+	if(fprintf(out, "profile:") < 0)
+		return -1;
+
+	for(i = 0; i < STAGE_INVALID; ++i)
+	{
+		if(profile->calls[i] == 0)
+			continue;
+
+		if(fprintf(out, " %s=%.3fs/%" PRIu64, s_profile_stage_names[i],
+			profile->seconds[i], profile->calls[i]) < 0)
+		{
+			return -1;
+		}
+	}
+
+	for(i = 0; i < COUNTER_INVALID; ++i)
+	{
+		if(fprintf(out, " %s=%" PRIu64, s_profile_counter_names[i],
+			profile->counters[i]) < 0)
+		{
+			return -1;
+		}
+	}
+
+	if(fprintf(out, " peak_rss_kb=%ld\n", rss) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*!
+ * This function writes the given measurements as a single line of JSON. Every
+ * stage and counter is listed (even if it is 0), so the report always has the
+ * same shape.
+ *
+ * \param out The stream to write the JSON to.
+ * \param profile The measurements to write.
+ * \param rss Our peak resident memory, in KiB, or -1 if it isn't available.
+ * \return 0 on success, or a negative value if writing fails.
+ */
+int s_profile_report_json(FILE *out, const s_profile_t *profile, long rss)
+{
+	int i;
+
+	if(fprintf(out, "{\"stages\":{") < 0)
+		return -1;
+
+	for(i = 0; i < STAGE_INVALID; ++i)
+	{
+		if(fprintf(out, "%s\"%s\":{\"seconds\":%.6f,\"calls\":%" PRIu64
+			"}", i > 0 ? "," : "", s_profile_stage_names[i],
+			profile->seconds[i], profile->calls[i]) < 0)
+		{
+			return -1;
+		}
+	}
+
+	if(fprintf(out, "},\"counters\":{") < 0)
+		return -1;
+
+	for(i = 0; i < COUNTER_INVALID; ++i)
+	{
+		if(fprintf(out, "%s\"%s\":%" PRIu64, i > 0 ? "," : "",
+			s_profile_counter_names[i], profile->counters[i]) < 0)
+		{
+			return -1;
+		}
+	}
+
+	if(fprintf(out, "},\"peak_rss_kb\":%ld}\n", rss) < 0)
+		return -1;
+
+	return 0;
+}
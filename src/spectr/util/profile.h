@@ -0,0 +1,39 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_UTIL_PROFILE_H
+#define INCLUDE_SPECTR_UTIL_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "spectr/types.h"
+
+extern void s_profile_enable();
+extern double s_profile_now();
+extern double s_profile_begin();
+extern void s_profile_end(s_profile_stage_t, double);
+extern void s_profile_count(s_profile_counter_t, uint64_t);
+extern void s_profile_alloc(size_t);
+extern long s_profile_peak_rss_kb();
+
+extern s_profile_format_t s_profile_format_from_name(const char *);
+extern int s_profile_report(FILE *, s_profile_format_t);
+
+#endif
@@ -0,0 +1,1672 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simd.h"
+
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <float.h>
+#include <pthread.h>
+
+#include "spectr/util/math.h"
+
+#if defined(__GNUC__) && defined(__SSE2__) && \
+	(defined(__x86_64__) || defined(__i386__))
+	#define S_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+	#define S_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+#ifdef S_SIMD_X86
+	#define S_SIMD_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+/*
+ * These are the constants our vectorized logarithms use. See
+ * s_simd_log_magnitudes for details.
+ */
+#define S_SIMD_EXPONENT_MAGIC 0x4330000000000000ULL
+#define S_SIMD_EXPONENT_BIAS 4503599627371519.0
+#define S_SIMD_MANTISSA_MASK 0x000FFFFFFFFFFFFFULL
+#define S_SIMD_MANTISSA_ONE 0x3FF0000000000000ULL
+
+#define S_SIMD_FEXPONENT_MAGIC 0x4B000000U
+#define S_SIMD_FEXPONENT_BIAS 8388735.0f
+#define S_SIMD_FMANTISSA_MASK 0x007FFFFFU
+#define S_SIMD_FMANTISSA_ONE 0x3F800000U
+
+/*!
+ * \brief This structure stores the implementations of each of our kernels.
+ *
+ * supported tells whether the CPU we're running on can use this set of
+ * kernels, or is NULL if any CPU which can run this build can.
+ */
+typedef struct s_simd_kernels
+{
+	const char *name;
+	int (*supported)();
+	void (*butterflies)(s_complex_t *, const s_complex_t *, size_t, size_t,
+		size_t);
+	void (*log_magnitudes)(double *, const s_complex_t *, size_t);
+	void (*butterflies_f)(s_fcomplex_t *, const s_fcomplex_t *, size_t,
+		size_t, size_t);
+	void (*log_magnitudes_f)(double *, const s_fcomplex_t *, size_t);
+	void (*multiply)(double *, const double *, const double *, size_t);
+	void (*multiply_f)(float *, const float *, const float *, size_t);
+	void (*mixdown)(int32_t *, const s_stereo_sample_t *, size_t);
+} s_simd_kernels_t;
+
+void s_simd_select();
+int s_simd_avx2_supported();
+
+void s_butterflies_scalar(s_complex_t *, const s_complex_t *, size_t, size_t,
+	size_t);
+void s_log_magnitudes_scalar(double *, const s_complex_t *, size_t);
+void s_butterflies_f_scalar(s_fcomplex_t *, const s_fcomplex_t *, size_t,
+	size_t, size_t);
+void s_log_magnitudes_f_scalar(double *, const s_fcomplex_t *, size_t);
+void s_multiply_scalar(double *, const double *, const double *, size_t);
+void s_multiply_f_scalar(float *, const float *, const float *, size_t);
+void s_mixdown_scalar(int32_t *, const s_stereo_sample_t *, size_t);
+
+#ifdef S_SIMD_X86
+	void s_butterflies_sse2(s_complex_t *, const s_complex_t *, size_t,
+		size_t, size_t);
+	void s_log_magnitudes_sse2(double *, const s_complex_t *, size_t);
+
+	S_SIMD_AVX2 void s_butterflies_avx2(s_complex_t *,
+		const s_complex_t *, size_t, size_t, size_t);
+	S_SIMD_AVX2 void s_log_magnitudes_avx2(double *, const s_complex_t *,
+		size_t);
+
+	void s_butterflies_f_sse2(s_fcomplex_t *, const s_fcomplex_t *,
+		size_t, size_t, size_t);
+	void s_log_magnitudes_f_sse2(double *, const s_fcomplex_t *, size_t);
+
+	S_SIMD_AVX2 void s_butterflies_f_avx2(s_fcomplex_t *,
+		const s_fcomplex_t *, size_t, size_t, size_t);
+	S_SIMD_AVX2 void s_log_magnitudes_f_avx2(double *,
+		const s_fcomplex_t *, size_t);
+
+	void s_multiply_sse2(double *, const double *, const double *,
+		size_t);
+	void s_multiply_f_sse2(float *, const float *, const float *, size_t);
+
+	S_SIMD_AVX2 void s_multiply_avx2(double *, const double *,
+		const double *, size_t);
+	S_SIMD_AVX2 void s_multiply_f_avx2(float *, const float *,
+		const float *, size_t);
+
+	void s_mixdown_sse2(int32_t *, const s_stereo_sample_t *, size_t);
+	S_SIMD_AVX2 void s_mixdown_avx2(int32_t *, const s_stereo_sample_t *,
+		size_t);
+#endif
+
+#ifdef S_SIMD_NEON
+	void s_butterflies_neon(s_complex_t *, const s_complex_t *, size_t,
+		size_t, size_t);
+	void s_log_magnitudes_neon(double *, const s_complex_t *, size_t);
+
+	void s_butterflies_f_neon(s_fcomplex_t *, const s_fcomplex_t *,
+		size_t, size_t, size_t);
+	void s_log_magnitudes_f_neon(double *, const s_fcomplex_t *, size_t);
+
+	void s_multiply_neon(double *, const double *, const double *,
+		size_t);
+	void s_multiply_f_neon(float *, const float *, const float *, size_t);
+
+	void s_mixdown_neon(int32_t *, const s_stereo_sample_t *, size_t);
+#endif
+
+/*
+ * Every set of kernels this build includes, from the slowest to the fastest.
+ * We use the last one the CPU supports.
+ */
+static const s_simd_kernels_t s_simd_sets[] = {
+	{
+		"scalar", NULL,
+		s_butterflies_scalar, s_log_magnitudes_scalar,
+		s_butterflies_f_scalar, s_log_magnitudes_f_scalar,
+		s_multiply_scalar, s_multiply_f_scalar, s_mixdown_scalar
+	},
+#ifdef S_SIMD_X86
+	{
+		"sse2", NULL,
+		s_butterflies_sse2, s_log_magnitudes_sse2,
+		s_butterflies_f_sse2, s_log_magnitudes_f_sse2,
+		s_multiply_sse2, s_multiply_f_sse2, s_mixdown_sse2
+	},
+	{
+		"avx2", s_simd_avx2_supported,
+		s_butterflies_avx2, s_log_magnitudes_avx2,
+		s_butterflies_f_avx2, s_log_magnitudes_f_avx2,
+		s_multiply_avx2, s_multiply_f_avx2, s_mixdown_avx2
+	},
+#endif
+#ifdef S_SIMD_NEON
+	{
+		"neon", NULL,
+		s_butterflies_neon, s_log_magnitudes_neon,
+		s_butterflies_f_neon, s_log_magnitudes_f_neon,
+		s_multiply_neon, s_multiply_f_neon, s_mixdown_neon
+	},
+#endif
+};
+
+/*
+ * The kernels we selected for this CPU. This is set exactly once, by
+ * s_simd_select, the first time any of our kernels are used (or by
+ * s_simd_force, in our self-test).
+ */
+static s_simd_kernels_t s_simd_kernels;
+
+/*
+ * This guards s_simd_kernels, so it is selected exactly once even if several
+ * of our STFT workers call a kernel at the same time.
+ */
+static pthread_once_t s_simd_once = PTHREAD_ONCE_INIT;
+
+/*!
+ * This function returns the name of the instruction set our vectorized
+ * kernels use on this CPU (e.g., "avx2" or "scalar").
+ *
+ * \return The name of the kernels we selected.
+ */
+const char *s_simd_name()
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	return s_simd_kernels.name;
+}
+
+/*!
+ * This function computes one stage of an iterative radix-2 FFT, in place. The
+ * stage combines each pair of adjacent DFT's of length half into a single DFT
+ * of length 2 * half, using the twiddle factors $W^{k \cdot step}$ from the
+ * given table. See s_fft_execute for details.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_simd_butterflies(s_complex_t *data, const s_complex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	s_simd_kernels.butterflies(data, twiddle, n, half, step);
+}
+
+/*!
+ * This function computes $log_{10}$ of the magnitude of each of the given
+ * complex values. This is the value our spectrograms accumulate for each DFT
+ * bin.
+ *
+ * Our vectorized implementations compute $log_{10} |z| = log_{10}(|z|^2) / 2$
+ * directly from the squared magnitude, by splitting it into its exponent e
+ * and a mantissa m in $[\sqrt{2} / 2, \sqrt{2})$, and then evaluating:
+ *
+ *     $ln(m) = 2 (s + s^3 / 3 + s^5 / 5 + ...)$, where $s = (m - 1) / (m + 1)$
+ *
+ * which converges quickly, since $|s| < 0.18$. The result agrees with the C
+ * library to within about $10^{-12}$. Zeros, subnormals and non-finite values
+ * are handed to the C library instead, so (e.g.) a zero still yields -inf.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_simd_log_magnitudes(double *dst, const s_complex_t *src, size_t n)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	s_simd_kernels.log_magnitudes(dst, src, n);
+}
+
+/*!
+ * This function is the single-precision equivalent of s_simd_butterflies.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_simd_butterflies_f(s_fcomplex_t *data, const s_fcomplex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	s_simd_kernels.butterflies_f(data, twiddle, n, half, step);
+}
+
+/*!
+ * This function is the single-precision equivalent of s_simd_log_magnitudes.
+ * The logarithms are computed in single precision as well (the same way, with
+ * fewer terms), and are then widened, so they agree with the C library to
+ * within about $10^{-6}$.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_simd_log_magnitudes_f(double *dst, const s_fcomplex_t *src, size_t n)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	s_simd_kernels.log_magnitudes_f(dst, src, n);
+}
+
+/*!
+ * This function multiplies two lists of values element-wise. This is how we
+ * apply a window function's coefficients to each frame of an STFT. The
+ * destination may be the same list as either input.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_simd_multiply(double *dst, const double *a, const double *b, size_t n)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	s_simd_kernels.multiply(dst, a, b, n);
+}
+
+/*!
+ * This function is the single-precision equivalent of s_simd_multiply.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_simd_multiply_f(float *dst, const float *a, const float *b, size_t n)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	s_simd_kernels.multiply_f(dst, a, b, n);
+}
+
+/*!
+ * This function mixes the given stereo samples down to mono, exactly as
+ * s_mono_sample does: each mono sample is the average of its two channels,
+ * rounded down. Since $\lfloor (l + r) / 2 \rfloor = (l >> 1) + (r >> 1) +
+ * (l \& r \& 1)$, the sum never needs more than 32 bits.
+ *
+ * \param dst This will receive the n mono samples.
+ * \param src The n stereo samples.
+ * \param n The number of samples.
+ */
+void s_simd_mixdown(int32_t *dst, const s_stereo_sample_t *src, size_t n)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	s_simd_kernels.mixdown(dst, src, n);
+}
+
+#ifdef SPECTR_DEBUG
+/*!
+ * This function makes our kernels use the given set of implementations (in
+ * order from the slowest, see s_simd_sets), so our self-test can check each
+ * of them, and not just the one this CPU would use. Passing SIZE_MAX selects
+ * the best set this CPU supports again. This must not be called while any
+ * other thread may be using our kernels.
+ *
+ * \param set The index of the set of kernels to use, or SIZE_MAX.
+ * \return 0 on success, -ENOTSUP if this CPU can't use the given set, or
+ * -EINVAL if there is no such set.
+ */
+int s_simd_force(size_t set)
+{
+	pthread_once(&s_simd_once, s_simd_select);
+
+	if(set == SIZE_MAX)
+	{
+		s_simd_select();
+		return 0;
+	}
+
+	if(set >= sizeof(s_simd_sets) / sizeof(s_simd_kernels_t))
+		return -EINVAL;
+
+	if((s_simd_sets[set].supported != NULL) &&
+		!s_simd_sets[set].supported())
+	{
+		return -ENOTSUP;
+	}
+
+	s_simd_kernels = s_simd_sets[set];
+
+	return 0;
+}
+#endif
+
+/*!
+ * This function selects the best implementation of each of our kernels which
+ * this CPU supports: the last of s_simd_sets it can use. SSE2 and NEON are
+ * always available on the architectures which have them, whereas AVX2 (and
+ * FMA) are detected at runtime.
+ */
+void s_simd_select()
+{
+	size_t i;
+
+	for(i = 0; i < sizeof(s_simd_sets) / sizeof(s_simd_kernels_t); ++i)
+	{
+		if((s_simd_sets[i].supported == NULL) ||
+			s_simd_sets[i].supported())
+		{
+			s_simd_kernels = s_simd_sets[i];
+		}
+	}
+}
+
+/*!
+ * This function returns whether this CPU supports our AVX2 kernels, which
+ * also need FMA.
+ *
+ * \return 1 if it does, or 0 otherwise.
+ */
+int s_simd_avx2_supported()
+{
+#ifdef S_SIMD_X86
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return 0;
+#endif
+}
+
+/*!
+ * This is the portable implementation of s_simd_butterflies.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_butterflies_scalar(s_complex_t *data, const s_complex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	const s_complex_t *w;
+	s_complex_t *even;
+	s_complex_t *odd;
+	double tr;
+	double ti;
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; ++k)
+		{
+			w = &(twiddle[k * step]);
+			even = &(data[start + k]);
+			odd = &(data[start + k + half]);
+
+			tr = w->r * odd->r - w->i * odd->i;
+			ti = w->r * odd->i + w->i * odd->r;
+
+			odd->r = even->r - tr;
+			odd->i = even->i - ti;
+
+			even->r += tr;
+			even->i += ti;
+		}
+	}
+}
+
+/*!
+ * This is the portable implementation of s_simd_log_magnitudes.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_log_magnitudes_scalar(double *dst, const s_complex_t *src, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i < n; ++i)
+	{
+		dst[i] = log10(sqrt(src[i].r * src[i].r +
+			src[i].i * src[i].i));
+	}
+}
+
+/*!
+ * This is the portable implementation of s_simd_butterflies_f.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_butterflies_f_scalar(s_fcomplex_t *data, const s_fcomplex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	const s_fcomplex_t *w;
+	s_fcomplex_t *even;
+	s_fcomplex_t *odd;
+	float tr;
+	float ti;
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; ++k)
+		{
+			w = &(twiddle[k * step]);
+			even = &(data[start + k]);
+			odd = &(data[start + k + half]);
+
+			tr = w->r * odd->r - w->i * odd->i;
+			ti = w->r * odd->i + w->i * odd->r;
+
+			odd->r = even->r - tr;
+			odd->i = even->i - ti;
+
+			even->r += tr;
+			even->i += ti;
+		}
+	}
+}
+
+/*!
+ * This is the portable implementation of s_simd_log_magnitudes_f. Since this
+ * is also the fallback for values our vectorized versions can't handle, the
+ * magnitudes are computed in double precision here.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_log_magnitudes_f_scalar(double *dst, const s_fcomplex_t *src,
+	size_t n)
+{
+	size_t i;
+	double r;
+	double im;
+
+	for(i = 0; i < n; ++i)
+	{
+		r = (double) src[i].r;
+		im = (double) src[i].i;
+
+		dst[i] = log10(sqrt(r * r + im * im));
+	}
+}
+
+/*!
+ * This is the portable implementation of s_simd_multiply.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_multiply_scalar(double *dst, const double *a, const double *b,
+	size_t n)
+{
+	size_t i;
+
+	for(i = 0; i < n; ++i)
+		dst[i] = a[i] * b[i];
+}
+
+/*!
+ * This is the portable implementation of s_simd_multiply_f.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_multiply_f_scalar(float *dst, const float *a, const float *b,
+	size_t n)
+{
+	size_t i;
+
+	for(i = 0; i < n; ++i)
+		dst[i] = a[i] * b[i];
+}
+
+/*!
+ * This is the portable implementation of s_simd_mixdown.
+ *
+ * \param dst This will receive the n mono samples.
+ * \param src The n stereo samples.
+ * \param n The number of samples.
+ */
+void s_mixdown_scalar(int32_t *dst, const s_stereo_sample_t *src, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i < n; ++i)
+		dst[i] = s_mono_sample(src[i]);
+}
+
+#ifdef S_SIMD_X86
+/*!
+ * This is the SSE2 implementation of s_simd_butterflies. Each complex value
+ * fills exactly one register, so we process one butterfly at a time, but
+ * without any of the scalar version's shuffling through memory.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_butterflies_sse2(s_complex_t *data, const s_complex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	double *even;
+	double *odd;
+	__m128d sign = _mm_set_pd(0.0, -0.0);
+	__m128d w;
+	__m128d e;
+	__m128d o;
+	__m128d t;
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; ++k)
+		{
+			w = _mm_loadu_pd((const double *) &(twiddle[k * step]));
+			even = (double *) &(data[start + k]);
+			odd = (double *) &(data[start + k + half]);
+
+			e = _mm_loadu_pd(even);
+			o = _mm_loadu_pd(odd);
+
+			// t = (wr * or - wi * oi, wr * oi + wi * or)
+
+			t = _mm_mul_pd(_mm_unpackhi_pd(w, w),
+				_mm_shuffle_pd(o, o, 1));
+			t = _mm_add_pd(_mm_mul_pd(_mm_unpacklo_pd(w, w), o),
+				_mm_xor_pd(t, sign));
+
+			_mm_storeu_pd(odd, _mm_sub_pd(e, t));
+			_mm_storeu_pd(even, _mm_add_pd(e, t));
+		}
+	}
+}
+
+/*!
+ * This is the SSE2 implementation of s_simd_log_magnitudes, which processes
+ * two values at a time.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_log_magnitudes_sse2(double *dst, const s_complex_t *src, size_t n)
+{
+	size_t i;
+
+	__m128d a;
+	__m128d b;
+	__m128d p;
+	__m128i bits;
+	__m128d e;
+	__m128d m;
+	__m128d big;
+	__m128d s;
+	__m128d s2;
+	__m128d poly;
+	__m128d valid;
+
+	for(i = 0; i + 2 <= n; i += 2)
+	{
+		a = _mm_loadu_pd((const double *) &(src[i]));
+		b = _mm_loadu_pd((const double *) &(src[i + 1]));
+
+		a = _mm_mul_pd(a, a);
+		b = _mm_mul_pd(b, b);
+		p = _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b));
+
+		// Split p into its exponent and mantissa.
+
+		bits = _mm_castpd_si128(p);
+
+		e = _mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52),
+			_mm_set1_epi64x((long long) S_SIMD_EXPONENT_MAGIC)));
+		e = _mm_sub_pd(e, _mm_set1_pd(S_SIMD_EXPONENT_BIAS));
+
+		m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits,
+			_mm_set1_epi64x((long long) S_SIMD_MANTISSA_MASK)),
+			_mm_set1_epi64x((long long) S_SIMD_MANTISSA_ONE)));
+
+		big = _mm_cmpgt_pd(m, _mm_set1_pd(M_SQRT2));
+		m = _mm_or_pd(_mm_and_pd(big, _mm_mul_pd(m, _mm_set1_pd(0.5))),
+			_mm_andnot_pd(big, m));
+		e = _mm_add_pd(e, _mm_and_pd(big, _mm_set1_pd(1.0)));
+
+		// Compute ln(m), and then log10(p) / 2.
+
+		s = _mm_div_pd(_mm_sub_pd(m, _mm_set1_pd(1.0)),
+			_mm_add_pd(m, _mm_set1_pd(1.0)));
+		s2 = _mm_mul_pd(s, s);
+
+		poly = _mm_set1_pd(1.0 / 13.0);
+		poly = _mm_add_pd(_mm_mul_pd(poly, s2),
+			_mm_set1_pd(1.0 / 11.0));
+		poly = _mm_add_pd(_mm_mul_pd(poly, s2), _mm_set1_pd(1.0 / 9.0));
+		poly = _mm_add_pd(_mm_mul_pd(poly, s2), _mm_set1_pd(1.0 / 7.0));
+		poly = _mm_add_pd(_mm_mul_pd(poly, s2), _mm_set1_pd(1.0 / 5.0));
+		poly = _mm_add_pd(_mm_mul_pd(poly, s2), _mm_set1_pd(1.0 / 3.0));
+		poly = _mm_add_pd(_mm_mul_pd(poly, s2), _mm_set1_pd(1.0));
+		poly = _mm_mul_pd(_mm_mul_pd(poly, s), _mm_set1_pd(2.0));
+
+		valid = _mm_and_pd(_mm_cmpge_pd(p, _mm_set1_pd(DBL_MIN)),
+			_mm_cmple_pd(p, _mm_set1_pd(DBL_MAX)));
+
+		p = _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(M_LN2)), poly);
+		_mm_storeu_pd(&(dst[i]),
+			_mm_mul_pd(p, _mm_set1_pd(0.5 / M_LN10)));
+
+		// Let the C library handle any values we can't.
+
+		if(_mm_movemask_pd(valid) != 0x3)
+			s_log_magnitudes_scalar(&(dst[i]), &(src[i]), 2);
+	}
+
+	s_log_magnitudes_scalar(&(dst[i]), &(src[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_X86
+/*!
+ * This is the AVX2 (and FMA) implementation of s_simd_butterflies, which
+ * processes two butterflies at a time. The first stage (half = 1) only has one
+ * butterfly per group, so it uses the SSE2 implementation instead.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+S_SIMD_AVX2 void s_butterflies_avx2(s_complex_t *data,
+	const s_complex_t *twiddle, size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	double *even;
+	double *odd;
+	__m256d w;
+	__m256d e;
+	__m256d o;
+	__m256d t;
+
+	if(half < 2)
+	{
+		s_butterflies_sse2(data, twiddle, n, half, step);
+		return;
+	}
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; k += 2)
+		{
+			w = _mm256_insertf128_pd(_mm256_castpd128_pd256(
+				_mm_loadu_pd((const double *)
+				&(twiddle[k * step]))),
+				_mm_loadu_pd((const double *)
+				&(twiddle[(k + 1) * step])), 1);
+
+			even = (double *) &(data[start + k]);
+			odd = (double *) &(data[start + k + half]);
+
+			e = _mm256_loadu_pd(even);
+			o = _mm256_loadu_pd(odd);
+
+			// t = (wr * or - wi * oi, wr * oi + wi * or)
+
+			t = _mm256_mul_pd(_mm256_permute_pd(w, 0xF),
+				_mm256_permute_pd(o, 0x5));
+			t = _mm256_fmaddsub_pd(_mm256_movedup_pd(w), o, t);
+
+			_mm256_storeu_pd(odd, _mm256_sub_pd(e, t));
+			_mm256_storeu_pd(even, _mm256_add_pd(e, t));
+		}
+	}
+}
+
+/*!
+ * This is the AVX2 (and FMA) implementation of s_simd_log_magnitudes, which
+ * processes four values at a time.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+S_SIMD_AVX2 void s_log_magnitudes_avx2(double *dst, const s_complex_t *src,
+	size_t n)
+{
+	size_t i;
+
+	__m256d a;
+	__m256d b;
+	__m256d p;
+	__m256i bits;
+	__m256d e;
+	__m256d m;
+	__m256d big;
+	__m256d s;
+	__m256d s2;
+	__m256d poly;
+	__m256d valid;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		a = _mm256_loadu_pd((const double *) &(src[i]));
+		b = _mm256_loadu_pd((const double *) &(src[i + 2]));
+
+		a = _mm256_mul_pd(a, a);
+		b = _mm256_mul_pd(b, b);
+
+		// This leaves the values in the order 0, 2, 1, 3.
+
+		p = _mm256_add_pd(_mm256_unpacklo_pd(a, b),
+			_mm256_unpackhi_pd(a, b));
+		p = _mm256_permute4x64_pd(p, 0xD8);
+
+		// Split p into its exponent and mantissa.
+
+		bits = _mm256_castpd_si256(p);
+
+		e = _mm256_castsi256_pd(_mm256_or_si256(
+			_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(
+			(long long) S_SIMD_EXPONENT_MAGIC)));
+		e = _mm256_sub_pd(e, _mm256_set1_pd(S_SIMD_EXPONENT_BIAS));
+
+		m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits,
+			_mm256_set1_epi64x((long long) S_SIMD_MANTISSA_MASK)),
+			_mm256_set1_epi64x((long long) S_SIMD_MANTISSA_ONE)));
+
+		big = _mm256_cmp_pd(m, _mm256_set1_pd(M_SQRT2), _CMP_GT_OQ);
+		m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)),
+			big);
+		e = _mm256_add_pd(e, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+
+		// Compute ln(m), and then log10(p) / 2.
+
+		s = _mm256_div_pd(_mm256_sub_pd(m, _mm256_set1_pd(1.0)),
+			_mm256_add_pd(m, _mm256_set1_pd(1.0)));
+		s2 = _mm256_mul_pd(s, s);
+
+		poly = _mm256_set1_pd(1.0 / 13.0);
+		poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0 / 11.0));
+		poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0 / 9.0));
+		poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0 / 7.0));
+		poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0 / 5.0));
+		poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0 / 3.0));
+		poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0));
+		poly = _mm256_mul_pd(_mm256_mul_pd(poly, s),
+			_mm256_set1_pd(2.0));
+
+		valid = _mm256_and_pd(
+			_mm256_cmp_pd(p, _mm256_set1_pd(DBL_MIN), _CMP_GE_OQ),
+			_mm256_cmp_pd(p, _mm256_set1_pd(DBL_MAX), _CMP_LE_OQ));
+
+		p = _mm256_fmadd_pd(e, _mm256_set1_pd(M_LN2), poly);
+		_mm256_storeu_pd(&(dst[i]),
+			_mm256_mul_pd(p, _mm256_set1_pd(0.5 / M_LN10)));
+
+		// Let the C library handle any values we can't.
+
+		if(_mm256_movemask_pd(valid) != 0xF)
+			s_log_magnitudes_scalar(&(dst[i]), &(src[i]), 4);
+	}
+
+	s_log_magnitudes_scalar(&(dst[i]), &(src[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_NEON
+/*!
+ * This is the NEON implementation of s_simd_butterflies. As with SSE2, each
+ * complex value fills one register.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_butterflies_neon(s_complex_t *data, const s_complex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	double *even;
+	double *odd;
+	const float64x2_t sign = {-1.0, 1.0};
+	float64x2_t w;
+	float64x2_t e;
+	float64x2_t o;
+	float64x2_t t;
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; ++k)
+		{
+			w = vld1q_f64((const double *) &(twiddle[k * step]));
+			even = (double *) &(data[start + k]);
+			odd = (double *) &(data[start + k + half]);
+
+			e = vld1q_f64(even);
+			o = vld1q_f64(odd);
+
+			// t = (wr * or - wi * oi, wr * oi + wi * or)
+
+			t = vmulq_f64(vdupq_laneq_f64(w, 1), sign);
+			t = vmulq_f64(t, vextq_f64(o, o, 1));
+			t = vfmaq_f64(t, vdupq_laneq_f64(w, 0), o);
+
+			vst1q_f64(odd, vsubq_f64(e, t));
+			vst1q_f64(even, vaddq_f64(e, t));
+		}
+	}
+}
+
+/*!
+ * This is the NEON implementation of s_simd_log_magnitudes, which processes
+ * two values at a time.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_log_magnitudes_neon(double *dst, const s_complex_t *src, size_t n)
+{
+	size_t i;
+
+	float64x2x2_t v;
+	float64x2_t p;
+	uint64x2_t bits;
+	float64x2_t e;
+	float64x2_t m;
+	uint64x2_t big;
+	float64x2_t s;
+	float64x2_t s2;
+	float64x2_t poly;
+	uint64x2_t valid;
+
+	for(i = 0; i + 2 <= n; i += 2)
+	{
+		// This deinterleaves the real and imaginary parts.
+
+		v = vld2q_f64((const double *) &(src[i]));
+		p = vfmaq_f64(vmulq_f64(v.val[0], v.val[0]), v.val[1],
+			v.val[1]);
+
+		// Split p into its exponent and mantissa.
+
+		bits = vreinterpretq_u64_f64(p);
+
+		e = vreinterpretq_f64_u64(vorrq_u64(vshrq_n_u64(bits, 52),
+			vdupq_n_u64(S_SIMD_EXPONENT_MAGIC)));
+		e = vsubq_f64(e, vdupq_n_f64(S_SIMD_EXPONENT_BIAS));
+
+		m = vreinterpretq_f64_u64(vorrq_u64(vandq_u64(bits,
+			vdupq_n_u64(S_SIMD_MANTISSA_MASK)),
+			vdupq_n_u64(S_SIMD_MANTISSA_ONE)));
+
+		big = vcgtq_f64(m, vdupq_n_f64(M_SQRT2));
+		m = vbslq_f64(big, vmulq_n_f64(m, 0.5), m);
+		e = vaddq_f64(e, vreinterpretq_f64_u64(vandq_u64(big,
+			vreinterpretq_u64_f64(vdupq_n_f64(1.0)))));
+
+		// Compute ln(m), and then log10(p) / 2.
+
+		s = vdivq_f64(vsubq_f64(m, vdupq_n_f64(1.0)),
+			vaddq_f64(m, vdupq_n_f64(1.0)));
+		s2 = vmulq_f64(s, s);
+
+		poly = vdupq_n_f64(1.0 / 13.0);
+		poly = vfmaq_f64(vdupq_n_f64(1.0 / 11.0), poly, s2);
+		poly = vfmaq_f64(vdupq_n_f64(1.0 / 9.0), poly, s2);
+		poly = vfmaq_f64(vdupq_n_f64(1.0 / 7.0), poly, s2);
+		poly = vfmaq_f64(vdupq_n_f64(1.0 / 5.0), poly, s2);
+		poly = vfmaq_f64(vdupq_n_f64(1.0 / 3.0), poly, s2);
+		poly = vfmaq_f64(vdupq_n_f64(1.0), poly, s2);
+		poly = vmulq_n_f64(vmulq_f64(poly, s), 2.0);
+
+		valid = vandq_u64(vcgeq_f64(p, vdupq_n_f64(DBL_MIN)),
+			vcleq_f64(p, vdupq_n_f64(DBL_MAX)));
+
+		p = vfmaq_n_f64(poly, e, M_LN2);
+		vst1q_f64(&(dst[i]), vmulq_n_f64(p, 0.5 / M_LN10));
+
+		// Let the C library handle any values we can't.
+
+		if((vgetq_lane_u64(valid, 0) & vgetq_lane_u64(valid, 1)) == 0)
+			s_log_magnitudes_scalar(&(dst[i]), &(src[i]), 2);
+	}
+
+	s_log_magnitudes_scalar(&(dst[i]), &(src[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_X86
+/*!
+ * This is the SSE2 implementation of s_simd_butterflies_f, which processes two
+ * butterflies at a time. The first stage (half = 1) only has one butterfly per
+ * group, so it uses the scalar implementation instead.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_butterflies_f_sse2(s_fcomplex_t *data, const s_fcomplex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	float *even;
+	float *odd;
+	__m128 sign = _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f);
+	__m128 w;
+	__m128 e;
+	__m128 o;
+	__m128 t;
+
+	if(half < 2)
+	{
+		s_butterflies_f_scalar(data, twiddle, n, half, step);
+		return;
+	}
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; k += 2)
+		{
+			// Each complex float is loaded as one 64-bit value.
+
+			w = _mm_castpd_ps(_mm_loadh_pd(_mm_load_sd(
+				(const double *) &(twiddle[k * step])),
+				(const double *) &(twiddle[(k + 1) * step])));
+
+			even = (float *) &(data[start + k]);
+			odd = (float *) &(data[start + k + half]);
+
+			e = _mm_loadu_ps(even);
+			o = _mm_loadu_ps(odd);
+
+			// t = (wr * or - wi * oi, wr * oi + wi * or)
+
+			t = _mm_mul_ps(_mm_shuffle_ps(w, w,
+				_MM_SHUFFLE(3, 3, 1, 1)), _mm_shuffle_ps(o, o,
+				_MM_SHUFFLE(2, 3, 0, 1)));
+			t = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(w, w,
+				_MM_SHUFFLE(2, 2, 0, 0)), o),
+				_mm_xor_ps(t, sign));
+
+			_mm_storeu_ps(odd, _mm_sub_ps(e, t));
+			_mm_storeu_ps(even, _mm_add_ps(e, t));
+		}
+	}
+}
+
+/*!
+ * This is the SSE2 implementation of s_simd_log_magnitudes_f, which processes
+ * four values at a time.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_log_magnitudes_f_sse2(double *dst, const s_fcomplex_t *src, size_t n)
+{
+	size_t i;
+
+	__m128 a;
+	__m128 b;
+	__m128 p;
+	__m128i bits;
+	__m128 e;
+	__m128 m;
+	__m128 big;
+	__m128 s;
+	__m128 s2;
+	__m128 poly;
+	__m128 valid;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		a = _mm_loadu_ps((const float *) &(src[i]));
+		b = _mm_loadu_ps((const float *) &(src[i + 2]));
+
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+		p = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+			_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		// Split p into its exponent and mantissa.
+
+		bits = _mm_castps_si128(p);
+
+		e = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(bits, 23),
+			_mm_set1_epi32((int) S_SIMD_FEXPONENT_MAGIC)));
+		e = _mm_sub_ps(e, _mm_set1_ps(S_SIMD_FEXPONENT_BIAS));
+
+		m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits,
+			_mm_set1_epi32((int) S_SIMD_FMANTISSA_MASK)),
+			_mm_set1_epi32((int) S_SIMD_FMANTISSA_ONE)));
+
+		big = _mm_cmpgt_ps(m, _mm_set1_ps((float) M_SQRT2));
+		m = _mm_or_ps(_mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))),
+			_mm_andnot_ps(big, m));
+		e = _mm_add_ps(e, _mm_and_ps(big, _mm_set1_ps(1.0f)));
+
+		// Compute ln(m), and then log10(p) / 2.
+
+		s = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)),
+			_mm_add_ps(m, _mm_set1_ps(1.0f)));
+		s2 = _mm_mul_ps(s, s);
+
+		poly = _mm_set1_ps(1.0f / 9.0f);
+		poly = _mm_add_ps(_mm_mul_ps(poly, s2),
+			_mm_set1_ps(1.0f / 7.0f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, s2),
+			_mm_set1_ps(1.0f / 5.0f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, s2),
+			_mm_set1_ps(1.0f / 3.0f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, s2), _mm_set1_ps(1.0f));
+		poly = _mm_mul_ps(_mm_mul_ps(poly, s), _mm_set1_ps(2.0f));
+
+		valid = _mm_and_ps(_mm_cmpge_ps(p, _mm_set1_ps(FLT_MIN)),
+			_mm_cmple_ps(p, _mm_set1_ps(FLT_MAX)));
+
+		p = _mm_add_ps(_mm_mul_ps(e, _mm_set1_ps((float) M_LN2)), poly);
+		p = _mm_mul_ps(p, _mm_set1_ps((float) (0.5 / M_LN10)));
+
+		_mm_storeu_pd(&(dst[i]), _mm_cvtps_pd(p));
+		_mm_storeu_pd(&(dst[i + 2]), _mm_cvtps_pd(_mm_movehl_ps(p, p)));
+
+		// Let the C library handle any values we can't.
+
+		if(_mm_movemask_ps(valid) != 0xF)
+			s_log_magnitudes_f_scalar(&(dst[i]), &(src[i]), 4);
+	}
+
+	s_log_magnitudes_f_scalar(&(dst[i]), &(src[i]), n - i);
+}
+
+/*!
+ * This is the AVX2 (and FMA) implementation of s_simd_butterflies_f, which
+ * processes four butterflies at a time. Stages with fewer than four
+ * butterflies per group use the SSE2 implementation instead.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+S_SIMD_AVX2 void s_butterflies_f_avx2(s_fcomplex_t *data,
+	const s_fcomplex_t *twiddle, size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	float *even;
+	float *odd;
+	__m256i idx;
+	__m256 w;
+	__m256 e;
+	__m256 o;
+	__m256 t;
+
+	if(half < 4)
+	{
+		s_butterflies_f_sse2(data, twiddle, n, half, step);
+		return;
+	}
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; k += 4)
+		{
+			// Each complex float is gathered as a 64-bit value.
+
+			idx = _mm256_set_epi64x((long long) ((k + 3) * step),
+				(long long) ((k + 2) * step),
+				(long long) ((k + 1) * step),
+				(long long) (k * step));
+			w = _mm256_castpd_ps(_mm256_i64gather_pd(
+				(const double *) twiddle, idx, 8));
+
+			even = (float *) &(data[start + k]);
+			odd = (float *) &(data[start + k + half]);
+
+			e = _mm256_loadu_ps(even);
+			o = _mm256_loadu_ps(odd);
+
+			// t = (wr * or - wi * oi, wr * oi + wi * or)
+
+			t = _mm256_mul_ps(_mm256_movehdup_ps(w),
+				_mm256_permute_ps(o, 0xB1));
+			t = _mm256_fmaddsub_ps(_mm256_moveldup_ps(w), o, t);
+
+			_mm256_storeu_ps(odd, _mm256_sub_ps(e, t));
+			_mm256_storeu_ps(even, _mm256_add_ps(e, t));
+		}
+	}
+}
+
+/*!
+ * This is the AVX2 (and FMA) implementation of s_simd_log_magnitudes_f, which
+ * processes eight values at a time.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+S_SIMD_AVX2 void s_log_magnitudes_f_avx2(double *dst, const s_fcomplex_t *src,
+	size_t n)
+{
+	size_t i;
+
+	__m256 a;
+	__m256 b;
+	__m256 p;
+	__m256i bits;
+	__m256 e;
+	__m256 m;
+	__m256 big;
+	__m256 s;
+	__m256 s2;
+	__m256 poly;
+	__m256 valid;
+
+	for(i = 0; i + 8 <= n; i += 8)
+	{
+		a = _mm256_loadu_ps((const float *) &(src[i]));
+		b = _mm256_loadu_ps((const float *) &(src[i + 4]));
+
+		a = _mm256_mul_ps(a, a);
+		b = _mm256_mul_ps(b, b);
+
+		// This leaves the values in the order 0, 1, 4, 5, 2, 3, 6, 7.
+
+		p = _mm256_hadd_ps(a, b);
+		p = _mm256_castpd_ps(_mm256_permute4x64_pd(
+			_mm256_castps_pd(p), 0xD8));
+
+		// Split p into its exponent and mantissa.
+
+		bits = _mm256_castps_si256(p);
+
+		e = _mm256_castsi256_ps(_mm256_or_si256(
+			_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(
+			(int) S_SIMD_FEXPONENT_MAGIC)));
+		e = _mm256_sub_ps(e, _mm256_set1_ps(S_SIMD_FEXPONENT_BIAS));
+
+		m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits,
+			_mm256_set1_epi32((int) S_SIMD_FMANTISSA_MASK)),
+			_mm256_set1_epi32((int) S_SIMD_FMANTISSA_ONE)));
+
+		big = _mm256_cmp_ps(m, _mm256_set1_ps((float) M_SQRT2),
+			_CMP_GT_OQ);
+		m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)),
+			big);
+		e = _mm256_add_ps(e, _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+
+		// Compute ln(m), and then log10(p) / 2.
+
+		s = _mm256_div_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)),
+			_mm256_add_ps(m, _mm256_set1_ps(1.0f)));
+		s2 = _mm256_mul_ps(s, s);
+
+		poly = _mm256_set1_ps(1.0f / 9.0f);
+		poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f / 7.0f));
+		poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f / 5.0f));
+		poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f / 3.0f));
+		poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f));
+		poly = _mm256_mul_ps(_mm256_mul_ps(poly, s),
+			_mm256_set1_ps(2.0f));
+
+		valid = _mm256_and_ps(
+			_mm256_cmp_ps(p, _mm256_set1_ps(FLT_MIN), _CMP_GE_OQ),
+			_mm256_cmp_ps(p, _mm256_set1_ps(FLT_MAX), _CMP_LE_OQ));
+
+		p = _mm256_fmadd_ps(e, _mm256_set1_ps((float) M_LN2), poly);
+		p = _mm256_mul_ps(p, _mm256_set1_ps((float) (0.5 / M_LN10)));
+
+		_mm256_storeu_pd(&(dst[i]),
+			_mm256_cvtps_pd(_mm256_castps256_ps128(p)));
+		_mm256_storeu_pd(&(dst[i + 4]),
+			_mm256_cvtps_pd(_mm256_extractf128_ps(p, 1)));
+
+		// Let the C library handle any values we can't.
+
+		if(_mm256_movemask_ps(valid) != 0xFF)
+			s_log_magnitudes_f_scalar(&(dst[i]), &(src[i]), 8);
+	}
+
+	s_log_magnitudes_f_scalar(&(dst[i]), &(src[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_NEON
+/*!
+ * This is the NEON implementation of s_simd_butterflies_f, which processes
+ * two butterflies at a time. The first stage (half = 1) only has one butterfly
+ * per group, so it uses the scalar implementation instead.
+ *
+ * \param data The n values being transformed.
+ * \param twiddle The twiddle factors for the full transform length.
+ * \param n The total number of values being transformed.
+ * \param half The length of the DFT's this stage combines.
+ * \param step The stride between this stage's twiddle factors.
+ */
+void s_butterflies_f_neon(s_fcomplex_t *data, const s_fcomplex_t *twiddle,
+	size_t n, size_t half, size_t step)
+{
+	size_t start;
+	size_t k;
+
+	float *even;
+	float *odd;
+	const float32x4_t sign = {-1.0f, 1.0f, -1.0f, 1.0f};
+	float32x4_t w;
+	float32x4_t e;
+	float32x4_t o;
+	float32x4_t t;
+
+	if(half < 2)
+	{
+		s_butterflies_f_scalar(data, twiddle, n, half, step);
+		return;
+	}
+
+	for(start = 0; start < n; start += 2 * half)
+	{
+		for(k = 0; k < half; k += 2)
+		{
+			w = vcombine_f32(
+				vld1_f32((const float *) &(twiddle[k * step])),
+				vld1_f32((const float *)
+				&(twiddle[(k + 1) * step])));
+
+			even = (float *) &(data[start + k]);
+			odd = (float *) &(data[start + k + half]);
+
+			e = vld1q_f32(even);
+			o = vld1q_f32(odd);
+
+			// t = (wr * or - wi * oi, wr * oi + wi * or)
+
+			t = vmulq_f32(vtrn2q_f32(w, w), sign);
+			t = vmulq_f32(t, vrev64q_f32(o));
+			t = vfmaq_f32(t, vtrn1q_f32(w, w), o);
+
+			vst1q_f32(odd, vsubq_f32(e, t));
+			vst1q_f32(even, vaddq_f32(e, t));
+		}
+	}
+}
+
+/*!
+ * This is the NEON implementation of s_simd_log_magnitudes_f, which processes
+ * four values at a time.
+ *
+ * \param dst This will receive the n log-magnitudes.
+ * \param src The n complex values.
+ * \param n The number of values.
+ */
+void s_log_magnitudes_f_neon(double *dst, const s_fcomplex_t *src, size_t n)
+{
+	size_t i;
+
+	float32x4x2_t v;
+	float32x4_t p;
+	uint32x4_t bits;
+	float32x4_t e;
+	float32x4_t m;
+	uint32x4_t big;
+	float32x4_t s;
+	float32x4_t s2;
+	float32x4_t poly;
+	uint32x4_t valid;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		// This deinterleaves the real and imaginary parts.
+
+		v = vld2q_f32((const float *) &(src[i]));
+		p = vfmaq_f32(vmulq_f32(v.val[0], v.val[0]), v.val[1],
+			v.val[1]);
+
+		// Split p into its exponent and mantissa.
+
+		bits = vreinterpretq_u32_f32(p);
+
+		e = vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(bits, 23),
+			vdupq_n_u32(S_SIMD_FEXPONENT_MAGIC)));
+		e = vsubq_f32(e, vdupq_n_f32(S_SIMD_FEXPONENT_BIAS));
+
+		m = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits,
+			vdupq_n_u32(S_SIMD_FMANTISSA_MASK)),
+			vdupq_n_u32(S_SIMD_FMANTISSA_ONE)));
+
+		big = vcgtq_f32(m, vdupq_n_f32((float) M_SQRT2));
+		m = vbslq_f32(big, vmulq_n_f32(m, 0.5f), m);
+		e = vaddq_f32(e, vreinterpretq_f32_u32(vandq_u32(big,
+			vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+
+		// Compute ln(m), and then log10(p) / 2.
+
+		s = vdivq_f32(vsubq_f32(m, vdupq_n_f32(1.0f)),
+			vaddq_f32(m, vdupq_n_f32(1.0f)));
+		s2 = vmulq_f32(s, s);
+
+		poly = vdupq_n_f32(1.0f / 9.0f);
+		poly = vfmaq_f32(vdupq_n_f32(1.0f / 7.0f), poly, s2);
+		poly = vfmaq_f32(vdupq_n_f32(1.0f / 5.0f), poly, s2);
+		poly = vfmaq_f32(vdupq_n_f32(1.0f / 3.0f), poly, s2);
+		poly = vfmaq_f32(vdupq_n_f32(1.0f), poly, s2);
+		poly = vmulq_n_f32(vmulq_f32(poly, s), 2.0f);
+
+		valid = vandq_u32(vcgeq_f32(p, vdupq_n_f32(FLT_MIN)),
+			vcleq_f32(p, vdupq_n_f32(FLT_MAX)));
+
+		p = vfmaq_n_f32(poly, e, (float) M_LN2);
+		p = vmulq_n_f32(p, (float) (0.5 / M_LN10));
+
+		vst1q_f64(&(dst[i]), vcvt_f64_f32(vget_low_f32(p)));
+		vst1q_f64(&(dst[i + 2]), vcvt_high_f64_f32(p));
+
+		// Let the C library handle any values we can't.
+
+		if(vminvq_u32(valid) == 0)
+			s_log_magnitudes_f_scalar(&(dst[i]), &(src[i]), 4);
+	}
+
+	s_log_magnitudes_f_scalar(&(dst[i]), &(src[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_X86
+/*!
+ * This is the SSE2 implementation of s_simd_multiply.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_multiply_sse2(double *dst, const double *a, const double *b, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i + 2 <= n; i += 2)
+	{
+		_mm_storeu_pd(&(dst[i]), _mm_mul_pd(_mm_loadu_pd(&(a[i])),
+			_mm_loadu_pd(&(b[i]))));
+	}
+
+	s_multiply_scalar(&(dst[i]), &(a[i]), &(b[i]), n - i);
+}
+
+/*!
+ * This is the SSE2 implementation of s_simd_multiply_f.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_multiply_f_sse2(float *dst, const float *a, const float *b, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_ps(&(dst[i]), _mm_mul_ps(_mm_loadu_ps(&(a[i])),
+			_mm_loadu_ps(&(b[i]))));
+	}
+
+	s_multiply_f_scalar(&(dst[i]), &(a[i]), &(b[i]), n - i);
+}
+
+/*!
+ * This is the AVX2 implementation of s_simd_multiply.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+S_SIMD_AVX2 void s_multiply_avx2(double *dst, const double *a,
+	const double *b, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		_mm256_storeu_pd(&(dst[i]), _mm256_mul_pd(
+			_mm256_loadu_pd(&(a[i])), _mm256_loadu_pd(&(b[i]))));
+	}
+
+	s_multiply_scalar(&(dst[i]), &(a[i]), &(b[i]), n - i);
+}
+
+/*!
+ * This is the AVX2 implementation of s_simd_multiply_f.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+S_SIMD_AVX2 void s_multiply_f_avx2(float *dst, const float *a,
+	const float *b, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i + 8 <= n; i += 8)
+	{
+		_mm256_storeu_ps(&(dst[i]), _mm256_mul_ps(
+			_mm256_loadu_ps(&(a[i])), _mm256_loadu_ps(&(b[i]))));
+	}
+
+	s_multiply_f_scalar(&(dst[i]), &(a[i]), &(b[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_NEON
+/*!
+ * This is the NEON implementation of s_simd_multiply.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_multiply_neon(double *dst, const double *a, const double *b, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i + 2 <= n; i += 2)
+	{
+		vst1q_f64(&(dst[i]), vmulq_f64(vld1q_f64(&(a[i])),
+			vld1q_f64(&(b[i]))));
+	}
+
+	s_multiply_scalar(&(dst[i]), &(a[i]), &(b[i]), n - i);
+}
+
+/*!
+ * This is the NEON implementation of s_simd_multiply_f.
+ *
+ * \param dst This will receive the n products.
+ * \param a The first list of n values.
+ * \param b The second list of n values.
+ * \param n The number of values.
+ */
+void s_multiply_f_neon(float *dst, const float *a, const float *b, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		vst1q_f32(&(dst[i]), vmulq_f32(vld1q_f32(&(a[i])),
+			vld1q_f32(&(b[i]))));
+	}
+
+	s_multiply_f_scalar(&(dst[i]), &(a[i]), &(b[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_X86
+/*!
+ * This is the SSE2 implementation of s_simd_mixdown, which mixes four samples
+ * at a time.
+ *
+ * \param dst This will receive the n mono samples.
+ * \param src The n stereo samples.
+ * \param n The number of samples.
+ */
+void s_mixdown_sse2(int32_t *dst, const s_stereo_sample_t *src, size_t n)
+{
+	size_t i;
+
+	__m128i a;
+	__m128i b;
+	__m128i l;
+	__m128i r;
+	__m128i m;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		a = _mm_loadu_si128((const __m128i *) &(src[i]));
+		b = _mm_loadu_si128((const __m128i *) &(src[i + 2]));
+
+		// Separate the left and right channels.
+
+		l = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, 0x88),
+			_mm_shuffle_epi32(b, 0x88));
+		r = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, 0xDD),
+			_mm_shuffle_epi32(b, 0xDD));
+
+		m = _mm_add_epi32(_mm_srai_epi32(l, 1), _mm_srai_epi32(r, 1));
+		m = _mm_add_epi32(m, _mm_and_si128(_mm_and_si128(l, r),
+			_mm_set1_epi32(1)));
+
+		_mm_storeu_si128((__m128i *) &(dst[i]), m);
+	}
+
+	s_mixdown_scalar(&(dst[i]), &(src[i]), n - i);
+}
+
+/*!
+ * This is the AVX2 implementation of s_simd_mixdown, which mixes eight samples
+ * at a time.
+ *
+ * \param dst This will receive the n mono samples.
+ * \param src The n stereo samples.
+ * \param n The number of samples.
+ */
+S_SIMD_AVX2 void s_mixdown_avx2(int32_t *dst, const s_stereo_sample_t *src,
+	size_t n)
+{
+	size_t i;
+
+	__m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	__m256i a;
+	__m256i b;
+	__m256i l;
+	__m256i r;
+	__m256i m;
+
+	for(i = 0; i + 8 <= n; i += 8)
+	{
+		// This leaves each register's left channels in its low half.
+
+		a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(
+			(const __m256i *) &(src[i])), split);
+		b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(
+			(const __m256i *) &(src[i + 4])), split);
+
+		l = _mm256_permute2x128_si256(a, b, 0x20);
+		r = _mm256_permute2x128_si256(a, b, 0x31);
+
+		m = _mm256_add_epi32(_mm256_srai_epi32(l, 1),
+			_mm256_srai_epi32(r, 1));
+		m = _mm256_add_epi32(m, _mm256_and_si256(_mm256_and_si256(l, r),
+			_mm256_set1_epi32(1)));
+
+		_mm256_storeu_si256((__m256i *) &(dst[i]), m);
+	}
+
+	s_mixdown_scalar(&(dst[i]), &(src[i]), n - i);
+}
+#endif
+
+#ifdef S_SIMD_NEON
+/*!
+ * This is the NEON implementation of s_simd_mixdown, which mixes four samples
+ * at a time. NEON's halving add computes exactly the rounded-down average we
+ * want, without overflowing.
+ *
+ * \param dst This will receive the n mono samples.
+ * \param src The n stereo samples.
+ * \param n The number of samples.
+ */
+void s_mixdown_neon(int32_t *dst, const s_stereo_sample_t *src, size_t n)
+{
+	size_t i;
+	int32x4x2_t v;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		v = vld2q_s32((const int32_t *) &(src[i]));
+		vst1q_s32(&(dst[i]), vhaddq_s32(v.val[0], v.val[1]));
+	}
+
+	s_mixdown_scalar(&(dst[i]), &(src[i]), n - i);
+}
+#endif
@@ -0,0 +1,45 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_SPECTR_UTIL_SIMD_H
+#define INCLUDE_SPECTR_UTIL_SIMD_H
+
+#include <stddef.h>
+
+#include "spectr/types.h"
+
+extern const char *s_simd_name();
+
+extern void s_simd_butterflies(s_complex_t *, const s_complex_t *, size_t,
+	size_t, size_t);
+extern void s_simd_log_magnitudes(double *, const s_complex_t *, size_t);
+
+extern void s_simd_butterflies_f(s_fcomplex_t *, const s_fcomplex_t *,
+	size_t, size_t, size_t);
+extern void s_simd_log_magnitudes_f(double *, const s_fcomplex_t *, size_t);
+
+extern void s_simd_multiply(double *, const double *, const double *, size_t);
+extern void s_simd_multiply_f(float *, const float *, const float *, size_t);
+
+extern void s_simd_mixdown(int32_t *, const s_stereo_sample_t *, size_t);
+
+#ifdef SPECTR_DEBUG
+	extern int s_simd_force(size_t);
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * spectr - A very simple spectrum analyzer for audio files.
+ * Copyright (C) 2014 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/*!
+ * \brief This structure stores the state of a single s_parallel_for worker.
+ */
+typedef struct s_parallel_job
+{
+	pthread_t thread;
+	int (*fn)(void *, size_t, size_t, size_t);
+	void *ctx;
+	size_t id;
+	size_t begin;
+	size_t end;
+	int result;
+} s_parallel_job_t;
+
+void *s_parallel_worker(void *);
+
+/*!
+ * This function returns the number of worker threads we should use. If the
+ * caller requested a specific number of threads, that many are used.
+ * Otherwise (if the request is 0), we use one thread per online CPU.
+ *
+ * \param requested The requested number of threads, or 0 for automatic.
+ * \return The number of threads to use (always at least 1).
+ */
+size_t s_get_thread_count(size_t requested)
+{
+	long cpus;
+
+	if(requested > 0)
+		return requested;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(cpus < 1)
+		return 1;
+
+	return (size_t) cpus;
+}
+
+/*!
+ * This function splits the range [0, n) into (at most) the given number of
+ * contiguous, roughly equal parts, and calls the given function once for each
+ * part, each on its own thread. The function is given the context pointer, the
+ * index of the worker, and the [begin, end) range it should process.
+ *
+ * Since each worker is given a contiguous range, workers which write to
+ * per-index output slots never touch the same memory as each other.
+ *
+ * If only one thread would be used, the function is simply called on the
+ * current thread.
+ *
+ * \param n The number of items to process.
+ * \param threads The maximum number of threads to use.
+ * \param fn The function which processes a range of items.
+ * \param ctx The context pointer given to each call of fn.
+ * \return 0 on success, or the first error any worker returned.
+ */
+int s_parallel_for(size_t n, size_t threads,
+	int (*fn)(void *, size_t, size_t, size_t), void *ctx)
+{
+	int r;
+	int ret = 0;
+	size_t i;
+	size_t started;
+	s_parallel_job_t *jobs;
+
+	if(threads > n)
+		threads = n;
+
+	if(threads <= 1)
+		return n > 0 ? fn(ctx, 0, 0, n) : 0;
+
+	jobs = malloc(sizeof(s_parallel_job_t) * threads);
+
+	if(jobs == NULL)
+		return -ENOMEM;
+
+	// Start one worker for each part of the range.
+
+	for(started = 0; started < threads; ++started)
+	{
+		jobs[started].fn = fn;
+		jobs[started].ctx = ctx;
+		jobs[started].id = started;
+		jobs[started].begin = (n * started) / threads;
+		jobs[started].end = (n * (started + 1)) / threads;
+		jobs[started].result = 0;
+
+		r = pthread_create(&(jobs[started].thread), NULL,
+			s_parallel_worker, &(jobs[started]));
+
+		if(r != 0)
+		{
+			ret = -r;
+			break;
+		}
+	}
+
+	// Wait for all of the workers we started to finish.
+
+	for(i = 0; i < started; ++i)
+	{
+		pthread_join(jobs[i].thread, NULL);
+
+		if((ret == 0) && (jobs[i].result < 0))
+			ret = jobs[i].result;
+	}
+
+	free(jobs);
+
+	return ret;
+}
+
+/*!
+ * This is the thread entry point for s_parallel_for workers.
+ *
+ * \param arg The s_parallel_job_t describing this worker's range.
+ * \return Always NULL; the result is stored in the job structure.
+ */
+void *s_parallel_worker(void *arg)
+{
+	s_parallel_job_t *job = arg;
+
+	job->result = job->fn(job->ctx, job->id, job->begin, job->end);
+
+	return NULL;
+}